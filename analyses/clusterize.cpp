@@ -32,19 +32,36 @@ Clusterize::Clusterize() :
 		   core::TrackAnalysis::run_post_callback_t{},
 	           std::bind(&Clusterize::finishCutClusterSize, this)
 	           );
+	// align only needs the clusters of the current event, so it runs in the same pass as clusterize
+	setProcessDependencies("align", {});
 	getOptionsDescription().add_options()
 		("align,a", "Force calculation of alignemnt data")
 	;
 }
 
 Clusterize::~Clusterize()
+{
+	closeOutputs();
+}
+
+void Clusterize::closeOutputs()
 {
 	_clusterFile.close();
 	if(_file) {
 		_file->Flush();
 		_file->Close();
 		delete _file;
+		_file = nullptr;
+	}
+}
+
+std::vector<std::string> Clusterize::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::TrackAnalysis::getDependencyFiles(vm);
+	if(vm.count("align") < 1) {
+		files.push_back(getFilename(".align"));
 	}
+	return files;
 }
 
 void Clusterize::init(const po::variables_map& vm)
@@ -129,7 +146,7 @@ bool Clusterize::align(const core::TrackStreamReader::event_t& track_event,
 	if(_aligner.gotAlignmentData()) {
 		return false;
 	}
-	const auto& clusters = _eventData[track_event.eventNumber].clusters;
+	const auto& clusters = _eventData[mpa_event.eventNumber].clusters;
 	for(const auto& track: track_event.tracks) {
 		auto b = track.extrapolateOnPlane(4, 5, 840, 2);
 		for(const auto& cluster: clusters) {
@@ -159,7 +176,7 @@ void Clusterize::finishAlign()
 bool Clusterize::cutClusterSize(const core::TrackStreamReader::event_t& track_event,
                        const core::BaseSensorStreamReader::event_t& mpa_event)
 {
-	const auto& clusters = _eventData[track_event.eventNumber].clusters;
+	const auto& clusters = _eventData[mpa_event.eventNumber].clusters;
 	for(const auto& track: track_event.tracks) {
 		auto b = track.extrapolateOnPlane(4, 5, 840, 2);
 		for(const auto& cluster: clusters) {
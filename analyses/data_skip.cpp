@@ -1,14 +1,16 @@
 
 #include "data_skip.h"
 #include "util.h"
-#include <TImage.h>
 #include <TText.h>
+#include <TGraph.h>
+#include <fstream>
+#include <algorithm>
 #include <cmath>
 
 REGISTER_ANALYSIS_TYPE(DataSkip, "Textual analysis description here.")
 
 DataSkip::DataSkip() :
- TrackAnalysis(), _file(nullptr), _currentHist(nullptr)
+ TrackAnalysis(), _output(nullptr), _currentHist(nullptr), _sweep(false), _updateRunlist(false)
 {
 	addProcess("analyze", CS_TRACK,
 		core::TrackAnalysis::init_callback_t{},
@@ -16,38 +18,81 @@ DataSkip::DataSkip() :
 		std::bind(&DataSkip::analyze, this, std::placeholders::_1, std::placeholders::_2),
 		core::TrackAnalysis::run_post_callback_t{},
 	        std::bind(&DataSkip::finish, this));
+	addProcess("sweep", CS_ALWAYS,
+		core::TrackAnalysis::init_callback_t{},
+		core::TrackAnalysis::run_init_callback_t{},
+		std::bind(&DataSkip::sweepRun, this, std::placeholders::_1, std::placeholders::_2),
+		core::TrackAnalysis::run_post_callback_t{},
+	        std::bind(&DataSkip::sweepFinish, this));
+	// only one of both processes does any work, depending on --sweep
+	setProcessDependencies("sweep", {});
 	getOptionsDescription().add_options()
 		("range", po::value<int>()->default_value(10), "Generate correlation in data offset range -NUM to NUM")
 		("num,n", po::value<int>()->default_value(5000), "Number of events used for correlation histogram")
 		("bins,b", po::value<int>()->default_value(500), "Number of bins in the history")
+		("sweep", "Read the run only once and evaluate all data offsets from the buffered events. The best offset is written to the runlist.")
+		("fft-threshold", po::value<int>()->default_value(50), "In --sweep mode, preselect candidates by FFT cross-correlation of hit and track counts if the range contains more offsets than this")
+		("candidates", po::value<int>()->default_value(5), "Number of FFT candidates to evaluate by their residuals")
+		("bin-width", po::value<double>()->default_value(0.1), "Residual bin width in mm used to rate the correlation strength in --sweep mode")
+		("no-update", "In --sweep mode, do not write the best offset to the runlist")
 	;
 }
 
 DataSkip::~DataSkip()
 {
-	if(_file) {
-		_file->Write();
-		_file->Close();
-		delete _file;
-	}
+	closeOutputs();
+}
+
+void DataSkip::closeOutputs()
+{
+	delete _output;
+	_output = nullptr;
+}
+
+bool DataSkip::loadConfig(const po::variables_map& vm)
+{
+	// needed by isCacheable() before init()
+	_sweep = vm.count("sweep") > 0;
+	_updateRunlist = vm.count("no-update") == 0;
+	return TrackAnalysis::loadConfig(vm);
+}
+
+bool DataSkip::isCacheable() const
+{
+	// a restored result would skip writing the offset to the runlist
+	return !_sweep || !_updateRunlist;
 }
 
 void DataSkip::init(const po::variables_map& vm)
 {
-	_file = new TFile(getRootFilename().c_str(), "RECREATE");
+	_output = new core::RootOutput(getRootFilename());
 	_numBins = vm["bins"].as<int>();
 	_range = vm["range"].as<int>();
-	setDataOffset(-_range);
 	_eventsPerRun = vm["num"].as<int>();
+	_fftThreshold = vm["fft-threshold"].as<int>();
+	_numCandidates = vm["candidates"].as<int>();
+	_binWidth = vm["bin-width"].as<double>();
+	_runlistFile = vm["runlist"].as<std::string>();
+	if(_sweep) {
+		// buffer the events as recorded, offsets are applied when evaluating
+		setDataOffset(0);
+		int numPlots = _range*2+1;
+		if(numPlots > _fftThreshold) {
+			numPlots = _numCandidates;
+		}
+		createCanvas(numPlots+1);
+		return;
+	}
+	setDataOffset(-_range);
+	_currentHist = createHistogram(getDataOffset());
+	createCanvas(_range*2+2);
+}
 
-	std::ostringstream name;
-	name << "xcorrelation_" << getDataOffset()+_range;
-	std::ostringstream title;
-	title << "data skip = " << getDataOffset();
-	_currentHist = new TH1D(name.str().c_str(), title.str().c_str(), _numBins, -10, -10);
-	int nx = core::max(1, static_cast<int>(std::sqrt(_range*2+2)));
-	int ny = core::max(1, (_range*2 + 2) / nx) + 1;
-	assert(nx*ny >= _range*2+2);
+void DataSkip::createCanvas(int numPlots)
+{
+	int nx = core::max(1, static_cast<int>(std::sqrt(numPlots)));
+	int ny = core::max(1, numPlots / nx) + 1;
+	assert(nx*ny >= numPlots);
 
 	_canvas = new TCanvas("canvas", "", 400*nx, 300*ny);
 	_canvas->Divide(nx, ny);
@@ -60,6 +105,15 @@ void DataSkip::init(const po::variables_map& vm)
 	txt->Draw();
 }
 
+TH1D* DataSkip::createHistogram(int dataOffset) const
+{
+	std::ostringstream name;
+	name << "xcorrelation_" << dataOffset+_range;
+	std::ostringstream title;
+	title << "data skip = " << dataOffset;
+	return new TH1D(name.str().c_str(), title.str().c_str(), _numBins, -10, -10);
+}
+
 std::string DataSkip::getUsage(const std::string& argv0) const
 {
 	return Analysis::getUsage(argv0);
@@ -73,6 +127,9 @@ std::string DataSkip::getHelp(const std::string& argv0) const
 bool DataSkip::analyze(const core::TrackStreamReader::event_t& track_event,
                       const core::BaseSensorStreamReader::event_t& mpa_event)
 {
+	if(_sweep) {
+		return false;
+	}
 	for(const auto& track: track_event.tracks) {
 		for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
 			if(!mpa_event.data[idx]) continue;
@@ -86,6 +143,9 @@ bool DataSkip::analyze(const core::TrackStreamReader::event_t& track_event,
 
 void DataSkip::finish()
 {
+	if(_sweep) {
+		return;
+	}
 	const double binratio = 0.1;
 	if(_currentHist->GetEntries() * binratio * 2 < _currentHist->GetNbinsX()) {
 		/*std::cout << "REBIN!\n"
@@ -95,21 +155,92 @@ void DataSkip::finish()
 		_currentHist->Rebin(_currentHist->GetNbinsX() / (_currentHist->GetEntries() * binratio));
 //		std::cout << "New reduced bin number: " << _currentHist->GetNbinsX() << std::endl;
 	}
+	// the canvas is rendered later, the histogram is replaced for the next offset
 	_canvas->cd(getDataOffset()+_range+2);
-	_currentHist->Draw();
+	_currentHist->DrawCopy();
+	_output->write(_currentHist);
+	_currentHist = nullptr;
 	if(getDataOffset()+1 <= _range) {
 		setDataOffset(getDataOffset()+1);
 		rerun();
-		
-		std::ostringstream name;
-		name << "xcorrelation_" << getDataOffset()+_range;
-		std::ostringstream title;
-		title << "data skip = " << getDataOffset();
-		_currentHist = new TH1D(name.str().c_str(), title.str().c_str(), _numBins, -10, -10);
+		_currentHist = createHistogram(getDataOffset());
 	} else {
-		auto img = TImage::Create();
-		img->FromPad(_canvas);
-		img->WriteImage(getFilename(".png").c_str());
-		delete img;
+		_output->addImage(_canvas, getFilename(".png"));
+		_canvas = nullptr;
+	}
+}
+
+bool DataSkip::sweepRun(const core::TrackStreamReader::event_t& track_event,
+                        const core::BaseSensorStreamReader::event_t& mpa_event)
+{
+	if(!_sweep) {
+		return false;
+	}
+	std::vector<double> hitX;
+	for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
+		if(!mpa_event.data[idx]) continue;
+		hitX.push_back(_mpaTransform.transform(idx)(0));
+	}
+	std::vector<double> trackX;
+	for(const auto& track: track_event.tracks) {
+		trackX.push_back(track.extrapolateOnPlane(0, 5, 840, 2)(0));
+	}
+	_finder.addEvent(mpa_event.eventNumber, hitX, trackX);
+	// Twice the number of entries at offset 0 leaves enough events for all other offsets
+	return _finder.getNumCombinations() < 2*static_cast<size_t>(_eventsPerRun) ||
+	       _finder.getNumEvents() < 4*static_cast<size_t>(_range);
+}
+
+void DataSkip::sweepFinish()
+{
+	if(!_sweep) {
+		return;
+	}
+	std::cout << "Buffered " << _finder.getNumEvents() << " events" << std::endl;
+	core::DataOffsetFinder::result_vec_t results;
+	if(_range*2+1 > _fftThreshold) {
+		auto correlation = _finder.crossCorrelate(-_range, _range);
+		auto graph = new TGraph(correlation.size());
+		graph->SetName("cross_correlation");
+		graph->SetTitle("Cross-correlation of hit and track counts");
+		for(size_t i = 0; i < correlation.size(); ++i) {
+			graph->SetPoint(i, correlation[i].offset, correlation[i].strength);
+		}
+		_output->write(graph);
+		auto ranked = core::DataOffsetFinder::ranked(correlation);
+		ranked.resize(std::min(ranked.size(), static_cast<size_t>(_numCandidates)));
+		for(const auto& candidate: ranked) {
+			auto res = _finder.residuals(candidate.offset, _eventsPerRun);
+			results.push_back({
+				candidate.offset,
+				core::DataOffsetFinder::peakStrength(res, _binWidth),
+				res.size()
+			});
+		}
+	} else {
+		results = _finder.sweep(-_range, _range, _binWidth, _eventsPerRun);
+	}
+	int pad = 2;
+	for(const auto& result: results) {
+		auto hist = createHistogram(result.offset);
+		for(const auto& r: _finder.residuals(result.offset, _eventsPerRun)) {
+			hist->Fill(r);
+		}
+		_canvas->cd(pad++);
+		hist->DrawCopy();
+		_output->write(hist);
+		std::cout << "data skip = " << result.offset << ": strength " << result.strength
+		          << " (" << result.entries << " entries)" << std::endl;
+	}
+	_output->addImage(_canvas, getFilename(".png"));
+	_canvas = nullptr;
+
+	auto best = core::DataOffsetFinder::best(results);
+	std::cout << "Best data offset: " << best.offset << " (strength " << best.strength << ")" << std::endl;
+	std::ofstream fout(getFilename(".offset"));
+	fout << best.offset << "\t" << best.strength << "\t" << best.entries << "\n";
+	if(_updateRunlist) {
+		core::QuickRunlistReader::writeDataOffset(_runlistFile, getCurrentRunId(), best.offset);
+		std::cout << "Updated data offset of MPA run " << getCurrentRunId() << " in " << _runlistFile << std::endl;
 	}
 }
@@ -3,7 +3,8 @@
 #define DATA_SKIP_H
 
 #include "trackanalysis.h"
-#include <TFile.h>
+#include "dataoffsetfinder.h"
+#include "rootoutput.h"
 #include <TH1D.h>
 #include <TCanvas.h>
 
@@ -13,6 +14,10 @@ public:
         DataSkip();
 	virtual ~DataSkip();
 
+	virtual bool loadConfig(const po::variables_map& vm);
+	virtual void closeOutputs();
+	virtual bool isCacheable() const;
+
 	virtual void init(const po::variables_map& vm);
 	virtual std::string getUsage(const std::string& argv0) const;
 	virtual std::string getHelp(const std::string& argv0) const;
@@ -21,12 +26,27 @@ private:
         bool analyze(const core::TrackStreamReader::event_t& track_event,
 	             const core::BaseSensorStreamReader::event_t& mpa_event);
 	void finish();
-	TFile* _file;
+
+	bool sweepRun(const core::TrackStreamReader::event_t& track_event,
+	              const core::BaseSensorStreamReader::event_t& mpa_event);
+	void sweepFinish();
+
+	void createCanvas(int numPlots);
+	TH1D* createHistogram(int dataOffset) const;
+
+	core::RootOutput* _output;
 	TH1D* _currentHist;
 	TCanvas* _canvas;
 	int _numBins;
 	int _eventsPerRun;
 	int _range;
+	bool _sweep;
+	int _fftThreshold;
+	int _numCandidates;
+	double _binWidth;
+	bool _updateRunlist;
+	std::string _runlistFile;
+	core::DataOffsetFinder _finder;
 };
 
 #endif//DATA_SKIP_H
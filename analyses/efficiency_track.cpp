@@ -26,12 +26,27 @@ EfficiencyTrack::EfficiencyTrack() :
 }
 
 EfficiencyTrack::~EfficiencyTrack()
+{
+	closeOutputs();
+}
+
+void EfficiencyTrack::closeOutputs()
 {
 	if(_file) {
 		_file->Write();
 		_file->Close();
 		delete _file;
+		_file = nullptr;
+	}
+}
+
+std::vector<std::string> EfficiencyTrack::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::TrackAnalysis::getDependencyFiles(vm);
+	for(auto runId: _allRunIds) {
+		files.push_back(_config.get<std::string>("output_dir") + "/ZAlignTest_" + getMpaIdPadded(runId) + ".align");
 	}
+	return files;
 }
 
 void EfficiencyTrack::init(const po::variables_map& vm)
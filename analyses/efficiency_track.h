@@ -16,6 +16,9 @@ public:
         EfficiencyTrack();
 	virtual ~EfficiencyTrack();
 
+	virtual void closeOutputs();
+	virtual std::vector<std::string> getDependencyFiles(const po::variables_map& vm);
+
 	virtual void init(const po::variables_map& vm);
 	virtual std::string getUsage(const std::string& argv0) const;
 	virtual std::string getHelp(const std::string& argv0) const;
@@ -19,10 +19,29 @@ GblAlign::GblAlign() :
 
 GblAlign::~GblAlign()
 {
-	_file->Write();
-	_file->Close();
-	delete _file;
-	_file = nullptr;
+	closeOutputs();
+}
+
+void GblAlign::closeOutputs()
+{
+	if(_file) {
+		_file->Write();
+		_file->Close();
+		delete _file;
+		_file = nullptr;
+	}
+}
+
+std::vector<std::string> GblAlign::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::MergedAnalysis::getDependencyFiles(vm);
+	// the runs are only known from the command line before init()
+	for(auto runId: vm["run"].as<std::vector<int>>()) {
+		auto prefix = _config.getVariable("output_dir") + "/RefPreAlign_" + getMpaIdPadded(runId);
+		files.push_back(prefix + "_ref.csv");
+		files.push_back(prefix + "_dut.csv");
+	}
+	return files;
 }
 
 void GblAlign::init()
@@ -51,8 +70,14 @@ void GblAlign::init()
 		_config.get<double>("dut_omega")
 		}) * M_PI / 180;
 	_trackConsts.dut_plateau_x = true;
+	_trackConsts.dut_assembly.loadChipPoses(_config);
 	std::cout << "DUT Offset:\n" << _trackConsts.dut_offset << std::endl;
 	std::cout << "DUT Rotation:\n" << _trackConsts.dut_rotation << std::endl;
+	std::cout << "DUT Chips:";
+	for(int mpaIdx: _trackConsts.dut_assembly.getEnabled()) {
+		std::cout << " " << mpaIdx;
+	}
+	std::cout << std::endl;
 	_gbl_chi2_dist = new TH1F("gbl_chi2ndf_dist", "", 1000, 0, 100);
 }
 
@@ -19,6 +19,9 @@ public:
 	GblAlign();
 	virtual ~GblAlign();
 
+	virtual void closeOutputs();
+	virtual std::vector<std::string> getDependencyFiles(const po::variables_map& vm);
+
 	virtual void init();
 	virtual void run(const core::run_data_t& run);
 	virtual void finalize();
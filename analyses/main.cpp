@@ -1,8 +1,55 @@
 
 #include <getopt.h>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "core.h"
 #include "analysis.h"
+#include "rootoutput.h"
+
+/** \brief Periodically print the progress of an analysis while it is running
+ *
+ * Replaces the former per-1000-events output of the event loop.
+ */
+class ProgressReporter
+{
+public:
+	ProgressReporter(const core::Progress& progress, std::chrono::seconds interval) :
+	 _progress(progress), _interval(interval), _stop(false),
+	 _thread(&ProgressReporter::report, this)
+	{
+	}
+
+	~ProgressReporter()
+	{
+		{
+			std::lock_guard<std::mutex> lk(_mutex);
+			_stop = true;
+		}
+		_cv.notify_one();
+		_thread.join();
+	}
+
+private:
+	void report()
+	{
+		std::unique_lock<std::mutex> lk(_mutex);
+		while(!_cv.wait_for(lk, _interval, [this] { return _stop; })) {
+			auto status = _progress.get();
+			if(status.step.size()) {
+				std::cout << core::Progress::format(status) << std::endl;
+			}
+		}
+	}
+
+	const core::Progress& _progress;
+	std::chrono::seconds _interval;
+	bool _stop;
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	std::thread _thread;
+};
 
 int main(int argc, char* argv[])
 {
@@ -80,7 +127,16 @@ int main(int argc, char* argv[])
 		if(!analysis->multirunConsistencyCheck(argv[0], vm)) {
 			return 2;
 		}
-		analysis->run(vm);
+		core::Instrumentation::setEnabled(vm.count("no-timing") == 0);
+		core::RootOutput::setImagesEnabled(vm.count("no-images") == 0);
+		bool restored;
+		{
+			ProgressReporter reporter(analysis->getProgress(), std::chrono::seconds(5));
+			restored = analysis->runCached(vm);
+		}
+		if(!restored && core::Instrumentation::isEnabled()) {
+			analysis->writeTimingReport();
+		}
 	} catch(core::CfgParse::parse_error& e) {
 		std::cerr << argv[0] << ": Error while parsing configuration:\n" << e.what() << std::endl;
 		return 1;
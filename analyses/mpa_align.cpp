@@ -1,20 +1,21 @@
 
 #include "mpa_align.h"
-#include <TImage.h>
 #include <TText.h>
 #include <TGraph.h>
 #include <iostream>
+#include <algorithm>
 
 REGISTER_ANALYSIS_TYPE(MpaAlign, "Perform XYZ and angular alignment of MPA.")
 
 MpaAlign::MpaAlign() :
- TrackAnalysis(), _aligner(), _file(nullptr)
+ TrackAnalysis(), _scan(4, 5), _aligners(), _output(nullptr)
 {
 	getOptionsDescription().add_options()
 		("low-z", po::value<double>()->default_value(820), "Lower bound of Z align scan")
 		("high-z", po::value<double>()->default_value(860), "Upper bound of Z align scan")
 		("num-steps,s", po::value<int>()->default_value(10), "Number of steps in the range (low,high)")
 		("sample-size,n", po::value<int>()->default_value(10000), "Number of data points to include in alignment histogram")
+		("scan-threads", po::value<int>()->default_value(1), "Number of threads evaluating the Z steps, 0 for one per hardware thread. Belphegor jobs use their --threads hint by default")
 	;
 	addProcess("scan", /* CS_ALWAYS */ CS_TRACK,
 	           core::TrackAnalysis::init_callback_t {},
@@ -27,19 +28,31 @@ MpaAlign::MpaAlign() :
 
 MpaAlign::~MpaAlign()
 {
-	if(_file) {
-		delete _file;
-	}
+	closeOutputs();
+}
+
+void MpaAlign::closeOutputs()
+{
+	delete _output;
+	_output = nullptr;
 }
 
 void MpaAlign::init(const po::variables_map& vm)
 {
-	_file = new TFile(getFilename(".root").c_str(), "RECREATE");
+	_output = new core::RootOutput(getFilename(".root"));
 	_twoPass = vm.count("two-pass") > 0;
 	_sampleSize = vm["sample-size"].as<int>();
+	setEventSample(_sampleSize);
 	_lowZ = vm["low-z"].as<double>();
 	_highZ = vm["high-z"].as<double>();
 	_numSteps = vm["num-steps"].as<int>();
+	_scanThreads = vm["scan-threads"].as<int>();
+	if(vm["scan-threads"].defaulted()) {
+		try {
+			_scanThreads = std::max(1, _config.get<int>("job_threads"));
+		} catch(const core::CfgParse::no_variable_error&) {
+		}
+	}
 	_currentScanStep = 0;
 	int num_plots = _numSteps + 3;
 	int n_x = std::sqrt(num_plots);
@@ -77,116 +90,121 @@ std::string MpaAlign::getHelp(const std::string& argv0) const
 void MpaAlign::scanInit()
 {
 	_numProcessedSamples = 0;
-	_currentZ = _lowZ + (_highZ - _lowZ) / (_numSteps-1) * _currentScanStep;
-	_mpaTransform.setOffset({0, 0, _currentZ});
-	std::cout << _currentScanStep << "/" << _numSteps
-	          << ": Calculate alignment constants for Z=" << _currentZ << std::endl;
-	_aligner.initHistograms(std::string("x_align_")+std::to_string(_currentScanStep),
-	                        std::string("y_align_")+std::to_string(_currentScanStep));
-	_currentSigmaMinimum = { 0.0, -1.0 };
+	// Pixel X and Y coordinates do not depend on Z as long as the MPA is not rotated
+	_mpaTransform.setOffset({0, 0, _lowZ});
 }
 
 bool MpaAlign::scanRun(const core::TrackStreamReader::event_t& track_event,
                       const core::BaseSensorStreamReader::event_t& mpa_event)
 {
-	for(const auto& track: track_event.tracks) {
-		auto b = track.extrapolateOnPlane(4, 5, _currentZ, 2);
-		for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
-			if(mpa_event.data[idx] == 0) continue;
-			auto a = _mpaTransform.transform(idx);
-			_aligner.Fill(b(0) - a(0), b(1) - a(1));
-		}
+	std::vector<core::ZScan::hit_t> hits;
+	for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
+		if(mpa_event.data[idx] == 0) continue;
+		auto a = _mpaTransform.transform(idx);
+		hits.push_back({static_cast<int>(idx), a.head<2>()});
 	}
+	_scan.addEvent(track_event.eventNumber, track_event.tracks, hits);
 	return (_numProcessedSamples++ < _sampleSize);
 }
 
 void MpaAlign::scanFinish()
 {
-	int cd = _currentScanStep+2;
-	std::cout << "cd-ing to Pad " << cd << std::endl;
-	_xCanvas->cd(cd);
-	_aligner.calculateAlignment();
-	_aligner.appendAlignmentData(getFilename(".csv"), std::to_string(_currentZ));
-	_alignments.push_back({
-		Eigen::Vector3d(
-			_aligner.getOffset()(0),
-			_aligner.getOffset()(1),
-			_currentZ),
-		_aligner.getCuts()(0),
-		_aligner.getCuts()(1)
-	});
-	if(_currentSigmaMinimum(1) < _aligner.getCuts()(0) || _currentSigmaMinimum(1) < 0) {
-		_currentSigmaMinimum = { _currentZ, _aligner.getCuts()(0) };
+	// All Z steps are filled from the sample cached by scanRun()
+	auto positions = core::ZScan::steps(_lowZ, _highZ, _numSteps);
+	_aligners.assign(_numSteps, core::Aligner());
+	for(int step = 0; step < _numSteps; ++step) {
+		_aligners[step].initHistograms(std::string("x_align_")+std::to_string(step),
+		                               std::string("y_align_")+std::to_string(step));
 	}
-	std::string title = "Z = ";
-	title += std::to_string(_currentZ);
-	title += " mm";
-	auto xcor = _aligner.getHistX();
-	auto ycor = _aligner.getHistY();
-	xcor->GetXaxis()->SetTitle("x residual (mm)");
-	ycor->GetYaxis()->SetTitle("y residual (mm)");
-	xcor->SetTitle(title.c_str());
-	ycor->SetTitle(title.c_str());
-	_xCanvas->cd(cd);
-	xcor->Draw();
-	_yCanvas->cd(cd);
-	ycor->Draw();
-	++_currentScanStep;
-	xcor->Write();
-	ycor->Write();
-	if(_currentScanStep < _numSteps) {
-		rerun();
-	} else {
-		auto xgraph = new TGraph(_numSteps);
-		xgraph->SetName("x_sigma");
-		auto ygraph = new TGraph(_numSteps);
-		ygraph->SetName("y_width");
-		for(size_t i=0; i < _alignments.size(); ++i) {
-			const auto& align = _alignments[i];
-			xgraph->SetPoint(i, align.position(2), align.x_sigma);
-			ygraph->SetPoint(i, align.position(2), align.y_width);
+	std::cout << "Fill " << _numSteps << " Z steps from " << _scan.getNumEvents() << " events" << std::endl;
+	_scan.scan(positions,
+	           [this](size_t step, size_t, const Eigen::Vector3d& b, const core::ZScan::hit_t& hit) {
+	                   _aligners[step].Fill(b(0) - hit.position(0), b(1) - hit.position(1));
+	           },
+	           core::ZScan::event_callback_t{}, _scanThreads);
+	_currentSigmaMinimum = { 0.0, -1.0 };
+	for(_currentScanStep = 0; _currentScanStep < _numSteps; ++_currentScanStep) {
+		auto& aligner = _aligners[_currentScanStep];
+		_currentZ = positions[_currentScanStep];
+		std::cout << _currentScanStep << "/" << _numSteps
+		          << ": Calculate alignment constants for Z=" << _currentZ << std::endl;
+		int cd = _currentScanStep+2;
+		_xCanvas->cd(cd);
+		aligner.calculateAlignment();
+		aligner.appendAlignmentData(getFilename(".csv"), std::to_string(_currentZ));
+		_alignments.push_back({
+			Eigen::Vector3d(
+				aligner.getOffset()(0),
+				aligner.getOffset()(1),
+				_currentZ),
+			aligner.getCuts()(0),
+			aligner.getCuts()(1)
+		});
+		if(_currentSigmaMinimum(1) < aligner.getCuts()(0) || _currentSigmaMinimum(1) < 0) {
+			_currentSigmaMinimum = { _currentZ, aligner.getCuts()(0) };
 		}
-		xgraph->Write();
-		ygraph->Write();
+		std::string title = "Z = ";
+		title += std::to_string(_currentZ);
+		title += " mm";
+		auto xcor = aligner.getHistX();
+		auto ycor = aligner.getHistY();
+		xcor->GetXaxis()->SetTitle("x residual (mm)");
+		ycor->GetYaxis()->SetTitle("y residual (mm)");
+		xcor->SetTitle(title.c_str());
+		ycor->SetTitle(title.c_str());
+		// the histograms of the aligner are reused, the canvases are rendered later
+		_xCanvas->cd(cd);
+		xcor->DrawCopy();
+		_yCanvas->cd(cd);
+		ycor->DrawCopy();
+		_output->writeCopy(xcor);
+		_output->writeCopy(ycor);
+	}
+	auto xgraph = new TGraph(_numSteps);
+	xgraph->SetName("x_sigma");
+	auto ygraph = new TGraph(_numSteps);
+	ygraph->SetName("y_width");
+	for(size_t i=0; i < _alignments.size(); ++i) {
+		const auto& align = _alignments[i];
+		xgraph->SetPoint(i, align.position(2), align.x_sigma);
+		ygraph->SetPoint(i, align.position(2), align.y_width);
+	}
+	_output->writeCopy(xgraph);
+	_output->writeCopy(ygraph);
 
-		_xCanvas->cd(_currentScanStep+2);
-		xgraph->Draw("A*");
-		_xCanvas->Update();
-		_yCanvas->cd(_currentScanStep+2);
-		ygraph->Draw("A*");
-		_yCanvas->Update();
+	_xCanvas->cd(_currentScanStep+2);
+	xgraph->Draw("A*");
+	_xCanvas->Update();
+	_yCanvas->cd(_currentScanStep+2);
+	ygraph->Draw("A*");
+	_yCanvas->Update();
 
-		auto img = TImage::Create();
-		img->FromPad(_xCanvas);
-		img->WriteImage(getFilename("_x.png").c_str());
-		delete img;
-		img = TImage::Create();
-		img->FromPad(_yCanvas);
-		img->WriteImage(getFilename("_y.png").c_str());
-		delete img;
+	_output->addImage(_xCanvas, getFilename("_x.png"));
+	_output->addImage(_yCanvas, getFilename("_y.png"));
+	_xCanvas = nullptr;
+	_yCanvas = nullptr;
 
-		double x_min = xgraph->GetX()[0];
-		double y_min = xgraph->GetY()[0];
-		size_t best_idx = 0;
-		for(size_t i=0; i < xgraph->GetN(); ++i) {
-			if(y_min > xgraph->GetY()[i]) {
-				x_min = xgraph->GetX()[i];
-				y_min = xgraph->GetY()[i];
-				best_idx = i;
-			}
-		}
-		if(_currentScanStep+1 >= _numSteps) {
-			std::ofstream of(getFilename(".align"));
-			auto align = _alignments[best_idx];
-			of << align.position(0) << " "
-			   << align.position(1) << " "
-			   << align.position(2) << " "
-			   << align.x_sigma << " "
-			   << "0 0 0 "
-			   << align.y_width << "\n";
-			of.flush();
-			of.close();
+	double x_min = xgraph->GetX()[0];
+	double y_min = xgraph->GetY()[0];
+	size_t best_idx = 0;
+	for(size_t i=0; i < xgraph->GetN(); ++i) {
+		if(y_min > xgraph->GetY()[i]) {
+			x_min = xgraph->GetX()[i];
+			y_min = xgraph->GetY()[i];
+			best_idx = i;
 		}
 	}
+	if(_currentScanStep+1 >= _numSteps) {
+		std::ofstream of(getFilename(".align"));
+		auto align = _alignments[best_idx];
+		of << align.position(0) << " "
+		   << align.position(1) << " "
+		   << align.position(2) << " "
+		   << align.x_sigma << " "
+		   << "0 0 0 "
+		   << align.y_width << "\n";
+		of.flush();
+		of.close();
+	}
 }
 
@@ -4,9 +4,10 @@
 
 #include "trackanalysis.h"
 #include "aligner.h"
+#include "zscan.h"
+#include "rootoutput.h"
 #include <TH1D.h>
 #include <TCanvas.h>
-#include <TFile.h>
 
 class MpaAlign : public core::TrackAnalysis
 {
@@ -14,6 +15,8 @@ public:
         MpaAlign();
 	virtual ~MpaAlign();
 
+	virtual void closeOutputs();
+
 	virtual void init(const po::variables_map& vm);
 	virtual std::string getUsage(const std::string& argv0) const;
 	virtual std::string getHelp(const std::string& argv0) const;
@@ -33,8 +36,9 @@ private:
 		double y_width;
 	};
 
-	core::Aligner _aligner;
-	TFile* _file;
+	core::ZScan _scan;
+	std::vector<core::Aligner> _aligners;
+	core::RootOutput* _output;
 	TCanvas* _xCanvas;
 	TCanvas* _yCanvas;
 	std::vector<alignment_t> _alignments;
@@ -45,6 +49,7 @@ private:
 	int _numSteps;
 	int _numProcessedSamples;
 	int _sampleSize;
+	int _scanThreads;
 	bool _twoPass;
 	Eigen::Vector2d _currentSigmaMinimum;
 };
@@ -44,7 +44,10 @@ void MpaClusterTest::run(const core::run_data_t& run)
 	std::ofstream fhits(getFilename("_hits.csv"));
 	std::ofstream fclusters(getFilename("_clusters.csv"));
 	for(size_t evt = 2; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+		{
+			CORE_TIMED_SCOPE("TTree::GetEntry");
+			run.tree->GetEntry(evt);
+		}
 		auto pixels = core::MpaHitGenerator::getCounterPixels(run, transform);
 		auto clusters = core::MpaHitGenerator::clusterize(pixels, &sizes, &areas);
 		for(auto pixel: pixels) {
@@ -1,5 +1,6 @@
 
 #include "mpa_cmaes_align.h"
+#include "fidelityschedule.h"
 #include <TImage.h>
 #include <TText.h>
 #include <TGraph.h>
@@ -9,13 +10,55 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <errno.h>
+#include <cmath>
+#include <random>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <sstream>
 
 using namespace libcmaes;
 
 REGISTER_ANALYSIS_TYPE(MpaCmaesAlign, "Perform XYZ and angular alignment of MPA.")
 
+// Same schema as created by utils/cmaes2sqlite.py, so existing database tools can read it
+static const char* databaseSchema = R"SQL(
+CREATE TABLE IF NOT EXISTS jobs (job_id INTEGER PRIMARY_KEY, run_id INTEGER, exit_status INTEGER);
+CREATE TABLE IF NOT EXISTS config_float (job_id INTEGER, key STRING, value FLOAT, PRIMARY KEY (job_id, key));
+CREATE TABLE IF NOT EXISTS config_int (job_id INTEGER, key STRING, value INTEGER, PRIMARY KEY (job_id, key));
+CREATE TABLE IF NOT EXISTS path (
+ id INTEGER PRIMARY KEY, job_id INTEGER, generation int,
+ x float, y float, z float, phi float, theta float, omega float, fitness float, sigma float
+);
+CREATE TABLE IF NOT EXISTS parameterspace (
+ id INTEGER PRIMARY KEY, job_id INTEGER, feval_no int,
+ x float, y float, z float, phi float, theta float, omega float, fitness float,
+ total_tracks float, used_tracks float
+);
+CREATE TABLE IF NOT EXISTS intermediate_status (id INTEGER PRIMARY KEY, job_id INTEGER, iteration INTEGER, status INTEGER);
+CREATE TABLE IF NOT EXISTS hitpairs (
+ id INTEGER PRIMARY KEY, run_id INTEGER, mpa_index INTEGER,
+ ax float, ay float, az float, bx float, by float, bz float
+);
+CREATE TABLE IF NOT EXISTS finals (
+ id INTEGER PRIMARY KEY, job_id INTEGER, generation int,
+ x float, y float, z float, phi float, theta float, omega float, fitness float, sigma float
+);
+CREATE INDEX IF NOT EXISTS index_jobs_run_id ON jobs(run_id);
+CREATE INDEX IF NOT EXISTS index_jobs_exit_status ON jobs(exit_status);
+CREATE INDEX IF NOT EXISTS index_config_float_value ON config_float(value);
+CREATE INDEX IF NOT EXISTS index_config_int_value ON config_int(value);
+CREATE INDEX IF NOT EXISTS index_path_job_id ON path(job_id);
+CREATE INDEX IF NOT EXISTS index_parameterspace_fitness ON parameterspace(fitness);
+CREATE INDEX IF NOT EXISTS index_intermediate_status_job_id ON intermediate_status(job_id);
+CREATE INDEX IF NOT EXISTS index_hitpairs_run_id ON hitpairs(run_id);
+CREATE INDEX IF NOT EXISTS index_finals_job_id ON finals(job_id);
+)SQL";
+
 MpaCmaesAlign::MpaCmaesAlign() :
- TrackAnalysis(), _aligner(), _file(nullptr)
+ TrackAnalysis(), _aligner(), _file(nullptr), _database(), _jobId(0), _numEvaluations(0)
 {
 	getOptionsDescription().add_options()
 		("low-z", po::value<double>()->default_value(820), "Lower bound of Z align scan")
@@ -26,6 +69,8 @@ MpaCmaesAlign::MpaCmaesAlign() :
 		("write-cache,C", "If set, up to 1000 hits from the cache are written to disk. Useful for debugging.")
 		("write-function,F", "If set, each traversed phase space point is written to disk. Timeconsuming!")
 		("efficiency-model,E", "Use efficiency based fitness function instead of chi2 model.")
+		("database", po::value<std::string>(), "Write configuration, optimization path, status, the hits of --write-cache and the phase space of --write-function into this SQLite database instead of text files. The database is created if required and may be shared by concurrent jobs.")
+		("job-id", po::value<int>(), "Job ID in the database. By default the next free ID is used.")
 	;
 	addProcess("load", /* CS_ALWAYS */ CS_TRACK,
 	           core::TrackAnalysis::init_callback_t {},
@@ -37,11 +82,39 @@ MpaCmaesAlign::MpaCmaesAlign() :
 }
 
 MpaCmaesAlign::~MpaCmaesAlign()
+{
+	closeOutputs();
+}
+
+void MpaCmaesAlign::closeOutputs()
 {
 	if(_file) {
 		_file->Write();
 		delete _file;
+		_file = nullptr;
+	}
+}
+
+std::vector<std::string> MpaCmaesAlign::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::TrackAnalysis::getDependencyFiles(vm);
+	if(_config.get<int>("cmaes_parameter_init_from_alignment") > 0) {
+		for(auto runId: _allRunIds) {
+			files.push_back(_config.get<std::string>("alignment_dir") + "/MpaAlign_" + getMpaIdPadded(runId) + ".align");
+		}
 	}
+	return files;
+}
+
+bool MpaCmaesAlign::isCacheable() const
+{
+	// the alignment database is only written for a warm start, these results would be missing after a restore
+	try {
+		_config.getVariable("alignment_db");
+		return _config.get<double>("alignment_warm_start_sigma") <= 0;
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
+	return true;
 }
 
 void MpaCmaesAlign::init(const po::variables_map& vm)
@@ -62,6 +135,9 @@ void MpaCmaesAlign::init(const po::variables_map& vm)
 		}
 		_config.setVariable("output_dir", output_dir);
 	}
+	if(vm.count("database") > 0) {
+		openDatabase(vm["database"].as<std::string>(), vm);
+	}
 	try {
 		std::ifstream fmask(_config.getVariable("pixel_mask"));
 		_pixelMask.resize(_mpaTransform.num_pixels, false);
@@ -82,16 +158,64 @@ void MpaCmaesAlign::init(const po::variables_map& vm)
 	_file = new TFile(getFilename(".root").c_str(), "RECREATE");
 	_aligner.initHistograms();
 	_sampleSize = vm["sample-size"].as<int>();
+	setEventSample(_sampleSize);
 	_writeCache = vm.count("write-cache") > 0;
 	_modelEfficiency = vm.count("efficiency-model") > 0;
+	// only events scanRun() can use are decoded
+	if(_modelEfficiency) {
+		setEventFilter([](const core::EventIndex::summary_t& evt) { return evt.tracks == 1 && evt.hits <= 1; });
+	} else {
+		setEventFilter([](const core::EventIndex::summary_t& evt) { return evt.tracks == 1 && evt.hits == 1; });
+	}
 	_writeFunction = vm.count("write-function") > 0;
 	_eventCache.reserve(_sampleSize);
 	_cacheFull = false;
 	_forceStatus = _config.get<int>("cmaes_force_status") > 0;
 	_allowedExitStatus = _config.getVector<int>("cmaes_allowed_exit_status");
 	_maxForceStatusRuns = _config.get<int>("cmaes_max_force_status_runs");
+	std::string restartStrategy = "ipop";
+	try {
+		restartStrategy = _config.get<std::string>("cmaes_restart_strategy");
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
+	if(restartStrategy == "none") {
+		_restartStrategy = RS_NONE;
+	} else if(restartStrategy == "ipop") {
+		_restartStrategy = RS_IPOP;
+	} else if(restartStrategy == "bipop") {
+		_restartStrategy = RS_BIPOP;
+	} else {
+		throw std::invalid_argument("Config variable 'cmaes_restart_strategy' must be none, ipop or bipop!");
+	}
+	// one run at a time unless configured, a belphegor job uses the threads it reserved
+	_parallelRestarts = 1;
+	try {
+		_parallelRestarts = std::max(1, _config.get<int>("cmaes_parallel_restarts"));
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
+	try {
+		_parallelRestarts = std::max(1, _config.get<int>("job_threads"));
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
 	_initFromAlignment = _config.get<int>("cmaes_parameter_init_from_alignment") > 0;
 	_nSigma = _config.get<double>("cmaes_efficiency_sigma");
+	_fidelityMinEvents = 0;
+	try {
+		_fidelityMinEvents = std::max(0, _config.get<int>("fidelity_min_events"));
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
+	if(_fidelityMinEvents > 0 && _config.get<int>("cmaes_elitism") != 0) {
+		// an elite of a smaller subset would be compared with candidates evaluated on more events
+		throw std::invalid_argument("Config variable 'cmaes_elitism' must be 0 if 'fidelity_min_events' is set!");
+	}
+	_warmStartSigma = 0.0;
+	try {
+		_warmStartSigma = _config.get<double>("alignment_warm_start_sigma");
+		if(_warmStartSigma > 0) {
+			_alignmentStore.reset(new core::AlignmentStore(_config.getVariable("alignment_db")));
+		}
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
 	std::cout << "cmaes_parameter_init_from_alignment " << _config.get<int>("cmaes_parameter_init_from_alignment") << std::endl;
 	std::remove(getFilename(".status").c_str());
 	std::ofstream statusFile(getFilename(".status"));
@@ -99,6 +223,43 @@ void MpaCmaesAlign::init(const po::variables_map& vm)
 	std::ofstream configFile(getFilename(".config"));
 }
 
+void MpaCmaesAlign::openDatabase(const std::string& filename, const po::variables_map& vm)
+{
+	_database.reset(new core::SqliteWriter(filename));
+	_database->exec(databaseSchema);
+	int run_id = getAllRunIds()[0];
+	if(vm.count("job-id") > 0) {
+		_jobId = vm["job-id"].as<int>();
+		if(_database->queryInt("SELECT count(*) FROM jobs WHERE job_id = " + std::to_string(_jobId)) > 0) {
+			throw std::invalid_argument(std::string("Job ID ") + std::to_string(_jobId)
+			                            + " already exists in database " + filename);
+		}
+		auto stmt = _database->prepare("INSERT INTO jobs (job_id, run_id) VALUES (?, ?)");
+		_database->write(stmt, _jobId, run_id);
+	} else {
+		// A single statement allocates the ID, so concurrent jobs get distinct IDs
+		auto stmt = _database->prepare("INSERT INTO jobs (job_id, run_id) SELECT IFNULL(MAX(job_id), 0)+1, ? FROM jobs");
+		_database->write(stmt, run_id);
+		_jobId = _database->queryInt("SELECT job_id FROM jobs WHERE rowid = "
+		                             + std::to_string(_database->lastInsertId()));
+	}
+	_database->commit();
+	std::cout << "Writing to database " << filename << " as job " << _jobId << std::endl;
+	_stmt.configInt = _database->prepare("INSERT OR REPLACE INTO config_int (job_id, key, value) VALUES (?,?,?)");
+	_stmt.configFloat = _database->prepare("INSERT OR REPLACE INTO config_float (job_id, key, value) VALUES (?,?,?)");
+	_stmt.path = _database->prepare("INSERT INTO path (job_id, generation, x, y, z, phi, theta, omega, fitness, sigma)"
+	                                " VALUES (?,?,?,?,?,?,?,?,?,?)");
+	_stmt.parameterspace = _database->prepare("INSERT INTO parameterspace (job_id, feval_no, x, y, z, phi, theta, omega,"
+	                                          " fitness, total_tracks, used_tracks) VALUES (?,?,?,?,?,?,?,?,?,?,?)");
+	_stmt.intermediateStatus = _database->prepare("INSERT INTO intermediate_status (job_id, iteration, status)"
+	                                              " VALUES (?,?,?)");
+	_stmt.exitStatus = _database->prepare("UPDATE jobs SET exit_status = ? WHERE job_id = ?");
+	_stmt.hitpairs = _database->prepare("INSERT INTO hitpairs (run_id, mpa_index, ax, ay, az, bx, by, bz)"
+	                                    " VALUES (?,?,?,?,?,?,?,?)");
+	_stmt.finals = _database->prepare("INSERT INTO finals (job_id, generation, x, y, z, phi, theta, omega, fitness, sigma)"
+	                                  " VALUES (?,?,?,?,?,?,?,?,?,?)");
+}
+
 std::string MpaCmaesAlign::getUsage(const std::string& argv0) const
 {
 	return Analysis::getUsage(argv0);
@@ -135,7 +296,25 @@ bool MpaCmaesAlign::scanRun(const core::TrackStreamReader::event_t& track_event,
 
 void MpaCmaesAlign::scanFinish()
 {
-	if(!_cacheFull && _writeCache) {
+	if(!_cacheFull && _writeCache && _database) {
+		// the hits only depend on the run, write them once for all jobs of a run. Check and insert in one
+		// transaction, so concurrent jobs cannot both find no hits
+		int run_id = getCurrentRunId();
+		_database->commit();
+		_database->begin();
+		if(_database->queryInt("SELECT count(id) FROM hitpairs WHERE run_id = " + std::to_string(run_id)) == 0) {
+			size_t numEventsWritten = 0;
+			for(const auto& evt: _eventCache) {
+				_database->write(_stmt.hitpairs, run_id, evt.mpa_index,
+				                 evt.track.points[3](0), evt.track.points[3](1), evt.track.points[3](2),
+				                 evt.track.points[5](0), evt.track.points[5](1), evt.track.points[5](2));
+				if(++numEventsWritten >= 1000) {
+					break;
+				}
+			}
+		}
+		_database->commit();
+	} else if(!_cacheFull && _writeCache) {
 		std::ofstream fout(getFilename(".cache"));
 		fout << "# MPA Index\tax ay az\tbx by bz\n";
 		size_t numEventsWritten = 0;
@@ -154,60 +333,22 @@ void MpaCmaesAlign::scanFinish()
 		}
 	}
 	_cacheFull = true;
-	std::ofstream func_file;
-	if(_writeFunction) {
-		func_file.open(getFilename("_space.csv"));
+	if(_fidelityMinEvents > 0) {
+		// the fitness is evaluated on growing prefixes of the cache, these must be random subsets
+		std::shuffle(_eventCache.begin(), _eventCache.end(), std::mt19937(1));
 	}
-	std::ofstream path_file(getFilename("_path.csv"));
-	ProgressFunc<CMAParameters<GenoPheno<pwqBoundStrategy>>, CMASolutions> select_time =
-		[this, &path_file](const CMAParameters<GenoPheno<pwqBoundStrategy>>& params, const CMASolutions& cmasols)
-	{
-		auto cand = cmasols.best_candidate();
-		Eigen::VectorXd bestparam = params.get_gp().pheno(cand.get_x_dvec());
-		std::cout << "Iteration " << std::setprecision(8) << cmasols.niter() << ", " << cmasols.elapsed_last_iter() << "ms"
-		          << ", fitness=" << cand.get_fvalue()
-			  << ", sigma=" << cmasols.sigma()
-			  << ", parameters (";
-		for(size_t i=0; i<3; ++i) {
-			std::cout << " " << bestparam[i];
-		}
-		for(size_t i=3; i<cand.get_x_size(); ++i) {
-			std::cout << " " << std::fixed << std::setprecision(2) << 180*bestparam[i]/3.1415;
-		}
-		std::cout << " )" << std::endl;
-		path_file << cand.get_fvalue() << "\t"
-		          << bestparam[0] << "\t"
-		          << bestparam[1] << "\t"
-		          << bestparam[2] << "\t"
-		          << bestparam[3] << "\t"
-		          << bestparam[4] << "\t"
-		          << bestparam[5] << "\t"
-			  << cmasols.sigma() << "\n" << std::flush;
-		return 0;
-	};
-	auto cmaparams = getParametersFromConfig();
-	std::function<double(const double*, const int& N)> model;
-	using std::placeholders::_1;
-	using std::placeholders::_2;
-	if(_modelEfficiency) {
-		std::cout << "Use 'efficiency' model" << std::endl;
-		model = std::bind(&MpaCmaesAlign::modelEfficiency, this, _1, _2, _writeFunction? &func_file : nullptr);
-	} else {
-		std::cout << "Use 'chi2' model" << std::endl;
-		model = std::bind(&MpaCmaesAlign::modelChi2, this, _1, _2, _writeFunction? &func_file : nullptr);
-	}
-	std::cout << "Samples per Generation lambda = " << cmaparams.lambda() << std::endl;
-	CMASolutions cmasols = cmaes<GenoPheno<pwqBoundStrategy>>(model, cmaparams, select_time);
+	auto config = getConfig();
+	auto best = optimize(config);
+	const auto& cmasols = best->solutions;
 	std::cout << "best solution: " << cmasols << std::endl;
 	std::cout << "optimization took: " << cmasols.elapsed_time() / 1000.0 << " seconds" << std::endl;
 	std::cout << "status: " << cmasols.run_status() << std::endl;
-	Candidate cand = cmasols.get_best_seen_candidate();
-	Eigen::VectorXd bestparam = cmaparams.get_gp().pheno(cand.get_x_dvec());
+	const Eigen::VectorXd& bestparam = best->bestParam;
 	std::ofstream of(getFilename(".align"));
 	of << bestparam(0) << " "
 	   << bestparam(1) << " "
 	   << bestparam(2) << " "
-	   << cand.get_fvalue() << " "
+	   << best->fitness << " "
 	   << bestparam(3) << " "
 	   << bestparam(4) << " "
 	   << bestparam(5) << "\n"
@@ -215,6 +356,51 @@ void MpaCmaesAlign::scanFinish()
 	   << "# status: " << cmasols.run_status() << "\n";
 	of.flush();
 	of.close();
+	auto acceptable = std::find(_allowedExitStatus.begin(), _allowedExitStatus.end(), cmasols.run_status());
+	// only acceptable alignments are used as start of other runs
+	if(_alignmentStore && acceptable != _allowedExitStatus.end()) {
+		_alignmentStore->save(getCurrentRunId(), "MpaCmaesAlign",
+		                      std::vector<double>(bestparam.data(), bestparam.data() + bestparam.size()),
+		                      best->fitness, cmasols.run_status());
+	}
+
+	// traces of the reported run only, like the files of the last rerun before
+	std::ofstream func_file;
+	if(_database) {
+		for(size_t generation = 0; generation < best->path.size(); ++generation) {
+			const auto& gen = best->path[generation];
+			_database->write(_stmt.path, _jobId, generation,
+			                 gen.param[0], gen.param[1], gen.param[2],
+			                 gen.param[3], gen.param[4], gen.param[5],
+			                 gen.fitness, gen.sigma);
+		}
+		if(!best->path.empty()) {
+			const auto& gen = best->path.back();
+			_database->write(_stmt.finals, _jobId, best->path.size() - 1,
+			                 gen.param[0], gen.param[1], gen.param[2],
+			                 gen.param[3], gen.param[4], gen.param[5],
+			                 gen.fitness, gen.sigma);
+		}
+	} else {
+		if(_writeFunction) {
+			func_file.open(getFilename("_space.csv"));
+		}
+		std::ofstream path_file(getFilename("_path.csv"));
+		for(const auto& gen: best->path) {
+			path_file << gen.fitness << "\t"
+			          << gen.param[0] << "\t"
+			          << gen.param[1] << "\t"
+			          << gen.param[2] << "\t"
+			          << gen.param[3] << "\t"
+			          << gen.param[4] << "\t"
+			          << gen.param[5] << "\t"
+			          << gen.sigma << "\n";
+		}
+	}
+	_numEvaluations = 0;
+	for(const auto& evaluation: best->evaluations) {
+		writeEvaluation(func_file, evaluation);
+	}
 
 	std::ofstream statusfile(getFilename("_status.csv"));
 	statusfile << cmasols.run_status() << std::endl;
@@ -236,22 +422,216 @@ void MpaCmaesAlign::scanFinish()
 	_file->Write();
 
 	std::ofstream statusFile(getFilename(".status"), std::ios_base::app);
-	statusFile << getRerunNumber() << "\t" << cmasols.run_status() << std::endl;
-	auto acceptable = std::find(_allowedExitStatus.begin(), _allowedExitStatus.end(), cmasols.run_status());
+	if(_database) {
+		_database->write(_stmt.exitStatus, cmasols.run_status(), _jobId);
+		_database->commit();
+	}
 	if(acceptable == _allowedExitStatus.end() && _forceStatus) {
-		if(getRerunNumber() < _maxForceStatusRuns) {
-			rerun();
-		} else {
-			std::cerr << "Did not find acceptable solution in required time." << std::endl;
-			statusFile << "# not acceptable!" << std::endl;
-		}
+		std::cerr << "Did not find acceptable solution in required time." << std::endl;
+		statusFile << "# not acceptable!" << std::endl;
 	} else if(_forceStatus){
-		std::cerr << "Found acceptable solution after " << getRerunNumber() << " optimization candidates." << std::endl;
+		std::cerr << "Found acceptable solution after " << best->number << " optimization candidates." << std::endl;
 		statusFile << "# acceptable!" << std::endl;
 	}
 }
 
-libcmaes::CMAParameters<GenoPheno<pwqBoundStrategy>> MpaCmaesAlign::getParametersFromConfig() const
+std::unique_ptr<MpaCmaesAlign::restart_t> MpaCmaesAlign::optimize(const cmaes_config_t& config)
+{
+	// libcmaes seeds from the clock, which is the same for runs started together
+	std::random_device device;
+	std::mt19937 random(device());
+	// default population size of libcmaes
+	int baseLambda = config.lambda >= 2 ? config.lambda : 4 + static_cast<int>(std::floor(3 * std::log(6)));
+	size_t numLarge = 0;
+	int largeLambda = baseLambda;
+	// evaluations of both BIPOP regimes, a running restart counts with its population size
+	size_t largeBudget = 0;
+	size_t smallBudget = 0;
+	size_t maxRuns = _forceStatus ? _maxForceStatusRuns + 1 : 1;
+
+	std::atomic<bool> cancelled(false);
+	std::mutex mutex;
+	std::condition_variable finishedCond;
+	std::deque<size_t> finished;
+	std::vector<std::unique_ptr<restart_t>> restarts;
+	// declared last, so running restarts end before the state they use is destroyed
+	std::vector<std::future<void>> tasks;
+	std::unique_ptr<restart_t> accepted;
+	std::unique_ptr<restart_t> last;
+	size_t numRunning = 0;
+	std::ofstream statusFile(getFilename(".status"), std::ios_base::app);
+	try {
+		while(true) {
+			while(!accepted && numRunning < _parallelRestarts && restarts.size() < maxRuns) {
+				std::unique_ptr<restart_t> restart(new restart_t{});
+				restart->number = restarts.size();
+				restart->seed = std::uniform_int_distribution<uint64_t>(1)(random);
+				restart->sigma = config.sigma;
+				restart->lambda = config.lambda;
+				restart->largePopulation = true;
+				// the configuration is not thread-safe, so the filename is built before the run starts
+				if(restart->number == 0) {
+					restart->fplotFilename = getFilename("_cmaes.dat");
+				} else {
+					restart->fplotFilename = getFilename("_cmaes_restart" + std::to_string(restart->number) + ".dat");
+				}
+				if(restart->number > 0 && _restartStrategy != RS_NONE) {
+					if(_restartStrategy == RS_BIPOP && smallBudget < largeBudget) {
+						// small population and step size, a uniform u in [0,1) picks both
+						double u = std::uniform_real_distribution<double>()(random);
+						restart->largePopulation = false;
+						restart->lambda = std::max(2, static_cast<int>(baseLambda *
+							std::pow(0.5 * largeLambda / baseLambda, u * u)));
+						restart->sigma = config.sigma * std::pow(10, -2 * u);
+					} else {
+						// no overflow of the population size for long series of restarts
+						numLarge = std::min<size_t>(numLarge + 1, 10);
+						largeLambda = baseLambda << numLarge;
+						restart->lambda = largeLambda;
+					}
+				}
+				(restart->largePopulation ? largeBudget : smallBudget) += std::max(restart->lambda, baseLambda);
+				statusFile << "# " << restart->number << "\tlambda " << restart->lambda
+				           << "\tsigma " << restart->sigma << std::endl;
+				auto run = restart.get();
+				restarts.push_back(std::move(restart));
+				tasks.push_back(std::async(std::launch::async,
+					[this, &config, run, &cancelled, &mutex, &finished, &finishedCond]() {
+						auto notify = [run, &mutex, &finished, &finishedCond]() {
+							std::lock_guard<std::mutex> lock(mutex);
+							finished.push_back(run->number);
+							finishedCond.notify_one();
+						};
+						try {
+							runCmaes(config, *run, cancelled);
+						} catch(...) {
+							notify();
+							throw;
+						}
+						notify();
+					}));
+				++numRunning;
+			}
+			if(numRunning == 0) {
+				break;
+			}
+			size_t number;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				finishedCond.wait(lock, [&finished]() { return !finished.empty(); });
+				number = finished.front();
+				finished.pop_front();
+			}
+			--numRunning;
+			tasks[number].get();
+			std::unique_ptr<restart_t> restart(std::move(restarts[number]));
+			if(restart->cancelled) {
+				statusFile << "# " << restart->number << "\tcancelled" << std::endl;
+				continue;
+			}
+			int status = restart->solutions.run_status();
+			size_t& budget = restart->largePopulation ? largeBudget : smallBudget;
+			budget += restart->solutions.fevals();
+			budget -= std::max(restart->lambda, baseLambda);
+			if(accepted) {
+				// finished concurrently with the accepted run, the last row is the reported run
+				statusFile << "# " << restart->number << "\t" << status << std::endl;
+				continue;
+			}
+			statusFile << restart->number << "\t" << status << std::endl;
+			if(_database) {
+				_database->write(_stmt.intermediateStatus, _jobId, restart->number, status);
+			}
+			std::cout << "Run " << restart->number << " finished with status " << status << std::endl;
+			auto acceptable = std::find(_allowedExitStatus.begin(), _allowedExitStatus.end(), status);
+			if(acceptable != _allowedExitStatus.end() || !_forceStatus) {
+				accepted = std::move(restart);
+				cancelled = true;
+			} else {
+				last = std::move(restart);
+			}
+		}
+	} catch(...) {
+		cancelled = true;
+		throw;
+	}
+	return accepted ? std::move(accepted) : std::move(last);
+}
+
+void MpaCmaesAlign::runCmaes(const cmaes_config_t& config, restart_t& restart,
+                             const std::atomic<bool>& cancelled) const
+{
+	struct cancelled_error {};
+	auto cmaparams = getParameters(config, restart);
+	core::FidelitySchedule fidelity(_eventCache.size(), _fidelityMinEvents, restart.sigma);
+	ProgressFunc<CMAParameters<GenoPheno<pwqBoundStrategy>>, CMASolutions> select_time =
+		[&restart, &fidelity](const CMAParameters<GenoPheno<pwqBoundStrategy>>& params, const CMASolutions& cmasols)
+	{
+		auto cand = cmasols.best_candidate();
+		Eigen::VectorXd bestparam = params.get_gp().pheno(cand.get_x_dvec());
+		// a single write, so lines of concurrent runs do not mix
+		std::ostringstream sstr;
+		sstr << "Run " << restart.number << ", "
+		     << "Iteration " << std::setprecision(8) << cmasols.niter() << ", " << cmasols.elapsed_last_iter() << "ms"
+		     << ", fitness=" << cand.get_fvalue()
+		     << ", sigma=" << cmasols.sigma()
+		     << ", events=" << fidelity.size()
+		     << ", parameters (";
+		for(size_t i=0; i<3; ++i) {
+			sstr << " " << bestparam[i];
+		}
+		for(size_t i=3; i<cand.get_x_size(); ++i) {
+			sstr << " " << std::fixed << std::setprecision(2) << 180*bestparam[i]/3.1415;
+		}
+		sstr << " )\n";
+		std::cout << sstr.str() << std::flush;
+		restart.path.push_back({bestparam, cand.get_fvalue(), cmasols.sigma()});
+		fidelity.update(cmasols.sigma(), cand.get_fvalue());
+		return 0;
+	};
+	std::function<double(const double*, const int& N)> model;
+	auto evaluations = _writeFunction ? &restart.evaluations : nullptr;
+	if(_modelEfficiency) {
+		model = [this, evaluations, &cancelled, &fidelity](const double* param, const int& N) {
+			if(cancelled) {
+				throw cancelled_error();
+			}
+			return modelEfficiency(param, N, fidelity.size(), evaluations);
+		};
+	} else {
+		model = [this, evaluations, &cancelled, &fidelity](const double* param, const int& N) {
+			if(cancelled) {
+				throw cancelled_error();
+			}
+			return modelChi2(param, N, fidelity.size(), evaluations);
+		};
+	}
+	std::cout << "Run " << restart.number << ": use '" << (_modelEfficiency ? "efficiency" : "chi2") << "' model, "
+	          << "samples per Generation lambda = " << cmaparams.lambda() << std::endl;
+	try {
+		restart.solutions = cmaes<GenoPheno<pwqBoundStrategy>>(model, cmaparams, select_time);
+	} catch(const cancelled_error&) {
+		restart.cancelled = true;
+		return;
+	}
+	const auto& gp = cmaparams.get_gp();
+	auto bestSeen = restart.solutions.get_best_seen_candidate();
+	restart.bestParam = gp.pheno(bestSeen.get_x_dvec());
+	restart.fitness = bestSeen.get_fvalue();
+	if(_fidelityMinEvents > 0) {
+		// the best seen fitness may be from a smaller subset, compare with the last generation on all events
+		Eigen::VectorXd last = gp.pheno(restart.solutions.best_candidate().get_x_dvec());
+		auto fullModel = _modelEfficiency ? &MpaCmaesAlign::modelEfficiency : &MpaCmaesAlign::modelChi2;
+		restart.fitness = (this->*fullModel)(restart.bestParam.data(), 6, _eventCache.size(), nullptr);
+		double lastFitness = (this->*fullModel)(last.data(), 6, _eventCache.size(), nullptr);
+		if(lastFitness < restart.fitness) {
+			restart.bestParam = last;
+			restart.fitness = lastFitness;
+		}
+	}
+}
+
+MpaCmaesAlign::cmaes_config_t MpaCmaesAlign::getConfig() const
 {
 	static const int dim = 6;
 	auto low = _config.getVector<double>("cmaes_parameters_low");
@@ -319,6 +699,22 @@ libcmaes::CMAParameters<GenoPheno<pwqBoundStrategy>> MpaCmaesAlign::getParameter
 			}
 		}
 	}
+	int warm_start_run = -1;
+	core::AlignmentStore::alignment_t warmStart;
+	if(!_initFromAlignment && _alignmentStore && _warmStartSigma > 0 &&
+	   _alignmentStore->findNearest(_runlist, getCurrentRunId(),
+	                                {{"MpaCmaesAlign", _allowedExitStatus}, {"MpaMinuitAlign", {0}}}, warmStart)) {
+		bool inside = warmStart.parameters.size() == dim;
+		for(size_t i = 0; inside && i < dim; ++i) {
+			inside = warmStart.parameters[i] >= low[i] && warmStart.parameters[i] <= high[i];
+		}
+		if(inside) {
+			init = warmStart.parameters;
+			warm_start_run = warmStart.runId;
+		} else {
+			std::cerr << "Alignment of run " << warmStart.runId << " is out of bounds, not used as start." << std::endl;
+		}
+	}
 	double sigma = 2.0;
 	int lambda = -1;
 	int max_iter = -1;
@@ -332,16 +728,27 @@ libcmaes::CMAParameters<GenoPheno<pwqBoundStrategy>> MpaCmaesAlign::getParameter
 	} catch(core::CfgParse::no_variable_error) {
 	}
 	max_iter = _config.get<int>("cmaes_max_iterations");
-	GenoPheno<pwqBoundStrategy> gp(&low.front(), &high.front(), dim);
-	CMAParameters<GenoPheno<pwqBoundStrategy>> cmaparams(init, sigma, lambda, 0, gp);
-	cmaparams.set_max_fevals(100000);
-	cmaparams.set_max_iter(max_iter);
-	cmaparams.set_ftarget(0.001);
-	cmaparams.set_fplot(getFilename("_cmaes.dat"));
-	cmaparams.set_elitism(elitism);
+	if(warm_start_run >= 0) {
+		sigma *= _warmStartSigma;
+		std::cout << "Start from the alignment of run " << warm_start_run << " with sigma_0 = " << sigma << std::endl;
+	}
 	
-	std::ofstream fout(getFilename(".config"));
 	auto run = _runlist.getByMpaRun(getCurrentRunId());
+	cmaes_config_t config {init, low, high, sigma, lambda, max_iter, elitism};
+	if(_database) {
+		_database->write(_stmt.configInt, _jobId, "lambda", lambda);
+		_database->write(_stmt.configInt, _jobId, "elitism", elitism);
+		_database->write(_stmt.configInt, _jobId, "sampleSize", _sampleSize);
+		_database->write(_stmt.configFloat, _jobId, "sigma0", sigma);
+		_database->write(_stmt.configFloat, _jobId, "angle", run.angle);
+		_database->write(_stmt.configFloat, _jobId, "bias_voltage", run.bias_voltage);
+		_database->write(_stmt.configFloat, _jobId, "bias_current", run.bias_current);
+		_database->write(_stmt.configFloat, _jobId, "threshold", run.threshold);
+		_database->write(_stmt.configInt, _jobId, "telescope_run", run.telescope_run);
+		_database->write(_stmt.configInt, _jobId, "warm_start_run", warm_start_run);
+		return config;
+	}
+	std::ofstream fout(getFilename(".config"));
 	fout << "int lambda " << lambda << "\n";
 	fout << "int elitism " << elitism << "\n";
 	fout << "int sampleSize " << _sampleSize << "\n";
@@ -351,11 +758,31 @@ libcmaes::CMAParameters<GenoPheno<pwqBoundStrategy>> MpaCmaesAlign::getParameter
 	fout << "float bias_current " << run.bias_current << "\n";
 	fout << "float threshold " << run.threshold << "\n";
 	fout << "int telescope_run " << run.telescope_run << "\n";
+	fout << "int warm_start_run " << warm_start_run << "\n";
+
+	return config;
+}
 
+libcmaes::CMAParameters<GenoPheno<pwqBoundStrategy>> MpaCmaesAlign::getParameters(const cmaes_config_t& config,
+                                                                                   const restart_t& restart) const
+{
+	static const int dim = 6;
+	auto init = config.init;
+	GenoPheno<pwqBoundStrategy> gp(&config.low.front(), &config.high.front(), dim);
+	CMAParameters<GenoPheno<pwqBoundStrategy>> cmaparams(init, restart.sigma, restart.lambda, restart.seed, gp);
+	cmaparams.set_max_fevals(100000);
+	cmaparams.set_max_iter(config.maxIter);
+	// the target holds for the whole run, on a subset of the events it would stop at an incomparable fitness
+	if(_fidelityMinEvents == 0) {
+		cmaparams.set_ftarget(0.001);
+	}
+	cmaparams.set_fplot(restart.fplotFilename);
+	cmaparams.set_elitism(config.elitism);
 	return cmaparams;
 }
 
-double MpaCmaesAlign::modelChi2(const double* param, const int N, std::ofstream* func_file)
+double MpaCmaesAlign::modelChi2(const double* param, const int N, size_t numEvents,
+                                std::vector<evaluation_t>* evaluations) const
 {
 	core::MpaTransform trans;
 	trans.setOffset({param[0], param[1], param[2]});
@@ -363,10 +790,11 @@ double MpaCmaesAlign::modelChi2(const double* param, const int N, std::ofstream*
 	double chi2val = 0.0;
 	size_t total_entries = 0;
 	size_t num_entries = 0;
-	for(const auto& evt: _eventCache) {
-		auto b = trans.mpaPlaneTrackIntersect(evt.track, 3, 5);
+	numEvents = std::min(numEvents, _eventCache.size());
+	for(auto evt = _eventCache.begin(); evt != _eventCache.begin() + numEvents; ++evt) {
+		auto b = trans.mpaPlaneTrackIntersect(evt->track, 3, 5);
 		++total_entries;
-		auto a = trans.transform(evt.mpa_index);
+		auto a = trans.transform(evt->mpa_index);
 		auto sqrdist = (b-a).squaredNorm();
 		if(sqrdist < 1) {
 			chi2val += sqrdist;
@@ -377,29 +805,24 @@ double MpaCmaesAlign::modelChi2(const double* param, const int N, std::ofstream*
 	if(num_entries > total_entries/100) {
 		fitness = chi2val / num_entries;
 	}
-	if(func_file) {
-		*func_file << fitness << "\t"
-		           << param[0] << "\t"
-		           << param[1] << "\t"
-		           << param[2] << "\t"
-		           << param[3] << "\t"
-		           << param[4] << "\t"
-		           << param[5] << "\t"
-			   << num_entries << "\t"
-		           << _eventCache.size() << "\n";
+	if(evaluations) {
+		evaluations->push_back({{param[0], param[1], param[2], param[3], param[4], param[5]},
+		                        fitness, num_entries, numEvents});
 	}
 	return fitness;
 }
 
-double MpaCmaesAlign::modelEfficiency(const double* param, const int N, std::ofstream* func_file)
+double MpaCmaesAlign::modelEfficiency(const double* param, const int N, size_t numEvents,
+                                      std::vector<evaluation_t>* evaluations) const
 {
 	core::MpaTransform trans;
 	trans.setOffset({param[0], param[1], param[2]});
 	trans.setRotation({param[3], param[4], param[5]});
 	size_t total_hits = 0;
 	size_t correlated_hits = 0;
-	for(const auto& evt: _eventCache) {
-		Eigen::Vector3d t_global = evt.track.extrapolateOnPlane(3, 5, trans.getOffset()(2), 2);
+	numEvents = std::min(numEvents, _eventCache.size());
+	for(auto evt = _eventCache.begin(); evt != _eventCache.begin() + numEvents; ++evt) {
+		Eigen::Vector3d t_global = evt->track.extrapolateOnPlane(3, 5, trans.getOffset()(2), 2);
 		Eigen::Vector3d t_local(t_global - trans.getOffset());
 		const auto sizeX = trans.total_width;
 		const auto sizeY = trans.total_height;
@@ -423,29 +846,42 @@ double MpaCmaesAlign::modelEfficiency(const double* param, const int N, std::ofs
 			continue;
 		}
 		++total_hits;
-		if(evt.mpa_index >= 0) {
-			auto pixel_coord = trans.transform(evt.mpa_index, true);
-			auto pixel_size = trans.getPixelSize(evt.mpa_index);
+		if(evt->mpa_index >= 0) {
+			auto pixel_coord = trans.transform(evt->mpa_index, true);
+			auto pixel_size = trans.getPixelSize(evt->mpa_index);
 			if(((pixel_coord - t_global).head<2>().array().abs() < pixel_size.array()*_nSigma).all()) {
 				++correlated_hits;
 			}
 		}
 	}
 	double fitness = 1.0 - static_cast<double>(correlated_hits) / static_cast<double>(total_hits);
-	if(total_hits < _eventCache.size()/100) {
+	if(total_hits < numEvents/100) {
 		fitness = 2.0;
 	}
-	if(func_file) {
-		*func_file << fitness << "\t"
-		           << param[0] << "\t"
-		           << param[1] << "\t"
-		           << param[2] << "\t"
-		           << param[3] << "\t"
-		           << param[4] << "\t"
-		           << param[5] << "\t"
-			   << total_hits << "\t"
-		           << _eventCache.size() << "\n";
+	if(evaluations) {
+		evaluations->push_back({{param[0], param[1], param[2], param[3], param[4], param[5]},
+		                        fitness, total_hits, numEvents});
 	}
 	return fitness;
 }
 
+void MpaCmaesAlign::writeEvaluation(std::ofstream& func_file, const evaluation_t& evaluation)
+{
+	const auto param = evaluation.param;
+	if(_database) {
+		// column assignment as imported from the _space.csv files by cmaes2sqlite.py
+		_database->write(_stmt.parameterspace, _jobId, _numEvaluations++,
+		                 param[0], param[1], param[2], param[3], param[4], param[5],
+		                 evaluation.fitness, evaluation.numEntries, evaluation.totalEntries);
+		return;
+	}
+	func_file << evaluation.fitness << "\t"
+	          << param[0] << "\t"
+	          << param[1] << "\t"
+	          << param[2] << "\t"
+	          << param[3] << "\t"
+	          << param[4] << "\t"
+	          << param[5] << "\t"
+	          << evaluation.numEntries << "\t"
+	          << evaluation.totalEntries << "\n";
+}
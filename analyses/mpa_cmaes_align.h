@@ -4,17 +4,25 @@
 
 #include "trackanalysis.h"
 #include "aligner.h"
+#include "sqlitewriter.h"
+#include "alignmentstore.h"
 #include <TH1D.h>
 #include <TCanvas.h>
 #include <TFile.h>
 #include <cmaes.h>
+#include <memory>
+#include <atomic>
 
-class MpaCmaesAlign : public core::TracTrackkAnalysis
+class MpaCmaesAlign : public core::TrackAnalysis
 {
 public:
         MpaCmaesAlign();
 	virtual ~MpaCmaesAlign();
 
+	virtual void closeOutputs();
+	virtual std::vector<std::string> getDependencyFiles(const po::variables_map& vm);
+	virtual bool isCacheable() const;
+
 	virtual void init(const po::variables_map& vm);
 	virtual std::string getUsage(const std::string& argv0) const;
 	virtual std::string getHelp(const std::string& argv0) const;
@@ -25,10 +33,77 @@ private:
 	             const core::BaseSensorStreamReader::event_t& mpa_event);
 	void scanFinish();
 
-	libcmaes::CMAParameters<libcmaes::GenoPheno<libcmaes::pwqBoundStrategy>> getParametersFromConfig() const;
+	/// Settings of the optimization read from the config, common to all restarts
+	struct cmaes_config_t {
+		std::vector<double> init;
+		std::vector<double> low;
+		std::vector<double> high;
+		double sigma;
+		int lambda;
+		int maxIter;
+		int elitism;
+	};
+	/// A single evaluation of the fitness function
+	struct evaluation_t {
+		double param[6];
+		double fitness;
+		size_t numEntries;
+		size_t totalEntries;
+	};
+	/// Best candidate of a generation
+	struct generation_t {
+		Eigen::VectorXd param;
+		double fitness;
+		double sigma;
+	};
+	/// A single CMA-ES run of the restart strategy
+	struct restart_t {
+		size_t number;
+		int lambda;
+		double sigma;
+		uint64_t seed;
+		bool largePopulation;
+		/// File libcmaes writes the iterations to
+		std::string fplotFilename;
+		/// Stopped because another run found an acceptable solution
+		bool cancelled;
+		libcmaes::CMASolutions solutions;
+		Eigen::VectorXd bestParam;
+		/// Fitness of bestParam on all cached events
+		double fitness;
+		std::vector<generation_t> path;
+		std::vector<evaluation_t> evaluations;
+	};
+	enum restart_strategy_t {
+		/// Restart with the same population size
+		RS_NONE,
+		/// Double the population size with every restart
+		RS_IPOP,
+		/// Alternate between doubled and small, randomized population sizes
+		RS_BIPOP
+	};
+
+	cmaes_config_t getConfig() const;
+	libcmaes::CMAParameters<libcmaes::GenoPheno<libcmaes::pwqBoundStrategy>> getParameters(
+		const cmaes_config_t& config, const restart_t& restart) const;
+	/** \brief Run CMA-ES until a run ends with an acceptable status
+	 *
+	 * Up to _parallelRestarts runs are optimized at the same time on the event cache. The restarts are
+	 * stopped as soon as a run ends with an acceptable status.
+	 * \return The first run with an acceptable status, otherwise the last finished run
+	 */
+	std::unique_ptr<restart_t> optimize(const cmaes_config_t& config);
+	void runCmaes(const cmaes_config_t& config, restart_t& restart, const std::atomic<bool>& cancelled) const;
+
+	void openDatabase(const std::string& filename, const po::variables_map& vm);
+	/// Record a single evaluation of the fitness function in the database or the function file
+	void writeEvaluation(std::ofstream& func_file, const evaluation_t& evaluation);
 	
-	double modelChi2(const double* param, const int N, std::ofstream* funcfile=nullptr);
-	double modelEfficiency(const double* param, const int N, std::ofstream* funcfile=nullptr);
+	/// Fitness of the first numEvents events of the cache
+	double modelChi2(const double* param, const int N, size_t numEvents,
+	                 std::vector<evaluation_t>* evaluations=nullptr) const;
+	double modelEfficiency(const double* param, const int N, size_t numEvents,
+	                       std::vector<evaluation_t>* evaluations=nullptr) const;
 
 	struct alignment_t {
 		Eigen::Vector3d position;
@@ -49,12 +124,36 @@ private:
 	bool _forceStatus;
 	bool _initFromAlignment;
 	size_t _maxForceStatusRuns;
+	restart_strategy_t _restartStrategy;
+	size_t _parallelRestarts;
+	/// Events of the first generations, see core::FidelitySchedule
+	size_t _fidelityMinEvents;
 
 	bool _writeCache;
 	bool _writeFunction;
 	bool _modelEfficiency;
 	double _nSigma;
 	std::vector<bool> _pixelMask;
+
+	/// Alignments of all runs, the alignment starts from the closest run of the same setup
+	std::unique_ptr<core::AlignmentStore> _alignmentStore;
+	/// Factor of the initial step size when started from another run
+	double _warmStartSigma;
+
+	/// Traces are written to this database instead of text files, if set
+	std::unique_ptr<core::SqliteWriter> _database;
+	int _jobId;
+	size_t _numEvaluations;
+	struct statements_t {
+		size_t configInt;
+		size_t configFloat;
+		size_t path;
+		size_t parameterspace;
+		size_t intermediateStatus;
+		size_t exitStatus;
+		size_t hitpairs;
+		size_t finals;
+	} _stmt;
 };
 
 #endif//MPA_CMAES_ALIGN_H
@@ -32,14 +32,30 @@ MpaEfficiency::MpaEfficiency() :
 }
 
 MpaEfficiency::~MpaEfficiency()
+{
+	closeOutputs();
+}
+
+void MpaEfficiency::closeOutputs()
 {
 	if(_file) {
 		_file->Write();
 		_file->Close();
 		delete _file;
+		_file = nullptr;
 	}
 }
 
+std::vector<std::string> MpaEfficiency::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::TrackAnalysis::getDependencyFiles(vm);
+	for(auto runId: _allRunIds) {
+		files.push_back(_config.get<std::string>("alignment_dir") + "/" + vm["align-type"].as<std::string>() + "_"
+		                + getMpaIdPadded(runId) + ".align");
+	}
+	return files;
+}
+
 void MpaEfficiency::init(const po::variables_map& vm)
 {
 	_file = new TFile(getRootFilename().c_str(), "RECREATE");
@@ -111,9 +127,10 @@ void MpaEfficiency::init(const po::variables_map& vm)
 	_fakeCount = 0;
 	_totalMpaCount = 0;
 	_bunchCrossingId = new TH1D("bunchCrossingID", "Bunch crossing IDs per Event", 65536, 0, 65536);
+	_pixelMask.assign(_mpaTransform.num_pixels, false);
+	_hasPixelMask = false;
 	try {
 		std::ifstream fmask(_config.getVariable("pixel_mask"));
-		_pixelMask.resize(_mpaTransform.num_pixels, false);
 		while(fmask.good()) {
 			int idx;
 			fmask >> idx;
@@ -123,6 +140,7 @@ void MpaEfficiency::init(const po::variables_map& vm)
 				throw std::out_of_range("Invalid pixel mask index, must be smaller than number of MPA pixels.");
 			}
 			_pixelMask[idx] = true;
+			_hasPixelMask = true;
 		}
 	} catch(core::CfgParse::no_variable_error& e) {
 		std::cout << "No pixel_mask option set." << std::endl;
@@ -167,6 +185,7 @@ void MpaEfficiency::analyzeRunInit()
 	fin >> phi >> theta >> omega;
 	_mpaTransform.setOffset({x, y, z});
 	_mpaTransform.setRotation({phi, theta, omega});
+	_residuals.setTransform(_mpaTransform);
 	auto offset = _mpaTransform.getOffset();
 	std::cout << "Run MPA offset: "
 	          << offset(0) << " "
@@ -193,40 +212,55 @@ bool MpaEfficiency::analyze(const core::TrackStreamReader::event_t& track_event,
 	for(auto& bxId : mpa_event.bunchCrossing) {
 		_bunchCrossingId->Fill(bxId);
 	}
-	bool hasTrackOnMpa = false;
-	bool hasNonmaskedTrackOnMpa = false;
+	// Extrapolate all tracks once and keep those hitting the MPA, then compute the residuals of these tracks
+	// to all pixels in one go.
+	const auto sizeX = _mpaTransform.total_width;
+	const auto sizeY = _mpaTransform.total_height;
+	_onMpaGlobal.clear();
+	_onMpaLocal.clear();
 	for(const auto& track: track_event.tracks) {
 		Eigen::Vector3d t_global = track.extrapolateOnPlane(3, 5, _mpaTransform.getOffset()(2), 2);
 		Eigen::Vector3d t_local(t_global - _mpaTransform.getOffset());
-		const auto sizeX = _mpaTransform.total_width;
-		const auto sizeY = _mpaTransform.total_height;
 		if(t_local(0) < 0.0 || t_local(0) > sizeX ||
 		   t_local(1) < 0.0 || t_local(1) > sizeY) {
 			continue;
 		}
+		_onMpaGlobal.push_back(t_global);
+		_onMpaLocal.push_back(t_local);
+	}
+	assert(mpa_event.data.size() <= static_cast<size_t>(core::TrackPixelMatrix::num_pixels));
+	static const double maskSigma = 0.5;
+	{
+		CORE_TIMED_SCOPE("MpaEfficiency::residuals");
+		_residuals.compute(_onMpaGlobal);
+		_residuals.window(maskSigma, _maskWindow);
+		_residuals.window(_nSigma, _correlationWindow);
+	}
+	const auto& dx = _residuals.getDx();
+	const auto& absDx = _residuals.getAbsDx();
+	const auto& absDy = _residuals.getAbsDy();
+	const auto& sizeYs = _residuals.getSizeY();
+	// histogram fills and counters until the end of the event
+	CORE_TIMED_SCOPE("MpaEfficiency::fill");
+	bool hasTrackOnMpa = !_onMpaGlobal.empty();
+	bool hasNonmaskedTrackOnMpa = false;
+	for(size_t track = 0; track < _onMpaGlobal.size(); ++track) {
 		for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
 			if(mpa_event.data[idx] > 0 && !_pixelMask[idx]) {
-				auto pixel_coord = _mpaTransform.transform(idx, true);
-				_fiducialResidual->Fill(pixel_coord(0) - t_global(0));
+				_fiducialResidual->Fill(dx(track, idx));
 			}
 		}
-		hasTrackOnMpa = true;
-		// first, see if Track hits a masked region and then discard it.
+		// first, see if Track hits a masked region and then discard it. Only the first pixel with the track
+		// inside its window is considered.
 		bool is_masked = false;
-		static const double maskSigma = 0.5;
-		for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
-			// (small, overzealous) optimization
-			if(!_pixelMask[idx] && !_inactiveMask) continue;
-			auto pixel_coord = _mpaTransform.transform(idx, true);
-			auto pixel_size = _mpaTransform.getPixelSize(idx);
-			if(((pixel_coord - t_global).head<2>().array().abs() < pixel_size.array()*maskSigma).all()) {
+		if(_inactiveMask || _hasPixelMask) {
+			for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
+				if(!_pixelMask[idx] && !_inactiveMask) continue;
+				if(!_maskWindow(track, idx)) continue;
 				if(_pixelMask[idx]) {
 					is_masked = true;
-				} else {
-					double y_distance = std::abs(pixel_coord(1) - t_global(1));
-					if(y_distance > pixel_size(1)/2-0.1) {
-						is_masked = true;
-					}
+				} else if(absDy(track, idx) > sizeYs(idx)/2-0.1) {
+					is_masked = true;
 				}
 				break;
 			}
@@ -236,17 +270,12 @@ bool MpaEfficiency::analyze(const core::TrackStreamReader::event_t& track_event,
 		}
 		// fill histograms and counters for actual analysis
 		hasNonmaskedTrackOnMpa = true;
+		const auto& t_local = _onMpaLocal[track];
 		for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
-			auto pixel_coord = _mpaTransform.transform(idx, true);
-			auto pixel_size = _mpaTransform.getPixelSize(idx);
-			if(!((pixel_coord - t_global).head<2>().array().abs() < pixel_size.array()*_nSigma).all()) {
-				continue;
-			}
-			if(mpa_event.data[idx] > 0) {
+			if(_correlationWindow(track, idx) && mpa_event.data[idx] > 0) {
 				_correlated->Fill(t_local(0), t_local(1));
 				++_correlatedCount;
-				//_correlationDistance->Fill((pixel_coord-t_global).head<2>().norm() / 0.1);
-				_correlationDistance->Fill((pixel_coord-t_global).head<1>().norm() / 0.1);
+				_correlationDistance->Fill(absDx(track, idx) / 0.1);
 				break;
 			}
 		}
@@ -266,32 +295,13 @@ bool MpaEfficiency::analyze(const core::TrackStreamReader::event_t& track_event,
 	if(hasTrackOnMpa) {
 		_hitsPerEventWithTrack->Fill(mpaHits);
 	}
-	// Calculate fake hits
+	// Calculate fake hits, i.e. hit pixels without any track on the MPA inside their window
 	for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
 		if(mpa_event.data[idx] == 0 || _pixelMask[idx]) {
 			continue;
 		}
 		++_totalMpaCount;
-		bool gotHit = false;
-		for(const auto& track: track_event.tracks) {
-			Eigen::Vector3d t_global = track.extrapolateOnPlane(3, 5, _mpaTransform.getOffset()(2), 2);
-			Eigen::Vector3d t_local(t_global - _mpaTransform.getOffset());
-			const auto sizeX = _mpaTransform.total_width;
-			const auto sizeY = _mpaTransform.total_height;
-			// track outside of MPA
-			if(t_local(0) < 0.0 || t_local(0) > sizeX ||
-			   t_local(1) < 0.0 || t_local(1) > sizeY) {
-				continue;
-			}
-			auto pixel_coord = _mpaTransform.transform(idx, true);
-			auto pixel_size = _mpaTransform.getPixelSize(idx);
-			if(!((pixel_coord - t_global).head<2>().array().abs() < pixel_size.array()*_nSigma).all()) {
-				continue;
-			}
-			gotHit = true;
-			break;
-		}
-		if(!gotHit) {
+		if(!_correlationWindow.col(idx).any()) {
 			auto pixel_coord = _mpaTransform.translatePixelIndex(idx);
 			_fake->Fill(pixel_coord(0), pixel_coord(1));
 			++_fakeCount;
@@ -4,6 +4,7 @@
 
 #include "trackanalysis.h"
 #include "aligner.h"
+#include "trackpixelmatrix.h"
 #include <TFile.h>
 #include <TH1D.h>
 #include <TH2D.h>
@@ -16,6 +17,9 @@ public:
         MpaEfficiency();
 	virtual ~MpaEfficiency();
 
+	virtual void closeOutputs();
+	virtual std::vector<std::string> getDependencyFiles(const po::variables_map& vm);
+
 	virtual void init(const po::variables_map& vm);
 	virtual std::string getUsage(const std::string& argv0) const;
 	virtual std::string getHelp(const std::string& argv0) const;
@@ -41,6 +45,12 @@ private:
 	TH1D* _fiducialResidual;
 	TH1D* _bunchCrossingId;
 	std::vector<bool> _pixelMask;
+	bool _hasPixelMask;
+	core::TrackPixelMatrix _residuals;
+	core::TrackPixelMatrix::mask_t _maskWindow;
+	core::TrackPixelMatrix::mask_t _correlationWindow;
+	std::vector<Eigen::Vector3d> _onMpaGlobal;
+	std::vector<Eigen::Vector3d> _onMpaLocal;
 	double _nSigma;
 	size_t _totalCount;
 	size_t _correlatedCount;
@@ -1,5 +1,6 @@
 
 #include "mpa_minuit_align.h"
+#include "fidelityschedule.h"
 #include <TImage.h>
 #include <TText.h>
 #include <TGraph.h>
@@ -7,11 +8,13 @@
 #include <Math/Functor.h>
 #include <Math/Factory.h>
 #include <Math/Minimizer.h>
+#include <random>
+#include <algorithm>
 
 REGISTER_ANALYSIS_TYPE(MpaMinuitAlign, "Perform XYZ and angular alignment of MPA.")
 
 MpaMinuitAlign::MpaMinuitAlign() :
- TrackAnalysis(), _aligner(), _file(nullptr)
+ TrackAnalysis(), _aligner(), _file(nullptr), _fidelityMinEvents(0), _numEvents(0), _warmStartSigma(0)
 {
 	getOptionsDescription().add_options()
 		("low-z", po::value<double>()->default_value(820), "Lower bound of Z align scan")
@@ -29,11 +32,28 @@ MpaMinuitAlign::MpaMinuitAlign() :
 }
 
 MpaMinuitAlign::~MpaMinuitAlign()
+{
+	closeOutputs();
+}
+
+void MpaMinuitAlign::closeOutputs()
 {
 	if(_file) {
 		_file->Write();
 		delete _file;
+		_file = nullptr;
+	}
+}
+
+bool MpaMinuitAlign::isCacheable() const
+{
+	// the alignment database is only written for a warm start, these results would be missing after a restore
+	try {
+		_config.getVariable("alignment_db");
+		return _config.get<double>("alignment_warm_start_sigma") <= 0;
+	} catch(const core::CfgParse::no_variable_error&) {
 	}
+	return true;
 }
 
 void MpaMinuitAlign::init(const po::variables_map& vm)
@@ -41,7 +61,26 @@ void MpaMinuitAlign::init(const po::variables_map& vm)
 	_file = new TFile(getFilename(".root").c_str(), "RECREATE");
 	_aligner.initHistograms();
 	_sampleSize = vm["sample-size"].as<int>();
+	setEventSample(_sampleSize);
 	_eventCache.reserve(_sampleSize);
+	// only events scanRun() can use are decoded
+	setEventFilter([](const core::EventIndex::summary_t& evt) { return evt.tracks == 1 && evt.hits == 1; });
+	_fidelityMinEvents = 0;
+	try {
+		_fidelityMinEvents = std::max(0, _config.get<int>("fidelity_min_events"));
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
+	try {
+		_warmStartSigma = _config.get<double>("alignment_warm_start_sigma");
+		if(_warmStartSigma > 0) {
+			_alignmentStore.reset(new core::AlignmentStore(_config.getVariable("alignment_db")));
+		}
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
+	try {
+		_cmaesAllowedExitStatus = _config.getVector<int>("cmaes_allowed_exit_status");
+	} catch(const core::CfgParse::no_variable_error&) {
+	}
 	/*int num_plots = _numSteps + 4;
 	int n_x = std::sqrt(num_plots);
 	int n_y = std::sqrt(num_plots);
@@ -105,25 +144,70 @@ void MpaMinuitAlign::scanFinish()
 	min->SetMaxIterations(1000);
 	min->SetTolerance(0.1);
 	min->SetPrintLevel(2);
-	min->SetVariable(0, "X", -2.96, 1);
-	min->SetVariable(1, "Y", -2.78, 1);
-	min->SetVariable(2, "Z", 878, 1);
-	min->SetVariable(3, "phi", 0, 0.1);
-	min->SetVariable(4, "theta", 0, 0.1);
-	min->SetVariable(5, "omega", 0, 0.1);
+	std::vector<double> init {-2.96, -2.78, 878, 0, 0, 0};
+	std::vector<double> steps {1, 1, 1, 0.1, 0.1, 0.1};
+	int warm_start_run = -1;
+	core::AlignmentStore::alignment_t warmStart;
+	if(_alignmentStore && _warmStartSigma > 0 &&
+	   _alignmentStore->findNearest(_runlist, getCurrentRunId(),
+	                                {{"MpaMinuitAlign", {0}}, {"MpaCmaesAlign", _cmaesAllowedExitStatus}}, warmStart) &&
+	   warmStart.parameters.size() == init.size()) {
+		std::cout << "Start from the " << warmStart.analysis << " alignment of run " << warmStart.runId << std::endl;
+		init = warmStart.parameters;
+		warm_start_run = warmStart.runId;
+		for(auto& step: steps) {
+			step *= _warmStartSigma;
+		}
+	}
+	std::ofstream fout(getFilename(".config"));
+	fout << "int warm_start_run " << warm_start_run << "\n";
+	fout.close();
+	min->SetVariable(0, "X", init[0], steps[0]);
+	min->SetVariable(1, "Y", init[1], steps[1]);
+	min->SetVariable(2, "Z", init[2], steps[2]);
+	min->SetVariable(3, "phi", init[3], steps[3]);
+	min->SetVariable(4, "theta", init[4], steps[4]);
+	min->SetVariable(5, "omega", init[5], steps[5]);
 //	min->SetVariable(0, "X", 0.0, 5);
 //	min->SetVariable(1, "Y", 0.0, 5);
 //	min->SetVariable(2, "Z", 860, 10);
 //	min->SetVariable(3, "phi", 0, 0.1);
 //	min->SetVariable(4, "theta", 0, 0.1);
 //	min->SetVariable(5, "omega", 0, 0.1);
-	if(!min->Minimize()) {
-		std::cout << "Minimization failed!" << std::endl;
-		return;
+	// Migrad cannot handle a changing function, each subset is minimized starting at the previous minimum
+	if(_fidelityMinEvents > 0) {
+		std::shuffle(_eventCache.begin(), _eventCache.end(), std::mt19937(1));
+	}
+	core::FidelitySchedule fidelity(_eventCache.size(), _fidelityMinEvents);
+	std::vector<double> start(init);
+	while(true) {
+		_numEvents = fidelity.size();
+		std::cout << "Minimize on " << _numEvents << " events" << std::endl;
+		if(min->Minimize()) {
+			auto x = min->X();
+			start.assign(x, x + 6);
+		} else if(fidelity.isFull()) {
+			std::cout << "Minimization failed!" << std::endl;
+			return;
+		} else {
+			// a small subset may be too noisy, only the minimization on all events decides
+			std::cout << "Minimization on " << _numEvents << " events failed, continue with more events" << std::endl;
+		}
+		if(!fidelity.grow()) {
+			break;
+		}
+		for(unsigned int i = 0; i < 6; ++i) {
+			min->SetVariableValue(i, start[i]);
+		}
 	}
 	auto par = min->X();
 	Eigen::VectorXd bestparam(6);
 	bestparam << par[0], par[1], par[2], par[3], par[4], par[5];
+	// only converged alignments are used as start of other runs
+	if(_alignmentStore && min->Status() == 0) {
+		_alignmentStore->save(getCurrentRunId(), "MpaMinuitAlign", std::vector<double>(par, par + 6), min->MinValue(),
+		                      min->Status());
+	}
 
 	_mpaTransform.setOffset(bestparam.head<3>());
 	_mpaTransform.setRotation(bestparam.tail<3>());
@@ -192,10 +276,10 @@ double MpaMinuitAlign::chi2(const double* param)
 	double chi2val = 0.0;
 	size_t total_entries = 0;
 	size_t num_entries = 0;
-	for(const auto& evt: _eventCache) {
-		auto b = trans.mpaPlaneTrackIntersect(evt.track, 0, 5);
+	for(auto evt = _eventCache.begin(); evt != _eventCache.begin() + _numEvents; ++evt) {
+		auto b = trans.mpaPlaneTrackIntersect(evt->track, 0, 5);
 		++total_entries;
-		auto a = trans.transform(evt.mpa_index);
+		auto a = trans.transform(evt->mpa_index);
 		auto sqrdist = (b-a).squaredNorm();
 		if(sqrdist < 1) {
 			chi2val += sqrdist;
@@ -4,10 +4,12 @@
 
 #include "trackanalysis.h"
 #include "aligner.h"
+#include "alignmentstore.h"
 #include <TH1D.h>
 #include <TCanvas.h>
 #include <TFile.h>
 #include <fstream>
+#include <memory>
 
 class MpaMinuitAlign : public core::TrackAnalysis
 {
@@ -15,6 +17,9 @@ public:
         MpaMinuitAlign();
 	virtual ~MpaMinuitAlign();
 
+	virtual void closeOutputs();
+	virtual bool isCacheable() const;
+
 	virtual void init(const po::variables_map& vm);
 	virtual std::string getUsage(const std::string& argv0) const;
 	virtual std::string getHelp(const std::string& argv0) const;
@@ -25,6 +30,7 @@ private:
 	             const core::BaseSensorStreamReader::event_t& mpa_event);
 	void scanFinish();
 
+	/// Fitness of the first _numEvents events of the cache
 	double chi2(const double* param);
 
 	struct alignment_t {
@@ -41,6 +47,15 @@ private:
 	TFile* _file;
 	core::Aligner _aligner;
 	size_t _sampleSize;
+	/// Events of the first minimization, see core::FidelitySchedule
+	size_t _fidelityMinEvents;
+	size_t _numEvents;
+	/// Alignments of all runs, the alignment starts from the closest run of the same setup
+	std::unique_ptr<core::AlignmentStore> _alignmentStore;
+	/// Factor of the initial step sizes when started from another run, 0 to always start from the defaults
+	double _warmStartSigma;
+	/// Exit statuses of MpaCmaesAlign whose alignments are used as start
+	std::vector<int> _cmaesAllowedExitStatus;
 	std::ofstream _spaceFile;
 };
 
@@ -7,6 +7,7 @@
 #include <TFitResult.h>
 #include <fstream>
 #include "mpatransform.h"
+#include "mpaassembly.h"
 #include <TF1.h>
 #include <algorithm>
 #include <TGraph.h>
@@ -15,8 +16,7 @@
 REGISTER_ANALYSIS_TYPE(MpaTripletEfficiency, "Calculate MPA Efficiency based on triplet-tracks")
 
 MpaTripletEfficiency::MpaTripletEfficiency() :
- _currentDutResX(nullptr), _currentDutResY(nullptr),
- _trackHitCount(0), _realHitCount(0)
+ _currentDutResX(nullptr), _currentDutResY(nullptr)
 {
 }
 
@@ -24,6 +24,16 @@ MpaTripletEfficiency::~MpaTripletEfficiency()
 {
 }
 
+std::vector<std::string> MpaTripletEfficiency::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::MergedAnalysis::getDependencyFiles(vm);
+	// the runs are only known from the command line before init()
+	for(auto runId: vm["run"].as<std::vector<int>>()) {
+		files.push_back(_config.getVariable("output_dir") + "/GblAlign_" + getMpaIdPadded(runId) + "_alignment.txt");
+	}
+	return files;
+}
+
 void MpaTripletEfficiency::init()
 {
 	_file = new TFile(getRootFilename().c_str(), "recreate");
@@ -49,30 +59,49 @@ void MpaTripletEfficiency::init()
 		_config.get<double>("dut_omega")
 		}) * M_PI / 180;
 	_trackConsts.dut_plateau_x = _config.get<int>("dut_plateau_x") > 0;
-	_trackHits = new TH2F("track_hits", "Tracks passing the MaPSA",
-	                      160, 0, 16,
-			      60, 0, 3);
-	_realHits = new TH2F("real_hits", "Registered Tracks",
-	                      160, 0, 16,
-			      60, 0, 3);
-	_pixelHits = new TH2F("pixel_hits", "Hits on MPA before clustering",
-	                      160, 0, 16,
-			      60, 0, 3);
-	_clusterHits = new TH2F("cluster_hits", "Hits on MPA after clustering",
-	                      160, 0, 16,
-			      60, 0, 3);
+	_trackConsts.dut_assembly.loadChipPoses(_config);
+	// chip 2 of the single chip setup, or a lone chip, keeps its histograms at the top level
+	const auto& enabled = _trackConsts.dut_assembly.getEnabled();
+	int topLevelChip = enabled.size() == 1 ? enabled.front() : 2;
+	for(int mpaIdx: enabled) {
+		chip_t chip;
+		chip.index = mpaIdx;
+		if(mpaIdx != topLevelChip) {
+			chip.directory = "mpa_" + std::to_string(mpaIdx);
+			_file->mkdir(chip.directory.c_str());
+			_file->cd(chip.directory.c_str());
+		} else {
+			_file->cd();
+		}
+		chip.trackHits = new TH2F("track_hits", "Tracks passing the MaPSA",
+		                          160, 0, 16,
+		                          60, 0, 3);
+		chip.realHits = new TH2F("real_hits", "Registered Tracks",
+		                         160, 0, 16,
+		                         60, 0, 3);
+		chip.pixelHits = new TH2F("pixel_hits", "Hits on MPA before clustering",
+		                          160, 0, 16,
+		                          60, 0, 3);
+		chip.clusterHits = new TH2F("cluster_hits", "Hits on MPA after clustering",
+		                            160, 0, 16,
+		                            60, 0, 3);
+		chip.overlayedTrackHits = new TH2F("overlayed_track_hits", "Tracks passing the MaPSA",
+		                                   30, 0, 2,
+		                                   100, 0, 1);
+		chip.overlayedRealHits = new TH2F("overlayed_real_hits", "Registered Tracks",
+		                                  30, 0, 2,
+		                                  100, 0, 1);
+		chip.dutResX = new TH1F("dut_res_x", "", 1000, -10, -10);
+		chip.dutResY = new TH1F("dut_res_y", "", 1000, -10, -10);
+		chip.dutResZ = new TH1F("dut_res_z", "", 1000, -10, -10);
+		chip.trackHitCount = 0;
+		chip.realHitCount = 0;
+		_chips.push_back(chip);
+	}
+	_file->cd();
 	_fakeHits = new TH2F("fake_hits", "Formerly Shit-Tracks",
 	                      160, 0, 16,
 			      60, 0, 3);
-	_overlayedTrackHits = new TH2F("overlayed_track_hits", "Tracks passing the MaPSA",
-	                      30, 0, 2,
-			      100, 0, 1);
-	_overlayedRealHits = new TH2F("overlayed_real_hits", "Registered Tracks",
-	                      30, 0, 2,
-			      100, 0, 1);
-	_dutResX = new TH1F("dut_res_x", "", 1000, -10, -10);
-	_dutResY = new TH1F("dut_res_y", "", 1000, -10, -10);
-	_dutResZ = new TH1F("dut_res_z", "", 1000, -10, -10);
 	int numRuns = _allRunIds.size();
 	int minId = *std::min_element(_allRunIds.begin(), _allRunIds.end());
 	int maxId = *std::max_element(_allRunIds.begin(), _allRunIds.end());
@@ -86,10 +115,20 @@ void MpaTripletEfficiency::run(const core::run_data_t& run)
 {
 	loadCurrentAlignment();
 
-	_maskedPixels.clear();
-	core::MpaTransform transform;
-	for(auto pixelIdx: _config.getVector<int>("triplet_efficiency_masked")) {
-		_maskedPixels.push_back(transform.translatePixelIndex(pixelIdx));
+	core::MpaAssembly assembly(_trackConsts.dut_assembly);
+	for(auto& chip: _chips) {
+		chip.maskedPixels.clear();
+		std::vector<int> masked;
+		try {
+			masked = _config.getVector<int>("triplet_efficiency_masked_" + std::to_string(chip.index));
+		} catch(core::CfgParse::no_variable_error&) {
+			if(chip.index == 2) {
+				masked = _config.getVector<int>("triplet_efficiency_masked");
+			}
+		}
+		for(auto pixelIdx: masked) {
+			chip.maskedPixels.push_back(assembly.getTransform(chip.index).translatePixelIndex(pixelIdx, chip.index));
+		}
 	}
 	_fiducialMin(0) = _config.get<double>("triplet_efficiency_fiducial_min_x");
 	_fiducialMin(1) = _config.get<double>("triplet_efficiency_fiducial_min_y");
@@ -107,55 +146,51 @@ void MpaTripletEfficiency::run(const core::run_data_t& run)
 	auto hists = core::TripletTrack::genDebugHistograms();
 	auto tracks = core::TripletTrack::getTracksWithRefDut(_trackConsts, run, hists, nullptr, nullptr, false);
 	size_t trackIdx = 0;
-	transform.setOffset(_dutAlignOffset);
-	transform.setRotation(_trackConsts.dut_rotation);
+	assembly.setPose(_dutAlignOffset, _trackConsts.dut_rotation);
 	std::cout << "Track particles to DUT" << std::endl;
-//	std::ofstream fout(getFilename("_hits.csv"));
+	core::MpaHitGenerator::assembly_hits_t mpaHits;
 	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
-		auto pixelHits = core::MpaHitGenerator::getCounterPixels(run, transform);
-		std::vector<int> clusterSizes;
-		auto clusterHits = core::MpaHitGenerator::clusterize(pixelHits, &clusterSizes, nullptr);
-		_mpaActivationHist->Fill(_currentRunId, pixelHits.size());
-		for(int cs: clusterSizes) {
-			_clusterSize->Fill(cs);
-		}
-		for(const auto& mpaHit: clusterHits) {
-			_clusterHits->Fill(mpaHit(0), mpaHit(1));
+		{
+			CORE_TIMED_SCOPE("TTree::GetEntry");
+			run.tree->GetEntry(evt);
 		}
-		for(const auto& mpaHit: pixelHits) {
-			_pixelHits->Fill(mpaHit(0), mpaHit(1));
+		core::MpaHitGenerator::getAssemblyHits(run, assembly, mpaHits);
+		size_t numPixels = 0;
+		for(auto& chip: _chips) {
+			const auto& chipHits = mpaHits.chips[chip.index - 1];
+			numPixels += chipHits.pixels.size();
+			for(int cs: chipHits.clusterSizes) {
+				_clusterSize->Fill(cs);
+			}
+			for(const auto& mpaHit: chipHits.clusters) {
+				chip.clusterHits->Fill(mpaHit(0), mpaHit(1));
+			}
+			for(const auto& mpaHit: chipHits.pixels) {
+				chip.pixelHits->Fill(mpaHit(0), mpaHit(1));
+			}
 		}
+		_mpaActivationHist->Fill(_currentRunId, numPixels);
 		for(; trackIdx < tracks.size() && tracks[trackIdx].first.getEventNo() < evt; ++trackIdx) {
-//			std::cout << " Skipping track " << trackIdx
-//			          << "  event " << evt
-//				  << " (" << tracks[trackIdx].first.getEventNo() << ")"
-//				  << std::endl;
 		}
 		for(; trackIdx < tracks.size() && tracks[trackIdx].first.getEventNo() == evt; ++trackIdx) {
-//			std::cout << "Accepting track " << trackIdx
-//			          << "  event " << evt
-//				  << " (" << tracks[trackIdx].first.getEventNo() << ")"
-//				  << std::endl;
-			auto track = tracks[trackIdx].first;
-			for(const auto& mpaHit: clusterHits) {
-				auto plane_hit = transform.mpaPlaneTrackIntersect(track.upstream());
-				auto hit = transform.pixelCoordToGlobal(mpaHit);
-				Eigen::Vector3d res = plane_hit - hit;
-				_currentDutResX->Fill(res(0));
-				_currentDutResY->Fill(res(1));
-				_currentDutResZ->Fill(res(2));
+			const auto& track = tracks[trackIdx].first;
+			for(auto& chip: _chips) {
+				const auto& chipHits = mpaHits.chips[chip.index - 1];
+				const auto& transform = assembly.getTransform(chip.index);
+				for(const auto& hit: chipHits.globalClusters) {
+					auto plane_hit = transform.mpaPlaneTrackIntersect(track.upstream());
+					Eigen::Vector3d res = plane_hit - hit;
+					_currentDutResX->Fill(res(0));
+					_currentDutResY->Fill(res(1));
+					_currentDutResZ->Fill(res(2));
+				}
+				calcTrack(chip, track, chipHits.clusters, transform);
 			}
-			calcTrack(track, clusterHits, transform, run);
-//			for(auto hitpoint: core::MpaHitGenerator::getCounterHits(run, transform)) {
-//				fout << hitpoint(0) << " " << hitpoint(1) << " " << hitpoint(2)+0.2 << "\n";
-//			}
 		}
-//		fout << "\n";
 	}
 	_runIdsDouble.push_back(_currentRunId);
 	_meanResX.push_back(_currentDutResX->GetMean());
-	_meanResY.push_back(_currentDutResY->GetMean()), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr;
+	_meanResY.push_back(_currentDutResY->GetMean());
 }
 
 void MpaTripletEfficiency::finalize()
@@ -175,16 +210,33 @@ void MpaTripletEfficiency::finalize()
 	img->FromPad(canvas);
 	img->WriteImage(getFilename(".png").c_str());
 	delete img;
-	auto efficiency = (TH2F*)_realHits->Clone("efficiency");
-	efficiency->Divide(_trackHits);
-	efficiency->SetTitle("MaPSA Efficiency Map");
-	auto overlayed_efficiency = (TH2F*)_overlayedRealHits->Clone("overlayed_efficiency");
-	overlayed_efficiency->Divide(_overlayedTrackHits);
-	overlayed_efficiency->SetTitle("MaPSA Pixel Map");
+	size_t trackHitCount = 0;
+	size_t realHitCount = 0;
+	std::ofstream fchips(getFilename("_efficiency_mpa.txt"));
+	fchips << "# Mpa\tTotal\tHits\tEfficiency\n";
+	for(const auto& chip: _chips) {
+		if(chip.directory.empty()) {
+			_file->cd();
+		} else {
+			_file->cd(chip.directory.c_str());
+		}
+		auto efficiency = (TH2F*)chip.realHits->Clone("efficiency");
+		efficiency->Divide(chip.trackHits);
+		efficiency->SetTitle("MaPSA Efficiency Map");
+		auto overlayed_efficiency = (TH2F*)chip.overlayedRealHits->Clone("overlayed_efficiency");
+		overlayed_efficiency->Divide(chip.overlayedTrackHits);
+		overlayed_efficiency->SetTitle("MaPSA Pixel Map");
+		double eff = (double)chip.realHitCount / (double)chip.trackHitCount;
+		fchips << chip.index << "\t" << chip.trackHitCount << "\t" << chip.realHitCount << "\t" << eff << "\n";
+		std::cout << "Efficiency MPA " << chip.index << ": " << eff*100 << " %" << std::endl;
+		trackHitCount += chip.trackHitCount;
+		realHitCount += chip.realHitCount;
+	}
+	fchips.close();
 	std::ofstream fefficiency(getFilename("_efficiency.txt"));
-	double eff = (double)_realHitCount / (double)_trackHitCount;
+	double eff = (double)realHitCount / (double)trackHitCount;
 	fefficiency << "# Total\tHits\tEfficiency\n"
-	            << _trackHitCount << "\t" << _realHitCount << "\t" << eff << "\n";
+	            << trackHitCount << "\t" << realHitCount << "\t" << eff << "\n";
 	fefficiency.flush();
 	fefficiency.close();
 	std::cout << "Efficiency: " << eff*100 << " %" << std::endl;
@@ -223,7 +275,9 @@ void MpaTripletEfficiency::loadCurrentAlignment()
 	std::cout << "Dut Alignment:\n" << _dutAlignOffset << std::endl;
 }
 
-void MpaTripletEfficiency::calcTrack(core::TripletTrack track, std::vector<Eigen::Vector2d> mpaHits, core::MpaTransform transform, core::run_data_t run)
+void MpaTripletEfficiency::calcTrack(chip_t& chip, const core::TripletTrack& track,
+                                     const std::vector<Eigen::Vector2d>& mpaHits,
+                                     const core::MpaTransform& transform)
 {
 	try { 
 		auto hitpoint = transform.mpaPlaneTrackIntersect(track.upstream());
@@ -234,21 +288,20 @@ void MpaTripletEfficiency::calcTrack(core::TripletTrack track, std::vector<Eigen
 		   pc(1) < _fiducialMin(1) || pc(1) > _fiducialMax(1)) {
 			return;
 		}
-		for(auto maskedPc: _maskedPixels) {
+		for(auto maskedPc: chip.maskedPixels) {
 			if((int)pc(0) == maskedPc(0) && (int)pc(1) == maskedPc(1)) {
 				return;
 			}
 		}
-		_trackHits->Fill(pc(0), pc(1));
-		_trackHitCount++;
+		chip.trackHits->Fill(pc(0), pc(1));
+		chip.trackHitCount++;
 		bool overlaying_pixel = true;
 		if(pc(0) < 1.0 || pc(0) > 15 || pc(1) > 2) {
 			overlaying_pixel = false;
 		} else {
-			_overlayedTrackHits->Fill(overlay_pc(0), overlay_pc(1));
+			chip.overlayedTrackHits->Fill(overlay_pc(0), overlay_pc(1));
 		}
 		_trackHist->Fill(_currentRunId);
-		auto pixels = (*run.mpaData[0].data)->counter.pixels;
 		for(const auto& pc2: mpaHits) {
 			auto mpaHit = transform.pixelCoordToGlobal(pc2);
 //			if(((pc - pc2).array().abs() > Eigen::Array2d{1.5, 1.5}).any()) {
@@ -259,15 +312,15 @@ void MpaTripletEfficiency::calcTrack(core::TripletTrack track, std::vector<Eigen
 			   std::abs(res(0)) > _resCutX) {
 				continue;
 			}
-			_realHits->Fill(pc(0), pc(1));
+			chip.realHits->Fill(pc(0), pc(1));
 			_mpaHitHist->Fill(_currentRunId);
 			if(overlaying_pixel) {
-				_overlayedRealHits->Fill(overlay_pc(0), overlay_pc(1));
+				chip.overlayedRealHits->Fill(overlay_pc(0), overlay_pc(1));
 			}
-			_dutResX->Fill(res(0));
-			_dutResY->Fill(res(1));
-			_dutResZ->Fill(res(2));
-			_realHitCount++;
+			chip.dutResX->Fill(res(0));
+			chip.dutResY->Fill(res(1));
+			chip.dutResZ->Fill(res(2));
+			chip.realHitCount++;
 			break;
 		}
 	} catch(std::out_of_range& e) {
@@ -13,27 +13,42 @@ public:
 	MpaTripletEfficiency();
 	virtual ~MpaTripletEfficiency();
 
+	virtual std::vector<std::string> getDependencyFiles(const po::variables_map& vm);
+
 	virtual void init();
 	virtual void run(const core::run_data_t& run);
 	virtual void finalize();
 
 private:
+	/// Histograms and counters of a single MPA chip
+	struct chip_t
+	{
+		int index;
+		/// Directory of the histograms in the output file, empty for the top level
+		std::string directory;
+		TH2F* trackHits;
+		TH2F* realHits;
+		TH2F* clusterHits;
+		TH2F* pixelHits;
+		TH2F* overlayedTrackHits;
+		TH2F* overlayedRealHits;
+		TH1F* dutResX;
+		TH1F* dutResY;
+		TH1F* dutResZ;
+		size_t trackHitCount;
+		size_t realHitCount;
+		std::vector<Eigen::Vector2i> maskedPixels;
+	};
+
 	void loadCurrentAlignment();
-	void calcTrack(core::TripletTrack track, std::vector<Eigen::Vector2d> mpaHits, core::MpaTransform transform, core::run_data_t run);
+	void calcTrack(chip_t& chip, const core::TripletTrack& track, const std::vector<Eigen::Vector2d>& mpaHits,
+	               const core::MpaTransform& transform);
 	TFile* _file;
 	core::TripletTrack::constants_t _trackConsts;
 	Eigen::Vector3d _refAlignOffset;
 	Eigen::Vector3d _dutAlignOffset;
-	TH2F* _trackHits;
-	TH2F* _realHits;
+	std::vector<chip_t> _chips;
 	TH2F* _fakeHits;
-	TH2F* _clusterHits;
-	TH2F* _pixelHits;
-	TH2F* _overlayedTrackHits;
-	TH2F* _overlayedRealHits;
-	TH1F* _dutResX;
-	TH1F* _dutResY;
-	TH1F* _dutResZ;
 	TH1F* _currentDutResX;
 	TH1F* _currentDutResY;
 	TH1F* _currentDutResZ;
@@ -41,8 +56,6 @@ private:
 	TH1F* _trackHist;
 	TH1F* _mpaActivationHist;
 	TH1F* _clusterSize;
-	size_t _trackHitCount;
-	size_t _realHitCount;
 	double _resCutX;
 	double _resCutY;
 	std::vector<double> _runIdsDouble;
@@ -50,7 +63,6 @@ private:
 	std::vector<double> _meanResY;
 	Eigen::Vector2d _fiducialMin;
 	Eigen::Vector2d _fiducialMax;
-	std::vector<Eigen::Vector2i> _maskedPixels;
 };
 
 #endif//MPA_TRIPLET_EFFICIENCY_H
@@ -19,10 +19,17 @@ RefPreAlign::RefPreAlign() :
 
 RefPreAlign::~RefPreAlign()
 {
-	_file->Write();
-	_file->Close();
-	delete _file;
-	_file = nullptr;
+	closeOutputs();
+}
+
+void RefPreAlign::closeOutputs()
+{
+	if(_file) {
+		_file->Write();
+		_file->Close();
+		delete _file;
+		_file = nullptr;
+	}
 }
 
 void RefPreAlign::init()
@@ -40,7 +47,10 @@ void RefPreAlign::run(const core::run_data_t& run)
 	std::cout << "Run " << run.runId << std::endl;
 	auto telHits = *run.telescopeHits;
 	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEvent(evt);
+		{
+			CORE_TIMED_SCOPE("TTree::GetEntry");
+			run.tree->GetEvent(evt);
+		}
 		core::MpaTransform transform;
 		for(size_t it = 0; it < telHits->p1.x.GetNoElements(); ++it) {
 			for(size_t ir = 0; ir < telHits->ref.x.GetNoElements(); ++ir) {
@@ -11,6 +11,8 @@ public:
 	RefPreAlign();
 	virtual ~RefPreAlign();
 
+	virtual void closeOutputs();
+
 	virtual void init();
 	virtual void run(const core::run_data_t& run);
 	virtual void finalize();
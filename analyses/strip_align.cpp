@@ -1,15 +1,16 @@
 
 #include "strip_align.h"
-#include <TImage.h>
 #include <TF1.h>
 #include <TText.h>
 #include <TGraph.h>
 #include <TFitResult.h>
+#include <sstream>
+#include <algorithm>
 
 REGISTER_ANALYSIS_TYPE(StripAlign, "Textual analysis description here.")
 
 StripAlign::StripAlign() :
- TrackAnalysis(), _file(nullptr)
+ TrackAnalysis(), _output(nullptr), _scan(1, 3)
 {
 	getOptionsDescription().add_options()
 		("low-y", po::value<double>()->default_value(-100), "Lower bound of Y align scan")
@@ -24,6 +25,7 @@ StripAlign::StripAlign() :
 		("high-shift", po::value<int>()->default_value(10), "Upper shift value for --shift mode")
 		("shift", "Do not scan different Z positions but different data shift values.")
 		("noisy-as-fuck,F", "Use alternative, slightly less stable residual fit. Useful for rather noisy runs")
+		("scan-threads", po::value<int>()->default_value(1), "Number of threads evaluating the Z steps, 0 for one per hardware thread. Belphegor jobs use their --threads hint by default")
 	;
 	addProcess("scan", /* CS_ALWAYS */ CS_TRACK,
 	           core::TrackAnalysis::init_callback_t {},
@@ -42,13 +44,24 @@ StripAlign::StripAlign() :
 }
 
 StripAlign::~StripAlign()
+{
+	closeOutputs();
+}
+
+void StripAlign::closeOutputs()
 {
 	_out.close();
-	if(_file) {
-		_file->Write();
-		_file->Close();
-		delete _file;
+	delete _output;
+	_output = nullptr;
+}
+
+std::vector<std::string> StripAlign::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::TrackAnalysis::getDependencyFiles(vm);
+	if(vm.count("reuse-z")) {
+		files.push_back(getFilename("_best.align"));
 	}
+	return files;
 }
 
 void StripAlign::init(const po::variables_map& vm)
@@ -57,9 +70,9 @@ void StripAlign::init(const po::variables_map& vm)
 	if(!_out.good()) {
 		throw std::ios_base::failure("Cannot open debug output file.");
 	}
-	_file = new TFile(getFilename(".root").c_str(), "RECREATE");
-	assert(_file);
+	_output = new core::RootOutput(getFilename(".root"));
 	_sampleSize = vm["sample-size"].as<int>();
+	setEventSample(_sampleSize);
 	_lowY = vm["low-y"].as<double>();
 	_highY = vm["high-y"].as<double>();
 	_lowZ = vm["low-z"].as<double>();
@@ -71,6 +84,13 @@ void StripAlign::init(const po::variables_map& vm)
 	_reuseZ	= vm.count("reuse-z") > 0;
 	_noY = vm.count("no-y") > 0;
 	_noisyAsFuckMode = vm.count("noisy-as-fuck") > 0;
+	_scanThreads = vm["scan-threads"].as<int>();
+	if(vm["scan-threads"].defaulted()) {
+		try {
+			_scanThreads = std::max(1, _config.get<int>("job_threads"));
+		} catch(const core::CfgParse::no_variable_error&) {
+		}
+	}
 	if(_shift) {
 		assert(_highShift > _lowShift);
 		_numSteps = _highShift - _lowShift + 1;
@@ -155,38 +175,21 @@ void StripAlign::scanInit()
 	if(_reuseZ) {
 		return;
 	}
-	assert(_file);
+	assert(_output);
 	_numProcessedSamples = 0;
 	if(_shift) {
+		// A different data offset changes the pairing of telescope and sensor events, so every shift value
+		// needs its own pass over the input files.
 		_currentShift = _lowShift + _currentScanStep;
 		setDataOffset(_currentShift);
 		_currentZ = _lowZ;
 		_config.setVariable("mpa_z_offset", _lowZ);
-	} else {
-		_currentZ = _lowZ + (_highZ - _lowZ) / (_numSteps-1) * _currentScanStep;
-		_config.setVariable("mpa_z_offset", _currentZ);
+		std::cout << _currentScanStep+1 << "/" << _numSteps
+		          << ": Calculate alignment constants for Z = " << _currentZ
+			  << "mm, skip = " << getDataOffset() << std::endl;
+		_steps.clear();
+		_steps.push_back(initScanStep(_currentScanStep, _currentZ));
 	}
-	std::cout << _currentScanStep+1 << "/" << _numSteps
-	          << ": Calculate alignment constants for Z = " << _currentZ
-		  << "mm, skip = " << getDataOffset() << std::endl;
-	std::string header = "Z = ";
-	header += std::to_string(_currentZ);
-	header += "mm, skip = ";
-	header += std::to_string(getDataOffset());
-	const int k = 2;
-	const int k_bin = 4;
-	_corHist = new TH1D((std::string("align_")+std::to_string(_currentScanStep)).c_str(), header.c_str(), 4000*k, -10*k, 10*k);
-	_corX = new TH2D((std::string("cor_x_")+std::to_string(_currentScanStep)).c_str(),
-	                 (std::string("X: ")+header).c_str(), 50*k_bin, -5*k, 5*k, 50*k_bin, -5*k, 5*k);
-	_corX->GetXaxis()->SetTitle("Track X");
-	_corX->GetYaxis()->SetTitle("Strip Position");
-	_corY = new TH2D((std::string("cor_y_")+std::to_string(_currentScanStep)).c_str(),
-	                 (std::string("Y: ")+header).c_str(), 50*k_bin, -5*k, 5*k, 50*k_bin, -5*k, 5*k);
-	_corY->GetXaxis()->SetTitle("Track Y");
-	_corY->GetYaxis()->SetTitle("Strip Position");
-	_file->Add(_corHist);
-	_file->Add(_corX);
-	_file->Add(_corY);
 	_currentSigmaMinimum = { 0.0, -1.0 };
 }
 
@@ -198,7 +201,20 @@ bool StripAlign::scanRun(const core::TrackStreamReader::event_t& track_event,
 	}
 	int n_strips = _config.get<int>("strip_count");
 	double pitch = _config.get<double>("strip_pitch");
-	double length = _config.get<double>("strip_length");
+	if(!_shift) {
+		// Only cache the sample, all Z steps are filled in scanFinish()
+		std::vector<core::ZScan::hit_t> hits;
+		for(const auto& idx: mpa_event.data) {
+			// ignore det1
+			if(idx >= 254) {
+				continue;
+			}
+			double x = (static_cast<double>(idx) - n_strips) * pitch;
+			hits.push_back({static_cast<int>(idx), Eigen::Vector2d(x, 0.0)});
+		}
+		_scan.addEvent(mpa_event.eventNumber, track_event.tracks, hits);
+		return (_numProcessedSamples++ < _sampleSize);
+	}
 	for(const auto& track: track_event.tracks) {
 		auto b = track.extrapolateOnPlane(1, 3, _currentZ, 2);
 		for(const auto& idx: mpa_event.data) {
@@ -207,16 +223,7 @@ bool StripAlign::scanRun(const core::TrackStreamReader::event_t& track_event,
 				continue;
 			}
 			double x = (static_cast<double>(idx) - n_strips) * pitch;
-			_out << mpa_event.eventNumber << "\t"
-			     << b(0) << "\t"
-			     << b(1) << "\t"
-			     << b(2) << "\t"
-			     << idx << "\t"
-			     << x << std::endl;
-			//std::cout << idx << " -> " << x << std::endl;
-			_corHist->Fill(b(0) - x);
-			_corX->Fill(b(0), x);
-			_corY->Fill(b(1), x);
+			fillScanStep(_steps.front(), mpa_event.eventNumber, b, idx, x, _out);
 		}
 	}
 	_out << std::endl;
@@ -227,17 +234,93 @@ void StripAlign::scanFinish()
 {
 	if(_reuseZ)
 		return;
-	_canvasX->cd(_currentScanStep+1);
-	_corX->Draw("COLZ");
-	_canvasY->cd(_currentScanStep+1);
-	_corY->Draw("COLZ");
+	if(_shift) {
+		_out.flush();
+		finishScanStep(_steps.front(), _currentScanStep, _currentZ);
+		++_currentScanStep;
+		if(_currentScanStep < _numSteps) {
+			rerun();
+		} else {
+			finishScan();
+		}
+		return;
+	}
+	auto positions = core::ZScan::steps(_lowZ, _highZ, _numSteps);
+	_steps.clear();
+	for(int step = 0; step < _numSteps; ++step) {
+		_steps.push_back(initScanStep(step, positions[step]));
+	}
+	std::cout << "Fill " << _numSteps << " Z steps from " << _scan.getNumEvents() << " events" << std::endl;
+	std::vector<std::ostringstream> out(_numSteps);
+	_scan.scan(positions,
+	           [this, &out](size_t step, size_t event, const Eigen::Vector3d& b, const core::ZScan::hit_t& hit) {
+	                   fillScanStep(_steps[step], _scan.getEventNumber(event), b,
+	                                hit.index, hit.position(0), out[step]);
+	           },
+	           [&out](size_t step, size_t) { out[step] << "\n"; },
+	           _scanThreads);
+	for(_currentScanStep = 0; _currentScanStep < _numSteps; ++_currentScanStep) {
+		_currentZ = positions[_currentScanStep];
+		_config.setVariable("mpa_z_offset", _currentZ);
+		std::cout << _currentScanStep+1 << "/" << _numSteps
+		          << ": Calculate alignment constants for Z = " << _currentZ
+			  << "mm, skip = " << getDataOffset() << std::endl;
+		_out << out[_currentScanStep].str();
+		out[_currentScanStep].str("");
+		finishScanStep(_steps[_currentScanStep], _currentScanStep, _currentZ);
+	}
 	_out.flush();
-	int cd = _currentScanStep+2;
+	finishScan();
+}
+
+StripAlign::scan_step_t StripAlign::initScanStep(int step, double z)
+{
+	std::string header = "Z = ";
+	header += std::to_string(z);
+	header += "mm, skip = ";
+	header += std::to_string(getDataOffset());
+	const int k = 2;
+	const int k_bin = 4;
+	scan_step_t hists;
+	hists.corHist = new TH1D((std::string("align_")+std::to_string(step)).c_str(), header.c_str(), 4000*k, -10*k, 10*k);
+	hists.corX = new TH2D((std::string("cor_x_")+std::to_string(step)).c_str(),
+	                      (std::string("X: ")+header).c_str(), 50*k_bin, -5*k, 5*k, 50*k_bin, -5*k, 5*k);
+	hists.corX->GetXaxis()->SetTitle("Track X");
+	hists.corX->GetYaxis()->SetTitle("Strip Position");
+	hists.corY = new TH2D((std::string("cor_y_")+std::to_string(step)).c_str(),
+	                      (std::string("Y: ")+header).c_str(), 50*k_bin, -5*k, 5*k, 50*k_bin, -5*k, 5*k);
+	hists.corY->GetXaxis()->SetTitle("Track Y");
+	hists.corY->GetYaxis()->SetTitle("Strip Position");
+	return hists;
+}
+
+void StripAlign::fillScanStep(scan_step_t& hists, int eventNumber, const Eigen::Vector3d& b, int idx, double x,
+                              std::ostream& out)
+{
+	out << eventNumber << "\t"
+	    << b(0) << "\t"
+	    << b(1) << "\t"
+	    << b(2) << "\t"
+	    << idx << "\t"
+	    << x << "\n";
+	hists.corHist->Fill(b(0) - x);
+	hists.corX->Fill(b(0), x);
+	hists.corY->Fill(b(1), x);
+}
+
+void StripAlign::finishScanStep(scan_step_t& hists, int step, double z)
+{
+	// the canvases are rendered later, they get copies and the histograms are handed to the output
+	_canvasX->cd(step+1);
+	hists.corX->DrawCopy("COLZ");
+	_canvasY->cd(step+1);
+	hists.corY->DrawCopy("COLZ");
+	int cd = step+2;
 	std::cout << "cd-ing to Pad " << cd << std::endl;
 	_canvas->cd(cd);
-	double mean = _corHist->GetMean();
-	double rms = _corHist->GetRMS();
-	auto result = _corHist->Fit("gaus", "SAME", "", mean-rms*2, mean+rms*2);
+	double mean = hists.corHist->GetMean();
+	double rms = hists.corHist->GetRMS();
+	auto result = hists.corHist->Fit("gaus", "SAME", "", mean-rms*2, mean+rms*2);
 
 	double sigma = result->Parameter(2);
 	double x = result->Parameter(1);
@@ -250,71 +333,67 @@ void StripAlign::scanFinish()
 		func->SetParameter(2, 0.1);
 		func->SetParameter(3, 1);
 		func->SetParLimits(2, 0, 0.3);
-		result = _corHist->Fit("gaus_base", "SAMER+", "", mean-rms, mean+rms);
+		result = hists.corHist->Fit("gaus_base", "SAMER+", "", mean-rms, mean+rms);
 		sigma = result->Parameter(2);
 		x = result->Parameter(1);
 	}
 	_alignments.push_back({
 		Eigen::Vector3d(
 			x, 0,
-			_currentZ),
+			z),
 		sigma
 	});
 	if(_currentSigmaMinimum(1) < sigma || _currentSigmaMinimum(1) < 0) {
-		_currentSigmaMinimum = { _currentZ, sigma };
+		_currentSigmaMinimum = { z, sigma };
 	}
-	_corHist->Draw();
-	++_currentScanStep;
-	if(_currentScanStep < _numSteps) {
-		rerun();
-	} else if(_currentScanStep+1 >= _numSteps) {
+	hists.corHist->DrawCopy();
+	_output->write(hists.corHist);
+	_output->write(hists.corX);
+	_output->write(hists.corY);
+	hists.corHist = nullptr;
+	hists.corX = nullptr;
+	hists.corY = nullptr;
+}
 
-		auto xgraph = new TGraph(_numSteps);
-		xgraph->SetName("x_sigma");
-		for(size_t i=0; i < _alignments.size(); ++i) {
-			const auto& align = _alignments[i];
-			if(_shift) {
-				xgraph->SetPoint(i, _lowShift+i, align.sigma);
-			} else {
-				xgraph->SetPoint(i, align.position(2), align.sigma);
-			}
+void StripAlign::finishScan()
+{
+	auto xgraph = new TGraph(_numSteps);
+	xgraph->SetName("x_sigma");
+	for(size_t i=0; i < _alignments.size(); ++i) {
+		const auto& align = _alignments[i];
+		if(_shift) {
+			xgraph->SetPoint(i, _lowShift+i, align.sigma);
+		} else {
+			xgraph->SetPoint(i, align.position(2), align.sigma);
 		}
-		_file->Add(xgraph);
-		double x_min = xgraph->GetX()[0];
-		double y_min = xgraph->GetY()[0];
-		size_t best_idx = 0;
-		for(size_t i=0; i < xgraph->GetN(); ++i) {
-			if(y_min > xgraph->GetY()[i]) {
-				x_min = xgraph->GetX()[i];
-				y_min = xgraph->GetY()[i];
-				best_idx = i;
-			}
+	}
+	_output->writeCopy(xgraph);
+	double x_min = xgraph->GetX()[0];
+	double y_min = xgraph->GetY()[0];
+	size_t best_idx = 0;
+	for(size_t i=0; i < xgraph->GetN(); ++i) {
+		if(y_min > xgraph->GetY()[i]) {
+			x_min = xgraph->GetX()[i];
+			y_min = xgraph->GetY()[i];
+			best_idx = i;
 		}
-		_canvas->cd(_currentScanStep+2);
-		xgraph->Draw("A*");
-		_canvas->Update();
-
-		auto img = TImage::Create();
-		img->FromPad(_canvas);
-		img->WriteImage(getFilename(".png").c_str());
-		delete img;
-
-		img = TImage::Create();
-		img->FromPad(_canvasX);
-		img->WriteImage(getFilename("_cor_x.png").c_str());
-		delete img;
+	}
+	_canvas->cd(_currentScanStep+2);
+	xgraph->Draw("A*");
+	_canvas->Update();
 
-		img = TImage::Create();
-		img->FromPad(_canvasY);
-		img->WriteImage(getFilename("_cor_y.png").c_str());
-		delete img;
+	_output->addImage(_canvas, getFilename(".png"));
+	_output->addImage(_canvasX, getFilename("_cor_x.png"));
+	_output->addImage(_canvasY, getFilename("_cor_y.png"));
+	_canvas = nullptr;
+	_canvasX = nullptr;
+	_canvasY = nullptr;
 
-		const auto& align = _alignments[best_idx];
-		_zAlignment = align;
-		std::cout << "Best aligment at Z = " << align.position(2) << "mm with a sigma of "
-		          << align.sigma << "mm" << std::endl;
-		writeAlignment(align);
-	}
+	const auto& align = _alignments[best_idx];
+	_zAlignment = align;
+	std::cout << "Best aligment at Z = " << align.position(2) << "mm with a sigma of "
+	          << align.sigma << "mm" << std::endl;
+	writeAlignment(align);
 }
 
 void StripAlign::yAlignInit()
@@ -384,10 +463,7 @@ void StripAlign::yAlignFinish()
 		graph->GetXaxis()->SetTitle("Y position (mm)");
 		graph->GetYaxis()->SetTitle("# track hits");
 		graph->Draw("A*");
-		auto img = TImage::Create();
-		img->FromPad(canvas);
-		img->WriteImage(getFilename("_yalign.png").c_str());
-		delete img;
+		_output->addImage(canvas, getFilename("_yalign.png"));
 		std::cout << "Maximum number of hits (" << best_hits << ") for Y = "
 		          << best_y << "mm to " << best_y_max << "mm\n";
 		_zAlignment.position(1) = (best_y + best_y_max)/2;
@@ -4,10 +4,11 @@
 
 #include "trackanalysis.h"
 #include "aligner.h"
+#include "zscan.h"
+#include "rootoutput.h"
 #include <TH1D.h>
 #include <TH2D.h>
 #include <TCanvas.h>
-#include <TFile.h>
 #include <fstream>
 
 class StripAlign : public core::TrackAnalysis
@@ -16,6 +17,9 @@ public:
         StripAlign();
 	virtual ~StripAlign();
 
+	virtual void closeOutputs();
+	virtual std::vector<std::string> getDependencyFiles(const po::variables_map& vm);
+
 	virtual void init(const po::variables_map& vm);
 	virtual std::string getUsage(const std::string& argv0) const;
 	virtual std::string getHelp(const std::string& argv0) const;
@@ -26,10 +30,22 @@ private:
 		double sigma;
 	};
 
+	/// Histograms of a single step of the scan
+	struct scan_step_t {
+		TH1D* corHist;
+		TH2D* corX;
+		TH2D* corY;
+	};
+
 	void scanInit();
         bool scanRun(const core::TrackStreamReader::event_t& track_event,
 	             const core::BaseSensorStreamReader::event_t& mpa_event);
 	void scanFinish();
+	scan_step_t initScanStep(int step, double z);
+	void fillScanStep(scan_step_t& hists, int eventNumber, const Eigen::Vector3d& b, int idx, double x,
+	                  std::ostream& out);
+	void finishScanStep(scan_step_t& hists, int step, double z);
+	void finishScan();
 
 	void yAlignInit();
         bool yAlignRun(const core::TrackStreamReader::event_t& track_event,
@@ -38,13 +54,12 @@ private:
 
 	void writeAlignment(const alignment_t& align) const;
 
-	TFile* _file;
+	core::RootOutput* _output;
 	TCanvas* _canvas;
 	TCanvas* _canvasX;
 	TCanvas* _canvasY;
-	TH1D* _corHist;
-	TH2D* _corX;
-	TH2D* _corY;
+	core::ZScan _scan;
+	std::vector<scan_step_t> _steps;
 	std::vector<alignment_t> _alignments;
 	alignment_t _zAlignment;
 	double _lowZ;
@@ -63,6 +78,7 @@ private:
 	int _numSteps;
 	int _numProcessedSamples;
 	int _sampleSize;
+	int _scanThreads;
 	bool _noisyAsFuckMode;
 	std::map<double, int> _yHitcounter;
 	std::ofstream _out;
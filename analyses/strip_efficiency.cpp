@@ -31,12 +31,30 @@ StripEfficiency::StripEfficiency() :
 }
 
 StripEfficiency::~StripEfficiency()
+{
+	closeOutputs();
+}
+
+void StripEfficiency::closeOutputs()
 {
 	if(_file) {
 		_file->Write();
 		_file->Close();
 		delete _file;
+		_file = nullptr;
+	}
+}
+
+std::vector<std::string> StripEfficiency::getDependencyFiles(const po::variables_map& vm)
+{
+	auto files = core::TrackAnalysis::getDependencyFiles(vm);
+	if(!vm.count("no-mask")) {
+		files.push_back(vm["mask"].as<std::string>());
+	}
+	for(auto runId: _allRunIds) {
+		files.push_back(_config.get<std::string>("output_dir") + "/StripAlign_" + getMpaIdPadded(runId) + "_best.align");
 	}
+	return files;
 }
 
 void StripEfficiency::init(const po::variables_map& vm)
@@ -3,12 +3,22 @@
 
 #include "mpatransform.h"
 #include <Eigen/Dense>
+#include <vector>
+#include <cstdint>
 
 class TH1D;
 
 namespace core
 {
 
+class RootOutput;
+
+/** \brief Alignment offset and cuts from the residuals between tracks and hits
+ *
+ * The residuals of each axis are counted in the bins of xHistogramConfig and yHistogramConfig, which must not
+ * change once residuals were added. The histograms are filled on demand from these counts, so a fit that
+ * rebinned them does not change the bins of the next one. They equal histograms filled with every residual.
+ */
 class Aligner
 {
 public:
@@ -20,6 +30,7 @@ public:
 	};
 
 	Aligner();
+	/// Histogram view of the X residuals, valid after initHistograms()
 	TH1D* getHistX() const;
 	TH1D* getHistY() const;
 
@@ -29,6 +40,8 @@ public:
 	void initHistograms(const std::string& xname="alignHistX", const std::string& yname="alignHistY");
 	void writeHistograms();
 	void writeHistogramImage(const std::string& filename);
+	/// Draw the histograms on a canvas that is rendered to filename when the output is closed
+	void writeHistogramImage(RootOutput& output, const std::string& filename);
 	void calculateAlignment(const bool& quiet=false);
 
 	void Fill(const double& xdiff, const double& ydiff);
@@ -81,10 +94,30 @@ public:
 	static Eigen::Vector2d alignPlateau(TH1D* cor, const double& nrms, const double& binratio, const bool& quiet, const bool& fixedMean=false);
 	static Eigen::Vector2d alignGaussian(TH1D* cor, const double& nrms, const double& binratio, const bool& quiet, const bool& fixedMean=false);
 private:
+	/// Counts of the residuals of one axis
+	struct binned_t
+	{
+		/// Number of residuals by bin, in the numbering of TH1 with underflow and overflow bin
+		std::vector<uint64_t> bins;
+		/// Sum of the residuals within the configured range and of their squares, for the histogram statistics
+		double sum;
+		double sum2;
+
+		binned_t() : sum(0), sum2(0) {}
+		void add(double value, const histogram_cfg_t& config);
+		void clear();
+	};
+
 	static bool rebinIfNeccessary(TH1D* cor, const double& nrms, const double& binratio);
+	static void fillHistogram(TH1D* hist, const binned_t& binned, const histogram_cfg_t& config);
+	/// Fill the histograms from the counts if residuals were added since
+	void updateHistograms() const;
 	double _nsigma;
 	TH1D* _alignX;
 	TH1D* _alignY;
+	binned_t _binnedX;
+	binned_t _binnedY;
+	mutable bool _histogramsCurrent;
 	bool _calculated;
 	Eigen::Vector3d _offset;
 	Eigen::Vector2d _cuts;
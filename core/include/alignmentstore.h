@@ -0,0 +1,83 @@
+#ifndef ALIGNMENT_STORE_H
+#define ALIGNMENT_STORE_H
+
+#include "sqlitewriter.h"
+#include "quickrunlistreader.h"
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace core {
+
+/** \brief Alignment constants of all runs in a single SQLite database
+ *
+ * Each alignment analysis writes its own text files per run. The store keeps the results of all runs in one
+ * table, keyed by run, analysis and version. Saving an alignment of a run again adds a new version, older
+ * versions are kept. Several jobs may share the database.
+ *
+ * An alignment of the same setup is a good starting point for the alignment of the next run. findNearest()
+ * looks up the aligned run with the same angle and bias voltage that is closest to a run. Only alignments with an
+ * accepted exit status of their optimizer are used.
+ */
+class AlignmentStore
+{
+public:
+	/// Name of an analysis and the exit statuses of its optimizer that are accepted
+	typedef std::pair<std::string, std::vector<int>> accepted_t;
+
+	struct alignment_t {
+		int runId;
+		std::string analysis;
+		int version;
+		/// Alignment parameters of the analysis, e.g. x, y, z, phi, theta and omega
+		std::vector<double> parameters;
+		double fitness;
+		/// Exit status of the optimizer
+		int status;
+	};
+
+	/** \brief Open the database, it is created if it does not exist
+	 *
+	 * \throw SqliteWriter::sqlite_error
+	 */
+	explicit AlignmentStore(const std::string& filename);
+
+	/** \brief Add an alignment as new version
+	 *
+	 * \return Version of the alignment
+	 */
+	int save(int runId, const std::string& analysis, const std::vector<double>& parameters, double fitness,
+	         int status=0);
+
+	/** \brief Load an alignment
+	 *
+	 * \param version Version to load, the latest version if negative
+	 * \return false if there is no such alignment
+	 */
+	bool load(int runId, const std::string& analysis, alignment_t& alignment, int version=-1);
+
+	/// Runs with an alignment of the analysis in ascending order
+	std::vector<int> getRuns(const std::string& analysis);
+
+	/** \brief Latest accepted alignment of the closest other run with the same angle and bias voltage
+	 *
+	 * Runs are compared by their MPA run ID. On equal distance the earlier run is used.
+	 * \param analyses Alignments of any of these analyses with one of its accepted statuses are used, the first
+	 * analysis if a run has several
+	 * \return false if no run of the runlist matches
+	 * \throw std::invalid_argument The run is not in the runlist
+	 */
+	bool findNearest(const QuickRunlistReader& runlist, int runId, const std::vector<accepted_t>& analyses,
+	                 alignment_t& alignment);
+
+private:
+	/// Latest version of an alignment matching the SQL condition
+	bool loadWhere(int runId, const std::string& analysis, const std::string& condition, alignment_t& alignment);
+
+	SqliteWriter _db;
+	size_t _insert;
+};
+
+} // namespace core
+
+#endif//ALIGNMENT_STORE_H
@@ -8,6 +8,9 @@
 #include "basesensorstreamreader.h"
 #include "quickrunlistreader.h"
 #include "mpatransform.h"
+#include "resultcache.h"
+#include "progress.h"
+#include "instrumentation.h"
 
 namespace po = boost::program_options;
 
@@ -29,6 +32,23 @@ namespace core {
  * error in the command line arguments are found. A sub-class should reimplement them if additional options
  * are implemented. Note that getHelp() only displays a free-text help message and not a option-by-option
  * documentation. Each option is autodocumented by Boost.
+ *
+ * \section Result cache
+ * If the configuration defines \c result_cache_dir, runCached() stores the output files of an analysis in a
+ * ResultCache and restores them instead of running the analysis again as long as the analysis name, the
+ * command line options, the resolved configuration, the runlist rows, the input files and the files of
+ * getDependencyFiles() did not change. The option --force always runs the analysis and replaces the cached
+ * result. An analysis that changes anything besides its output files returns false from isCacheable().
+ *
+ * The outputs are closed by closeOutputs() before they are stored. Only files named after one of
+ * getOutputStems() are stored, so concurrent jobs writing into the same directory do not mix their results.
+ *
+ * \section Timing report
+ * Unless --no-timing is given, the stages instrumented with CORE_TIMED_SCOPE() are timed while the analysis
+ * runs. writeTimingReport() prints a table and writes it as JSON next to the ROOT output.
+ *
+ * \section Images
+ * The option --no-images disables the PNG images of analyses writing their results with a RootOutput.
  */
 class Analysis
 {
@@ -53,6 +73,60 @@ public:
 	 */
 	virtual void run(const po::variables_map& vm) = 0;
 
+	/** \brief Run the analysis or restore its output files from the result cache
+	 *
+	 * Without \c result_cache_dir in the configuration this is equivalent to run() followed by closeOutputs().
+	 *
+	 * \return true if the outputs were restored from the cache
+	 */
+	bool runCached(const po::variables_map& vm);
+
+	/** \brief Hash of everything the results of the analysis depend on
+	 *
+	 * Combines the analysis name, the command line options, all resolved configuration variables,
+	 * getRunlistKey() and the fingerprints of getInputFiles() and getDependencyFiles().
+	 *
+	 * \param description Set to the human readable text the hash is computed of
+	 */
+	std::string getCacheKey(const po::variables_map& vm, ResultCache& cache, std::string* description=nullptr);
+
+	/// Input data files read by the analysis, used for the result cache key
+	virtual std::vector<std::string> getInputFiles(const po::variables_map& vm) { return {}; }
+
+	/// Serialized runlist information of the analyzed runs, used for the result cache key
+	virtual std::string getRunlistKey() const { return ""; }
+
+	/** \brief Further files the results depend on, used for the result cache key
+	 *
+	 * E.g. alignments written by other analyses. The default implementation returns the \c pixel_mask.
+	 * Called before run().
+	 */
+	virtual std::vector<std::string> getDependencyFiles(const po::variables_map& vm);
+
+	/// false if the results cannot be restored from the result cache, e.g. as the analysis writes a database
+	virtual bool isCacheable() const { return true; }
+
+	/** \brief Write and close all output files
+	 *
+	 * Called by runCached() after run(). Sub-classes closing their files in the destructor should move this
+	 * into closeOutputs() and call it from the destructor, so it must be safe to call twice.
+	 */
+	virtual void closeOutputs() {}
+
+	/** \brief Names of the output files without directory and suffix
+	 *
+	 * Output files are identified by their name starting with a stem, followed by anything but further run
+	 * IDs. The default implementation returns the stems of getFilename() and getFilename(runId) for all runs.
+	 */
+	virtual std::vector<std::string> getOutputStems() const;
+
+	/** \brief Print the timing of all instrumented stages and write it to getFilename(".timing.json")
+	 *
+	 * Events per second are based on the events published to the Progress object. Without such events,
+	 * e.g. in a MergedAnalysis, the number of TTree entries read is used.
+	 */
+	void writeTimingReport() const;
+
 	/** \brief Get boost::program_options::options_description object to add further command line
 	 * arguments
 	 */
@@ -100,8 +174,16 @@ public:
 
 	virtual bool multirunConsistencyCheck(const std::string& argv0, const po::variables_map& vm) = 0;
 
+	/** \brief Progress of the running analysis
+	 *
+	 * May be read and cancelled from other threads.
+	 */
+	Progress& getProgress() { return _progress; }
+	const Progress& getProgress() const { return _progress; }
+
 protected:
 	CfgParse _config;
+	Progress _progress;
 	std::vector<int> _allRunIds;
 	int _currentRunId;
 
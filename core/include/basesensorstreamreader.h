@@ -3,7 +3,11 @@
 #define BASE_SENSOR_STREAM_READER_H
 
 #include "abstractfactory.h"
+#include "runcache.h"
+#include "eventindex.h"
 #include <type_traits>
+#include <typeinfo>
+#include <algorithm>
 
 namespace core {
 
@@ -14,7 +18,11 @@ namespace core {
  * data of each event in a very simple fashion. For easy access, two iterator classes are provided (iterator
  * and const_iterator), satisfying the C++ iterator concepts.
  *
- * The actual work is performed by a subclassed BaseSensorStreamReader::reader class.
+ * The actual work is performed by a subclassed BaseSensorStreamReader::reader class. If the RunCache is
+ * enabled, the events are decoded once and further iterators read them from memory.
+ *
+ * With setSelection() the iterators only visit the selected events of an EventIndex. Readers that can seek
+ * to an event skip the others without decoding them.
  */
 class BaseSensorStreamReader
 {
@@ -51,7 +59,7 @@ public:
 	 */
 	class reader {
 	public:
-		reader(const std::string& filename) : _filename(filename) {}
+		reader(const std::string& filename) : _filename(filename), _empty(false) {}
 		virtual ~reader() {}
 		/** \brief Read next event
 		 */
@@ -66,13 +74,25 @@ public:
 		{
 			return _currentEvent.eventNumber;
 		}
+		/** \brief Read the event described by an index entry directly
+		 *
+		 * \return false if the reader cannot seek, the event is then searched by reading sequentially
+		 */
+		virtual bool seek(const EventIndex::entry_t& entry)
+		{
+			return false;
+		}
 
 		event_t& get() { return _currentEvent; }
 		const event_t& get() const { return _currentEvent; }
 		const std::string& getFilename() const { return _filename; }
+		/// true if there was no first event to read, e.g. because the file is empty
+		bool empty() const { return _empty; }
 
 	protected:
 		event_t _currentEvent;
+		/// Set by readers whose first next() in the constructor reached the end
+		bool _empty;
 	private:
 		std::string _filename;
 	};
@@ -184,7 +204,11 @@ public:
 	 */
 	iterator begin()
 	{
-		return iterator(getReader(_filename), false);
+		auto read = getSelectedReader();
+		if(!read) {
+			return end();
+		}
+		return iterator(read, false);
 	}
 
 	/** \brief Create new iterator pointing to the first event
@@ -193,7 +217,11 @@ public:
 	 */
 	const_iterator begin() const
 	{
-		return const_iterator(getReader(_filename), false);
+		auto read = getSelectedReader();
+		if(!read) {
+			return end();
+		}
+		return const_iterator(read, false);
 	}
 
 	/** \brief Create new beyond-last-element iterator
@@ -210,6 +238,32 @@ public:
 		return const_iterator(nullptr, true);
 	}
 
+	/** \brief Index of the data file
+	 *
+	 * \return nullptr if the file format does not support an index
+	 * \throw std::ios_base::failure The data file cannot be read
+	 */
+	virtual std::shared_ptr<const EventIndex> getIndex() const
+	{
+		return nullptr;
+	}
+
+	/** \brief Restrict new iterators to the selected events
+	 *
+	 * The entries must be taken from getIndex() of the same file, in ascending order. nullptr removes the
+	 * selection.
+	 */
+	void setSelection(std::shared_ptr<const EventIndex::selection_t> selection)
+	{
+		_selection = selection;
+	}
+
+	/// Number of hit pixels or strips of an event, as counted by the index
+	virtual size_t countHits(const event_t& event) const
+	{
+		return std::count_if(event.data.begin(), event.data.end(), [](int value) { return value != 0; });
+	}
+
 protected:
 	/** \brief Create sub-type specific reader instance
 	 *
@@ -219,7 +273,142 @@ protected:
 	virtual reader* getReader(const std::string& filename) const = 0;
 
 private:
+	/// Reads the events decoded by the RunCache
+	class cachedreader : public reader {
+	public:
+		cachedreader(const std::string& filename, std::shared_ptr<const std::vector<event_t>> events) :
+		 reader(filename), _events(events), _pos(0)
+		{
+			_empty = _events->empty();
+			if(!_empty) {
+				_currentEvent = _events->front();
+			}
+		}
+		virtual bool next()
+		{
+			if(_pos + 1 >= _events->size()) {
+				return true;
+			}
+			_currentEvent = (*_events)[++_pos];
+			return false;
+		}
+		virtual reader* clone() const
+		{
+			return new cachedreader(*this);
+		}
+		/// Moves to the next event not before the entry, which is the entry itself unless it is missing
+		virtual bool seek(const EventIndex::entry_t& entry)
+		{
+			auto it = std::lower_bound(_events->begin() + _pos, _events->end(), entry.eventNumber,
+				[](const event_t& event, int eventNumber) { return event.eventNumber < eventNumber; });
+			if(it != _events->end()) {
+				_pos = it - _events->begin();
+				_currentEvent = *it;
+			}
+			return true;
+		}
+
+	private:
+		std::shared_ptr<const std::vector<event_t>> _events;
+		size_t _pos;
+	};
+
+	/// Visits the selected events of another reader, the iteration ends at the first missing event
+	class selectedreader : public reader {
+	public:
+		selectedreader(reader* read, std::shared_ptr<const EventIndex::selection_t> selection) :
+		 reader(read->getFilename()), _reader(read), _selection(selection), _pos(0)
+		{
+			_empty = _reader->empty() || _selection->empty() || !moveTo((*_selection)[0]);
+		}
+		selectedreader(const selectedreader& other) :
+		 reader(other), _reader(other._reader->clone()), _selection(other._selection), _pos(other._pos)
+		{
+		}
+		virtual ~selectedreader()
+		{
+			delete _reader;
+		}
+		virtual bool next()
+		{
+			if(_pos + 1 >= _selection->size()) {
+				return true;
+			}
+			return !moveTo((*_selection)[++_pos]);
+		}
+		virtual reader* clone() const
+		{
+			return new selectedreader(*this);
+		}
+
+	private:
+		/// \return false if the event is not in the file, e.g. because it changed after the index was built
+		bool moveTo(const EventIndex::entry_t& entry)
+		{
+			if(!_reader->seek(entry)) {
+				while(_reader->eventNumber() < entry.eventNumber) {
+					if(_reader->next()) {
+						return false;
+					}
+				}
+			}
+			if(_reader->eventNumber() != entry.eventNumber) {
+				return false;
+			}
+			_currentEvent = _reader->get();
+			return true;
+		}
+
+		reader* _reader;
+		std::shared_ptr<const EventIndex::selection_t> _selection;
+		size_t _pos;
+	};
+
+	/** \brief Reader of the selected events if a selection is set, getCachedReader() otherwise
+	 *
+	 * \return nullptr if there is no event to read
+	 */
+	reader* getSelectedReader() const
+	{
+		auto read = getCachedReader();
+		if(_selection) {
+			read = new selectedreader(read, _selection);
+		}
+		if(read->empty()) {
+			delete read;
+			return nullptr;
+		}
+		return read;
+	}
+
+	/** \brief Reader of the cached events if the RunCache is enabled, getReader() otherwise
+	 *
+	 * \return an empty() reader if the file has no events
+	 */
+	reader* getCachedReader() const
+	{
+		if(RunCache::isEnabled()) {
+			auto events = RunCache::get<event_t>(typeid(*this).name(), _filename,
+				[this](std::vector<event_t>& events, size_t maxBytes) {
+					size_t bytes = 0;
+					auto read = getReader(_filename);
+					const_iterator it(read, read->empty());
+					for(; it != end() && bytes <= maxBytes; ++it) {
+						events.push_back(*it);
+						bytes += sizeof(event_t) + RunCache::vectorBytes(events.back().data) +
+						         RunCache::vectorBytes(events.back().bunchCrossing);
+					}
+					return bytes;
+				});
+			if(events) {
+				return new cachedreader(_filename, events);
+			}
+		}
+		return getReader(_filename);
+	}
+
 	std::string _filename;
+	std::shared_ptr<const EventIndex::selection_t> _selection;
 };
 
 
@@ -0,0 +1,57 @@
+#ifndef CANDIDATE_GRID_H
+#define CANDIDATE_GRID_H
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <Eigen/Dense>
+
+namespace core {
+
+/** \brief Grid of points in a plane to find the points close to another point
+ *
+ * The points are sorted into square cells of the size of the largest distance of interest, so only the
+ * points in the cell of a query point and its eight neighbours can be closer than this distance in both
+ * coordinates. The cells are slightly enlarged to cover rounding, query() never misses a point within the
+ * distance. Points with a non-finite coordinate are returned by all queries, and all points are returned if
+ * the distance is negative or not finite, so a cut on the returned points gives the same result as a cut on
+ * all points.
+ */
+class CandidateGrid
+{
+public:
+	/// \param distance Largest distance of matching points per coordinate
+	explicit CandidateGrid(double distance);
+
+	/// Add a point, its index is the number of points added before
+	void insert(const Eigen::Vector2d& position);
+	void clear();
+	size_t size() const { return _size; }
+
+	/// Indices of the points that may be within the distance of position, in ascending order
+	void query(const Eigen::Vector2d& position, std::vector<size_t>& indices) const;
+
+private:
+	typedef std::pair<int64_t, int64_t> cell_t;
+	struct cell_hash_t {
+		size_t operator()(const cell_t& cell) const
+		{
+			return std::hash<int64_t>()(cell.first * 1000003 + cell.second);
+		}
+	};
+	/// false if position has no cell
+	bool getCell(const Eigen::Vector2d& position, cell_t& cell) const;
+
+	double _cellSize;
+	bool _enabled;
+	size_t _size;
+	std::unordered_map<cell_t, std::vector<size_t>, cell_hash_t> _cells;
+	/// Points without a cell
+	std::vector<size_t> _everywhere;
+};
+
+} // namespace core
+
+#endif//CANDIDATE_GRID_H
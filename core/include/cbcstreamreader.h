@@ -6,13 +6,27 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <TFile.h>
 #include <TTree.h>
+#include <TBranch.h>
 #include "basesensorstreamreader.h"
 #include "interface/DataFormats.h"
 
 namespace core {
 
+/** \brief Reader for CBC strip data in the analysisTree of the tbeam ntuples
+ *
+ * Only the branches DUT, Condition and goodEventFlag are read, each of them only once per tree entry. The
+ * strip channels of det0 and det1 are copied into the reused data vector of the event. det1 channels are
+ * offset by 254.
+ *
+ * CBCPrefetchStreamReader additionally reads the upcoming entries on a background thread of each reader, so
+ * reading and decompressing the tree overlaps with the analysis of the events.
+ */
 class CBCStreamReader : public BaseSensorStreamReader
 {
 public:
@@ -20,6 +34,9 @@ public:
 	CBCStreamReader(const std::string& filename);
 	virtual ~CBCStreamReader();
 
+	/// The data of an event lists the hit strips
+	virtual size_t countHits(const event_t& event) const { return event.data.size(); }
+
 protected:
 	/** \brief Iterator for traversing separate events in the CBC data file
 	 *
@@ -29,25 +46,73 @@ protected:
 	 */
         class cbcreader : public BaseSensorStreamReader::reader {
 	public:
-		cbcreader(const std::string& filename, size_t eventNum=0);
+		cbcreader(const std::string& filename, size_t eventNum=0, bool prefetch=false);
 		virtual ~cbcreader();
 		virtual bool next();
 		virtual BaseSensorStreamReader::reader* clone() const;
 
 	private:
+		/// Branch values of an entry read by the prefetch thread
+		struct record_t {
+			Long64_t entry;
+			bool good;
+			unsigned int event;
+			/// Only read for good entries
+			std::vector<int> channels;
+		};
+
                 void open();
+		void readEntry(Long64_t entry);
+		void readChannels(Long64_t entry);
+		void copyChannels(std::vector<int>& data) const;
+		/// Body of the prefetch thread, reads all entries starting at first
+		void prefetch(Long64_t first);
+		/// Wait for the record of an entry from the prefetch thread
+		void takePrefetched(Long64_t entry);
+		void stopPrefetch();
                 TFile _fin;
                 TTree* _analysisTree;
+		TBranch* _dutBranch;
+		TBranch* _conditionBranch;
+		TBranch* _goodEventBranch;
                 tbeam::dutEvent* _dutEvent;
                 tbeam::condEvent* _condition;
-		tbeam::TelescopeEvent* _telescopeEvent;
 		bool _goodEventFlag;
 		size_t _numEventsRead;
+		Long64_t _numEntries;
+		/// Entries currently held by the branch buffers, -1 if none
+		Long64_t _flagEntry;
+		Long64_t _dutEntry;
+		/// goodEventFlag and condition event number of _flagEntry
+		bool _entryGood;
+		unsigned int _entryEvent;
+		bool _prefetch;
+		/// With prefetching, the branches are only read by this thread
+		std::thread _prefetchThread;
+		std::mutex _prefetchMutex;
+		std::condition_variable _prefetchReady;
+		std::condition_variable _prefetchSpace;
+		std::deque<record_t> _prefetched;
+		record_t _record;
+		bool _prefetchDone;
+		bool _prefetchStop;
+		std::string _prefetchError;
 	};
 	
 	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
 };
 
+/// CBCStreamReader reading the tree on a background thread
+class CBCPrefetchStreamReader : public CBCStreamReader
+{
+public:
+	CBCPrefetchStreamReader() : CBCStreamReader() {}
+	CBCPrefetchStreamReader(const std::string& filename) : CBCStreamReader(filename) {}
+
+protected:
+	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
+};
+
 } // namespace core
 
 #endif//CBC_STREAM_READER_H
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 #include <boost/lexical_cast.hpp>
 #ifndef _POSIX_C_SOURCE
@@ -31,9 +32,29 @@ data_path = /path/to/some/directory
 run_db = @data_path@/run.database
 run_data_file = @data_path@/run@RunNumber@.data # RunNumber is set by software via setVariable()
 \endcode
+ *
+ * \section Caching
+ * Resolved values are cached. While resolving a variable, the parser records which variables
+ * were substituted into it. Changing a variable with setVariable() only invalidates the cached
+ * values that (transitively) depend on it, e.g. setting \c RunNumber in the example above
+ * invalidates \c run_data_file but keeps \c run_db.
+ *
+ * CfgParse is not thread-safe, even the const getters write the cache. Read the variables on the
+ * thread owning the parser and pass the values to worker threads.
  */
 class CfgParse
 {
+private:
+	/// Raw and resolved value of a variable including its dependency information
+	struct entry_t {
+		entry_t() : raw(), resolved(), valid(false), dependents() {}
+		std::string raw;
+		mutable std::string resolved;
+		mutable bool valid;
+		/// Variables which substitute this variable
+		mutable std::set<std::string> dependents;
+	};
+
 public:
 	CfgParse();
 
@@ -65,16 +86,21 @@ public:
 	 */
 	void parse(std::istream& config, const std::string& filename="string");
 
-	/// Set a variable to a specific value
+	/** \brief Set a variable to a specific value
+	 *
+	 * Cached values of all variables depending on \p var are invalidated. Setting a variable to
+	 * its current value is a no-op.
+	 */
 	template<typename T>
 	void setVariable(const std::string& var, const T& value)
 	{
-		_variables[var] = std::to_string(value);
+		setVariable(var, std::to_string(value));
 	}
 
-	void setVariable(const std::string& var, const std::string& value)
+	void setVariable(const std::string& var, const std::string& value);
+	void setVariable(const std::string& var, const char* value)
 	{
-		_variables[var] = value;
+		setVariable(var, std::string(value));
 	}
 
 	/**\brief Query a variable and perform replacements as required
@@ -223,8 +249,9 @@ public:
 
 private:
 	std::vector<std::string> tokenize(const std::string& line) const;
-	std::string getVariable(const std::string& var, size_t depth, const std::string& original) const;
-	std::map<std::string, std::string> _variables;
+	const std::string& getVariable(const std::string& var, size_t depth, const std::string& original) const;
+	void invalidate(const entry_t& entry);
+	std::map<std::string, entry_t> _variables;
 	regex_t regexSubstitution;
 };
 
@@ -0,0 +1,82 @@
+#ifndef DATA_OFFSET_FINDER_H
+#define DATA_OFFSET_FINDER_H
+
+#include <vector>
+#include <map>
+#include <cstddef>
+
+namespace core {
+
+/** \brief Find the offset between sensor and telescope event numbers from a single pass over the data
+ *
+ * The X positions of all sensor hits and track extrapolations are buffered per event number with
+ * addEvent(). A data offset k pairs the sensor event e with the telescope event e+k, the same convention
+ * as TrackAnalysis::setDataOffset().
+ *
+ * Two measures of the correlation strength are provided:
+ *  * residuals() and sweep() pair hits and tracks for each offset directly. The strength is the significance
+ *    of the highest bin of the residual histogram above the mean bin content. This is exact but costs
+ *    O(range * events).
+ *  * crossCorrelate() correlates the event-indexed number of hits with the number of tracks for all offsets
+ *    at once via FFT, O(events * log(events)). It does not need any alignment but is a weaker measure,
+ *    so it is meant to preselect candidates for large ranges.
+ */
+class DataOffsetFinder
+{
+public:
+	/// Correlation strength for a single data offset
+	struct result_t {
+		int offset;
+		double strength;
+		size_t entries;
+	};
+	typedef std::vector<result_t> result_vec_t;
+
+	DataOffsetFinder() : _combinations(0) {}
+
+	/// Buffer the hit and track X positions of an event
+	void addEvent(int eventNumber, const std::vector<double>& hitX, const std::vector<double>& trackX);
+	void clear();
+
+	size_t getNumEvents() const { return _events.size(); }
+	/// Number of track/hit pairs for data offset 0
+	size_t getNumCombinations() const { return _combinations; }
+
+	/** \brief Residuals track minus hit for a data offset
+	 *
+	 * Events are processed in ascending sensor event number. Processing stops after the event with which the
+	 * number of residuals reaches maxEntries, 0 for no limit.
+	 */
+	std::vector<double> residuals(int offset, size_t maxEntries=0) const;
+
+	/// Significance of the highest bin of a residual histogram with the given bin width
+	static double peakStrength(const std::vector<double>& residuals, double binWidth);
+
+	/// Correlation strength of the residuals for all offsets in [low, high]
+	result_vec_t sweep(int low, int high, double binWidth, size_t maxEntries=0) const;
+
+	/** \brief Normalized cross-correlation of hit and track counts for all offsets in [low, high]
+	 *
+	 * The strength is the Pearson correlation coefficient of the number of sensor hits in event e and the
+	 * number of tracks in event e+offset.
+	 */
+	result_vec_t crossCorrelate(int low, int high) const;
+
+	/// Result with the highest strength
+	static result_t best(const result_vec_t& results);
+
+	/// Results ordered by descending strength
+	static result_vec_t ranked(result_vec_t results);
+
+private:
+	struct event_t {
+		std::vector<double> hitX;
+		std::vector<double> trackX;
+	};
+	std::map<int, event_t> _events;
+	size_t _combinations;
+};
+
+} // namespace core
+
+#endif//DATA_OFFSET_FINDER_H
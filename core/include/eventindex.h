@@ -0,0 +1,110 @@
+#ifndef EVENT_INDEX_H
+#define EVENT_INDEX_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <istream>
+#include <cstdint>
+
+namespace core {
+
+/** \brief Summary of the events of a data file
+ *
+ * Many analyses only use a small subset of the events, e.g. the alignment only needs events with a single
+ * track and a single hit. The index stores for each event of a file its event number, the number of hits or
+ * tracks, the number of bunch crossings and the position of the event in the file. It is built by a light
+ * scan of the file on the first request, without decoding the events. With a selection derived from the
+ * indices of the pixel and the track file, the readers seek from one selected event to the next and only
+ * decode those.
+ *
+ * An index is kept in memory for the lifetime of the process and saved next to the data file with the
+ * suffix ".evidx". Both are dropped if size or modification time of the data file changed. If the index
+ * file cannot be written, e.g. in a read-only data directory, the index is built again by the next process.
+ */
+class EventIndex
+{
+public:
+	/// A single event in a data file
+	struct entry_t {
+		int eventNumber;
+		/// Number of hit pixels or strips, or number of tracks
+		uint32_t count;
+		uint32_t bunchCrossings;
+		/// Position of the first character of the event in the file
+		uint64_t offset;
+	};
+
+	/// Properties of an event of a run, used to select events
+	struct summary_t {
+		/// Event number of the pixel data
+		int eventNumber;
+		size_t tracks;
+		size_t hits;
+		size_t bunchCrossings;
+	};
+
+	typedef std::function<bool(const summary_t&)> filter_t;
+	typedef std::vector<entry_t> selection_t;
+	/** \brief Scans a data file and appends an entry for every event in file order
+	 *
+	 * The same scan must always yield the same events and offsets for the same file content.
+	 */
+	typedef std::function<void(std::istream& in, std::vector<entry_t>& entries)> builder_t;
+
+	/** \brief Index of a file, built by build if no valid index exists
+	 *
+	 * \param type Name of the file format, part of the key
+	 * \throw std::ios_base::failure The data file cannot be read
+	 */
+	static std::shared_ptr<const EventIndex> get(const std::string& type, const std::string& filename,
+	                                             const builder_t& build);
+
+	/// Drop all indices held in memory, index files are kept
+	static void clear();
+
+	/// Entries in file order
+	const std::vector<entry_t>& getEntries() const { return _entries; }
+
+	/** \brief Select the events of a run
+	 *
+	 * The pixel event with number n is joined with the track event with number n + dataOffset, like the
+	 * TrackAnalysis does. Events without track event have zero tracks. Entries of both files are expected in
+	 * ascending order of the event number.
+	 *
+	 * \param pixelSelection Selected pixel events
+	 * \param trackSelection Track events joined with a selected pixel event
+	 */
+	static void select(const EventIndex& pixels, const EventIndex& tracks, int dataOffset,
+	                   const filter_t& filter, selection_t& pixelSelection, selection_t& trackSelection);
+
+	/** \brief Reduce a selection made by select() to some of its pixel events
+	 *
+	 * \param positions Positions of the pixel events to keep in pixelSelection, in ascending order
+	 */
+	static void keep(selection_t& pixelSelection, selection_t& trackSelection, int dataOffset,
+	                 const std::vector<size_t>& positions);
+
+	/** \brief Parse a filter expression
+	 *
+	 * An expression compares the fields tracks, hits and bx (number of bunch crossings) to integers with
+	 * ==, !=, <, <=, > or >=. Comparisons can be combined with && and ||, where && binds stronger. Example:
+	 * \verbatim tracks == 1 && hits <= 1 \endverbatim
+	 *
+	 * \throw std::invalid_argument Syntax error in the expression
+	 */
+	static filter_t parseFilter(const std::string& expression);
+
+private:
+	explicit EventIndex(std::vector<entry_t>&& entries) : _entries(std::move(entries)) {}
+
+	static bool load(const std::string& indexFile, const std::string& header, std::vector<entry_t>& entries);
+	static void save(const std::string& indexFile, const std::string& header, const std::vector<entry_t>& entries);
+
+	std::vector<entry_t> _entries;
+};
+
+} // namespace core
+
+#endif//EVENT_INDEX_H
@@ -0,0 +1,59 @@
+#ifndef EVENT_SAMPLER_H
+#define EVENT_SAMPLER_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstddef>
+
+namespace core {
+
+/** \brief Draws a reproducible random sample of events
+ *
+ * Analyses that only need a sample of a run, e.g. the alignments, used the first events of the run. Such a
+ * sample misses any drift during the run. Together with an EventIndex, the TrackAnalysis reads a sample
+ * spread over the whole run instead, at the cost of reading only the sampled events.
+ *
+ * The sampler works on positions in a list of candidate events in file order:
+ *  - SM_FIRST: the first events, like stopping after the sample size
+ *  - SM_UNIFORM: a uniform random subset
+ *  - SM_STRATIFIED: the candidates are split into as many consecutive strata of equal size as events are
+ *    drawn, one event is drawn from each stratum. As the event order follows the recording time, the sample
+ *    covers the run evenly.
+ *
+ * The same seed always draws the same sample.
+ */
+class EventSampler
+{
+public:
+	enum sampling_mode_t {
+		SM_FIRST,
+		SM_UNIFORM,
+		SM_STRATIFIED
+	};
+
+	EventSampler(sampling_mode_t mode, unsigned int seed) : _mode(mode), _random(seed) {}
+
+	/** \brief Positions of the drawn events in ascending order
+	 *
+	 * \param count Number of candidate events
+	 * \param size Number of events to draw, all candidates are returned if there are not more
+	 */
+	std::vector<size_t> draw(size_t count, size_t size);
+
+	sampling_mode_t getMode() const { return _mode; }
+
+	/** \brief Mode by name: first, uniform or stratified
+	 *
+	 * \throw std::invalid_argument Unknown name
+	 */
+	static sampling_mode_t parseMode(const std::string& name);
+
+private:
+	sampling_mode_t _mode;
+	std::mt19937 _random;
+};
+
+} // namespace core
+
+#endif//EVENT_SAMPLER_H
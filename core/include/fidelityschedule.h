@@ -0,0 +1,67 @@
+#ifndef FIDELITY_SCHEDULE_H
+#define FIDELITY_SCHEDULE_H
+
+#include <cstddef>
+
+namespace core {
+
+/** \brief Number of events a fitness function of an alignment is evaluated on
+ *
+ * Far from the optimum, the ranking of alignment candidates does not need the precision of all cached events.
+ * The fitness is evaluated on the first size() events of the cache, which is shuffled once before the
+ * optimization. As the subsets grow by appending events, all candidates are compared on the same events
+ * (common random numbers) and a larger subset contains the smaller ones.
+ *
+ * An evolution strategy calls update() after every generation. The subset grows with the square of the
+ * shrinking step size, as the differences of the fitness of neighbouring candidates shrink like the square of
+ * their distance near the optimum. It is doubled if the best fitness did not improve for some generations,
+ * which is the case once the noise of the subset hides the differences. A sequential minimizer calls grow()
+ * and minimizes again starting from the previous minimum, until the subset contains all events.
+ */
+class FidelitySchedule
+{
+public:
+	/**
+	 * \param total Number of cached events
+	 * \param minSize Number of events of the first generations, all events are used if zero
+	 * \param initialSigma Initial step size of the evolution strategy
+	 */
+	FidelitySchedule(size_t total, size_t minSize, double initialSigma=1.0);
+
+	/// Number of events for the next evaluations
+	size_t size() const { return _size; }
+	/// Whether all events are used
+	bool isFull() const { return _size == _total; }
+
+	/** \brief Adapt the size after a generation
+	 *
+	 * \param sigma Step size of the next generation
+	 * \param bestFitness Best fitness of the finished generation
+	 */
+	void update(double sigma, double bestFitness);
+
+	/** \brief Double the size
+	 *
+	 * \return false if all events were used already
+	 */
+	bool grow();
+
+	/// Number of generations without improvement until the size is doubled
+	static constexpr size_t patience = 10;
+	/// Relative improvement of the best fitness that resets the patience
+	static constexpr double min_improvement = 1e-3;
+
+private:
+	void setSize(size_t size);
+
+	size_t _total;
+	size_t _minSize;
+	size_t _size;
+	double _initialSigma;
+	double _bestFitness;
+	size_t _stagnation;
+};
+
+} // namespace core
+
+#endif//FIDELITY_SCHEDULE_H
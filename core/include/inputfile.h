@@ -0,0 +1,56 @@
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <istream>
+#include <memory>
+#include <string>
+
+namespace core {
+
+/** \brief Input stream of plain or compressed data files
+ *
+ * The counter, memory and track files compress about tenfold. The readers open their files as InputFile,
+ * which picks the decompression by the file extension: ".gz" for gzip, ".zst" for zstd. Any other file is
+ * read as plain file like by std::ifstream. Compressed files are decompressed in blocks on a helper thread,
+ * so parsing continues while the next block is decompressed.
+ *
+ * Positions of tellg() and seekg() refer to the decompressed data, so an EventIndex of a compressed file
+ * works like the index of the plain file. zstd files in the seekable format (independent frames followed by a
+ * seek table) have cheap random access and their frames are decompressed in parallel. Any other compressed
+ * file is decompressed sequentially, so seeking backwards starts again at the beginning of the file.
+ *
+ * zstd files can only be read if built with ENABLE_ZSTD.
+ */
+class InputFile : public std::istream
+{
+public:
+	enum compression_t {
+		CT_NONE,
+		CT_GZIP,
+		CT_ZSTD
+	};
+
+	InputFile();
+	explicit InputFile(const std::string& filename);
+	InputFile(InputFile&& other);
+	InputFile& operator=(InputFile&& other);
+	~InputFile();
+
+	/** \brief Open a file, closing the previous one
+	 *
+	 * Like std::ifstream, the failbit is set if the file cannot be opened.
+	 */
+	void open(const std::string& filename);
+	void close();
+	bool is_open() const;
+
+	/// Compression by file extension
+	static compression_t getCompression(const std::string& filename);
+
+private:
+	std::unique_ptr<std::streambuf> _buf;
+};
+
+} // namespace core
+
+#endif//INPUT_FILE_H
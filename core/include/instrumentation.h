@@ -0,0 +1,138 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace core {
+
+/** \brief Per-stage timers and counters for the hot paths of the analyses
+ *
+ * A stage is a named piece of code, e.g. "MPAStreamReader::next" or "Aligner::Fill". Stages are registered
+ * once with stage() and are identified by their index afterwards. Each thread accumulates the number of
+ * calls, the elapsed time and an arbitrary counter per stage in its own buffer, so recording never needs a
+ * lock. collect() sums the buffers of all threads including threads that already finished.
+ *
+ * Instrumentation is disabled by default. Then a ScopedTimer costs a single relaxed atomic load. Defining
+ * NO_INSTRUMENTATION removes the CORE_TIMED_SCOPE() timers completely.
+ *
+ * Stage times are inclusive, i.e. the time of a stage contains the time of all stages called from it.
+ */
+class Instrumentation
+{
+public:
+	static constexpr size_t max_stages = 256;
+
+	/// Accumulated statistics of a stage
+	struct stage_t {
+		std::string name;
+		uint64_t calls;
+		uint64_t nanoseconds;
+		/// Sum of the values passed to count()
+		uint64_t count;
+	};
+
+	/// Summary of an analysis run for the timing report
+	struct report_t {
+		std::string analysis;
+		std::vector<int> runs;
+		double wallSeconds;
+		uint64_t events;
+		/// Peak resident set size in kB
+		long peakRss;
+		std::vector<stage_t> stages;
+	};
+
+	/** \brief Index of the stage with the given name, the stage is created if required
+	 *
+	 * \throw std::length_error More than max_stages stages
+	 */
+	static size_t stage(const std::string& name);
+
+	static void setEnabled(bool enabled) { _enabled.store(enabled); }
+	static bool isEnabled() { return _enabled.load(std::memory_order_relaxed); }
+
+	/// Record a single call of a stage taking the given time
+	static void add(size_t stage, uint64_t nanoseconds);
+	/// Add n to the counter of a stage, e.g. the number of processed items
+	static void count(size_t stage, uint64_t n=1);
+
+	/// Statistics of all stages with at least one call or count, in order of registration
+	static std::vector<stage_t> collect();
+	/// Reset the statistics of all threads, the registered stages are kept
+	static void reset();
+
+	/// Peak resident set size of the process in kB
+	static long peakRss();
+
+	/// Human readable table of a report
+	static std::string formatTable(const report_t& report);
+	/// JSON representation of a report
+	static std::string formatJson(const report_t& report);
+
+	/// Statistics of a single thread, opaque
+	struct buffer_t;
+
+private:
+	struct counter_t {
+		std::atomic<uint64_t> calls;
+		std::atomic<uint64_t> nanoseconds;
+		std::atomic<uint64_t> count;
+	};
+	static buffer_t& buffer();
+	static std::atomic<bool> _enabled;
+};
+
+/// Measures the time from construction to destruction as one call of a stage
+class ScopedTimer
+{
+public:
+	explicit ScopedTimer(size_t stage) :
+	 _stage(stage), _active(Instrumentation::isEnabled())
+	{
+		if(_active) {
+			_start = clock::now();
+		}
+	}
+
+	~ScopedTimer()
+	{
+		if(_active) {
+			auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - _start);
+			Instrumentation::add(_stage, elapsed.count());
+		}
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+	typedef std::chrono::steady_clock clock;
+	size_t _stage;
+	bool _active;
+	clock::time_point _start;
+};
+
+} // namespace core
+
+#define CORE_INSTRUMENTATION_CONCAT2(a, b) a##b
+#define CORE_INSTRUMENTATION_CONCAT(a, b) CORE_INSTRUMENTATION_CONCAT2(a, b)
+
+/** \brief Time the rest of the enclosing scope as stage name
+ *
+ * The stage is registered on first execution.
+ */
+#ifdef NO_INSTRUMENTATION
+#define CORE_TIMED_SCOPE(name)
+#else
+#define CORE_TIMED_SCOPE(name) \
+	static const size_t CORE_INSTRUMENTATION_CONCAT(_timedStage, __LINE__) = core::Instrumentation::stage(name); \
+	core::ScopedTimer CORE_INSTRUMENTATION_CONCAT(_timedScope, __LINE__)(CORE_INSTRUMENTATION_CONCAT(_timedStage, __LINE__))
+#endif
+
+#endif//INSTRUMENTATION_H
@@ -28,6 +28,9 @@ public:
 
 	virtual bool multirunConsistencyCheck(const std::string& argv0, const po::variables_map& vm);
 
+	/// Merged testbeam data files of all runs and the runlist
+	virtual std::vector<std::string> getInputFiles(const po::variables_map& vm);
+
 private:
 	std::vector<run_data_t> _runData;
 	RunlistReader _runlist;
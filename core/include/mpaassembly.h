@@ -0,0 +1,90 @@
+#ifndef MPA_ASSEMBLY_H
+#define MPA_ASSEMBLY_H
+
+#include "mpatransform.h"
+#include <array>
+#include <vector>
+
+namespace core {
+
+class CfgParse;
+
+/** \brief Geometry of all MPA chips of a MaPSA
+ *
+ * The pose of the assembly is the pose of chip 2, which is what the analyses used as DUT position so far.
+ * Every other chip is placed by an offset and a rotation relative to the local frame of chip 2. Only chips
+ * with a known pose are enabled; a default constructed assembly contains chip 2 alone and reproduces the
+ * single-chip geometry.
+ *
+ * The counter data of all chips is handled as one block of num_pixels values, the pixels of chip n start at
+ * blockOffset(n).
+ */
+class MpaAssembly
+{
+public:
+	static constexpr int num_mpas = MpaTransform::num_mpas;
+	static constexpr int num_pixels = num_mpas * MpaTransform::num_pixels;
+
+	MpaAssembly();
+
+	/// Place the assembly in world coordinates, rotation angles in radians
+	void setPose(const Eigen::Vector3d& offset, const Eigen::Vector3d& rotation);
+	Eigen::Vector3d getOffset() const { return _offset; }
+	Eigen::Vector3d getAngles() const { return _angles; }
+
+	/** \brief Place a chip relative to chip 2 and enable it
+	 *
+	 * \param rotation Rotation angles in radians, applied before the rotation of the assembly
+	 * \throw std::out_of_range Invalid chip index
+	 */
+	void setChipPose(int mpaIdx, const Eigen::Vector3d& offset, const Eigen::Vector3d& rotation={0, 0, 0});
+
+	/// \throw std::out_of_range Invalid chip index
+	void disableChip(int mpaIdx);
+
+	/** \brief Read the chip poses from the configuration
+	 *
+	 * A chip n is enabled if mpa_<n>_offset is set ("x y z" in mm). The rotation is read from the optional
+	 * mpa_<n>_rotation ("phi theta omega" in degrees). Chips without offset keep their current state.
+	 *
+	 * \throw CfgParse::bad_cast A pose has not exactly three values
+	 */
+	void loadChipPoses(const CfgParse& config);
+
+	/// \throw std::out_of_range Invalid chip index
+	bool isEnabled(int mpaIdx) const;
+
+	/// Indices of the enabled chips in ascending order
+	const std::vector<int>& getEnabled() const { return _enabled; }
+
+	/** \brief Transform of a chip in world coordinates
+	 *
+	 * \throw std::out_of_range Invalid chip index
+	 */
+	const MpaTransform& getTransform(int mpaIdx) const;
+
+	/// Position of the first pixel of a chip in the counter block
+	static size_t blockOffset(int mpaIdx) { return (mpaIdx - 1) * MpaTransform::num_pixels; }
+
+private:
+	struct chip_t
+	{
+		bool enabled;
+		Eigen::Vector3d offset;
+		Eigen::Vector3d angles;
+		MpaTransform transform;
+	};
+
+	static void checkIndex(int mpaIdx);
+	void updateTransform(chip_t& chip);
+
+	Eigen::Vector3d _offset;
+	Eigen::Vector3d _angles;
+	Eigen::Matrix3d _rotation;
+	std::array<chip_t, num_mpas> _chips;
+	std::vector<int> _enabled;
+};
+
+} // namespace core
+
+#endif//MPA_ASSEMBLY_H
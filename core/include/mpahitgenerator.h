@@ -4,12 +4,44 @@
 #include <Eigen/Dense>
 #include "datastructures.h"
 #include "mpatransform.h"
+#include "mpaassembly.h"
+#include <array>
+#include <vector>
 
 namespace core {
 
 class MpaHitGenerator
 {
 public:
+	/// Hits on one chip of a MaPSA
+	struct chip_hits_t
+	{
+		int index;
+		std::vector<Eigen::Vector2i> pixels;
+		std::vector<Eigen::Vector2d> clusters;
+		std::vector<int> clusterSizes;
+		/// Cluster positions in world coordinates, same order as clusters
+		std::vector<Eigen::Vector3d> globalClusters;
+	};
+
+	/// Hits on all chips of a MaPSA for one event
+	struct assembly_hits_t
+	{
+		/// Counter values of all chips, see MpaAssembly::blockOffset()
+		std::array<UShort_t, MpaAssembly::num_pixels> counters;
+		/// Indexed by chip index - 1
+		std::array<chip_hits_t, MpaAssembly::num_mpas> chips;
+	};
+
+	/** \brief Decode and clusterize all enabled chips of the current entry in one pass
+	 *
+	 * The counters of the chips are copied into a single block which is then scanned once for activated
+	 * pixels. Chips that are disabled in the assembly or have no branch in the tree stay empty. The vectors in
+	 * \p hits are cleared and refilled, so reusing the same object for all events avoids reallocations.
+	 */
+	static void getAssemblyHits(const run_data_t& run, const MpaAssembly& assembly, assembly_hits_t& hits);
+
+	/// Hits of the chip the transform belongs to
 	static std::vector<Eigen::Vector3d> getCounterHits(run_data_t run, Eigen::Vector3d offset, Eigen::Vector3d rotation);
 	static std::vector<Eigen::Vector3d> getCounterHits(run_data_t run, const MpaTransform& transform);
 	static std::vector<Eigen::Vector2i> getCounterPixels(run_data_t run, const MpaTransform& transform);
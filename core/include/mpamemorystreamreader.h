@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include "inputfile.h"
 #include "basesensorstreamreader.h"
 
 namespace core {
@@ -44,7 +45,7 @@ protected:
 
 	private:
 		void open(size_t seek);
-		mutable std::ifstream _fin;
+		mutable InputFile _fin;
 		size_t _numEventsRead;
 	};
 	
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include "inputfile.h"
 #include "basesensorstreamreader.h"
 
 namespace core {
@@ -34,6 +35,14 @@ public:
 	MPAStreamReader() : BaseSensorStreamReader() {}
 	MPAStreamReader(const std::string& filename) : BaseSensorStreamReader(filename) {}
 
+	virtual std::shared_ptr<const EventIndex> getIndex() const;
+
+	/** \brief Index every non-empty line with its number of non-zero counters
+	 *
+	 * \sa EventIndex::builder_t
+	 */
+	static void buildIndex(std::istream& in, std::vector<EventIndex::entry_t>& entries);
+
 protected:
 	/** \brief Iterator for traversing separate events in the MPA data file
 	 *
@@ -47,10 +56,11 @@ protected:
 		virtual ~mpareader();
 		virtual bool next();
 		virtual BaseSensorStreamReader::reader* clone() const;
+		virtual bool seek(const EventIndex::entry_t& entry);
 
 	private:
 		void open(size_t seek);
-		mutable std::ifstream _fin;
+		mutable InputFile _fin;
 		size_t _numEventsRead;
 	};
 	
@@ -28,6 +28,9 @@ namespace core {
  *
  * The reference point for the world coordinates is the lower-left corner of pixel (0/0).
  *
+ * A transform describes a single chip of a MaPSA, by default chip 2. All chips share the pixel layout above,
+ * MpaAssembly places the chips of a MaPSA relative to each other.
+ *
  * \warning So far only the "light" type sensor geometry is implemented!
  */
 class MpaTransform
@@ -36,6 +39,7 @@ public:
 	static constexpr int num_pixels_x = 16;
 	static constexpr int num_pixels_y = 3;
 	static constexpr int num_pixels = num_pixels_x * num_pixels_y;
+	static constexpr int num_mpas = 6;
 	static constexpr double outer_pixel_width = 0.2;
 	static constexpr double inner_pixel_width = 0.1;
 	static constexpr double upper_pixel_height = 1.446;
@@ -43,11 +47,11 @@ public:
 	static constexpr double total_width = 2 * outer_pixel_width + 14 * inner_pixel_width; // 18mm
 	static constexpr double total_height = 2 * upper_pixel_height + bottom_pixel_height;
 
-	MpaTransform()
+	MpaTransform(int mpaIdx=2)
 	{
 		// Initialize normal vector and rotation matrix
 		setRotation({0.0, 0.0, 0.0});
-		_mpaIdx = 2;
+		setMpaIndex(mpaIdx);
 	}
 
 	/// \brief Transform pixel index to world coordinates	
@@ -56,12 +60,18 @@ public:
 		return pixelCoordToGlobal(translatePixelIndex(pixelIdx), midpoints);
 	}
 
-	/// \brief Translates the pixel index to 2D pixel coordinates
+	/** \brief Translates the pixel index to 2D pixel coordinates
+	 *
+	 * The layout is the same for every chip, \p mpaIdx is only checked for validity.
+	 */
 	Eigen::Vector2i translatePixelIndex(const size_t& pixelIdx, const int& mpaIdx=2) const
 	{
-		if(pixelIdx > num_pixels) {
+		if(pixelIdx >= num_pixels) {
 			throw std::out_of_range("Pixel index out of range");
 		}
+		if(mpaIdx < 1 || mpaIdx > num_mpas) {
+			throw std::out_of_range("MPA index out of range");
+		}
 		int py = 2 - pixelIdx/16;
 		return Eigen::Vector2i(
 			((py==1)?15:0) + static_cast<unsigned int>(pixelIdx)%16 * ((py==1)?-1:1),
@@ -228,6 +238,16 @@ public:
 
 	Eigen::Vector3d getAngles() const { return _angles; }
 
+	/// Index of the chip on the MaPSA, 1 to num_mpas
+	int getMpaIndex() const { return _mpaIdx; }
+	void setMpaIndex(int mpaIdx)
+	{
+		if(mpaIdx < 1 || mpaIdx > num_mpas) {
+			throw std::out_of_range("MPA index out of range");
+		}
+		_mpaIdx = mpaIdx;
+	}
+
 	Eigen::Vector2d getPixelSize(const size_t& idx) const { return getPixelSize(translatePixelIndex(idx)); }
 	Eigen::Vector2d getPixelSize(const Eigen::Vector2i& pixel_coord) const
 	{
@@ -0,0 +1,140 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <stdexcept>
+#include <sstream>
+#include <cstdint>
+
+namespace core {
+
+/** \brief Thread-safe progress counter of a running analysis
+ *
+ * The analysis thread announces each step (process and run) with begin() and publishes the number of
+ * processed events with update(). Other threads, e.g. the belphegor listener or a console reporter, read a
+ * consistent snapshot with get(). Updating is a single relaxed atomic store, so it can be called from the
+ * event loop; TrackAnalysis publishes every 1024 events.
+ *
+ * A running analysis can be asked to stop with cancel(). The event loop checks isCancelled() and throws
+ * cancelled_error.
+ */
+class Progress
+{
+public:
+	/// Snapshot of the progress
+	struct status_t {
+		/// Name of the current step, e.g. the process name
+		std::string step;
+		/// Run ID of the current step
+		int runId;
+		/// Rerun number of the current step
+		size_t rerun;
+		/// Events processed in the current step
+		uint64_t events;
+		/// Events expected in the current step, 0 if unknown
+		uint64_t expectedEvents;
+		/// Events processed in all finished steps
+		uint64_t totalEvents;
+		/// Seconds since begin() of the current step
+		double stepSeconds;
+		/// Seconds since construction of the Progress object
+		double totalSeconds;
+		/// Processing rate of the current step
+		double eventsPerSecond;
+		/// Estimated seconds until the current step is finished, negative if unknown
+		double eta;
+	};
+
+	/// Thrown by the event loop if the analysis was cancelled
+	class cancelled_error : public std::runtime_error {
+	public:
+		cancelled_error() : std::runtime_error("Analysis was cancelled") {}
+	};
+
+	Progress() :
+	 _mutex(), _step(), _runId(0), _rerun(0), _expected(0), _total(0),
+	 _start(clock::now()), _stepStart(_start), _events(0), _cancelled(false)
+	{
+	}
+
+	/// Start a new step, the events of the previous step are added to the total
+	void begin(const std::string& step, int runId, size_t rerun, uint64_t expectedEvents=0)
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+		_total += _events.exchange(0);
+		_step = step;
+		_runId = runId;
+		_rerun = rerun;
+		_expected = expectedEvents;
+		_stepStart = clock::now();
+	}
+
+	/// Publish number of events processed in the current step
+	void update(uint64_t events)
+	{
+		_events.store(events, std::memory_order_relaxed);
+	}
+
+	status_t get() const
+	{
+		std::lock_guard<std::mutex> lk(_mutex);
+		auto now = clock::now();
+		status_t status;
+		status.step = _step;
+		status.runId = _runId;
+		status.rerun = _rerun;
+		status.events = _events.load(std::memory_order_relaxed);
+		status.expectedEvents = _expected;
+		status.totalEvents = _total;
+		status.stepSeconds = std::chrono::duration<double>(now - _stepStart).count();
+		status.totalSeconds = std::chrono::duration<double>(now - _start).count();
+		status.eventsPerSecond = status.stepSeconds > 0 ? status.events / status.stepSeconds : 0;
+		status.eta = -1;
+		if(_expected > 0 && status.eventsPerSecond > 0) {
+			status.eta = status.events < _expected ? (_expected - status.events) / status.eventsPerSecond : 0;
+		}
+		return status;
+	}
+
+	void cancel() { _cancelled.store(true); }
+	bool isCancelled() const { return _cancelled.load(std::memory_order_relaxed); }
+
+	/// Human readable single line representation
+	static std::string format(const status_t& status)
+	{
+		std::ostringstream sstr;
+		sstr << status.step << ": " << status.events;
+		if(status.expectedEvents) {
+			sstr << "/" << status.expectedEvents;
+		}
+		sstr << " events";
+		if(status.rerun) {
+			sstr << " rerun " << status.rerun;
+		}
+		sstr << " for MPA run " << status.runId << ", " << static_cast<uint64_t>(status.eventsPerSecond) << " events/s";
+		if(status.eta >= 0) {
+			sstr << ", ETA " << static_cast<uint64_t>(status.eta) << " s";
+		}
+		return sstr.str();
+	}
+
+private:
+	typedef std::chrono::steady_clock clock;
+	mutable std::mutex _mutex;
+	std::string _step;
+	int _runId;
+	size_t _rerun;
+	uint64_t _expected;
+	uint64_t _total;
+	clock::time_point _start;
+	clock::time_point _stepStart;
+	std::atomic<uint64_t> _events;
+	std::atomic<bool> _cancelled;
+};
+
+} // namespace core
+
+#endif//PROGRESS_H
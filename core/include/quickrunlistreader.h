@@ -53,6 +53,20 @@ public:
 	 */
 	void read(const std::string& filename);
 
+	/** \brief Change the data offset of a run in a runlist file
+	 *
+	 * Only the "Data Offset" column of the row for the MPA run is modified, all other lines and columns are
+	 * written back unchanged. The file is replaced atomically. Concurrent writers are serialized by an exclusive
+	 * flock() on the runlist, held from reading until the replacement.
+	 *
+	 * \param filename Name of the runlist file
+	 * \param mpaRun MPA run ID
+	 * \param dataOffset New data offset
+	 * \throw std::ios_base::failure File cannot be read or written
+	 * \throw std::invalid_argument MPA run ID not found in file
+	 */
+	static void writeDataOffset(const std::string& filename, int mpaRun, int dataOffset);
+
 	/** \brief Return the MPA run corresponding to a certain telescope run
 	 *
 	 * \param telRun Telescope run ID
@@ -76,6 +90,13 @@ public:
 	 * \throw std::invalid_argument Run ID was not specified in loaded runlist data
 	 */
 	const run_t& getByMpaRun(int mpaRun) const;
+
+	/** \brief Get all interpreted information for specified MPA run, if it is in the runlist
+	 *
+	 * \param mpaRun MPA run ID
+	 * \return Run-specific information, nullptr if the run ID was not specified in loaded runlist data
+	 */
+	const run_t* findByMpaRun(int mpaRun) const;
 	
 	/** \brief Get all interpreted information for specified telescope run
 	 *
@@ -99,6 +120,8 @@ public:
 	run_vec_t::iterator begin() { return _runs.begin(); }
 	run_vec_t::const_iterator end() const { return _runs.end(); }
 	run_vec_t::iterator end() { return _runs.end(); }
+	/// Column index of the data offset
+	static constexpr int data_offset_column = 10;
 private:
 	run_vec_t _runs;
 };
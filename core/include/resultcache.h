@@ -0,0 +1,112 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <stdexcept>
+#include <sstream>
+#include <cstdint>
+
+namespace core {
+
+/** \brief Persistent, content-addressed store for analysis output files
+ *
+ * Each entry is identified by a key, usually the hash of everything the result of an analysis depends on
+ * (see Analysis::getCacheKey()). An entry is a directory inside the cache directory containing copies of
+ * the output files and a MANIFEST listing their paths relative to the output directory.
+ *
+ * The output files of an analysis are found by comparing a snapshot() of the output directory taken before
+ * the analysis ran with the state after it finished. Entries are written to a temporary directory first and
+ * renamed afterwards, so concurrent jobs storing the same key do not corrupt the cache.
+ *
+ * \section Checksums
+ * Checksums of input files are computed over the whole file. They are remembered in the file
+ * <tt>checksums</tt> inside the cache directory together with size and modification time, so every file
+ * version is only read once.
+ */
+class ResultCache
+{
+public:
+	/// Size and modification time of a file
+	struct file_state_t {
+		uint64_t size;
+		int64_t mtime_sec;
+		int64_t mtime_nsec;
+		bool operator==(const file_state_t& other) const {
+			return size == other.size && mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec;
+		}
+		bool operator!=(const file_state_t& other) const { return !(*this == other); }
+	};
+	/// State of all files in a directory, indexed by relative path
+	typedef std::map<std::string, file_state_t> snapshot_t;
+
+	/** \brief Open cache in directory, the directory is created if required
+	 *
+	 * \throw std::ios_base::failure Directory cannot be created
+	 */
+	explicit ResultCache(const std::string& directory);
+
+	/// 64 bit FNV-1a hash of data as hexadecimal string
+	static std::string hash(const std::string& data);
+
+	/** \brief Fingerprint of an input file consisting of size, modification time and checksum
+	 *
+	 * Returns "missing" if the file does not exist.
+	 */
+	std::string fingerprint(const std::string& filename);
+
+	/// Check whether an entry for key exists
+	bool contains(const std::string& key) const;
+
+	/** \brief Copy the files of a cached entry into outputDir
+	 *
+	 * \return false if there is no (complete) entry for key
+	 * \throw std::ios_base::failure Files cannot be written
+	 */
+	bool restore(const std::string& key, const std::string& outputDir) const;
+
+	/// Record the state of all files below directory
+	snapshot_t snapshot(const std::string& directory) const;
+
+	/** \brief Store files that were created or modified since snapshot before was taken
+	 *
+	 * Only files whose name matches one of stems are stored, see matchesStem(). Nothing is stored if no file
+	 * changed.
+	 *
+	 * \param key Key of the entry
+	 * \param outputDir Directory the snapshot was taken of
+	 * \param before Snapshot taken before the analysis ran
+	 * \param stems Names of the output files without suffix, empty for all files
+	 * \param description Human readable description of the key, stored alongside the files
+	 * \return Number of stored files
+	 * \throw std::ios_base::failure Files cannot be copied
+	 */
+	size_t store(const std::string& key, const std::string& outputDir, const snapshot_t& before,
+	             const std::vector<std::string>& stems, const std::string& description);
+
+	/** \brief Check whether the file name of path starts with stem and is not the name of more runs
+	 *
+	 * E.g. "MpaAlign_0001" matches "MpaAlign_0001.root" and "sub/MpaAlign_0001_x.png", but neither
+	 * "MpaAlign_0001_0002.root" nor "MpaAlign_0001-to-0020.root" of a job analysing more runs.
+	 */
+	static bool matchesStem(const std::string& path, const std::string& stem);
+
+	const std::string& getDirectory() const { return _directory; }
+
+	/// Create directory and all of its parents
+	static void makePath(const std::string& path);
+
+private:
+	void snapshot(const std::string& base, const std::string& relative, snapshot_t& snap) const;
+	static void copyFile(const std::string& from, const std::string& to);
+	static void removeRecursive(const std::string& path);
+	void loadChecksums();
+
+	std::string _directory;
+	std::map<std::string, std::string> _checksums;
+};
+
+} // namespace core
+
+#endif//RESULT_CACHE_H
@@ -0,0 +1,125 @@
+#ifndef ROOT_OUTPUT_H
+#define ROOT_OUTPUT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class TFile;
+class TObject;
+class TCanvas;
+
+namespace core {
+
+/** \brief ROOT output file written by a background thread
+ *
+ * Writing an object to a ROOT file serializes and compresses it, which can take longer than filling it. Instead
+ * of keeping every histogram attached to a TFile until the analysis ends, the analysis hands each object to
+ * write() as soon as it is final. A worker thread owns the file, writes the queued objects in order and deletes
+ * them afterwards, so the results of a scan step are on disk and out of memory while the next step is running.
+ *
+ * ROOT graphics are not thread-safe, so images of canvases are rendered by the thread owning the RootOutput when
+ * it calls flush() or close(). The canvas is deleted right afterwards together with everything drawn on it.
+ * Draw histograms that change or are deleted before with DrawCopy(). Images are skipped entirely if they are
+ * disabled with setImagesEnabled(), e.g. by the --no-images option.
+ *
+ * Without the thread-safe mode of ROOT 6 the objects are written synchronously by write().
+ */
+class RootOutput
+{
+public:
+	/** \brief Create or overwrite a ROOT file
+	 *
+	 * \throw std::ios_base::failure The file cannot be created
+	 */
+	RootOutput(const std::string& filename);
+	/// Calls close(), errors are printed
+	~RootOutput();
+
+	RootOutput(const RootOutput&) = delete;
+	RootOutput& operator=(const RootOutput&) = delete;
+
+	/** \brief Queue an object for writing and take its ownership
+	 *
+	 * Histograms are detached from the current directory. The object must not be used after this call.
+	 *
+	 * \param directory Sub-directory of the file, created if required
+	 */
+	void write(TObject* obj, const std::string& directory="");
+
+	/** \brief Queue a copy of an object for writing
+	 *
+	 * The object remains with the caller, e.g. because it is still drawn on a canvas.
+	 */
+	void writeCopy(const TObject* obj, const std::string& directory="");
+
+	/** \brief Render a canvas into an image file on the next flush() or close() and take its ownership
+	 *
+	 * The canvas is removed from the list of canvases of ROOT, so a new canvas of the same name does not delete
+	 * it. It must not be used after this call. A second image with the same filename replaces the first one.
+	 * Does nothing but delete the canvas if images are disabled.
+	 */
+	void addImage(TCanvas* canvas, const std::string& filename);
+
+	/** \brief Render the images and wait until all queued objects are written
+	 *
+	 * \throw std::ios_base::failure An object could not be written
+	 */
+	void flush();
+
+	/** \brief Render the images, write all queued objects and close the file
+	 *
+	 * \throw std::ios_base::failure An object could not be written
+	 */
+	void close();
+
+	/// Number of objects written so far
+	size_t getNumWritten() const;
+
+	const std::string& getFilename() const { return _filename; }
+
+	static void setImagesEnabled(bool enabled);
+	static bool getImagesEnabled();
+
+private:
+	struct item_t
+	{
+		TObject* obj;
+		std::string directory;
+	};
+	struct image_t
+	{
+		TCanvas* canvas;
+		std::string filename;
+	};
+
+	void worker();
+	void writeItem(const item_t& item);
+	void renderImages();
+	void checkError();
+
+	std::string _filename;
+	TFile* _file;
+	/// Canvases not rendered yet, only used by the owning thread
+	std::vector<image_t> _images;
+	bool _async;
+	std::thread _thread;
+	mutable std::mutex _mutex;
+	std::condition_variable _queued;
+	std::condition_variable _written;
+	std::deque<item_t> _queue;
+	bool _busy;
+	bool _closing;
+	bool _opened;
+	size_t _numWritten;
+	std::string _error;
+
+	static bool _imagesEnabled;
+};
+
+} // namespace core
+
+#endif//ROOT_OUTPUT_H
@@ -0,0 +1,86 @@
+#ifndef RUN_CACHE_H
+#define RUN_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstddef>
+
+namespace core {
+
+/** \brief Process-wide cache of decoded input files
+ *
+ * Parsing the text files of a run takes much longer than most analyses need to process the events. A process
+ * running many analyses of the same run, e.g. the belphegor daemon during a parameter sweep, can keep the
+ * decoded events in memory. BaseSensorStreamReader and TrackStreamReader serve their iterators from the cache
+ * transparently if it is enabled.
+ *
+ * The cache is disabled by default (budget 0). Entries are shared: an entry evicted by the least recently used
+ * policy stays alive until the last iterator reading it is destroyed. An entry is identified by the reader
+ * type and the filename and is dropped if size or modification time of the file changed. Files whose events
+ * do not fit into the budget are not cached and read from disk as before. Concurrent requests for the same
+ * file wait for a single decoding pass.
+ */
+class RunCache
+{
+public:
+	/// Statistics for status reports
+	struct statistics_t {
+		size_t entries;
+		size_t bytes;
+		size_t budget;
+		size_t hits;
+		size_t misses;
+	};
+
+	/** \brief Decodes all events of a file into events
+	 *
+	 * Returns the memory used by the events. Loading may stop once maxBytes is exceeded.
+	 */
+	template<typename Event>
+	using loader_t = std::function<size_t(std::vector<Event>& events, size_t maxBytes)>;
+
+	/// Set the memory budget in bytes, 0 disables the cache and drops all entries
+	static void setBudget(size_t bytes);
+	static size_t getBudget();
+	static bool isEnabled() { return getBudget() > 0; }
+
+	/// Drop all entries and reset the statistics
+	static void clear();
+
+	static statistics_t getStatistics();
+
+	/** \brief Events of a file, decoded by load on the first request
+	 *
+	 * \param type Name of the reader type, part of the key
+	 * \return nullptr if the cache is disabled or the events exceed the budget
+	 */
+	template<typename Event>
+	static std::shared_ptr<const std::vector<Event>> get(const std::string& type, const std::string& filename,
+	                                                     const loader_t<Event>& load)
+	{
+		auto erasedLoad = [&load](size_t maxBytes, size_t& bytes) {
+			std::shared_ptr<std::vector<Event>> events(new std::vector<Event>);
+			bytes = load(*events, maxBytes);
+			return std::shared_ptr<const void>(events);
+		};
+		return std::static_pointer_cast<const std::vector<Event>>(get(type + "\t" + filename, filename, erasedLoad));
+	}
+
+	/// Memory estimate of a vector with its elements, not including memory owned by the elements
+	template<typename T>
+	static size_t vectorBytes(const std::vector<T>& vec)
+	{
+		return vec.capacity() * sizeof(T);
+	}
+
+private:
+	typedef std::function<std::shared_ptr<const void>(size_t maxBytes, size_t& bytes)> erased_loader_t;
+	static std::shared_ptr<const void> get(const std::string& key, const std::string& filename,
+	                                       const erased_loader_t& load);
+};
+
+} // namespace core
+
+#endif//RUN_CACHE_H
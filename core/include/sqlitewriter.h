@@ -0,0 +1,142 @@
+#ifndef SQLITE_WRITER_H
+#define SQLITE_WRITER_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <type_traits>
+#include <functional>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace core {
+
+/** \brief Buffered writer for SQLite databases
+ *
+ * Inserting rows one by one into SQLite is slow because every statement outside a transaction is a
+ * transaction of its own. SqliteWriter compiles each statement once with prepare() and groups all executions
+ * of write() into transactions of batchSize statements. The current transaction is committed by commit(), before
+ * exec() and on destruction.
+ *
+ * Several processes may write to the same database, e.g. jobs of a batch submission. A writer waits up to
+ * busyTimeout milliseconds for the database lock before it fails.
+ */
+class SqliteWriter
+{
+public:
+	/// Error reported by SQLite
+	class sqlite_error : public std::runtime_error
+	{
+	public:
+		sqlite_error(const std::string& what) : std::runtime_error(what) {}
+	};
+
+	/** \brief Open database file, it is created if it does not exist
+	 *
+	 * \throw sqlite_error The database cannot be opened
+	 */
+	SqliteWriter(const std::string& filename, size_t batchSize=10000, int busyTimeout=600000);
+	~SqliteWriter();
+
+	SqliteWriter(const SqliteWriter&) = delete;
+	SqliteWriter& operator=(const SqliteWriter&) = delete;
+
+	/** \brief Execute SQL directly, e.g. to create tables
+	 *
+	 * A pending transaction is committed before.
+	 * \throw sqlite_error
+	 */
+	void exec(const std::string& sql);
+
+	/** \brief Compile a statement with ?-parameters for write()
+	 *
+	 * \return Index of the statement
+	 * \throw sqlite_error
+	 */
+	size_t prepare(const std::string& sql);
+
+	/** \brief Bind values to the parameters of a prepared statement and execute it
+	 *
+	 * Integral types are bound as integers, floating point types as doubles and strings as text. The
+	 * statement is executed inside the current transaction, which is started if required.
+	 * \throw sqlite_error
+	 */
+	template<typename... Args>
+	void write(size_t statement, const Args&... values)
+	{
+		begin();
+		bindAll(statement, 1, values...);
+		step(statement);
+	}
+
+	/** \brief Start a transaction unless one is pending
+	 *
+	 * The write lock is taken right away, so a check with queryInt() and the following write() calls are
+	 * atomic with respect to other writers until commit().
+	 * \throw sqlite_error
+	 */
+	void begin();
+
+	/// Commit the current transaction, if any
+	void commit();
+
+	/// Row ID of the last inserted row
+	int64_t lastInsertId() const;
+
+	/// Number of statements executed with write() since the writer was opened
+	size_t getNumWrites() const { return _numWrites; }
+
+	/** \brief Value of the first column of the first row of a query, or fallback for an empty result
+	 *
+	 * The query sees the rows of the current transaction.
+	 */
+	int64_t queryInt(const std::string& sql, int64_t fallback=0);
+
+	/** \brief Call row for every row of a query with the columns as text, NULL as empty string
+	 *
+	 * \throw sqlite_error
+	 */
+	void query(const std::string& sql, const std::function<void(const std::vector<std::string>&)>& row);
+
+private:
+	void step(size_t statement);
+	void check(int ret, const std::string& action) const;
+
+	void bindInt(size_t statement, int idx, int64_t value);
+	void bindDouble(size_t statement, int idx, double value);
+	void bindText(size_t statement, int idx, const std::string& value);
+
+	template<typename T>
+	typename std::enable_if<std::is_integral<T>::value>::type bind(size_t statement, int idx, T value)
+	{
+		bindInt(statement, idx, static_cast<int64_t>(value));
+	}
+	template<typename T>
+	typename std::enable_if<std::is_floating_point<T>::value>::type bind(size_t statement, int idx, T value)
+	{
+		bindDouble(statement, idx, static_cast<double>(value));
+	}
+	void bind(size_t statement, int idx, const std::string& value) { bindText(statement, idx, value); }
+	void bind(size_t statement, int idx, const char* value) { bindText(statement, idx, value); }
+
+	void bindAll(size_t statement, int idx) {}
+	template<typename T, typename... Args>
+	void bindAll(size_t statement, int idx, const T& value, const Args&... values)
+	{
+		bind(statement, idx, value);
+		bindAll(statement, idx+1, values...);
+	}
+
+	sqlite3* _db;
+	std::vector<sqlite3_stmt*> _statements;
+	size_t _batchSize;
+	size_t _pending;
+	size_t _numWrites;
+	bool _inTransaction;
+};
+
+} // namespace core
+
+#endif//SQLITE_WRITER_H
@@ -0,0 +1,135 @@
+#ifndef TESTBEAM_GENERATOR_H
+#define TESTBEAM_GENERATOR_H
+
+#include <array>
+#include <vector>
+#include <string>
+#include <random>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include "mpatransform.h"
+#include "track.h"
+
+namespace core {
+
+/** \brief Deterministic generator for synthetic testbeam runs
+ *
+ * Simulates straight tracks through the six telescope planes, the REF plane and a MaPSA-light with a
+ * configurable pose. The MaPSA response uses the MpaTransform geometry together with a per-pixel hit
+ * efficiency and a noise probability. Telescope and REF hits are smeared by their resolutions.
+ *
+ * generate() writes all input formats the analyses read:
+ *  * counter text as read by MPAStreamReader
+ *  * memory text as read by MpaMemoryStreamReader
+ *  * reftracks CSV as read by TrackStreamReader, points ordered by plane with the REF last
+ *  * merged ROOT tree as read by MergedAnalysis, the MaPSA-light is stored as <tt>mpa_2</tt>
+ *  * an alignment file with the true MaPSA pose in the format written by MpaAlign
+ *
+ * The output only depends on the configuration including the seed, so a run can be regenerated at will.
+ * Events are generated one after another and never kept in memory.
+ */
+class TestbeamGenerator
+{
+public:
+	static constexpr size_t num_planes = 6;
+
+	/// Simulation parameters, lengths in mm
+	struct config_t {
+		size_t numEvents;
+		unsigned long seed;
+		/// Run ID written to the reftracks CSV
+		int runId;
+		/// Z positions of the telescope planes
+		std::array<double, num_planes> planeZ;
+		/// Z position of the REF plane
+		double refZ;
+		/// Position of the lower-left corner of the MaPSA-light
+		Eigen::Vector3d mpaOffset;
+		/// Rotation angles of the MaPSA-light, see MpaTransform::setRotation()
+		Eigen::Vector3d mpaRotation;
+		/// Mean number of tracks per event (Poisson distributed)
+		double meanTracks;
+		/// Tracks start uniformly distributed in center +- halfSize at Z=0
+		Eigen::Vector2d beamCenter;
+		Eigen::Vector2d beamHalfSize;
+		/// RMS of the track slopes
+		double divergence;
+		double telescopeResolution;
+		double refResolution;
+		/// Probability that a track crossing a MaPSA pixel is detected
+		double efficiency;
+		/// Probability of a noise hit per pixel and event
+		double noise;
+		/// Offset of the MaPSA data relative to the telescope data, see TrackAnalysis::setDataOffset()
+		int dataOffset;
+
+		/// Default setup: MaPSA-light in the beam centre between upstream and downstream triplet
+		static config_t defaults();
+	};
+
+	/// Output file names, empty names are skipped
+	struct output_t {
+		std::string counterFile;
+		std::string memoryFile;
+		std::string trackFile;
+		std::string rootFile;
+		std::string alignFile;
+	};
+
+	/// A single simulated event
+	struct event_t {
+		int eventNumber;
+		/// Measured track points, telescope planes followed by the REF
+		std::vector<Track> tracks;
+		/// Hit counters of the MaPSA-light pixels
+		std::array<int, MpaTransform::num_pixels> pixels;
+	};
+
+	/// Output file cannot be written
+	class io_error : public std::runtime_error
+	{
+	public:
+		io_error(const std::string& filename) : std::runtime_error(""), msg()
+		{
+			msg = std::string("Cannot write output file '") + filename + "'";
+		}
+		virtual const char* what() const noexcept { return msg.c_str(); }
+	private:
+		std::string msg;
+	};
+
+	explicit TestbeamGenerator(const config_t& config);
+
+	/// Generate the next event, events are numbered consecutively starting at 0
+	event_t next();
+
+	/** \brief Generate config.numEvents events and write them to all requested outputs
+	 *
+	 * Restarts the random number sequence, so calling generate() twice writes identical files.
+	 * \throw io_error An output file cannot be written
+	 */
+	void generate(const output_t& output);
+
+	const config_t& getConfig() const { return _config; }
+	const MpaTransform& getTransform() const { return _transform; }
+
+	/// Counter text line of an event
+	static std::string counterLine(const event_t& event);
+	/// Memory text line of an event, the bunch crossing ID is the lower 16 bit of the event number
+	static std::string memoryLine(const event_t& event);
+	/// Event without tracks and MaPSA hits
+	static event_t emptyEvent(int eventNumber);
+
+private:
+	void reset();
+	double gauss(double sigma);
+
+	config_t _config;
+	MpaTransform _transform;
+	std::mt19937_64 _rng;
+	int _eventNumber;
+};
+
+} // namespace core
+
+#endif//TESTBEAM_GENERATOR_H
@@ -7,6 +7,8 @@
 #include "basesensorstreamreader.h"
 #include "quickrunlistreader.h"
 #include "mpatransform.h"
+#include "eventindex.h"
+#include "eventsampler.h"
 
 namespace po = boost::program_options;
 
@@ -53,6 +55,9 @@ public:
 		run_callback_t run;
 		run_post_callback_t run_post;
 		post_callback_t post;
+		/** Names of the processes whose post() must have finished before this process starts. Set to the
+		 * previously added process by addProcess(), see setProcessDependencies(). */
+		std::vector<std::string> depends;
 	};
 
 	/** \brief Load configuration from file and from command line
@@ -69,6 +74,12 @@ public:
 	/** \brief Perform analysis. Must be reimplemented.
 	 *
 	 * This is the work-horse to perform any actual analysis.
+	 *
+	 * The default implementation executes the registered processes. All processes whose dependencies are
+	 * finished are fused into a single pass over the data: every run is read once and each event is handed
+	 * to the run callbacks of all processes, in the order they were added and according to their
+	 * callback_stop_t mode. A process that returns false from its run callback only stops itself. Processes
+	 * that request rerun() in their post callback are repeated in the next pass.
 	 */
 	virtual void run(const po::variables_map& vm);
 
@@ -100,6 +111,11 @@ public:
 	
 	virtual bool multirunConsistencyCheck(const std::string& argv0, const po::variables_map& vm);
 
+	/// MPA and track data files of all runs
+	virtual std::vector<std::string> getInputFiles(const po::variables_map& vm);
+	/// Runlist rows of all runs
+	virtual std::string getRunlistKey() const;
+
 protected:
 	void addProcess(const process_t& proc);
 	void addProcess(const std::string& name,
@@ -112,6 +128,31 @@ protected:
 	{
 		addProcess({name, mode, init, run_init, run, run_post, stop});
 	}
+	/** \brief Declare which processes a process needs to be finished before it can start
+	 *
+	 * By default a process depends on the process added before it, so all processes run one after another.
+	 * A process that does not use the results of the post callback of its predecessor can be declared
+	 * independent to be executed in the same pass. Within a pass, the run callbacks are called in the
+	 * order the processes were added, so a process may use per-event results of a process added before it.
+	 *
+	 * \throw std::invalid_argument A process of that name has not been added
+	 */
+	void setProcessDependencies(const std::string& name, const std::vector<std::string>& depends);
+	/** \brief Only hand events accepted by filter to the run callbacks
+	 *
+	 * The filter is combined with the --event-filter option. If the pixel reader supports an EventIndex, the
+	 * events are selected from the indices of the run and the others are never decoded. Otherwise the
+	 * decoded events are filtered. An empty filter accepts all events.
+	 */
+	void setEventFilter(const EventIndex::filter_t& filter) { _eventFilter = filter; }
+	/** \brief Read a random sample of the accepted events in every pass
+	 *
+	 * The sample is drawn as selected by the --sampling and --sample-seed options and split between the
+	 * runs in proportion to their number of events. For CS_TRACK processes, only events with a track event
+	 * are drawn. Without an EventIndex of the pixel data, the sample is drawn from the track events if no
+	 * event filter is set, otherwise all events are read. 0 disables sampling.
+	 */
+	void setEventSample(size_t size) { _sampleSize = size; }
 	void setDataOffset(int dataOffset);
 	int getDataOffset() const { return _dataOffset; }
 	void rerun();
@@ -129,12 +170,39 @@ private:
 		int runId;
 		std::shared_ptr<core::BaseSensorStreamReader> pixelreader;
 		core::TrackStreamReader trackreader;
+		/// The event filter is applied to decoded events because the pixel reader has no index
+		bool filterDecoded;
+		/// Share of the sample drawn from this run
+		size_t sampleSize;
 	};
 
-	void executeProcess(const std::vector<run_read_pair_t>& reader,
+	void executeProcess(std::vector<run_read_pair_t>& reader,
                             const process_t& proc);
+	/// Run several processes on a single pass over the data
+	void executeFusedProcesses(std::vector<run_read_pair_t>& reader,
+	                           std::vector<const process_t*> processes);
+	/// Set the selections of the readers of a run according to the event filters, the sample and the data offset
+	void selectEvents(run_read_pair_t& read, callback_stop_t mode);
+	/// Split the sample size between the runs
+	void distributeSample(std::vector<run_read_pair_t>& reader);
+	bool acceptEvent(const EventIndex::summary_t& summary) const;
+	/// Filter events that could not be selected before decoding
+	bool acceptDecodedEvent(const run_read_pair_t& read, size_t tracks,
+	                        const BaseSensorStreamReader::event_t& pixel) const;
+	/// Progress is published every (progress_interval_mask+1) events
+	static constexpr size_t progress_interval_mask = 0x3ff;
+	void publishProgress(size_t evtCount);
+	void finishProgress(callback_stop_t mode, int runId, size_t evtCount);
 
 	std::vector<process_t> _processes;
+	/// Number of events of previous passes, indexed by mode and run ID. Used for progress estimation.
+	std::map<std::pair<int, int>, size_t> _eventsPerRun;
+	EventIndex::filter_t _eventFilter;
+	/// Filter given by --event-filter
+	EventIndex::filter_t _optionFilter;
+	size_t _sampleSize;
+	EventSampler::sampling_mode_t _samplingMode;
+	unsigned int _sampleSeed;
 	int _dataOffset;
 	bool _analysisRunning;
 	bool _rerunProcess;
@@ -0,0 +1,103 @@
+#ifndef TRACK_PIXEL_MATRIX_H
+#define TRACK_PIXEL_MATRIX_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include "mpatransform.h"
+
+namespace core {
+
+/** \brief Distances between all track intersection points and all MPA pixel centres of an event
+ *
+ * Pixel centres and sizes are precomputed with setTransform() whenever the alignment changes. For every event
+ * compute() evaluates the signed residuals pixel centre minus track point in X and Y for all tracks and pixels
+ * at once, one row per track and one column per pixel index. window() then yields a boolean matrix telling
+ * whether a track lies within a window of n pixel sizes around a pixel.
+ *
+ * The arithmetic is the same as using MpaTransform::transform() and MpaTransform::getPixelSize() directly,
+ * so results are bit-identical to the per-pixel computation.
+ */
+class TrackPixelMatrix
+{
+public:
+	static constexpr int num_pixels = MpaTransform::num_pixels;
+	typedef Eigen::Array<double, 1, num_pixels> row_t;
+	typedef Eigen::Array<double, Eigen::Dynamic, num_pixels, Eigen::RowMajor> matrix_t;
+	typedef Eigen::Array<bool, Eigen::Dynamic, num_pixels, Eigen::RowMajor> mask_t;
+
+	TrackPixelMatrix() : _numTracks(0) {}
+
+	explicit TrackPixelMatrix(const MpaTransform& transform) : _numTracks(0)
+	{
+		setTransform(transform);
+	}
+
+	/// Precompute pixel centres and sizes, has to be called after every alignment change
+	void setTransform(const MpaTransform& transform)
+	{
+		for(int idx = 0; idx < num_pixels; ++idx) {
+			auto center = transform.transform(idx, true);
+			auto size = transform.getPixelSize(idx);
+			_centerX(idx) = center(0);
+			_centerY(idx) = center(1);
+			_sizeX(idx) = size(0);
+			_sizeY(idx) = size(1);
+		}
+	}
+
+	/// Compute residuals of all pixels to the given track points
+	void compute(const std::vector<Eigen::Vector3d>& points)
+	{
+		_numTracks = points.size();
+		_dx.resize(_numTracks, num_pixels);
+		_dy.resize(_numTracks, num_pixels);
+		for(size_t track = 0; track < _numTracks; ++track) {
+			_dx.row(track) = _centerX - points[track](0);
+			_dy.row(track) = _centerY - points[track](1);
+		}
+		_absDx = _dx.abs();
+		_absDy = _dy.abs();
+	}
+
+	/** \brief Determine which tracks lie within a window of nSigma pixel sizes around each pixel
+	 *
+	 * \param nSigma Half-width of the window in units of the pixel size
+	 * \param window Boolean matrix with one row per track and one column per pixel
+	 */
+	void window(double nSigma, mask_t& window) const
+	{
+		const row_t maxX = _sizeX * nSigma;
+		const row_t maxY = _sizeY * nSigma;
+		window.resize(_numTracks, num_pixels);
+		for(size_t track = 0; track < _numTracks; ++track) {
+			window.row(track) = (_absDx.row(track) < maxX) && (_absDy.row(track) < maxY);
+		}
+	}
+
+	size_t getNumTracks() const { return _numTracks; }
+	/// Signed residuals in X, pixel centre minus track point
+	const matrix_t& getDx() const { return _dx; }
+	/// Signed residuals in Y, pixel centre minus track point
+	const matrix_t& getDy() const { return _dy; }
+	const matrix_t& getAbsDx() const { return _absDx; }
+	const matrix_t& getAbsDy() const { return _absDy; }
+	const row_t& getCenterX() const { return _centerX; }
+	const row_t& getCenterY() const { return _centerY; }
+	const row_t& getSizeX() const { return _sizeX; }
+	const row_t& getSizeY() const { return _sizeY; }
+
+private:
+	row_t _centerX;
+	row_t _centerY;
+	row_t _sizeX;
+	row_t _sizeY;
+	size_t _numTracks;
+	matrix_t _dx;
+	matrix_t _dy;
+	matrix_t _absDx;
+	matrix_t _absDy;
+};
+
+} // namespace core
+
+#endif//TRACK_PIXEL_MATRIX_H
@@ -4,8 +4,11 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <memory>
 #include <regex.h>
 #include "track.h"
+#include "inputfile.h"
+#include "eventindex.h"
 
 namespace core {
 
@@ -128,8 +131,17 @@ public:
 		 * \param filename The filename of the file to be opened.
 		 * \param end If set to true, the iterator will be a beyond-last-element iterator. The file
 		 * will not be opened in that case.
+		 * \param selection If set, only these events are read, seeking from one to the next.
 		 */
-		EventIterator(const std::string& filename, bool end);
+		EventIterator(const std::string& filename, bool end,
+		              std::shared_ptr<const EventIndex::selection_t> selection=nullptr);
+		/** Construct an iterator over events decoded before, e.g. by the RunCache.
+		 * \param filename The filename the events were read from, used for comparisons.
+		 * \param events The events, the iterator is an end iterator if it is empty.
+		 * \param selection If set, only these events are visited.
+		 */
+		EventIterator(const std::string& filename, std::shared_ptr<const std::vector<event_t>> events,
+		              std::shared_ptr<const EventIndex::selection_t> selection=nullptr);
 		EventIterator(const EventIterator& other);
 		EventIterator(EventIterator&& other) noexcept;
 		~EventIterator();
@@ -177,7 +189,7 @@ public:
 	private:
 		void open();
 		void compileRegex();
-		mutable std::ifstream _fin;
+		mutable InputFile _fin;
 		std::string _filename;
 		bool _end;
 		event_t _currentEvent;
@@ -187,6 +199,11 @@ public:
 		regex_t _regexComment;
 		size_t _eventsRead;
 		size_t _currentLineNo;
+		/// Decoded events if the iterator does not read the file
+		std::shared_ptr<const std::vector<event_t>> _events;
+		std::shared_ptr<const EventIndex::selection_t> _selection;
+		/// Next entry of _selection to read
+		size_t _selectionPos;
 	};
 
 	/** \brief Construct a new TrackStreamReader instance.
@@ -199,7 +216,8 @@ public:
 
 	/** Get the iterator pointing to the first event.
 	 *
-	 * This will perform a read operation to retrieve the first event.
+	 * This will perform a read operation to retrieve the first event. If the RunCache is enabled, the
+	 * whole file is decoded on the first call and the iterator reads the events from memory.
 	 */
 	EventIterator begin() const;
 
@@ -207,8 +225,28 @@ public:
 	EventIterator end() const;
 
 	std::string getFilename() const { return _filename; }
+
+	/** \brief Index of the track file, the count of an entry is its number of tracks
+	 *
+	 * \throw std::ios_base::failure The track file cannot be read
+	 */
+	std::shared_ptr<const EventIndex> getIndex() const;
+
+	/** \brief Restrict new iterators to the selected events
+	 *
+	 * The entries must be taken from getIndex(), in ascending order. nullptr removes the selection.
+	 */
+	void setSelection(std::shared_ptr<const EventIndex::selection_t> selection) { _selection = selection; }
+
+	/** \brief Index every event with the offset of its first data line and its number of tracks
+	 *
+	 * Lines that cannot be parsed are skipped, they are reported when the event is read.
+	 * \sa EventIndex::builder_t
+	 */
+	static void buildIndex(std::istream& in, std::vector<EventIndex::entry_t>& entries);
 private:
 	std::string _filename;
+	std::shared_ptr<const EventIndex::selection_t> _selection;
 };
 
 } // namespace core
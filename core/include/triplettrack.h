@@ -3,8 +3,11 @@
 
 #include "triplet.h"
 #include "mpatransform.h"
+#include "mpaassembly.h"
 #include <TH1F.h>
 #include <iostream>
+#include <vector>
+#include <utility>
 
 namespace core
 {
@@ -128,6 +131,8 @@ public:
 		double dut_residual_cut_y;
 		Eigen::Vector3d dut_offset;
 		Eigen::Vector3d dut_rotation;
+		/// Chip layout of the DUT, placed at dut_offset and dut_rotation
+		MpaAssembly dut_assembly;
 		bool dut_plateau_x;
 		Eigen::Vector3d ref_prealign;
 		Eigen::Vector3d dut_prealign;
@@ -146,6 +151,24 @@ public:
 							 Eigen::Vector3d* new_dut_prealign,
 							 bool useDut=true);
 
+	/** \brief Pairs of REF hits and downstream triplets with residuals within cut
+	 *
+	 * Only hits and triplets in neighbouring cells of a CandidateGrid are compared.
+	 * \param prealign Subtracted from the REF hits
+	 * \return Indices of hit and triplet, ordered by hit and then by triplet
+	 */
+	static std::vector<std::pair<size_t, size_t>> matchRefHits(const std::vector<Eigen::Vector3d>& refHits,
+	                                                           const std::vector<Triplet>& downstream,
+	                                                           const Eigen::Vector3d& prealign, double cut);
+	/** \brief Pairs of downstream and upstream triplets with residuals at z within cut
+	 *
+	 * Only triplets in neighbouring cells of a CandidateGrid are compared.
+	 * \return Indices of downstream and upstream triplet, ordered by downstream and then by upstream triplet
+	 */
+	static std::vector<std::pair<size_t, size_t>> matchTriplets(const std::vector<Triplet>& downstream,
+	                                                            const std::vector<Triplet>& upstream,
+	                                                            double z, double cut);
+
 private:
 	static Eigen::Vector3d fitDutPrealignment(TH1D* x, TH1D* y, const MpaTransform& transform, bool plateau_x=false);
 	int _eventNo;
@@ -0,0 +1,85 @@
+#ifndef ZSCAN_H
+#define ZSCAN_H
+
+#include "track.h"
+#include <Eigen/Dense>
+#include <vector>
+#include <functional>
+
+namespace core {
+
+/** \brief Evaluate several Z position hypotheses on a sample that was read only once
+ *
+ * Alignment scans try a number of Z positions for a sensor and fill one residual histogram per position.
+ * Instead of rereading the input files for every position, the analysis stores the sample with addEvent():
+ * the two track points used for the extrapolation and the hits of the sensor. scan() then extrapolates every
+ * track onto every Z position and hands track point and hit to a fill callback.
+ *
+ * Each step is processed by exactly one thread and visits the events, tracks and hits in the order they were
+ * added, so the histogram of a step is filled exactly as in a sequential pass over the input files. Steps are
+ * distributed over several threads, the fill callback therefore must only touch data of its step.
+ */
+class ZScan
+{
+public:
+	/// Sensor hit of an event
+	struct hit_t {
+		/// Raw index of the hit, e.g. pixel or strip index
+		int index;
+		/// Position of the hit in the sensor plane
+		Eigen::Vector2d position;
+	};
+
+	/// Called for each combination of track and hit of an event
+	typedef std::function<void(size_t step, size_t event, const Eigen::Vector3d& track, const hit_t& hit)> fill_callback_t;
+	/// Called after all tracks and hits of an event were passed to the fill callback
+	typedef std::function<void(size_t step, size_t event)> event_callback_t;
+
+	/** \brief Create scan using the track points a and b for the extrapolation
+	 *
+	 * \param axis Axis perpendicular to the scanned planes
+	 */
+	ZScan(size_t a, size_t b, size_t axis=2);
+
+	/// Remove all cached events
+	void clear();
+
+	/// Cache an event of the sample
+	void addEvent(int eventNumber, const std::vector<Track>& tracks, const std::vector<hit_t>& hits);
+
+	size_t getNumEvents() const { return _eventNumbers.size(); }
+	int getEventNumber(size_t event) const { return _eventNumbers.at(event); }
+
+	/** \brief Fill all Z hypotheses from the cached sample
+	 *
+	 * \param positions Z positions to extrapolate the tracks onto, one per step
+	 * \param fill Called for every step, event, track and hit
+	 * \param eventDone Called for every step after each event, may be empty
+	 * \param numThreads Number of threads, 0 for the number of hardware threads
+	 */
+	void scan(const std::vector<double>& positions, const fill_callback_t& fill,
+	          const event_callback_t& eventDone=event_callback_t{}, size_t numThreads=0) const;
+
+	/// Equidistant steps from low to high, both included
+	static std::vector<double> steps(double low, double high, int numSteps);
+
+private:
+	void scanStep(size_t step, double position, const fill_callback_t& fill,
+	              const event_callback_t& eventDone) const;
+
+	size_t _a;
+	size_t _b;
+	size_t _axis;
+	std::vector<int> _eventNumbers;
+	/// Index of the first track of each event, one additional entry at the end
+	std::vector<size_t> _trackBegin;
+	/// Index of the first hit of each event, one additional entry at the end
+	std::vector<size_t> _hitBegin;
+	std::vector<Eigen::Vector3d> _trackPoints;
+	std::vector<Eigen::Vector3d> _trackDirections;
+	std::vector<hit_t> _hits;
+};
+
+} // namespace core
+
+#endif//ZSCAN_H
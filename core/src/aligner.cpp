@@ -1,11 +1,14 @@
 
 #include "aligner.h"
+#include "instrumentation.h"
 #include "functions.h"
 #include "histogramfit.h"
+#include "rootoutput.h"
 
 #include <cassert>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
 #include <TH1D.h>
 #include <TCanvas.h>
 #include <TImage.h>
@@ -14,20 +17,43 @@
 
 using namespace core;
 
+namespace {
+
+/// Fraction of the residuals outside the histogram range that is reported
+const double range_tail = 1e-3;
+
+/// Bin of a value with the rounding of TAxis::FindBin, 0 is the underflow and nbins + 1 the overflow bin
+int findBin(double value, const Aligner::histogram_cfg_t& config)
+{
+	if(value < config.min) {
+		return 0;
+	}
+	// also NaN, like TH1::Fill
+	if(!(value < config.max)) {
+		return config.nbins + 1;
+	}
+	int bin = 1 + static_cast<int>(config.nbins * (value - config.min) / (config.max - config.min));
+	return bin > config.nbins ? config.nbins : bin;
+}
+
+} // namespace
 
 Aligner::Aligner() :
  xHistogramConfig{-5, 5, 2000} , yHistogramConfig{-5, 5, 250},
- _nsigma(1.0), _alignX(nullptr), _alignY(nullptr),
+ _nsigma(1.0), _alignX(nullptr), _alignY(nullptr), _binnedX(), _binnedY(),
+ _histogramsCurrent(false),
  _calculated(false), _offset(0, 0, 0), _cuts(0, 0)
 {
 }
 
 TH1D* Aligner::getHistX() const
 {
+	updateHistograms();
 	return _alignX;
 }
 TH1D* Aligner::getHistY() const
 {
+	updateHistograms();
 	return _alignY;
 }
 
@@ -38,10 +64,66 @@ void Aligner::initHistograms(const std::string& xname, const std::string& yname)
 	                   xHistogramConfig.nbins, xHistogramConfig.min, xHistogramConfig.max);
 	_alignY = new TH1D(yname.c_str(), "Alignment Correlation on Y axis",
 	                   yHistogramConfig.nbins, yHistogramConfig.min, yHistogramConfig.max);
+	_histogramsCurrent = false;
+}
+
+void Aligner::binned_t::add(double value, const histogram_cfg_t& config)
+{
+	if(bins.empty()) {
+		bins.resize(config.nbins + 2, 0);
+	}
+	int bin = findBin(value, config);
+	++bins[bin];
+	// TH1::Fill leaves residuals outside of the range out of the statistics
+	if(bin > 0 && bin <= config.nbins) {
+		sum += value;
+		sum2 += value * value;
+	}
+}
+
+void Aligner::binned_t::clear()
+{
+	bins.clear();
+	sum = sum2 = 0;
+}
+
+void Aligner::fillHistogram(TH1D* hist, const binned_t& binned, const histogram_cfg_t& config)
+{
+	// a previous fit may have rebinned the histogram
+	hist->SetBins(config.nbins, config.min, config.max);
+	hist->Reset();
+	if(binned.bins.empty()) {
+		return;
+	}
+	double total = 0;
+	for(int bin = 0; bin <= config.nbins + 1; ++bin) {
+		hist->SetBinContent(bin, binned.bins[bin]);
+		total += binned.bins[bin];
+	}
+	double outside = binned.bins.front() + binned.bins.back();
+	// the statistics of the residuals themselves, not of the bin centres
+	double stats[] = {total - outside, total - outside, binned.sum, binned.sum2};
+	hist->PutStats(stats);
+	hist->SetEntries(total);
+	if(outside > range_tail * total) {
+		std::cerr << "Warning: " << outside / total * 100 << "% of the residuals of " << hist->GetName()
+		          << " are outside of [" << config.min << ", " << config.max << "]" << std::endl;
+	}
+}
+
+void Aligner::updateHistograms() const
+{
+	if(_histogramsCurrent || !_alignX || !_alignY)
+		return;
+	CORE_TIMED_SCOPE("Aligner::updateHistograms");
+	fillHistogram(_alignX, _binnedX, xHistogramConfig);
+	fillHistogram(_alignY, _binnedY, yHistogramConfig);
+	_histogramsCurrent = true;
 }
 
 void Aligner::writeHistograms()
 {
+	updateHistograms();
 	if(_alignX && _alignY) {
 		_alignX->Write();
 		_alignY->Write();
@@ -50,8 +132,9 @@ void Aligner::writeHistograms()
 
 void Aligner::writeHistogramImage(const std::string& filename)
 {
-	if(!_alignX || !_alignY)
+	if(!_alignX || !_alignY || !RootOutput::getImagesEnabled())
 		return;
+	updateHistograms();
 	std::ostringstream info;
 	auto canvas = new TCanvas("alignmentCanvas", "", 400, 600);
 	canvas->Divide(1, 2);
@@ -66,12 +149,28 @@ void Aligner::writeHistogramImage(const std::string& filename)
 	delete img;
 }
 
+void Aligner::writeHistogramImage(RootOutput& output, const std::string& filename)
+{
+	if(!_alignX || !_alignY || !RootOutput::getImagesEnabled())
+		return;
+	updateHistograms();
+	auto canvas = new TCanvas("alignmentCanvas", "", 400, 600);
+	canvas->Divide(1, 2);
+	// the canvas is rendered later, copies stay valid if the histograms are reset or deleted meanwhile
+	canvas->cd(1);
+	_alignX->DrawCopy();
+	canvas->cd(2);
+	_alignY->DrawCopy();
+	output.addImage(canvas, filename);
+}
+
 void Aligner::calculateAlignment(const bool& quiet)
 {
 	if(_calculated)
 		return;
 	assert(_alignX);
 	assert(_alignY);
+	updateHistograms();
 	_calculated = true;
 	auto xalign = alignGaussian(_alignX, 0.5, 0.1, quiet);
 	auto yalign = alignPlateau(_alignY, 1, 0.05, quiet);	
@@ -97,17 +196,21 @@ void Aligner::calculateAlignment(const bool& quiet)
 
 void Aligner::Fill(const double& xdiff, const double& ydiff)
 {
-	assert(_alignX);
-	assert(_alignY);
-	_alignX->Fill(xdiff);
-	_alignY->Fill(ydiff);
+	_binnedX.add(xdiff, xHistogramConfig);
+	_binnedY.add(ydiff, yHistogramConfig);
+	_histogramsCurrent = false;
 }
 
 void Aligner::clear()
 {
 	_calculated = false;
-	_alignX->Reset();
-	_alignY->Reset();
+	_binnedX.clear();
+	_binnedY.clear();
+	_histogramsCurrent = false;
+	if(_alignX && _alignY) {
+		_alignX->Reset();
+		_alignY->Reset();
+	}
 }
 
 Eigen::Vector3d Aligner::getOffset() const
@@ -209,6 +312,7 @@ bool Aligner::rebinIfNeccessary(TH1D* cor, const double& nrms, const double& bin
 
 Eigen::Vector2d Aligner::alignPlateau(TH1D* cor, const double& nrms, const double& binratio, const bool& quiet, const bool& fixedMean)
 {
+	CORE_TIMED_SCOPE("Aligner::alignPlateau");
 	auto maxBin = cor->GetMaximumBin();
 	auto mean = cor->GetBinLowEdge(maxBin);
 	auto rms = cor->GetRMS();
@@ -238,6 +342,7 @@ Eigen::Vector2d Aligner::alignPlateau(TH1D* cor, const double& nrms, const doubl
 
 Eigen::Vector2d Aligner::alignGaussian(TH1D* cor, const double& nrms, const double& binratio, const bool& quiet, const bool& fixedMean)
 {
+	CORE_TIMED_SCOPE("Aligner::alignGaussian");
 	auto maxBin = cor->GetMaximumBin();
 	auto mean = cor->GetBinLowEdge(maxBin);
 	auto rms = cor->GetRMS();
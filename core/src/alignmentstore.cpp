@@ -0,0 +1,132 @@
+#include "alignmentstore.h"
+#include <sstream>
+#include <limits>
+#include <cstdlib>
+
+using namespace core;
+
+namespace {
+
+const char* schema = R"SQL(
+CREATE TABLE IF NOT EXISTS alignments (
+ run_id INTEGER, analysis STRING, version INTEGER, parameters STRING, fitness FLOAT, status INTEGER,
+ created STRING DEFAULT CURRENT_TIMESTAMP, PRIMARY KEY (run_id, analysis, version)
+);
+CREATE INDEX IF NOT EXISTS index_alignments_analysis ON alignments(analysis, run_id);
+)SQL";
+
+/// String literal for SQL
+std::string quote(const std::string& value)
+{
+	std::string quoted = "'";
+	for(char c: value) {
+		quoted += c;
+		if(c == '\'') {
+			quoted += c;
+		}
+	}
+	return quoted + "'";
+}
+
+} // namespace
+
+AlignmentStore::AlignmentStore(const std::string& filename) :
+ _db(filename)
+{
+	_db.exec(schema);
+	// a single statement allocates the version, so concurrent jobs get distinct versions
+	_insert = _db.prepare("INSERT INTO alignments (run_id, analysis, version, parameters, fitness, status)"
+	                      " SELECT ?1, ?2, IFNULL(MAX(version), 0)+1, ?3, ?4, ?5 FROM alignments"
+	                      " WHERE run_id = ?1 AND analysis = ?2");
+}
+
+int AlignmentStore::save(int runId, const std::string& analysis, const std::vector<double>& parameters,
+                         double fitness, int status)
+{
+	std::ostringstream sstr;
+	sstr.precision(std::numeric_limits<double>::max_digits10);
+	for(size_t i = 0; i < parameters.size(); ++i) {
+		sstr << (i > 0 ? " " : "") << parameters[i];
+	}
+	_db.write(_insert, runId, analysis, sstr.str(), fitness, status);
+	int version = _db.queryInt("SELECT version FROM alignments WHERE rowid = " + std::to_string(_db.lastInsertId()));
+	_db.commit();
+	return version;
+}
+
+bool AlignmentStore::load(int runId, const std::string& analysis, alignment_t& alignment, int version)
+{
+	return loadWhere(runId, analysis, version >= 0 ? "version = " + std::to_string(version) : "", alignment);
+}
+
+bool AlignmentStore::loadWhere(int runId, const std::string& analysis, const std::string& condition,
+                               alignment_t& alignment)
+{
+	std::ostringstream sql;
+	sql << "SELECT version, parameters, fitness, status FROM alignments"
+	    << " WHERE run_id = " << runId << " AND analysis = " << quote(analysis);
+	if(!condition.empty()) {
+		sql << " AND " << condition;
+	}
+	sql << " ORDER BY version DESC LIMIT 1";
+	bool found = false;
+	_db.query(sql.str(), [&](const std::vector<std::string>& row) {
+		alignment.runId = runId;
+		alignment.analysis = analysis;
+		alignment.version = std::atoi(row[0].c_str());
+		alignment.parameters.clear();
+		std::istringstream sstr(row[1]);
+		double value;
+		while(sstr >> value) {
+			alignment.parameters.push_back(value);
+		}
+		alignment.fitness = std::strtod(row[2].c_str(), nullptr);
+		alignment.status = std::atoi(row[3].c_str());
+		found = true;
+	});
+	return found;
+}
+
+std::vector<int> AlignmentStore::getRuns(const std::string& analysis)
+{
+	std::vector<int> runs;
+	_db.query("SELECT DISTINCT run_id FROM alignments WHERE analysis = " + quote(analysis) + " ORDER BY run_id",
+	          [&runs](const std::vector<std::string>& row) { runs.push_back(std::atoi(row[0].c_str())); });
+	return runs;
+}
+
+bool AlignmentStore::findNearest(const QuickRunlistReader& runlist, int runId,
+                                 const std::vector<accepted_t>& analyses, alignment_t& alignment)
+{
+	const auto& run = runlist.getByMpaRun(runId);
+	bool found = false;
+	int bestDistance = std::numeric_limits<int>::max();
+	int bestRun = std::numeric_limits<int>::max();
+	for(const auto& accepted: analyses) {
+		const auto& analysis = accepted.first;
+		if(accepted.second.empty()) {
+			continue;
+		}
+		std::string condition = "status IN (";
+		for(size_t i = 0; i < accepted.second.size(); ++i) {
+			condition += (i > 0 ? ", " : "") + std::to_string(accepted.second[i]);
+		}
+		condition += ")";
+		for(auto other: getRuns(analysis)) {
+			int distance = std::abs(other - runId);
+			if(other == runId || distance > bestDistance || (distance == bestDistance && other >= bestRun)) {
+				continue;
+			}
+			auto otherRun = runlist.findByMpaRun(other);
+			if(!otherRun || otherRun->angle != run.angle || otherRun->bias_voltage != run.bias_voltage) {
+				continue;
+			}
+			if(loadWhere(other, analysis, condition, alignment)) {
+				bestDistance = distance;
+				bestRun = other;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
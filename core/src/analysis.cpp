@@ -5,6 +5,7 @@
 #include <iostream>
 #include <cxxabi.h>
 #include <algorithm>
+#include <fstream>
 #include "mpastreamreader.h"
 #include "util.h"
 
@@ -20,6 +21,9 @@ Analysis::Analysis() :
 		("config,c", po::value<std::string>()->default_value("../config.cfg"),
 		 "Configuration file to load variables from")
 		("run,r", po::value<std::vector<int>>()->required(), "MPA Run ID")
+		("force", "Ignore cached results and run the analysis")
+		("no-timing", "Do not time the analysis stages and write no timing report")
+		("no-images", "Do not render PNG images of the plots")
 	;
 }
 
@@ -34,6 +38,152 @@ bool Analysis::loadConfig(const po::variables_map& vm)
 	return true;
 }
 
+namespace {
+
+/// String representation of the option types used by the analyses
+std::string optionToString(const boost::any& value)
+{
+	std::ostringstream sstr;
+	if(value.empty()) {
+		sstr << "<set>";
+	} else if(auto v = boost::any_cast<std::string>(&value)) {
+		sstr << *v;
+	} else if(auto v = boost::any_cast<int>(&value)) {
+		sstr << *v;
+	} else if(auto v = boost::any_cast<double>(&value)) {
+		sstr << std::setprecision(17) << *v;
+	} else if(auto v = boost::any_cast<bool>(&value)) {
+		sstr << *v;
+	} else if(auto v = boost::any_cast<std::vector<int>>(&value)) {
+		for(const auto& i: *v) {
+			sstr << i << " ";
+		}
+	} else if(auto v = boost::any_cast<std::vector<std::string>>(&value)) {
+		for(const auto& i: *v) {
+			sstr << i << "\x1f";
+		}
+	} else {
+		sstr << "<" << value.type().name() << ">";
+	}
+	return sstr.str();
+}
+
+} // namespace
+
+std::string Analysis::getCacheKey(const po::variables_map& vm, ResultCache& cache, std::string* description)
+{
+	std::ostringstream sstr;
+	sstr << "analysis\t" << getName() << "\n";
+	for(const auto& option: vm) {
+		if(option.first == "force" || option.first == "help" || option.first == "no-timing") {
+			continue;
+		}
+		sstr << "option\t" << option.first << "\t" << optionToString(option.second.value()) << "\n";
+	}
+	for(const auto& var: _config.getDefinedVariables()) {
+		sstr << "config\t" << var << "\t";
+		try {
+			sstr << _config.getVariable(var);
+		} catch(std::runtime_error& e) {
+			sstr << "<unresolved>";
+		}
+		sstr << "\n";
+	}
+	sstr << "runlist\t" << getRunlistKey() << "\n";
+	for(const auto& file: getInputFiles(vm)) {
+		sstr << "input\t" << file << "\t" << cache.fingerprint(file) << "\n";
+	}
+	for(const auto& file: getDependencyFiles(vm)) {
+		sstr << "dependency\t" << file << "\t" << cache.fingerprint(file) << "\n";
+	}
+	if(description) {
+		*description = sstr.str();
+	}
+	return ResultCache::hash(sstr.str());
+}
+
+bool Analysis::runCached(const po::variables_map& vm)
+{
+	std::string directory;
+	try {
+		directory = _config.getVariable("result_cache_dir");
+	} catch(CfgParse::no_variable_error& e) {
+	}
+	if(directory.empty() || !isCacheable()) {
+		run(vm);
+		closeOutputs();
+		return false;
+	}
+	ResultCache cache(directory);
+	std::string description;
+	auto key = getCacheKey(vm, cache, &description);
+	auto output_dir = _config.getVariable("output_dir");
+	if(vm.count("force") == 0 && cache.restore(key, output_dir)) {
+		std::cout << "Restored results of " << getName() << " from cache entry " << key << std::endl;
+		return true;
+	}
+	auto before = cache.snapshot(output_dir);
+	run(vm);
+	closeOutputs();
+	auto stored = cache.store(key, output_dir, before, getOutputStems(), description);
+	if(stored) {
+		std::cout << "Stored " << stored << " result files in cache entry " << key << std::endl;
+	}
+	return false;
+}
+
+std::vector<std::string> Analysis::getDependencyFiles(const po::variables_map& vm)
+{
+	std::vector<std::string> files;
+	try {
+		auto mask = _config.getVariable("pixel_mask");
+		if(mask.size()) {
+			files.push_back(mask);
+		}
+	} catch(CfgParse::no_variable_error& e) {
+	}
+	return files;
+}
+
+std::vector<std::string> Analysis::getOutputStems() const
+{
+	auto stem = [](const std::string& filename) {
+		return filename.substr(filename.rfind('/') + 1);
+	};
+	std::vector<std::string> stems { stem(getFilename()) };
+	for(auto runId: _allRunIds) {
+		stems.push_back(stem(getFilename(runId)));
+	}
+	return stems;
+}
+
+void Analysis::writeTimingReport() const
+{
+	auto status = _progress.get();
+	Instrumentation::report_t report;
+	report.analysis = getName();
+	report.runs = _allRunIds;
+	report.wallSeconds = status.totalSeconds;
+	report.events = status.totalEvents + status.events;
+	report.peakRss = Instrumentation::peakRss();
+	report.stages = Instrumentation::collect();
+	if(report.events == 0) {
+		for(const auto& stage: report.stages) {
+			if(stage.name == "TTree::GetEntry") {
+				report.events = stage.calls;
+			}
+		}
+	}
+	std::cout << Instrumentation::formatTable(report) << std::flush;
+	auto filename = getFilename(".timing.json");
+	std::ofstream fout(filename);
+	if(!fout) {
+		std::cerr << "Cannot write timing report '" << filename << "'" << std::endl;
+		return;
+	}
+	fout << Instrumentation::formatJson(report);
+}
+
 std::string Analysis::getUsage(const std::string& argv0) const
 {
 	std::ostringstream sstr;
@@ -0,0 +1,77 @@
+#include "candidategrid.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace core;
+
+namespace {
+
+/// Enlargement of the cells against rounding, relative and absolute in mm
+const double relative_margin = 1e-6;
+const double absolute_margin = 1e-9;
+/// Cell indices beyond are not exact in a double
+const double max_cell_index = 1e15;
+
+} // namespace
+
+CandidateGrid::CandidateGrid(double distance) :
+ _cellSize(distance * (1 + relative_margin) + absolute_margin),
+ _enabled(distance >= 0 && std::isfinite(distance)), _size(0)
+{
+}
+
+void CandidateGrid::insert(const Eigen::Vector2d& position)
+{
+	cell_t cell;
+	if(getCell(position, cell)) {
+		_cells[cell].push_back(_size);
+	} else {
+		_everywhere.push_back(_size);
+	}
+	++_size;
+}
+
+void CandidateGrid::clear()
+{
+	_cells.clear();
+	_everywhere.clear();
+	_size = 0;
+}
+
+bool CandidateGrid::getCell(const Eigen::Vector2d& position, cell_t& cell) const
+{
+	if(!_enabled) {
+		return false;
+	}
+	double x = std::floor(position(0) / _cellSize);
+	double y = std::floor(position(1) / _cellSize);
+	// also false for NaN
+	if(!(std::abs(x) < max_cell_index && std::abs(y) < max_cell_index)) {
+		return false;
+	}
+	cell = {static_cast<int64_t>(x), static_cast<int64_t>(y)};
+	return true;
+}
+
+void CandidateGrid::query(const Eigen::Vector2d& position, std::vector<size_t>& indices) const
+{
+	indices.clear();
+	cell_t cell;
+	if(!getCell(position, cell)) {
+		indices.resize(_size);
+		for(size_t i = 0; i < _size; ++i) {
+			indices[i] = i;
+		}
+		return;
+	}
+	indices = _everywhere;
+	for(int64_t dx = -1; dx <= 1; ++dx) {
+		for(int64_t dy = -1; dy <= 1; ++dy) {
+			auto found = _cells.find({cell.first + dx, cell.second + dy});
+			if(found != _cells.end()) {
+				indices.insert(indices.end(), found->second.begin(), found->second.end());
+			}
+		}
+	}
+	std::sort(indices.begin(), indices.end());
+}
@@ -1,12 +1,26 @@
 #include "cbcstreamreader.h"
-#ifdef ENABLE_CBC_ANALSIS
+#include "instrumentation.h"
+#ifdef ENABLE_CBC_ANALYSIS
 #include <cassert>
-#include <regex.h>
 #include <TFile.h>
+#include <TROOT.h>
+#include <RVersion.h>
+#include <algorithm>
 #include <iostream>
 
 using namespace core;
 
+namespace {
+
+/// Map keys of the strip channels, constructed once instead of for every lookup
+const std::string det0Key("det0");
+const std::string det1Key("det1");
+/// Size of the TTreeCache in bytes
+const Long64_t treeCacheSize = 64*1024*1024;
+/// Maximum number of entries read ahead by the prefetch thread
+const size_t prefetchEntries = 4096;
+
+}
 
 CBCStreamReader::CBCStreamReader() :
  BaseSensorStreamReader()
@@ -22,84 +36,194 @@ CBCStreamReader::~CBCStreamReader()
 {
 }
 
-CBCStreamReader::cbcreader::cbcreader(const std::string& filename, size_t eventNum) :
- reader(filename), _fin(filename.c_str(), "READ"), _analysisTree(nullptr), _dutEvent(new tbeam::dutEvent),
- _condition(new tbeam::condEvent), _telescopeEvent(new tbeam::TelescopeEvent),_goodEventFlag(false),
- _numEventsRead(eventNum)
+CBCStreamReader::cbcreader::cbcreader(const std::string& filename, size_t eventNum, bool prefetch) :
+ reader(filename), _fin(filename.c_str(), "READ"), _analysisTree(nullptr), _dutBranch(nullptr),
+ _conditionBranch(nullptr), _goodEventBranch(nullptr), _dutEvent(new tbeam::dutEvent),
+ _condition(new tbeam::condEvent), _goodEventFlag(false), _numEventsRead(eventNum), _numEntries(0),
+ _flagEntry(-1), _dutEntry(-1), _entryGood(false), _entryEvent(0), _prefetch(prefetch), _prefetchDone(false),
+ _prefetchStop(false)
 {
 	_currentEvent.eventNumber = 0;
         open();
+	if(_prefetch) {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+		// the tree is read on another thread than the one creating histograms
+		ROOT::EnableThreadSafety();
+#endif
+		_prefetchThread = std::thread(&cbcreader::prefetch, this, static_cast<Long64_t>(eventNum));
+	}
 	if(eventNum == 0) {
-		next();
+		_empty = next();
 	}
 }
 
 CBCStreamReader::cbcreader::~cbcreader()
 {
+	stopPrefetch();
 	_fin.Close();
 	delete _dutEvent;
 	delete _condition;
-	delete _telescopeEvent;
+}
+
+void CBCStreamReader::cbcreader::stopPrefetch()
+{
+	if(!_prefetchThread.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_prefetchMutex);
+		_prefetchStop = true;
+	}
+	_prefetchSpace.notify_one();
+	_prefetchThread.join();
+}
+
+void CBCStreamReader::cbcreader::prefetch(Long64_t first)
+{
+	std::string error;
+	try {
+		for(Long64_t entry = first; entry < _numEntries; ++entry) {
+			record_t record;
+			record.entry = entry;
+			_goodEventBranch->GetEntry(entry);
+			_conditionBranch->GetEntry(entry);
+			record.good = _goodEventFlag;
+			record.event = _condition->event;
+			if(record.good) {
+				_dutBranch->GetEntry(entry);
+				copyChannels(record.channels);
+			}
+			std::unique_lock<std::mutex> lock(_prefetchMutex);
+			_prefetchSpace.wait(lock, [this]() { return _prefetched.size() < prefetchEntries || _prefetchStop; });
+			if(_prefetchStop) {
+				return;
+			}
+			_prefetched.push_back(std::move(record));
+			lock.unlock();
+			_prefetchReady.notify_one();
+		}
+	} catch(std::exception& e) {
+		error = e.what();
+	}
+	{
+		std::lock_guard<std::mutex> lock(_prefetchMutex);
+		_prefetchDone = true;
+		_prefetchError = error;
+	}
+	_prefetchReady.notify_one();
+}
+
+void CBCStreamReader::cbcreader::takePrefetched(Long64_t entry)
+{
+	CORE_TIMED_SCOPE("CBCStreamReader::takePrefetched");
+	std::unique_lock<std::mutex> lock(_prefetchMutex);
+	do {
+		_prefetchReady.wait(lock, [this]() { return !_prefetched.empty() || _prefetchDone; });
+		if(_prefetched.empty()) {
+			throw std::ios_base::failure("Cannot read entry " + std::to_string(entry) + " of " + getFilename()
+			                             + (_prefetchError.empty() ? "" : ": " + _prefetchError));
+		}
+		_record = std::move(_prefetched.front());
+		_prefetched.pop_front();
+		_prefetchSpace.notify_one();
+	} while(_record.entry < entry);
+}
+
+void CBCStreamReader::cbcreader::readEntry(Long64_t entry)
+{
+	// an entry whose event number did not match is evaluated again for the next event
+	if(entry == _flagEntry) {
+		return;
+	}
+	if(_prefetch) {
+		takePrefetched(entry);
+		_entryGood = _record.good;
+		_entryEvent = _record.event;
+	} else {
+		_goodEventBranch->GetEntry(entry);
+		_conditionBranch->GetEntry(entry);
+		_entryGood = _goodEventFlag;
+		_entryEvent = _condition->event;
+	}
+	_flagEntry = entry;
+}
+
+void CBCStreamReader::cbcreader::readChannels(Long64_t entry)
+{
+	if(_prefetch) {
+		// readEntry() took the record of the entry
+		_currentEvent.data = _record.channels;
+		return;
+	}
+	if(entry != _dutEntry) {
+		_dutBranch->GetEntry(entry);
+		_dutEntry = entry;
+	}
+	copyChannels(_currentEvent.data);
+}
+
+void CBCStreamReader::cbcreader::copyChannels(std::vector<int>& data) const
+{
+	const auto& det0 = _dutEvent->dut_channel.at(det0Key);
+	const auto& det1 = _dutEvent->dut_channel.at(det1Key);
+	data.resize(det0.size() + det1.size());
+	std::copy(det0.begin(), det0.end(), data.begin());
+	std::transform(det1.begin(), det1.end(), data.begin() + det0.size(), [](int n) { return n + 254; });
 }
 
 bool CBCStreamReader::cbcreader::next()
 {
+	CORE_TIMED_SCOPE("CBCStreamReader::next");
 	bool good = true;
+	Long64_t entry;
 	do {
-//		if(!good) {
-//			std::cout << "Skipped not-good event " << _currentEvent.eventNumber << std::endl;
-//		}
 		_currentEvent.data.clear();
-		if(_numEventsRead == _analysisTree->GetEntries()) {
+		if(static_cast<Long64_t>(_numEventsRead) == _numEntries) {
 			return true;
 		}
-		_analysisTree->GetEvent(_numEventsRead);
-		good = _goodEventFlag > 0;
+		entry = _numEventsRead;
+		readEntry(entry);
+		good = _entryGood;
 		// The +2 offset was "empiricaly" observed. Quite a magic constant ATM
-		if(_currentEvent.eventNumber + 2 == _condition->event) {
-		/*	std::cout << "\n-----------------------------\n  Event No:" << _currentEvent.eventNumber
-			          << "\ngoodEvent " << _goodEventFlag
-				  << "\ncondEvent.event " << _condition->event
-				  << "\nTelescopeEvent.euEvt " << _telescopeEvent->euEvt
-				  << "\nevt difference " << (_condition->event - _currentEvent.eventNumber)
-				  << "\n-----------------------------"
-				  << std::endl; */
+		if(_currentEvent.eventNumber + 2 == _entryEvent) {
 			++_numEventsRead;
 		}
 		_currentEvent.eventNumber++;
 	} while(!good);
-	for(const auto &n: _dutEvent->dut_channel.at("det0"))
-	{
-	    _currentEvent.data.push_back(n);
-	}
-	for(const auto &n: _dutEvent->dut_channel.at("det1"))
-	{
-	    _currentEvent.data.push_back(n + 254);
-	}
+	readChannels(entry);
 	return false;
 }
 
 
 void CBCStreamReader::cbcreader::open()
 {
-        /*if(_fin)
-	{
-		throw std::ios_base::failure("Cannot open");
-	}*/
 	_analysisTree = dynamic_cast<TTree*>(_fin.Get("analysisTree"));
 	if(!_analysisTree)
 	{
 		throw std::ios_base::failure("analysisTree not found in ROOT file.");
 	}
-	_analysisTree->SetBranchAddress("DUT", &_dutEvent);
-	_analysisTree->SetBranchAddress("Condition", &_condition);
-	_analysisTree->SetBranchAddress("TelescopeEvent", &_telescopeEvent);
-	_analysisTree->SetBranchAddress("goodEventFlag", &_goodEventFlag);
+	// The telescope event and all other branches are never used
+	_analysisTree->SetBranchStatus("*", 0);
+	_analysisTree->SetBranchStatus("DUT*", 1);
+	_analysisTree->SetBranchStatus("Condition*", 1);
+	_analysisTree->SetBranchStatus("goodEventFlag", 1);
+	_analysisTree->SetBranchAddress("DUT", &_dutEvent, &_dutBranch);
+	_analysisTree->SetBranchAddress("Condition", &_condition, &_conditionBranch);
+	_analysisTree->SetBranchAddress("goodEventFlag", &_goodEventFlag, &_goodEventBranch);
+	if(!_dutBranch || !_conditionBranch || !_goodEventBranch) {
+		throw std::ios_base::failure("Branch DUT, Condition or goodEventFlag not found in analysisTree.");
+	}
+	_numEntries = _analysisTree->GetEntries();
+	// read the baskets of whole entry clusters at once
+	_analysisTree->SetCacheSize(treeCacheSize);
+	_analysisTree->AddBranchToCache("DUT*", true);
+	_analysisTree->AddBranchToCache("Condition*", true);
+	_analysisTree->AddBranchToCache("goodEventFlag", true);
 }
 
 BaseSensorStreamReader::reader* CBCStreamReader::cbcreader::clone() const
 {
-	auto newReader = new cbcreader(getFilename(), _numEventsRead);
+	auto newReader = new cbcreader(getFilename(), _numEventsRead, _prefetch);
 	newReader->_currentEvent = _currentEvent;
 	newReader->_numEventsRead = _numEventsRead;
 	return newReader;
@@ -109,4 +233,9 @@ BaseSensorStreamReader::reader* CBCStreamReader::getReader(const std::string& fi
 {
 	return new cbcreader(filename);
 }
+
+BaseSensorStreamReader::reader* CBCPrefetchStreamReader::getReader(const std::string& filename) const
+{
+	return new cbcreader(filename, 0, true);
+}
 #endif//ENABLE_CBC_ANALYSIS
@@ -60,24 +60,65 @@ void CfgParse::parse(std::istream& config, const std::string& filename)
 	}
 }
 
-std::string CfgParse::getVariable(const std::string& var, size_t depth, const std::string& original) const
+void CfgParse::setVariable(const std::string& var, const std::string& value)
 {
-	if(_variables.find(var) == _variables.end()) {
+	auto it = _variables.find(var);
+	if(it == _variables.end()) {
+		_variables[var].raw = value;
+		return;
+	}
+	if(it->second.raw == value) {
+		return;
+	}
+	it->second.raw = value;
+	invalidate(it->second);
+}
+
+void CfgParse::invalidate(const entry_t& entry)
+{
+	// An invalid entry never has valid dependents, because resolving a dependent
+	// resolves (and validates) all of its substitutions. This also ends cycles.
+	if(!entry.valid) {
+		return;
+	}
+	entry.valid = false;
+	for(const auto& dependent: entry.dependents) {
+		auto it = _variables.find(dependent);
+		if(it != _variables.end()) {
+			invalidate(it->second);
+		}
+	}
+}
+
+const std::string& CfgParse::getVariable(const std::string& var, size_t depth, const std::string& original) const
+{
+	auto it = _variables.find(var);
+	if(it == _variables.end()) {
 		throw no_variable_error(var, depth, original);
 	}
+	const entry_t& entry = it->second;
+	if(entry.valid) {
+		return entry.resolved;
+	}
 	if(depth > _variables.size())
 	{
 		throw recursion_error(original);
 	}
-	std::string value(_variables.at(var));
+	std::string value(entry.raw);
 	int ret;
 	regmatch_t m[2];
 	while((ret = regexec(&regexSubstitution, value.c_str(), 2, m, 0)) != REG_NOMATCH) {
 		auto sub_var = value.substr(m[1].rm_so, m[1].rm_eo - m[1].rm_so);
+		auto sub_it = _variables.find(sub_var);
+		if(sub_it != _variables.end()) {
+			sub_it->second.dependents.insert(var);
+		}
 		auto sub_value = getVariable(sub_var, depth+1, original);
 		value = value.replace(m[0].rm_so, m[0].rm_eo - m[0].rm_so, sub_value);
 	}
-	return value;
+	entry.resolved = value;
+	entry.valid = true;
+	return entry.resolved;
 }
 
 std::vector<std::string> CfgParse::getDefinedVariables() const
@@ -11,9 +11,10 @@ void initClasses()
 {
 	REGISTER_PIXEL_STREAM_READER_TYPE(MPAStreamReader);
 	REGISTER_PIXEL_STREAM_READER_TYPE(MpaMemoryStreamReader);
-#ifdef ENABLE_CBC_ANALYIS
+#ifdef ENABLE_CBC_ANALYSIS
 	REGISTER_PIXEL_STREAM_READER_TYPE(CBCStreamReader);
-#endif//ENABLE_CBC_ANALYIS
+	REGISTER_PIXEL_STREAM_READER_TYPE(CBCPrefetchStreamReader);
+#endif//ENABLE_CBC_ANALYSIS
 }
 
 } // namespace core
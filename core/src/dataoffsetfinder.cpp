@@ -0,0 +1,190 @@
+#include "dataoffsetfinder.h"
+#include <algorithm>
+#include <complex>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace core;
+
+namespace {
+
+typedef std::complex<double> complex_t;
+
+/// In-place iterative radix-2 FFT, size of data must be a power of two
+void fft(std::vector<complex_t>& data, bool inverse)
+{
+	const size_t n = data.size();
+	for(size_t i = 1, j = 0; i < n; ++i) {
+		size_t bit = n >> 1;
+		for(; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if(i < j) {
+			std::swap(data[i], data[j]);
+		}
+	}
+	for(size_t len = 2; len <= n; len <<= 1) {
+		double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+		complex_t wlen(std::cos(angle), std::sin(angle));
+		for(size_t i = 0; i < n; i += len) {
+			complex_t w(1);
+			for(size_t j = 0; j < len/2; ++j) {
+				complex_t u = data[i+j];
+				complex_t v = data[i+j+len/2] * w;
+				data[i+j] = u + v;
+				data[i+j+len/2] = u - v;
+				w *= wlen;
+			}
+		}
+	}
+	if(inverse) {
+		for(auto& x: data) {
+			x /= static_cast<double>(n);
+		}
+	}
+}
+
+} // namespace
+
+void DataOffsetFinder::addEvent(int eventNumber, const std::vector<double>& hitX, const std::vector<double>& trackX)
+{
+	auto& event = _events[eventNumber];
+	event.hitX.insert(event.hitX.end(), hitX.begin(), hitX.end());
+	event.trackX.insert(event.trackX.end(), trackX.begin(), trackX.end());
+	_combinations += hitX.size() * trackX.size();
+}
+
+void DataOffsetFinder::clear()
+{
+	_events.clear();
+	_combinations = 0;
+}
+
+std::vector<double> DataOffsetFinder::residuals(int offset, size_t maxEntries) const
+{
+	std::vector<double> res;
+	for(const auto& event: _events) {
+		if(event.second.hitX.empty()) {
+			continue;
+		}
+		auto track = _events.find(event.first + offset);
+		if(track == _events.end()) {
+			continue;
+		}
+		for(const auto& trackX: track->second.trackX) {
+			for(const auto& hitX: event.second.hitX) {
+				res.push_back(trackX - hitX);
+			}
+		}
+		if(maxEntries && res.size() >= maxEntries) {
+			break;
+		}
+	}
+	return res;
+}
+
+double DataOffsetFinder::peakStrength(const std::vector<double>& residuals, double binWidth)
+{
+	if(binWidth <= 0) {
+		throw std::invalid_argument("Bin width must be positive");
+	}
+	if(residuals.size() < 2) {
+		return 0.0;
+	}
+	auto range = std::minmax_element(residuals.begin(), residuals.end());
+	size_t nbins = static_cast<size_t>((*range.second - *range.first) / binWidth) + 1;
+	if(nbins < 2) {
+		return 0.0;
+	}
+	std::vector<size_t> hist(nbins, 0);
+	for(const auto& r: residuals) {
+		++hist[static_cast<size_t>((r - *range.first) / binWidth)];
+	}
+	double mean = static_cast<double>(residuals.size()) / nbins;
+	double peak = *std::max_element(hist.begin(), hist.end());
+	return (peak - mean) / std::sqrt(mean);
+}
+
+DataOffsetFinder::result_vec_t DataOffsetFinder::sweep(int low, int high, double binWidth, size_t maxEntries) const
+{
+	result_vec_t results;
+	for(int offset = low; offset <= high; ++offset) {
+		auto res = residuals(offset, maxEntries);
+		results.push_back({offset, peakStrength(res, binWidth), res.size()});
+	}
+	return results;
+}
+
+DataOffsetFinder::result_vec_t DataOffsetFinder::crossCorrelate(int low, int high) const
+{
+	result_vec_t results;
+	if(_events.empty()) {
+		for(int offset = low; offset <= high; ++offset) {
+			results.push_back({offset, 0.0, 0});
+		}
+		return results;
+	}
+	const int first = _events.begin()->first;
+	const size_t length = _events.rbegin()->first - first + 1;
+	double meanHits = 0;
+	double meanTracks = 0;
+	for(const auto& event: _events) {
+		meanHits += event.second.hitX.size();
+		meanTracks += event.second.trackX.size();
+	}
+	meanHits /= _events.size();
+	meanTracks /= _events.size();
+	// zero-padding to at least twice the length avoids wrap-around of the circular correlation
+	size_t size = 1;
+	while(size < 2*length) {
+		size <<= 1;
+	}
+	std::vector<complex_t> hits(size, 0.0);
+	std::vector<complex_t> tracks(size, 0.0);
+	double normHits = 0;
+	double normTracks = 0;
+	for(const auto& event: _events) {
+		// missing events contribute the mean, i.e. zero after mean subtraction
+		double h = event.second.hitX.size() - meanHits;
+		double t = event.second.trackX.size() - meanTracks;
+		hits[event.first - first] = h;
+		tracks[event.first - first] = t;
+		normHits += h*h;
+		normTracks += t*t;
+	}
+	fft(hits, false);
+	fft(tracks, false);
+	for(size_t i = 0; i < size; ++i) {
+		hits[i] = std::conj(hits[i]) * tracks[i];
+	}
+	// hits[k] = sum_n h[n] * t[n+k]
+	fft(hits, true);
+	const double norm = std::sqrt(normHits * normTracks);
+	for(int offset = low; offset <= high; ++offset) {
+		size_t overlap = static_cast<size_t>(std::abs(offset)) < length ? length - std::abs(offset) : 0;
+		double strength = 0.0;
+		if(overlap && norm > 0) {
+			strength = hits[offset >= 0 ? offset : size + offset].real() / norm;
+		}
+		results.push_back({offset, strength, overlap});
+	}
+	return results;
+}
+
+DataOffsetFinder::result_t DataOffsetFinder::best(const result_vec_t& results)
+{
+	if(results.empty()) {
+		throw std::invalid_argument("No data offsets evaluated");
+	}
+	return *std::max_element(results.begin(), results.end(),
+	                         [](const result_t& a, const result_t& b) { return a.strength < b.strength; });
+}
+
+DataOffsetFinder::result_vec_t DataOffsetFinder::ranked(result_vec_t results)
+{
+	std::stable_sort(results.begin(), results.end(),
+	                 [](const result_t& a, const result_t& b) { return a.strength > b.strength; });
+	return results;
+}
@@ -0,0 +1,306 @@
+#include "eventindex.h"
+#include "inputfile.h"
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cctype>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace core;
+
+namespace {
+
+/// Increase when the index file layout or a builder changes
+constexpr int index_version = 1;
+
+struct cached_index_t
+{
+	std::string fingerprint;
+	std::shared_ptr<const EventIndex> index;
+};
+
+std::mutex& cacheMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+std::map<std::string, cached_index_t>& cache()
+{
+	static std::map<std::string, cached_index_t> c;
+	return c;
+}
+
+/// Size and modification time, changes if the file is rewritten
+std::string fingerprint(const std::string& filename)
+{
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0) {
+		return "missing";
+	}
+	std::ostringstream sstr;
+	sstr << st.st_size << ":" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+	return sstr.str();
+}
+
+template<typename T>
+void writeValue(std::ostream& out, const T& value)
+{
+	out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+void readValue(std::istream& in, T& value)
+{
+	in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+/// Recursive descent parser of filter expressions
+class FilterParser
+{
+public:
+	FilterParser(const std::string& expression) : _expr(expression), _pos(0) {}
+
+	EventIndex::filter_t parse()
+	{
+		auto filter = parseOr();
+		skipSpace();
+		if(_pos != _expr.size()) {
+			error("unexpected '" + _expr.substr(_pos) + "'");
+		}
+		return filter;
+	}
+
+private:
+	EventIndex::filter_t parseOr()
+	{
+		auto left = parseAnd();
+		while(accept("||")) {
+			auto right = parseAnd();
+			left = [left, right](const EventIndex::summary_t& evt) { return left(evt) || right(evt); };
+		}
+		return left;
+	}
+
+	EventIndex::filter_t parseAnd()
+	{
+		auto left = parseComparison();
+		while(accept("&&")) {
+			auto right = parseComparison();
+			left = [left, right](const EventIndex::summary_t& evt) { return left(evt) && right(evt); };
+		}
+		return left;
+	}
+
+	EventIndex::filter_t parseComparison()
+	{
+		skipSpace();
+		size_t start = _pos;
+		while(_pos < _expr.size() && std::isalpha(_expr[_pos])) {
+			++_pos;
+		}
+		auto name = _expr.substr(start, _pos - start);
+		std::function<long long(const EventIndex::summary_t&)> field;
+		if(name == "tracks") {
+			field = [](const EventIndex::summary_t& evt) { return (long long)evt.tracks; };
+		} else if(name == "hits") {
+			field = [](const EventIndex::summary_t& evt) { return (long long)evt.hits; };
+		} else if(name == "bx") {
+			field = [](const EventIndex::summary_t& evt) { return (long long)evt.bunchCrossings; };
+		} else {
+			error("expected tracks, hits or bx");
+		}
+		std::function<bool(long long, long long)> op;
+		// two-character operators first, so "<=" is not read as "<"
+		if(accept("==")) {
+			op = [](long long a, long long b) { return a == b; };
+		} else if(accept("!=")) {
+			op = [](long long a, long long b) { return a != b; };
+		} else if(accept("<=")) {
+			op = [](long long a, long long b) { return a <= b; };
+		} else if(accept(">=")) {
+			op = [](long long a, long long b) { return a >= b; };
+		} else if(accept("<")) {
+			op = [](long long a, long long b) { return a < b; };
+		} else if(accept(">")) {
+			op = [](long long a, long long b) { return a > b; };
+		} else {
+			error("expected comparison operator");
+		}
+		skipSpace();
+		start = _pos;
+		if(_pos < _expr.size() && _expr[_pos] == '-') {
+			++_pos;
+		}
+		while(_pos < _expr.size() && std::isdigit(_expr[_pos])) {
+			++_pos;
+		}
+		if(_pos == start || _expr[_pos - 1] == '-') {
+			error("expected integer");
+		}
+		long long value = std::stoll(_expr.substr(start, _pos - start));
+		return [field, op, value](const EventIndex::summary_t& evt) { return op(field(evt), value); };
+	}
+
+	void skipSpace()
+	{
+		while(_pos < _expr.size() && std::isspace(_expr[_pos])) {
+			++_pos;
+		}
+	}
+
+	bool accept(const std::string& token)
+	{
+		skipSpace();
+		if(_expr.compare(_pos, token.size(), token) == 0) {
+			_pos += token.size();
+			return true;
+		}
+		return false;
+	}
+
+	void error(const std::string& message) const
+	{
+		std::ostringstream sstr;
+		sstr << "Invalid event filter '" << _expr << "' at position " << _pos << ": " << message;
+		throw std::invalid_argument(sstr.str());
+	}
+
+	std::string _expr;
+	size_t _pos;
+};
+
+} // namespace
+
+std::shared_ptr<const EventIndex> EventIndex::get(const std::string& type, const std::string& filename,
+                                                  const builder_t& build)
+{
+	auto key = type + "\t" + filename;
+	auto print = fingerprint(filename);
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex());
+		auto it = cache().find(key);
+		if(it != cache().end() && it->second.fingerprint == print) {
+			return it->second.index;
+		}
+	}
+	std::ostringstream header;
+	header << "evidx " << index_version << " " << type << " " << print;
+	std::vector<entry_t> entries;
+	auto indexFile = filename + ".evidx";
+	if(!load(indexFile, header.str(), entries)) {
+		InputFile fin;
+		fin.exceptions(std::ios_base::failbit);
+		fin.open(filename);
+		fin.exceptions(std::ios_base::goodbit);
+		build(fin, entries);
+		save(indexFile, header.str(), entries);
+	}
+	std::shared_ptr<const EventIndex> index(new EventIndex(std::move(entries)));
+	std::lock_guard<std::mutex> lock(cacheMutex());
+	cache()[key] = {print, index};
+	return index;
+}
+
+void EventIndex::clear()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex());
+	cache().clear();
+}
+
+void EventIndex::select(const EventIndex& pixels, const EventIndex& tracks, int dataOffset,
+                        const filter_t& filter, selection_t& pixelSelection, selection_t& trackSelection)
+{
+	pixelSelection.clear();
+	trackSelection.clear();
+	auto track = tracks._entries.begin();
+	for(const auto& pixel: pixels._entries) {
+		while(track != tracks._entries.end() && track->eventNumber < pixel.eventNumber + dataOffset) {
+			++track;
+		}
+		bool matched = track != tracks._entries.end() && track->eventNumber == pixel.eventNumber + dataOffset;
+		summary_t summary {pixel.eventNumber, matched ? track->count : 0, pixel.count, pixel.bunchCrossings};
+		if(!filter(summary)) {
+			continue;
+		}
+		pixelSelection.push_back(pixel);
+		if(matched) {
+			trackSelection.push_back(*track);
+		}
+	}
+}
+
+void EventIndex::keep(selection_t& pixelSelection, selection_t& trackSelection, int dataOffset,
+                      const std::vector<size_t>& positions)
+{
+	selection_t pixels;
+	selection_t tracks;
+	pixels.reserve(positions.size());
+	auto track = trackSelection.begin();
+	for(auto pos: positions) {
+		const auto& pixel = pixelSelection[pos];
+		pixels.push_back(pixel);
+		while(track != trackSelection.end() && track->eventNumber < pixel.eventNumber + dataOffset) {
+			++track;
+		}
+		if(track != trackSelection.end() && track->eventNumber == pixel.eventNumber + dataOffset) {
+			tracks.push_back(*track);
+		}
+	}
+	pixelSelection.swap(pixels);
+	trackSelection.swap(tracks);
+}
+
+EventIndex::filter_t EventIndex::parseFilter(const std::string& expression)
+{
+	return FilterParser(expression).parse();
+}
+
+bool EventIndex::load(const std::string& indexFile, const std::string& header, std::vector<entry_t>& entries)
+{
+	std::ifstream fin(indexFile, std::ios_base::binary);
+	std::string line;
+	if(!std::getline(fin, line) || line != header) {
+		return false;
+	}
+	uint64_t size = 0;
+	readValue(fin, size);
+	entries.resize(size);
+	for(auto& entry: entries) {
+		readValue(fin, entry.eventNumber);
+		readValue(fin, entry.count);
+		readValue(fin, entry.bunchCrossings);
+		readValue(fin, entry.offset);
+	}
+	if(!fin.good()) {
+		entries.clear();
+		return false;
+	}
+	return true;
+}
+
+void EventIndex::save(const std::string& indexFile, const std::string& header, const std::vector<entry_t>& entries)
+{
+	// written to a temporary file first, so concurrent readers never see a partial index
+	auto tmpFile = indexFile + ".tmp" + std::to_string(getpid());
+	std::ofstream fout(tmpFile, std::ios_base::binary);
+	if(!fout.good()) {
+		return;
+	}
+	fout << header << "\n";
+	writeValue(fout, (uint64_t)entries.size());
+	for(const auto& entry: entries) {
+		writeValue(fout, entry.eventNumber);
+		writeValue(fout, entry.count);
+		writeValue(fout, entry.bunchCrossings);
+		writeValue(fout, entry.offset);
+	}
+	fout.close();
+	if(fout.fail() || std::rename(tmpFile.c_str(), indexFile.c_str()) != 0) {
+		std::remove(tmpFile.c_str());
+	}
+}
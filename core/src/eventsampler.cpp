@@ -0,0 +1,53 @@
+#include "eventsampler.h"
+#include <set>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace core;
+
+std::vector<size_t> EventSampler::draw(size_t count, size_t size)
+{
+	std::vector<size_t> positions;
+	if(size >= count || _mode == SM_FIRST) {
+		size = std::min(size, count);
+		positions.reserve(size);
+		for(size_t i = 0; i < size; ++i) {
+			positions.push_back(i);
+		}
+		return positions;
+	}
+	positions.reserve(size);
+	if(_mode == SM_STRATIFIED) {
+		for(size_t stratum = 0; stratum < size; ++stratum) {
+			// bounds are computed in this order to avoid overflow of stratum * count
+			size_t begin = stratum * (count / size) + stratum * (count % size) / size;
+			size_t end = (stratum + 1) * (count / size) + (stratum + 1) * (count % size) / size;
+			std::uniform_int_distribution<size_t> dist(begin, end - 1);
+			positions.push_back(dist(_random));
+		}
+		return positions;
+	}
+	// Floyd's algorithm, size distinct positions with size random numbers
+	std::set<size_t> drawn;
+	for(size_t upper = count - size; upper < count; ++upper) {
+		std::uniform_int_distribution<size_t> dist(0, upper);
+		size_t pos = dist(_random);
+		if(!drawn.insert(pos).second) {
+			drawn.insert(upper);
+		}
+	}
+	positions.assign(drawn.begin(), drawn.end());
+	return positions;
+}
+
+EventSampler::sampling_mode_t EventSampler::parseMode(const std::string& name)
+{
+	if(name == "first") {
+		return SM_FIRST;
+	} else if(name == "uniform") {
+		return SM_UNIFORM;
+	} else if(name == "stratified") {
+		return SM_STRATIFIED;
+	}
+	throw std::invalid_argument("Unknown sampling mode '" + name + "', expected first, uniform or stratified");
+}
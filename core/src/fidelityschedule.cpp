@@ -0,0 +1,58 @@
+#include "fidelityschedule.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace core;
+
+constexpr size_t FidelitySchedule::patience;
+constexpr double FidelitySchedule::min_improvement;
+
+FidelitySchedule::FidelitySchedule(size_t total, size_t minSize, double initialSigma) :
+ _total(total), _minSize(minSize), _size(total), _initialSigma(initialSigma),
+ _bestFitness(std::numeric_limits<double>::infinity()), _stagnation(0)
+{
+	if(minSize > 0) {
+		_size = std::min(minSize, total);
+	}
+}
+
+void FidelitySchedule::update(double sigma, double bestFitness)
+{
+	if(isFull()) {
+		return;
+	}
+	if(std::isinf(_bestFitness) || bestFitness < _bestFitness - std::abs(_bestFitness) * min_improvement) {
+		_bestFitness = bestFitness;
+		_stagnation = 0;
+	} else if(++_stagnation >= patience) {
+		grow();
+		return;
+	}
+	if(sigma > 0 && sigma < _initialSigma) {
+		double ratio = _initialSigma / sigma;
+		double size = _minSize * ratio * ratio;
+		// no overflow of size_t for tiny step sizes
+		setSize(size < _total ? static_cast<size_t>(size) : _total);
+	}
+}
+
+bool FidelitySchedule::grow()
+{
+	if(isFull()) {
+		return false;
+	}
+	setSize(std::min(2 * _size, _total));
+	return true;
+}
+
+void FidelitySchedule::setSize(size_t size)
+{
+	if(size <= _size) {
+		return;
+	}
+	_size = size;
+	// the fitness of a larger subset is not comparable to the best fitness seen before
+	_bestFitness = std::numeric_limits<double>::infinity();
+	_stagnation = 0;
+}
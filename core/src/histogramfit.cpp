@@ -1,4 +1,5 @@
 #include "histogramfit.h"
+#include "instrumentation.h"
 #include <iostream>
 #include <cassert>
 #include <TMath.h>
@@ -42,6 +43,7 @@ size_t HistogramFit::getNumDimensions() const
 
 void HistogramFit::fit()
 {
+	CORE_TIMED_SCOPE("HistogramFit::fit");
 	size_t nbins = _hist->GetNbinsX() * _hist->GetNbinsY() * _hist->GetNbinsZ();
 	_histX.clear();
 	_histY.clear();
@@ -0,0 +1,515 @@
+#include "inputfile.h"
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <future>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace core;
+
+namespace {
+
+/// Size of the blocks of sequentially decompressed data
+constexpr size_t block_size = 1 << 20;
+/// Number of decompressed blocks the helper thread may be ahead of the reader
+constexpr size_t max_queued_blocks = 8;
+/// A random access file is decompressed from a new position if a seek skips more than this
+constexpr uint64_t restart_distance = 4 * block_size;
+
+struct block_t
+{
+	/// Position of the first byte in the decompressed data
+	uint64_t start;
+	std::vector<char> data;
+};
+
+/** \brief Stream buffer serving blocks decompressed by a helper thread
+ *
+ * The thread is started on the first read. A seek inside the current block only moves the read pointer, a
+ * seek forward skips blocks and a seek backwards starts a new helper thread.
+ */
+class DecompressBuf : public std::streambuf
+{
+public:
+	DecompressBuf(const std::string& filename) :
+	 _filename(filename), _current{0, {}}, _running(false), _finished(false), _stopping(false)
+	{
+	}
+
+protected:
+	/** \brief Decompress the file on the helper thread
+	 *
+	 * Pushes the blocks in order, starting with the block containing pos or any block before it. Stops when
+	 * push() returns false.
+	 * \throw std::runtime_error Read or decompression error
+	 */
+	virtual void produce(uint64_t pos) = 0;
+
+	/// Whether a distant position is reached faster by a new produce() than by decompressing up to it
+	virtual bool randomAccess() const { return false; }
+
+	/// Called by produce(), returns false if the reader does not need more blocks
+	bool push(block_t&& block)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_popped.wait(lock, [this]() { return _stopping || _queue.size() < max_queued_blocks; });
+		if(_stopping) {
+			return false;
+		}
+		_queue.push_back(std::move(block));
+		_pushed.notify_one();
+		return true;
+	}
+
+	/// Stop the helper thread, must be called by the destructor of the sub-class
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_popped.notify_all();
+		if(_thread.joinable()) {
+			_thread.join();
+		}
+		_queue.clear();
+		_running = false;
+		_finished = false;
+		_stopping = false;
+		_error.clear();
+	}
+
+	virtual int_type underflow()
+	{
+		while(gptr() == egptr()) {
+			if(!nextBlock()) {
+				return traits_type::eof();
+			}
+		}
+		return traits_type::to_int_type(*gptr());
+	}
+
+	virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		if(dir == std::ios_base::cur) {
+			if(off == 0) {
+				return pos_type(position());
+			}
+			return seekpos(pos_type(position() + off), which);
+		} else if(dir == std::ios_base::beg) {
+			return seekpos(pos_type(off), which);
+		}
+		// the size of the decompressed data is not known
+		return pos_type(off_type(-1));
+	}
+
+	virtual pos_type seekpos(pos_type sp, std::ios_base::openmode which)
+	{
+		if(!(which & std::ios_base::in) || off_type(sp) < 0) {
+			return pos_type(off_type(-1));
+		}
+		uint64_t pos = off_type(sp);
+		uint64_t end = _current.start + _current.data.size();
+		if(pos >= _current.start && pos <= end && eback()) {
+			setg(eback(), eback() + (pos - _current.start), egptr());
+			return sp;
+		}
+		if(_running && (pos < end || (randomAccess() && pos > queuedEnd() + restart_distance))) {
+			stop();
+		}
+		// nextBlock() skips the blocks before pos
+		_current.start = pos;
+		_current.data.clear();
+		setg(nullptr, nullptr, nullptr);
+		return sp;
+	}
+
+	std::string _filename;
+
+private:
+	uint64_t position() const
+	{
+		return _current.start + (gptr() - eback());
+	}
+
+	uint64_t queuedEnd()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if(_queue.empty()) {
+			return _current.start + _current.data.size();
+		}
+		return _queue.back().start + _queue.back().data.size();
+	}
+
+	void start(uint64_t pos)
+	{
+		_running = true;
+		_thread = std::thread([this, pos]() {
+			std::string error;
+			try {
+				produce(pos);
+			} catch(std::exception& e) {
+				error = e.what();
+				std::cerr << "Cannot read " << _filename << ": " << error << std::endl;
+			}
+			std::lock_guard<std::mutex> lock(_mutex);
+			_error = error;
+			_finished = true;
+			_pushed.notify_one();
+		});
+	}
+
+	/// Make the block following the current one the current block
+	bool nextBlock()
+	{
+		uint64_t pos = _current.start + _current.data.size();
+		if(!_running) {
+			start(pos);
+		}
+		std::unique_lock<std::mutex> lock(_mutex);
+		while(true) {
+			_pushed.wait(lock, [this]() { return !_queue.empty() || _finished; });
+			if(_queue.empty()) {
+				if(!_error.empty()) {
+					throw std::ios_base::failure(_filename + ": " + _error);
+				}
+				return false;
+			}
+			block_t block = std::move(_queue.front());
+			_queue.pop_front();
+			_popped.notify_one();
+			if(block.start + block.data.size() <= pos) {
+				continue;
+			}
+			_current = std::move(block);
+			char* data = _current.data.data();
+			setg(data, data + (pos - _current.start), data + _current.data.size());
+			return true;
+		}
+	}
+
+	block_t _current;
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _pushed;
+	std::condition_variable _popped;
+	std::deque<block_t> _queue;
+	bool _running;
+	bool _finished;
+	bool _stopping;
+	std::string _error;
+};
+
+/// gzip files, also with several members, decompressed sequentially
+class GzipBuf : public DecompressBuf
+{
+public:
+	GzipBuf(const std::string& filename) : DecompressBuf(filename) {}
+	virtual ~GzipBuf() { stop(); }
+
+protected:
+	virtual void produce(uint64_t)
+	{
+		// a gzip stream can only be decompressed from the beginning
+		gzFile file = gzopen(_filename.c_str(), "rb");
+		if(!file) {
+			throw std::runtime_error("cannot open file");
+		}
+		gzbuffer(file, 1 << 17);
+		uint64_t start = 0;
+		while(true) {
+			block_t block {start, std::vector<char>(block_size)};
+			int len = gzread(file, block.data.data(), block_size);
+			if(len < 0) {
+				int err;
+				std::string message = gzerror(file, &err);
+				gzclose(file);
+				throw std::runtime_error(message);
+			}
+			if(len == 0) {
+				break;
+			}
+			block.data.resize(len);
+			start += len;
+			if(!push(std::move(block))) {
+				break;
+			}
+		}
+		gzclose(file);
+	}
+};
+
+#ifdef HAVE_ZSTD
+/** \brief zstd files, frames of the seekable format are decompressed in parallel
+ *
+ * The seek table of the seekable format is a skippable frame at the end of the file listing the compressed
+ * and decompressed size of every frame. Files without seek table are decompressed sequentially.
+ */
+class ZstdBuf : public DecompressBuf
+{
+public:
+	ZstdBuf(const std::string& filename) : DecompressBuf(filename)
+	{
+		readSeekTable();
+	}
+	virtual ~ZstdBuf() { stop(); }
+
+protected:
+	virtual bool randomAccess() const { return !_frames.empty(); }
+
+	virtual void produce(uint64_t pos)
+	{
+		if(_frames.empty()) {
+			produceStream();
+		} else {
+			produceFrames(pos);
+		}
+	}
+
+private:
+	struct frame_t
+	{
+		/// Position in the compressed file
+		uint64_t offset;
+		uint32_t compressedSize;
+		/// Position in the decompressed data
+		uint64_t start;
+		uint32_t size;
+	};
+
+	static uint32_t readLE32(const unsigned char* data)
+	{
+		return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+	}
+
+	void readSeekTable()
+	{
+		static constexpr uint32_t seekable_magic = 0x8F92EAB1;
+		static constexpr uint32_t skippable_magic = 0x184D2A5E;
+		static constexpr size_t footer_size = 9;
+		std::ifstream fin(_filename, std::ios_base::binary);
+		unsigned char footer[footer_size];
+		if(!fin.seekg(-(off_type)footer_size, std::ios_base::end) ||
+		   !fin.read(reinterpret_cast<char*>(footer), footer_size) ||
+		   readLE32(footer + 5) != seekable_magic) {
+			return;
+		}
+		uint64_t fileSize = fin.tellg();
+		uint32_t numFrames = readLE32(footer);
+		size_t entrySize = (footer[4] & 0x80) ? 12 : 8;
+		uint64_t tableSize = numFrames * entrySize + footer_size;
+		if(tableSize + 8 > fileSize) {
+			return;
+		}
+		std::vector<unsigned char> table(tableSize + 8);
+		fin.seekg(fileSize - table.size());
+		if(!fin.read(reinterpret_cast<char*>(table.data()), table.size()) ||
+		   readLE32(table.data()) != skippable_magic || readLE32(table.data() + 4) != tableSize) {
+			return;
+		}
+		uint64_t offset = 0;
+		uint64_t start = 0;
+		for(uint32_t i = 0; i < numFrames; ++i) {
+			const unsigned char* entry = table.data() + 8 + i * entrySize;
+			frame_t frame {offset, readLE32(entry), start, readLE32(entry + 4)};
+			offset += frame.compressedSize;
+			start += frame.size;
+			_frames.push_back(frame);
+		}
+	}
+
+	void produceFrames(uint64_t pos)
+	{
+		auto first = std::upper_bound(_frames.begin(), _frames.end(), pos,
+			[](uint64_t p, const frame_t& frame) { return p < frame.start + frame.size; });
+		int fd = ::open(_filename.c_str(), O_RDONLY);
+		if(fd < 0) {
+			throw std::runtime_error("cannot open file");
+		}
+		auto decompress = [fd](const frame_t& frame) {
+			std::vector<char> compressed(frame.compressedSize);
+			if(pread(fd, compressed.data(), compressed.size(), frame.offset) != (ssize_t)compressed.size()) {
+				throw std::runtime_error("cannot read frame");
+			}
+			block_t block {frame.start, std::vector<char>(frame.size)};
+			size_t ret = ZSTD_decompress(block.data.data(), block.data.size(), compressed.data(), compressed.size());
+			if(ZSTD_isError(ret)) {
+				throw std::runtime_error(ZSTD_getErrorName(ret));
+			} else if(ret != frame.size) {
+				throw std::runtime_error("frame size does not match the seek table");
+			}
+			return block;
+		};
+		size_t numThreads = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+		std::deque<std::future<block_t>> running;
+		try {
+			auto next = first;
+			while(next != _frames.end() || !running.empty()) {
+				while(running.size() < numThreads && next != _frames.end()) {
+					running.push_back(std::async(std::launch::async, decompress, *next++));
+				}
+				auto block = running.front().get();
+				running.pop_front();
+				if(!push(std::move(block))) {
+					break;
+				}
+			}
+		} catch(...) {
+			running.clear();
+			::close(fd);
+			throw;
+		}
+		// waits for frames decompressed ahead
+		running.clear();
+		::close(fd);
+	}
+
+	void produceStream()
+	{
+		std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(_filename.c_str(), "rb"), &fclose);
+		if(!file) {
+			throw std::runtime_error("cannot open file");
+		}
+		std::unique_ptr<ZSTD_DStream, size_t(*)(ZSTD_DStream*)> stream(ZSTD_createDStream(), &ZSTD_freeDStream);
+		ZSTD_initDStream(stream.get());
+		std::vector<char> in(ZSTD_DStreamInSize());
+		uint64_t start = 0;
+		block_t block {start, std::vector<char>(block_size)};
+		size_t filled = 0;
+		size_t len;
+		while((len = fread(in.data(), 1, in.size(), file.get())) > 0) {
+			ZSTD_inBuffer input {in.data(), len, 0};
+			bool full;
+			do {
+				ZSTD_outBuffer output {block.data.data(), block.data.size(), filled};
+				size_t ret = ZSTD_decompressStream(stream.get(), &output, &input);
+				if(ZSTD_isError(ret)) {
+					throw std::runtime_error(ZSTD_getErrorName(ret));
+				}
+				filled = output.pos;
+				full = filled == block.data.size();
+				if(full) {
+					start += filled;
+					if(!push(std::move(block))) {
+						return;
+					}
+					block = block_t{start, std::vector<char>(block_size)};
+					filled = 0;
+				}
+			} while(input.pos < input.size || full);
+		}
+		if(ferror(file.get())) {
+			throw std::runtime_error("cannot read file");
+		}
+		block.data.resize(filled);
+		push(std::move(block));
+	}
+
+	std::vector<frame_t> _frames;
+};
+#endif
+
+} // namespace
+
+InputFile::InputFile() :
+ std::istream(nullptr)
+{
+	close();
+}
+
+InputFile::InputFile(const std::string& filename) :
+ std::istream(nullptr)
+{
+	open(filename);
+}
+
+InputFile::InputFile(InputFile&& other) :
+ std::istream(std::move(other)), _buf(std::move(other._buf))
+{
+	set_rdbuf(_buf.get());
+	other.set_rdbuf(nullptr);
+}
+
+InputFile& InputFile::operator=(InputFile&& other)
+{
+	close();
+	std::istream::operator=(std::move(other));
+	_buf = std::move(other._buf);
+	set_rdbuf(_buf.get());
+	other.set_rdbuf(nullptr);
+	return *this;
+}
+
+InputFile::~InputFile()
+{
+}
+
+void InputFile::open(const std::string& filename)
+{
+	close();
+	std::unique_ptr<std::streambuf> buf;
+	auto compression = getCompression(filename);
+	if(compression == CT_NONE) {
+		std::unique_ptr<std::filebuf> file(new std::filebuf);
+		if(file->open(filename, std::ios_base::in)) {
+			buf = std::move(file);
+		}
+	} else if(std::ifstream(filename).is_open()) {
+		if(compression == CT_GZIP) {
+			buf.reset(new GzipBuf(filename));
+		} else {
+#ifdef HAVE_ZSTD
+			buf.reset(new ZstdBuf(filename));
+#else
+			std::cerr << "Cannot read " << filename << ": zstd support is not enabled (ENABLE_ZSTD)" << std::endl;
+#endif
+		}
+	}
+	if(!buf) {
+		setstate(std::ios_base::failbit);
+		return;
+	}
+	_buf = std::move(buf);
+	rdbuf(_buf.get());
+}
+
+void InputFile::close()
+{
+	// like a closed std::ifstream, the stream stays usable with a buffer without file
+	std::unique_ptr<std::streambuf> buf(new std::filebuf);
+	rdbuf(buf.get());
+	_buf = std::move(buf);
+}
+
+bool InputFile::is_open() const
+{
+	auto file = dynamic_cast<std::filebuf*>(_buf.get());
+	return _buf && (!file || file->is_open());
+}
+
+InputFile::compression_t InputFile::getCompression(const std::string& filename)
+{
+	auto endsWith = [&filename](const std::string& suffix) {
+		return filename.size() >= suffix.size() &&
+		       filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	if(endsWith(".gz")) {
+		return CT_GZIP;
+	} else if(endsWith(".zst")) {
+		return CT_ZSTD;
+	}
+	return CT_NONE;
+}
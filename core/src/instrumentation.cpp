@@ -0,0 +1,225 @@
+#include "instrumentation.h"
+#include <mutex>
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <sys/resource.h>
+
+using namespace core;
+
+std::atomic<bool> Instrumentation::_enabled(false);
+
+struct Instrumentation::buffer_t {
+	buffer_t();
+	~buffer_t();
+	std::array<counter_t, max_stages> counters;
+};
+
+namespace {
+
+/// Stage names and the buffers of all threads
+struct registry_t {
+	std::mutex mutex;
+	std::vector<std::string> names;
+	std::map<std::string, size_t> index;
+	std::vector<Instrumentation::buffer_t*> buffers;
+	/// Statistics of finished threads
+	std::array<uint64_t, Instrumentation::max_stages> calls;
+	std::array<uint64_t, Instrumentation::max_stages> nanoseconds;
+	std::array<uint64_t, Instrumentation::max_stages> count;
+	registry_t() { calls.fill(0); nanoseconds.fill(0); count.fill(0); }
+};
+
+registry_t& registry()
+{
+	static registry_t reg;
+	return reg;
+}
+
+/// Increment of a counter only written by the owning thread, avoids a locked read-modify-write
+inline void increment(std::atomic<uint64_t>& counter, uint64_t n)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+std::string jsonEscape(const std::string& str)
+{
+	std::string escaped;
+	for(char ch: str) {
+		if(ch == '"' || ch == '\\') {
+			escaped += '\\';
+		}
+		escaped += ch;
+	}
+	return escaped;
+}
+
+} // namespace
+
+Instrumentation::buffer_t::buffer_t()
+{
+	for(auto& counter: counters) {
+		counter.calls = 0;
+		counter.nanoseconds = 0;
+		counter.count = 0;
+	}
+	auto& reg = registry();
+	std::lock_guard<std::mutex> lk(reg.mutex);
+	reg.buffers.push_back(this);
+}
+
+Instrumentation::buffer_t::~buffer_t()
+{
+	auto& reg = registry();
+	std::lock_guard<std::mutex> lk(reg.mutex);
+	for(size_t i = 0; i < max_stages; ++i) {
+		reg.calls[i] += counters[i].calls;
+		reg.nanoseconds[i] += counters[i].nanoseconds;
+		reg.count[i] += counters[i].count;
+	}
+	reg.buffers.erase(std::remove(reg.buffers.begin(), reg.buffers.end(), this), reg.buffers.end());
+}
+
+Instrumentation::buffer_t& Instrumentation::buffer()
+{
+	thread_local buffer_t buf;
+	return buf;
+}
+
+size_t Instrumentation::stage(const std::string& name)
+{
+	auto& reg = registry();
+	std::lock_guard<std::mutex> lk(reg.mutex);
+	auto it = reg.index.find(name);
+	if(it != reg.index.end()) {
+		return it->second;
+	}
+	if(reg.names.size() >= max_stages) {
+		throw std::length_error("Too many instrumentation stages");
+	}
+	reg.index[name] = reg.names.size();
+	reg.names.push_back(name);
+	return reg.names.size() - 1;
+}
+
+void Instrumentation::add(size_t stage, uint64_t nanoseconds)
+{
+	auto& counter = buffer().counters[stage];
+	increment(counter.calls, 1);
+	increment(counter.nanoseconds, nanoseconds);
+}
+
+void Instrumentation::count(size_t stage, uint64_t n)
+{
+	if(isEnabled()) {
+		increment(buffer().counters[stage].count, n);
+	}
+}
+
+std::vector<Instrumentation::stage_t> Instrumentation::collect()
+{
+	auto& reg = registry();
+	std::lock_guard<std::mutex> lk(reg.mutex);
+	std::vector<stage_t> stages;
+	for(size_t i = 0; i < reg.names.size(); ++i) {
+		stage_t stage { reg.names[i], reg.calls[i], reg.nanoseconds[i], reg.count[i] };
+		for(const auto& buf: reg.buffers) {
+			stage.calls += buf->counters[i].calls.load(std::memory_order_relaxed);
+			stage.nanoseconds += buf->counters[i].nanoseconds.load(std::memory_order_relaxed);
+			stage.count += buf->counters[i].count.load(std::memory_order_relaxed);
+		}
+		if(stage.calls || stage.count) {
+			stages.push_back(stage);
+		}
+	}
+	return stages;
+}
+
+void Instrumentation::reset()
+{
+	auto& reg = registry();
+	std::lock_guard<std::mutex> lk(reg.mutex);
+	reg.calls.fill(0);
+	reg.nanoseconds.fill(0);
+	reg.count.fill(0);
+	for(const auto& buf: reg.buffers) {
+		for(auto& counter: buf->counters) {
+			counter.calls = 0;
+			counter.nanoseconds = 0;
+			counter.count = 0;
+		}
+	}
+}
+
+long Instrumentation::peakRss()
+{
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+	// kB on Linux
+	return usage.ru_maxrss;
+}
+
+std::string Instrumentation::formatTable(const report_t& report)
+{
+	std::ostringstream sstr;
+	sstr << "Timing report for " << report.analysis << ": "
+	     << report.events << " events in " << std::fixed << std::setprecision(2) << report.wallSeconds << " s";
+	if(report.wallSeconds > 0) {
+		sstr << ", " << std::setprecision(0) << report.events / report.wallSeconds << " events/s";
+	}
+	sstr << ", peak RSS " << report.peakRss / 1024 << " MB\n";
+	size_t width = 5;
+	for(const auto& stage: report.stages) {
+		width = std::max(width, stage.name.size());
+	}
+	sstr << std::left << std::setw(width) << "Stage" << std::right
+	     << std::setw(12) << "Calls"
+	     << std::setw(12) << "Total s"
+	     << std::setw(8) << "Wall%"
+	     << std::setw(12) << "Mean µs"
+	     << std::setw(12) << "Count" << "\n";
+	for(const auto& stage: report.stages) {
+		double seconds = stage.nanoseconds * 1e-9;
+		sstr << std::left << std::setw(width) << stage.name << std::right
+		     << std::setw(12) << stage.calls
+		     << std::setw(12) << std::setprecision(3) << seconds
+		     << std::setw(8) << std::setprecision(1)
+		     << (report.wallSeconds > 0 ? 100 * seconds / report.wallSeconds : 0.0)
+		     << std::setw(12) << std::setprecision(3)
+		     << (stage.calls ? stage.nanoseconds * 1e-3 / stage.calls : 0.0)
+		     << std::setw(12) << stage.count << "\n";
+	}
+	return sstr.str();
+}
+
+std::string Instrumentation::formatJson(const report_t& report)
+{
+	std::ostringstream sstr;
+	sstr << std::setprecision(9);
+	sstr << "{\n"
+	     << "  \"analysis\": \"" << jsonEscape(report.analysis) << "\",\n"
+	     << "  \"runs\": [";
+	for(size_t i = 0; i < report.runs.size(); ++i) {
+		sstr << (i ? ", " : "") << report.runs[i];
+	}
+	sstr << "],\n"
+	     << "  \"wall_seconds\": " << report.wallSeconds << ",\n"
+	     << "  \"events\": " << report.events << ",\n"
+	     << "  \"events_per_second\": " << (report.wallSeconds > 0 ? report.events / report.wallSeconds : 0.0) << ",\n"
+	     << "  \"peak_rss_kb\": " << report.peakRss << ",\n"
+	     << "  \"stages\": [";
+	for(size_t i = 0; i < report.stages.size(); ++i) {
+		const auto& stage = report.stages[i];
+		sstr << (i ? "," : "") << "\n    {"
+		     << "\"name\": \"" << jsonEscape(stage.name) << "\", "
+		     << "\"calls\": " << stage.calls << ", "
+		     << "\"seconds\": " << stage.nanoseconds * 1e-9 << ", "
+		     << "\"count\": " << stage.count << "}";
+	}
+	sstr << "\n  ]\n}\n";
+	return sstr.str();
+}
@@ -90,6 +90,19 @@ void MergedAnalysis::run(const po::variables_map& vm)
 	finalize();
 }
 
+std::vector<std::string> MergedAnalysis::getInputFiles(const po::variables_map& vm)
+{
+	std::vector<std::string> files;
+	for(auto runId: vm["run"].as<std::vector<int>>()) {
+		_config.setVariable("MpaRun", getMpaIdPadded(runId));
+		files.push_back(_config.getVariable("testbeam_data"));
+	}
+	if(vm.count("runlist")) {
+		files.push_back(vm["runlist"].as<std::string>());
+	}
+	return files;
+}
+
 bool MergedAnalysis::multirunConsistencyCheck(const std::string& argv0, const po::variables_map& vm)
 {
 	return true;
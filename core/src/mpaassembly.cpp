@@ -0,0 +1,116 @@
+#include "mpaassembly.h"
+#include "cfgparse.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace core;
+
+constexpr int MpaAssembly::num_mpas;
+constexpr int MpaAssembly::num_pixels;
+
+MpaAssembly::MpaAssembly() :
+ _offset(0, 0, 0), _angles(0, 0, 0), _rotation(Eigen::Matrix3d::Identity())
+{
+	for(int i = 0; i < num_mpas; ++i) {
+		auto& chip = _chips[i];
+		chip.enabled = false;
+		chip.offset = Eigen::Vector3d(0, 0, 0);
+		chip.angles = Eigen::Vector3d(0, 0, 0);
+		chip.transform.setMpaIndex(i + 1);
+		updateTransform(chip);
+	}
+	_chips[1].enabled = true;
+	_enabled.push_back(2);
+}
+
+void MpaAssembly::setPose(const Eigen::Vector3d& offset, const Eigen::Vector3d& rotation)
+{
+	_offset = offset;
+	_angles = rotation;
+	_rotation = Eigen::AngleAxis<double>(rotation(0), Eigen::Vector3d::UnitX()) *
+	            Eigen::AngleAxis<double>(rotation(1), Eigen::Vector3d::UnitY()) *
+	            Eigen::AngleAxis<double>(rotation(2), Eigen::Vector3d::UnitZ());
+	for(auto& chip: _chips) {
+		updateTransform(chip);
+	}
+}
+
+void MpaAssembly::setChipPose(int mpaIdx, const Eigen::Vector3d& offset, const Eigen::Vector3d& rotation)
+{
+	checkIndex(mpaIdx);
+	auto& chip = _chips[mpaIdx - 1];
+	chip.offset = offset;
+	chip.angles = rotation;
+	updateTransform(chip);
+	if(!chip.enabled) {
+		chip.enabled = true;
+		_enabled.insert(std::upper_bound(_enabled.begin(), _enabled.end(), mpaIdx), mpaIdx);
+	}
+}
+
+void MpaAssembly::disableChip(int mpaIdx)
+{
+	checkIndex(mpaIdx);
+	_chips[mpaIdx - 1].enabled = false;
+	_enabled.erase(std::remove(_enabled.begin(), _enabled.end(), mpaIdx), _enabled.end());
+}
+
+void MpaAssembly::loadChipPoses(const CfgParse& config)
+{
+	auto readVector = [&config](const std::string& var) {
+		auto values = config.getVector<double>(var);
+		if(values.size() != 3) {
+			throw CfgParse::bad_cast(var, "3D vector", config.getVariable(var));
+		}
+		return Eigen::Vector3d(values[0], values[1], values[2]);
+	};
+	for(int mpaIdx = 1; mpaIdx <= num_mpas; ++mpaIdx) {
+		std::string prefix = "mpa_" + std::to_string(mpaIdx);
+		Eigen::Vector3d offset;
+		try {
+			offset = readVector(prefix + "_offset");
+		} catch(CfgParse::no_variable_error&) {
+			continue;
+		}
+		Eigen::Vector3d rotation(0, 0, 0);
+		try {
+			rotation = readVector(prefix + "_rotation") * M_PI / 180;
+		} catch(CfgParse::no_variable_error&) {
+		}
+		setChipPose(mpaIdx, offset, rotation);
+	}
+}
+
+bool MpaAssembly::isEnabled(int mpaIdx) const
+{
+	checkIndex(mpaIdx);
+	return _chips[mpaIdx - 1].enabled;
+}
+
+const MpaTransform& MpaAssembly::getTransform(int mpaIdx) const
+{
+	checkIndex(mpaIdx);
+	return _chips[mpaIdx - 1].transform;
+}
+
+void MpaAssembly::checkIndex(int mpaIdx)
+{
+	if(mpaIdx < 1 || mpaIdx > num_mpas) {
+		throw std::out_of_range("MPA index out of range");
+	}
+}
+
+void MpaAssembly::updateTransform(chip_t& chip)
+{
+	// world = R_assembly * (R_chip * local + offset_chip) + offset_assembly
+	Eigen::Vector3d angles = _angles;
+	if(!chip.angles.isZero()) {
+		Eigen::Matrix3d rotation = _rotation *
+		                           Eigen::AngleAxis<double>(chip.angles(0), Eigen::Vector3d::UnitX()) *
+		                           Eigen::AngleAxis<double>(chip.angles(1), Eigen::Vector3d::UnitY()) *
+		                           Eigen::AngleAxis<double>(chip.angles(2), Eigen::Vector3d::UnitZ());
+		angles = rotation.eulerAngles(0, 1, 2);
+	}
+	chip.transform.setRotation(angles);
+	chip.transform.setOffset(_rotation * chip.offset + _offset);
+}
@@ -1,5 +1,6 @@
 #include "mpahitgenerator.h"
 #include "mpatransform.h"
+#include "instrumentation.h"
 #include <deque>
 #include <algorithm>
 #include <iostream>
@@ -20,14 +21,13 @@ std::vector<Eigen::Vector3d> MpaHitGenerator::getCounterHits(run_data_t run, con
 	assert(MpaTransform::num_pixels == 48);
 	std::vector<Eigen::Vector3d> hits;
 	for(auto& mpa: run.mpaData) {
-		if(mpa.index != 2) continue;
+		if(mpa.index != transform.getMpaIndex()) continue;
 		auto& data = (*mpa.data)->counter.pixels;
 		for(size_t pixel = 0; pixel < 48; ++pixel) {
 			if(data[pixel] == 0) {
 				continue;
 			}
 			Eigen::Vector3d hit = transform.transform(pixel);
-			//Eigen::Vector3d hit = transform.transform(pixel, mpa.index);
 			hits.push_back(hit);
 		}
 	}
@@ -39,20 +39,61 @@ std::vector<Eigen::Vector2i> MpaHitGenerator::getCounterPixels(run_data_t run, c
 	assert(MpaTransform::num_pixels == 48);
 	std::vector<Eigen::Vector2i> hits;
 	for(auto& mpa: run.mpaData) {
-		if(mpa.index != 2) continue;
+		if(mpa.index != transform.getMpaIndex()) continue;
 		auto& data = (*mpa.data)->counter.pixels;
 		for(size_t pixel = 0; pixel < 48; ++pixel) {
 			if(data[pixel] == 0) {
 				continue;
 			}
-			Eigen::Vector2i hit = transform.translatePixelIndex(pixel);
-			//Eigen::Vector2i hit = transform.translatePixelIndex(pixel, mpa.index);
+			Eigen::Vector2i hit = transform.translatePixelIndex(pixel, mpa.index);
 			hits.push_back(hit);
 		}
 	}
 	return hits;
 }
 
+void MpaHitGenerator::getAssemblyHits(const run_data_t& run, const MpaAssembly& assembly, assembly_hits_t& hits)
+{
+	CORE_TIMED_SCOPE("MpaHitGenerator::getAssemblyHits");
+	constexpr size_t chipPixels = MpaTransform::num_pixels;
+	static_assert(sizeof(RippleCounter::pixels) == chipPixels * sizeof(UShort_t), "Unexpected MPA counter size");
+	hits.counters.fill(0);
+	for(size_t i = 0; i < hits.chips.size(); ++i) {
+		auto& chip = hits.chips[i];
+		chip.index = i + 1;
+		chip.pixels.clear();
+		chip.clusters.clear();
+		chip.clusterSizes.clear();
+		chip.globalClusters.clear();
+	}
+	for(const auto& mpa: run.mpaData) {
+		if(!assembly.isEnabled(mpa.index) || !*mpa.data) {
+			continue;
+		}
+		const auto& data = (*mpa.data)->counter.pixels;
+		std::copy(data, data + chipPixels, hits.counters.begin() + MpaAssembly::blockOffset(mpa.index));
+	}
+	// counters of absent chips are zero, so a single scan finds the pixels of all chips
+	static const MpaTransform layout;
+	for(size_t idx = 0; idx < hits.counters.size(); ++idx) {
+		if(hits.counters[idx] == 0) {
+			continue;
+		}
+		auto& chip = hits.chips[idx / chipPixels];
+		chip.pixels.push_back(layout.translatePixelIndex(idx % chipPixels, chip.index));
+	}
+	for(auto& chip: hits.chips) {
+		if(chip.pixels.empty()) {
+			continue;
+		}
+		chip.clusters = clusterize(chip.pixels, &chip.clusterSizes, nullptr);
+		const auto& transform = assembly.getTransform(chip.index);
+		for(const auto& cluster: chip.clusters) {
+			chip.globalClusters.push_back(transform.pixelCoordToGlobal(cluster));
+		}
+	}
+}
+
 std::vector<Eigen::Vector2d> MpaHitGenerator::getCounterClustersLocal(run_data_t run, MpaTransform transform,
                                                                       std::vector<int>* clusterSizes,
                                                                       std::vector<double>* clusterAreas)
@@ -77,6 +118,7 @@ std::vector<Eigen::Vector2d> MpaHitGenerator::clusterize(std::vector<Eigen::Vect
                                                          std::vector<int>* clusterSizes,
                                                          std::vector<double>* clusterAreas)
 {
+	CORE_TIMED_SCOPE("MpaHitGenerator::clusterize");
 //	std::cout << "\n\nCLUSTERIZE!" << std::endl;
 	std::vector<Eigen::Vector2d> clusters;
 	if(clusterSizes)
@@ -1,5 +1,6 @@
 
 #include "mpamemorystreamreader.h"
+#include "instrumentation.h"
 #include <cassert>
 #include <regex.h>
 #include <bitset>
@@ -12,7 +13,7 @@ MpaMemoryStreamReader::mpareader::mpareader(const std::string& filename, size_t
 {
 	open(seek);
 	if(seek == 0) {
-		next();
+		_empty = next();
 	}
 }
 
@@ -23,6 +24,7 @@ MpaMemoryStreamReader::mpareader::~mpareader()
 
 bool MpaMemoryStreamReader::mpareader::next()
 {
+	CORE_TIMED_SCOPE("MpaMemoryStreamReader::next");
 	// last read reached EOF, so we are an end-iterator now
 	if(!_fin.good()) {
 		return true;
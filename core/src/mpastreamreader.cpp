@@ -1,6 +1,8 @@
 
 #include "mpastreamreader.h"
+#include "instrumentation.h"
 #include <cassert>
+#include <cctype>
 #include <regex.h>
 
 using namespace core;
@@ -10,7 +12,7 @@ MPAStreamReader::mpareader::mpareader(const std::string& filename, size_t seek)
 {
 	open(seek);
 	if(seek == 0) {
-		next();
+		_empty = next();
 	}
 }
 
@@ -21,6 +23,7 @@ MPAStreamReader::mpareader::~mpareader()
 
 bool MPAStreamReader::mpareader::next()
 {
+	CORE_TIMED_SCOPE("MPAStreamReader::next");
 	// last read reached EOF, so we are an end-iterator now
 	if(!_fin.good()) {
 		return true;
@@ -77,6 +80,52 @@ BaseSensorStreamReader::reader* MPAStreamReader::mpareader::clone() const
 	return newReader;
 }
 
+bool MPAStreamReader::mpareader::seek(const EventIndex::entry_t& entry)
+{
+	_fin.clear();
+	_fin.seekg(entry.offset);
+	_numEventsRead = entry.eventNumber;
+	next();
+	return true;
+}
+
+std::shared_ptr<const EventIndex> MPAStreamReader::getIndex() const
+{
+	return EventIndex::get("MPAStreamReader", getFilename(), &MPAStreamReader::buildIndex);
+}
+
+void MPAStreamReader::buildIndex(std::istream& in, std::vector<EventIndex::entry_t>& entries)
+{
+	std::string line;
+	uint64_t offset = 0;
+	int eventNumber = 0;
+	while(std::getline(in, line)) {
+		uint64_t lineOffset = offset;
+		offset += line.size() + 1;
+		// like mpareader::next(), ignore a last line without line break
+		if(in.eof()) {
+			break;
+		}
+		if(line == "\r" || line == "") {
+			continue;
+		}
+		uint32_t hits = 0;
+		bool inNumber = false;
+		bool nonZero = false;
+		for(char ch: line) {
+			if(std::isdigit(ch)) {
+				inNumber = true;
+				nonZero |= ch != '0';
+				continue;
+			}
+			hits += inNumber && nonZero;
+			inNumber = nonZero = false;
+		}
+		hits += inNumber && nonZero;
+		entries.push_back({eventNumber++, hits, 1, lineOffset});
+	}
+}
+
 BaseSensorStreamReader::reader* MPAStreamReader::getReader(const std::string& filename) const
 {
 	return new mpareader(filename);
@@ -5,6 +5,7 @@ namespace core {
 constexpr int MpaTransform::num_pixels_x;
 constexpr int MpaTransform::num_pixels_y;
 constexpr int MpaTransform::num_pixels;
+constexpr int MpaTransform::num_mpas;
 constexpr double MpaTransform::outer_pixel_width;
 constexpr double MpaTransform::inner_pixel_width;
 constexpr double MpaTransform::upper_pixel_height;
@@ -3,10 +3,68 @@
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <cstdio>
+#include <cerrno>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <boost/algorithm/string.hpp>
 
 using namespace core;
 
+constexpr int QuickRunlistReader::data_offset_column;
+
+namespace {
+
+/** \brief Exclusive flock() on a runlist file
+ *
+ * The runlist is replaced by rename(), so a writer waiting for the lock may end up locking the replaced file.
+ * The lock is only taken once the locked file is still the one found under the file name.
+ */
+class RunlistLock
+{
+public:
+	explicit RunlistLock(const std::string& filename) : _fd(-1), _mode(0644)
+	{
+		while(true) {
+			_fd = open(filename.c_str(), O_RDONLY);
+			if(_fd < 0) {
+				throw std::ios_base::failure(std::string("Cannot read runlist '") + filename + "'");
+			}
+			int result;
+			while((result = flock(_fd, LOCK_EX)) != 0 && errno == EINTR);
+			struct stat locked, current;
+			if(result != 0 || fstat(_fd, &locked) != 0) {
+				close(_fd);
+				throw std::ios_base::failure(std::string("Cannot lock runlist '") + filename + "'");
+			}
+			if(stat(filename.c_str(), &current) == 0 && current.st_dev == locked.st_dev
+			   && current.st_ino == locked.st_ino) {
+				_mode = locked.st_mode & 07777;
+				return;
+			}
+			// replaced while waiting, lock the new file
+			close(_fd);
+		}
+	}
+	~RunlistLock()
+	{
+		close(_fd);
+	}
+	RunlistLock(const RunlistLock&) = delete;
+	RunlistLock& operator=(const RunlistLock&) = delete;
+
+	mode_t mode() const { return _mode; }
+
+private:
+	int _fd;
+	mode_t _mode;
+};
+
+} // namespace
+
 void QuickRunlistReader::read(const std::string& filename)
 {
 	std::ifstream fin(filename);
@@ -33,7 +91,7 @@ void QuickRunlistReader::read(const std::string& filename)
 				else if(colno == 3) run.bias_voltage = std::stod(col);
 				else if(colno == 4) run.bias_current = std::stod(col);
 				else if(colno == 5) run.threshold = std::stod(col);
-				else if(colno == 10) run.data_offset = std::stoi(col);
+				else if(colno == data_offset_column) run.data_offset = std::stoi(col);
 			} catch(std::invalid_argument& e) {
 			}
 			colno++;
@@ -42,6 +100,79 @@ void QuickRunlistReader::read(const std::string& filename)
 	}
 }
 
+void QuickRunlistReader::writeDataOffset(const std::string& filename, int mpaRun, int dataOffset)
+{
+	// the lock is held until the new file replaced the runlist, so concurrent writers do not lose updates
+	RunlistLock lock(filename);
+	std::ifstream fin(filename);
+	if(!fin.is_open()) {
+		throw std::ios_base::failure(std::string("Cannot read runlist '") + filename + "'");
+	}
+	std::ostringstream content;
+	std::string line;
+	bool found = false;
+	int line_no = 0;
+	while(getline(fin, line)) {
+		++line_no;
+		std::string trimmed = boost::trim_copy(line);
+		if(line_no > 1 && trimmed.size() && trimmed[0] != '#') {
+			// split manually, getline() would drop empty trailing columns
+			std::vector<std::string> cols;
+			boost::split(cols, line, boost::is_any_of("\t"));
+			int run = 0;
+			try {
+				run = std::stoi(cols[0]);
+			} catch(std::invalid_argument& e) {
+			}
+			if(run == mpaRun) {
+				if(cols.size() <= data_offset_column) {
+					cols.resize(data_offset_column+1);
+				}
+				cols[data_offset_column] = std::to_string(dataOffset);
+				line = boost::join(cols, "\t");
+				found = true;
+			}
+		}
+		content << line << "\n";
+	}
+	fin.close();
+	if(!found) {
+		throw std::invalid_argument("MPA Run ID not found");
+	}
+	// a unique name in the same directory, rename() cannot replace across file systems
+	std::vector<char> tmp(filename.begin(), filename.end());
+	const std::string pattern(".XXXXXX");
+	tmp.insert(tmp.end(), pattern.begin(), pattern.end());
+	tmp.push_back('\0');
+	int fd = mkstemp(tmp.data());
+	if(fd < 0) {
+		throw std::ios_base::failure(std::string("Cannot create temporary file for runlist '") + filename + "'");
+	}
+	// mkstemp() creates the file readable by the owner only
+	fchmod(fd, lock.mode());
+	const std::string data = content.str();
+	size_t written = 0;
+	while(written < data.size()) {
+		auto n = write(fd, data.data() + written, data.size() - written);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		} else if(n < 0) {
+			break;
+		}
+		written += n;
+	}
+	bool good = written == data.size() && fsync(fd) == 0;
+	good = close(fd) == 0 && good;
+	if(!good) {
+		std::remove(tmp.data());
+		throw std::ios_base::failure(std::string("Cannot write runlist '") + tmp.data() + "'");
+	}
+	if(std::rename(tmp.data(), filename.c_str()) != 0) {
+		std::remove(tmp.data());
+		throw std::ios_base::failure(std::string("Cannot replace runlist '") + filename + "'");
+	}
+}
+
 const QuickRunlistReader::run_t& QuickRunlistReader::getByTelRun(int telRun) const
 {
 	for(const auto& run: *this)
@@ -54,14 +185,23 @@ const QuickRunlistReader::run_t& QuickRunlistReader::getByTelRun(int telRun) con
 }
 
 const QuickRunlistReader::run_t& QuickRunlistReader::getByMpaRun(int mpaRun) const
+{
+	auto run = findByMpaRun(mpaRun);
+	if(!run) {
+		throw std::invalid_argument("MPA Run ID not found");
+	}
+	return *run;
+}
+
+const QuickRunlistReader::run_t* QuickRunlistReader::findByMpaRun(int mpaRun) const
 {
 	for(const auto& run: *this)
 	{
 		if(run.mpa_run == mpaRun) {
-			return run;
+			return &run;
 		}
 	}
-	throw std::invalid_argument("MPA Run ID not found");
+	return nullptr;
 }
 
 int QuickRunlistReader::getMpaRunByTelRun(int telRun) const
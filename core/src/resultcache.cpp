@@ -0,0 +1,294 @@
+#include "resultcache.h"
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace core;
+
+namespace {
+
+const uint64_t fnv_offset = 14695981039346656037ULL;
+const uint64_t fnv_prime = 1099511628211ULL;
+
+inline uint64_t fnv1a(uint64_t h, const char* data, size_t size)
+{
+	for(size_t i = 0; i < size; ++i) {
+		h ^= static_cast<unsigned char>(data[i]);
+		h *= fnv_prime;
+	}
+	return h;
+}
+
+std::string toHex(uint64_t h)
+{
+	std::ostringstream sstr;
+	sstr << std::hex << std::setfill('0') << std::setw(16) << h;
+	return sstr.str();
+}
+
+bool getState(const std::string& path, struct stat& st)
+{
+	return stat(path.c_str(), &st) == 0;
+}
+
+} // namespace
+
+ResultCache::ResultCache(const std::string& directory) :
+ _directory(directory), _checksums()
+{
+	makePath(_directory);
+	loadChecksums();
+}
+
+std::string ResultCache::hash(const std::string& data)
+{
+	return toHex(fnv1a(fnv_offset, data.data(), data.size()));
+}
+
+void ResultCache::makePath(const std::string& path)
+{
+	size_t pos = 0;
+	do {
+		pos = path.find('/', pos+1);
+		auto sub = path.substr(0, pos);
+		if(sub.empty()) {
+			continue;
+		}
+		if(mkdir(sub.c_str(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) != 0 && errno != EEXIST) {
+			throw std::ios_base::failure(std::string("Cannot create directory '") + sub + "': " + strerror(errno));
+		}
+	} while(pos != std::string::npos);
+}
+
+void ResultCache::loadChecksums()
+{
+	std::ifstream fin(_directory + "/checksums");
+	std::string line;
+	while(std::getline(fin, line)) {
+		// <state>\t<checksum>\t<path>
+		auto a = line.find('\t');
+		auto b = line.find('\t', a+1);
+		if(a == std::string::npos || b == std::string::npos) {
+			continue;
+		}
+		_checksums[line.substr(b+1) + "\t" + line.substr(0, a)] = line.substr(a+1, b-a-1);
+	}
+}
+
+std::string ResultCache::fingerprint(const std::string& filename)
+{
+	struct stat st;
+	if(!getState(filename, st)) {
+		return "missing";
+	}
+	std::ostringstream state;
+	state << st.st_size << ":" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+	auto index = filename + "\t" + state.str();
+	auto it = _checksums.find(index);
+	if(it != _checksums.end()) {
+		return state.str() + ":" + it->second;
+	}
+	std::ifstream fin(filename, std::ios::binary);
+	if(!fin.is_open()) {
+		return "unreadable";
+	}
+	std::vector<char> buf(1 << 20);
+	uint64_t h = fnv_offset;
+	while(fin.good()) {
+		fin.read(buf.data(), buf.size());
+		h = fnv1a(h, buf.data(), fin.gcount());
+	}
+	auto checksum = toHex(h);
+	_checksums[index] = checksum;
+	std::ofstream fout(_directory + "/checksums", std::ios::app);
+	fout << state.str() << "\t" << checksum << "\t" << filename << std::endl;
+	return state.str() + ":" + checksum;
+}
+
+bool ResultCache::contains(const std::string& key) const
+{
+	struct stat st;
+	return getState(_directory + "/" + key + "/MANIFEST", st);
+}
+
+bool ResultCache::restore(const std::string& key, const std::string& outputDir) const
+{
+	std::ifstream manifest(_directory + "/" + key + "/MANIFEST");
+	if(!manifest.is_open()) {
+		return false;
+	}
+	std::vector<std::string> files;
+	std::string line;
+	while(std::getline(manifest, line)) {
+		if(line.size()) {
+			files.push_back(line);
+		}
+	}
+	for(const auto& file: files) {
+		auto target = outputDir + "/" + file;
+		auto pos = target.rfind('/');
+		makePath(target.substr(0, pos));
+		copyFile(_directory + "/" + key + "/files/" + file, target);
+	}
+	return true;
+}
+
+ResultCache::snapshot_t ResultCache::snapshot(const std::string& directory) const
+{
+	snapshot_t snap;
+	snapshot(directory, "", snap);
+	return snap;
+}
+
+void ResultCache::snapshot(const std::string& base, const std::string& relative, snapshot_t& snap) const
+{
+	auto path = relative.empty() ? base : base + "/" + relative;
+	// never descend into the cache itself
+	struct stat st_cache, st_path;
+	if(getState(_directory, st_cache) && getState(path, st_path) &&
+	   st_cache.st_dev == st_path.st_dev && st_cache.st_ino == st_path.st_ino) {
+		return;
+	}
+	DIR* dir = opendir(path.c_str());
+	if(!dir) {
+		return;
+	}
+	struct dirent* entry;
+	while((entry = readdir(dir)) != nullptr) {
+		std::string name(entry->d_name);
+		if(name == "." || name == "..") {
+			continue;
+		}
+		auto rel = relative.empty() ? name : relative + "/" + name;
+		struct stat st;
+		if(!getState(base + "/" + rel, st)) {
+			continue;
+		}
+		if(S_ISDIR(st.st_mode)) {
+			snapshot(base, rel, snap);
+		} else if(S_ISREG(st.st_mode)) {
+			snap[rel] = file_state_t{
+				static_cast<uint64_t>(st.st_size),
+				static_cast<int64_t>(st.st_mtim.tv_sec),
+				static_cast<int64_t>(st.st_mtim.tv_nsec)
+			};
+		}
+	}
+	closedir(dir);
+}
+
+bool ResultCache::matchesStem(const std::string& path, const std::string& stem)
+{
+	auto name = path.substr(path.rfind('/') + 1);
+	if(name.compare(0, stem.size(), stem) != 0) {
+		return false;
+	}
+	auto rest = name.substr(stem.size());
+	if(rest.compare(0, 4, "-to-") == 0) {
+		return false;
+	}
+	return !(rest.size() > 1 && rest[0] == '_' && std::isdigit(static_cast<unsigned char>(rest[1])));
+}
+
+size_t ResultCache::store(const std::string& key, const std::string& outputDir, const snapshot_t& before,
+                          const std::vector<std::string>& stems, const std::string& description)
+{
+	std::vector<std::string> changed;
+	for(const auto& item: snapshot(outputDir)) {
+		if(stems.size() && std::none_of(stems.begin(), stems.end(),
+		                                [&item](const std::string& stem) { return matchesStem(item.first, stem); })) {
+			continue;
+		}
+		auto it = before.find(item.first);
+		if(it == before.end() || it->second != item.second) {
+			changed.push_back(item.first);
+		}
+	}
+	if(changed.empty()) {
+		return 0;
+	}
+	std::ostringstream tmp;
+	tmp << _directory << "/" << key << ".tmp." << getpid() << "."
+	    << std::hash<std::thread::id>()(std::this_thread::get_id());
+	removeRecursive(tmp.str());
+	try {
+		for(const auto& file: changed) {
+			auto target = tmp.str() + "/files/" + file;
+			makePath(target.substr(0, target.rfind('/')));
+			copyFile(outputDir + "/" + file, target);
+		}
+		std::ofstream(tmp.str() + "/KEY") << description;
+		std::ofstream manifest(tmp.str() + "/MANIFEST");
+		for(const auto& file: changed) {
+			manifest << file << "\n";
+		}
+	} catch(...) {
+		removeRecursive(tmp.str());
+		throw;
+	}
+	auto entry = _directory + "/" + key;
+	if(contains(key)) {
+		// replace outdated entry, e.g. after a forced rerun
+		auto old = tmp.str() + ".old";
+		if(rename(entry.c_str(), old.c_str()) == 0) {
+			removeRecursive(old);
+		}
+	}
+	if(rename(tmp.str().c_str(), entry.c_str()) != 0) {
+		// another job stored the same key in the meantime
+		removeRecursive(tmp.str());
+		return 0;
+	}
+	return changed.size();
+}
+
+void ResultCache::copyFile(const std::string& from, const std::string& to)
+{
+	std::ifstream fin(from, std::ios::binary);
+	if(!fin.is_open()) {
+		throw std::ios_base::failure(std::string("Cannot read file '") + from + "'");
+	}
+	std::ofstream fout(to, std::ios::binary | std::ios::trunc);
+	if(!fout.is_open()) {
+		throw std::ios_base::failure(std::string("Cannot write file '") + to + "'");
+	}
+	if(fin.peek() != std::ifstream::traits_type::eof()) {
+		fout << fin.rdbuf();
+	}
+	if(!fout.good()) {
+		throw std::ios_base::failure(std::string("Cannot write file '") + to + "'");
+	}
+}
+
+void ResultCache::removeRecursive(const std::string& path)
+{
+	struct stat st;
+	if(lstat(path.c_str(), &st) != 0) {
+		return;
+	}
+	if(S_ISDIR(st.st_mode)) {
+		DIR* dir = opendir(path.c_str());
+		if(dir) {
+			struct dirent* entry;
+			while((entry = readdir(dir)) != nullptr) {
+				std::string name(entry->d_name);
+				if(name != "." && name != "..") {
+					removeRecursive(path + "/" + name);
+				}
+			}
+			closedir(dir);
+		}
+		rmdir(path.c_str());
+	} else {
+		unlink(path.c_str());
+	}
+}
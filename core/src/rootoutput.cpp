@@ -0,0 +1,232 @@
+#include "rootoutput.h"
+#include "instrumentation.h"
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TROOT.h>
+#include <TSeqCollection.h>
+#include <TCanvas.h>
+#include <TImage.h>
+#include <TH1.h>
+#include <RVersion.h>
+#include <iostream>
+#include <ios>
+
+using namespace core;
+
+bool RootOutput::_imagesEnabled = true;
+
+RootOutput::RootOutput(const std::string& filename) :
+ _filename(filename), _file(nullptr), _images(), _async(false), _busy(false), _closing(false), _opened(false),
+ _numWritten(0)
+{
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+	// makes gDirectory thread-local, so the file of the worker does not become the directory of new histograms
+	ROOT::EnableThreadSafety();
+	_async = true;
+#endif
+	if(_async) {
+		_thread = std::thread(&RootOutput::worker, this);
+		std::unique_lock<std::mutex> lock(_mutex);
+		_written.wait(lock, [this]() { return _opened; });
+		if(!_file) {
+			lock.unlock();
+			_thread.join();
+		}
+	} else {
+		TDirectory::TContext context;
+		_file = new TFile(_filename.c_str(), "RECREATE");
+		if(_file->IsZombie()) {
+			delete _file;
+			_file = nullptr;
+		}
+	}
+	if(!_file) {
+		throw std::ios_base::failure("Cannot create ROOT file '" + _filename + "'");
+	}
+}
+
+RootOutput::~RootOutput()
+{
+	try {
+		close();
+	} catch(std::ios_base::failure& e) {
+		std::cerr << e.what() << std::endl;
+	}
+}
+
+void RootOutput::setImagesEnabled(bool enabled)
+{
+	_imagesEnabled = enabled;
+}
+
+bool RootOutput::getImagesEnabled()
+{
+	return _imagesEnabled;
+}
+
+void RootOutput::write(TObject* obj, const std::string& directory)
+{
+	if(!obj) {
+		return;
+	}
+	if(auto hist = dynamic_cast<TH1*>(obj)) {
+		hist->SetDirectory(nullptr);
+	}
+	if(!_async) {
+		writeItem({obj, directory});
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back({obj, directory});
+	}
+	_queued.notify_one();
+}
+
+void RootOutput::writeCopy(const TObject* obj, const std::string& directory)
+{
+	if(obj) {
+		write(obj->Clone(), directory);
+	}
+}
+
+void RootOutput::addImage(TCanvas* canvas, const std::string& filename)
+{
+	if(!_imagesEnabled) {
+		delete canvas;
+		return;
+	}
+	gROOT->GetListOfCanvases()->Remove(canvas);
+	for(auto& image: _images) {
+		if(image.filename == filename) {
+			if(image.canvas != canvas) {
+				delete image.canvas;
+			}
+			image.canvas = canvas;
+			return;
+		}
+	}
+	_images.push_back({canvas, filename});
+}
+
+void RootOutput::renderImages()
+{
+	if(_images.empty()) {
+		return;
+	}
+	CORE_TIMED_SCOPE("RootOutput::renderImages");
+	for(const auto& image: _images) {
+		auto img = TImage::Create();
+		img->FromPad(image.canvas);
+		img->WriteImage(image.filename.c_str());
+		delete img;
+		delete image.canvas;
+	}
+	_images.clear();
+}
+
+void RootOutput::flush()
+{
+	renderImages();
+	if(_async) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_written.wait(lock, [this]() { return _queue.empty() && !_busy; });
+	}
+	checkError();
+}
+
+void RootOutput::close()
+{
+	renderImages();
+	if(_async) {
+		if(_thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_closing = true;
+			}
+			_queued.notify_one();
+			_thread.join();
+		}
+	} else if(_file) {
+		_file->Close();
+		delete _file;
+		_file = nullptr;
+	}
+	checkError();
+}
+
+size_t RootOutput::getNumWritten() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _numWritten;
+}
+
+void RootOutput::checkError()
+{
+	std::string error;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::swap(error, _error);
+	}
+	if(!error.empty()) {
+		throw std::ios_base::failure(error);
+	}
+}
+
+void RootOutput::writeItem(const item_t& item)
+{
+	TDirectory* dir = _file;
+	if(!item.directory.empty()) {
+		dir = _file->GetDirectory(item.directory.c_str());
+		if(!dir) {
+			dir = _file->mkdir(item.directory.c_str());
+		}
+	}
+	int bytes = dir ? dir->WriteTObject(item.obj) : 0;
+	std::string name = item.obj->GetName();
+	delete item.obj;
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(bytes <= 0 && _error.empty()) {
+		_error = "Cannot write '" + name + "' to ROOT file '" + _filename + "'";
+	}
+	++_numWritten;
+}
+
+void RootOutput::worker()
+{
+	{
+		// the file must not become the current directory of the thread creating the RootOutput
+		TDirectory::TContext context;
+		auto file = new TFile(_filename.c_str(), "RECREATE");
+		if(file->IsZombie()) {
+			delete file;
+			file = nullptr;
+		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		_file = file;
+		_opened = true;
+	}
+	_written.notify_all();
+	if(!_file) {
+		return;
+	}
+	std::unique_lock<std::mutex> lock(_mutex);
+	while(true) {
+		_queued.wait(lock, [this]() { return !_queue.empty() || _closing; });
+		if(_queue.empty()) {
+			break;
+		}
+		auto item = _queue.front();
+		_queue.pop_front();
+		_busy = true;
+		lock.unlock();
+		writeItem(item);
+		lock.lock();
+		_busy = false;
+		_written.notify_all();
+	}
+	lock.unlock();
+	_file->Close();
+	delete _file;
+	_file = nullptr;
+}
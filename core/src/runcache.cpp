@@ -0,0 +1,165 @@
+#include "runcache.h"
+#include <map>
+#include <list>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <sys/stat.h>
+
+using namespace core;
+
+namespace {
+
+struct entry_t
+{
+	std::string fingerprint;
+	std::shared_ptr<const void> data;
+	size_t bytes;
+	/// Position in state_t::lru
+	std::list<std::string>::iterator lru;
+};
+
+struct state_t
+{
+	state_t() : budget(0), bytes(0), hits(0), misses(0) {}
+
+	std::mutex mutex;
+	std::condition_variable loaded;
+	std::map<std::string, entry_t> entries;
+	/// Keys, most recently used first
+	std::list<std::string> lru;
+	/// Keys currently decoded by some thread
+	std::set<std::string> loading;
+	/// Fingerprints of files that did not fit into the budget, they are not decoded again
+	std::map<std::string, std::string> oversized;
+	size_t budget;
+	size_t bytes;
+	size_t hits;
+	size_t misses;
+
+	void erase(std::map<std::string, entry_t>::iterator it)
+	{
+		bytes -= it->second.bytes;
+		lru.erase(it->second.lru);
+		entries.erase(it);
+	}
+
+	/// Evict least recently used entries until additional bytes fit into the budget
+	void makeRoom(size_t additional)
+	{
+		while(!lru.empty() && bytes + additional > budget) {
+			erase(entries.find(lru.back()));
+		}
+	}
+};
+
+state_t& state()
+{
+	static state_t s;
+	return s;
+}
+
+/// Size and modification time, changes if the file is rewritten
+std::string fingerprint(const std::string& filename)
+{
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0) {
+		return "missing";
+	}
+	std::ostringstream sstr;
+	sstr << st.st_size << ":" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+	return sstr.str();
+}
+
+} // namespace
+
+void RunCache::setBudget(size_t bytes)
+{
+	auto& s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.budget = bytes;
+	s.oversized.clear();
+	s.makeRoom(0);
+}
+
+size_t RunCache::getBudget()
+{
+	auto& s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	return s.budget;
+}
+
+void RunCache::clear()
+{
+	auto& s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.entries.clear();
+	s.lru.clear();
+	s.oversized.clear();
+	s.bytes = 0;
+	s.hits = 0;
+	s.misses = 0;
+}
+
+RunCache::statistics_t RunCache::getStatistics()
+{
+	auto& s = state();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	return { s.entries.size(), s.bytes, s.budget, s.hits, s.misses };
+}
+
+std::shared_ptr<const void> RunCache::get(const std::string& key, const std::string& filename,
+                                          const erased_loader_t& load)
+{
+	auto& s = state();
+	auto print = fingerprint(filename);
+	std::unique_lock<std::mutex> lock(s.mutex);
+	// wait for another thread decoding the same file
+	s.loaded.wait(lock, [&]() { return s.loading.count(key) == 0; });
+	if(s.budget == 0) {
+		return nullptr;
+	}
+	auto it = s.entries.find(key);
+	if(it != s.entries.end()) {
+		if(it->second.fingerprint == print) {
+			++s.hits;
+			s.lru.splice(s.lru.begin(), s.lru, it->second.lru);
+			return it->second.data;
+		}
+		s.erase(it);
+	}
+	auto oversized = s.oversized.find(key);
+	if(oversized != s.oversized.end() && oversized->second == print) {
+		return nullptr;
+	}
+	++s.misses;
+	s.loading.insert(key);
+	size_t maxBytes = s.budget;
+	lock.unlock();
+	std::shared_ptr<const void> data;
+	size_t bytes = 0;
+	try {
+		data = load(maxBytes, bytes);
+	} catch(...) {
+		lock.lock();
+		s.loading.erase(key);
+		lock.unlock();
+		s.loaded.notify_all();
+		throw;
+	}
+	lock.lock();
+	s.loading.erase(key);
+	if(bytes > s.budget) {
+		data.reset();
+		s.oversized[key] = print;
+	} else {
+		s.makeRoom(bytes);
+		s.lru.push_front(key);
+		s.entries[key] = { print, data, bytes, s.lru.begin() };
+		s.bytes += bytes;
+	}
+	lock.unlock();
+	s.loaded.notify_all();
+	return data;
+}
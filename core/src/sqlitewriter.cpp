@@ -0,0 +1,140 @@
+#include "sqlitewriter.h"
+#include <sqlite3.h>
+#include <iostream>
+
+using namespace core;
+
+SqliteWriter::SqliteWriter(const std::string& filename, size_t batchSize, int busyTimeout) :
+ _db(nullptr), _statements(), _batchSize(batchSize), _pending(0), _numWrites(0), _inTransaction(false)
+{
+	int ret = sqlite3_open(filename.c_str(), &_db);
+	if(ret != SQLITE_OK) {
+		std::string msg = std::string("Cannot open database '") + filename + "': " +
+		                  (_db ? sqlite3_errmsg(_db) : sqlite3_errstr(ret));
+		sqlite3_close(_db);
+		throw sqlite_error(msg);
+	}
+	sqlite3_busy_timeout(_db, busyTimeout);
+}
+
+SqliteWriter::~SqliteWriter()
+{
+	try {
+		commit();
+	} catch(sqlite_error& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	for(auto stmt: _statements) {
+		sqlite3_finalize(stmt);
+	}
+	sqlite3_close(_db);
+}
+
+void SqliteWriter::check(int ret, const std::string& action) const
+{
+	if(ret != SQLITE_OK && ret != SQLITE_DONE && ret != SQLITE_ROW) {
+		throw sqlite_error(std::string("SQLite error while ") + action + ": " + sqlite3_errmsg(_db));
+	}
+}
+
+void SqliteWriter::exec(const std::string& sql)
+{
+	commit();
+	check(sqlite3_exec(_db, sql.c_str(), nullptr, nullptr, nullptr), "executing '" + sql + "'");
+}
+
+size_t SqliteWriter::prepare(const std::string& sql)
+{
+	sqlite3_stmt* stmt = nullptr;
+	check(sqlite3_prepare_v2(_db, sql.c_str(), -1, &stmt, nullptr), "preparing '" + sql + "'");
+	_statements.push_back(stmt);
+	return _statements.size() - 1;
+}
+
+void SqliteWriter::begin()
+{
+	if(!_inTransaction) {
+		// take the write lock right away, so concurrent writers wait here instead of failing on commit
+		check(sqlite3_exec(_db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr), "starting transaction");
+		_inTransaction = true;
+	}
+}
+
+void SqliteWriter::commit()
+{
+	if(_inTransaction) {
+		check(sqlite3_exec(_db, "COMMIT", nullptr, nullptr, nullptr), "committing transaction");
+		_inTransaction = false;
+		_pending = 0;
+	}
+}
+
+void SqliteWriter::step(size_t statement)
+{
+	auto stmt = _statements.at(statement);
+	int ret = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	check(ret, "executing statement");
+	++_numWrites;
+	if(++_pending >= _batchSize) {
+		commit();
+	}
+}
+
+void SqliteWriter::bindInt(size_t statement, int idx, int64_t value)
+{
+	check(sqlite3_bind_int64(_statements.at(statement), idx, value), "binding value");
+}
+
+void SqliteWriter::bindDouble(size_t statement, int idx, double value)
+{
+	check(sqlite3_bind_double(_statements.at(statement), idx, value), "binding value");
+}
+
+void SqliteWriter::bindText(size_t statement, int idx, const std::string& value)
+{
+	check(sqlite3_bind_text(_statements.at(statement), idx, value.c_str(), value.size(), SQLITE_TRANSIENT),
+	      "binding value");
+}
+
+int64_t SqliteWriter::lastInsertId() const
+{
+	return sqlite3_last_insert_rowid(_db);
+}
+
+int64_t SqliteWriter::queryInt(const std::string& sql, int64_t fallback)
+{
+	sqlite3_stmt* stmt = nullptr;
+	check(sqlite3_prepare_v2(_db, sql.c_str(), -1, &stmt, nullptr), "preparing '" + sql + "'");
+	int ret = sqlite3_step(stmt);
+	int64_t value = fallback;
+	if(ret == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+		value = sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	check(ret, "executing '" + sql + "'");
+	return value;
+}
+
+void SqliteWriter::query(const std::string& sql, const std::function<void(const std::vector<std::string>&)>& row)
+{
+	sqlite3_stmt* stmt = nullptr;
+	check(sqlite3_prepare_v2(_db, sql.c_str(), -1, &stmt, nullptr), "preparing '" + sql + "'");
+	std::vector<std::string> columns(sqlite3_column_count(stmt));
+	int ret;
+	try {
+		while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+			for(size_t i = 0; i < columns.size(); ++i) {
+				auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+				columns[i] = text ? text : "";
+			}
+			row(columns);
+		}
+	} catch(...) {
+		sqlite3_finalize(stmt);
+		throw;
+	}
+	sqlite3_finalize(stmt);
+	check(ret, "executing '" + sql + "'");
+}
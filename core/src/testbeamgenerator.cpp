@@ -0,0 +1,267 @@
+#include "testbeamgenerator.h"
+#include "datastructures.h"
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+
+using namespace core;
+
+TestbeamGenerator::config_t TestbeamGenerator::config_t::defaults()
+{
+	config_t config;
+	config.numEvents = 10000;
+	config.seed = 42;
+	config.runId = 1;
+	config.planeZ = {{0.0, 150.0, 300.0, 450.0, 600.0, 750.0}};
+	config.refZ = 900.0;
+	config.mpaOffset = {-1.0, -2.5, 385.0};
+	config.mpaRotation = {0.0, 0.0, 0.0};
+	config.meanTracks = 1.5;
+	config.beamCenter = {0.0, 0.0};
+	config.beamHalfSize = {4.0, 5.0};
+	config.divergence = 0.0005;
+	config.telescopeResolution = 0.0035;
+	config.refResolution = 0.01;
+	config.efficiency = 0.95;
+	config.noise = 1e-4;
+	config.dataOffset = 0;
+	return config;
+}
+
+TestbeamGenerator::TestbeamGenerator(const config_t& config) :
+ _config(config), _transform(), _rng(), _eventNumber(0)
+{
+	if(config.efficiency < 0.0 || config.efficiency > 1.0) {
+		throw std::invalid_argument("Efficiency must be in [0, 1]");
+	}
+	if(config.noise < 0.0 || config.noise > 1.0) {
+		throw std::invalid_argument("Noise probability must be in [0, 1]");
+	}
+	if(config.meanTracks < 0.0) {
+		throw std::invalid_argument("Mean number of tracks must not be negative");
+	}
+	_transform.setOffset(config.mpaOffset);
+	_transform.setRotation(config.mpaRotation);
+	reset();
+}
+
+void TestbeamGenerator::reset()
+{
+	_rng.seed(_config.seed);
+	_eventNumber = 0;
+}
+
+double TestbeamGenerator::gauss(double sigma)
+{
+	if(sigma <= 0.0) {
+		return 0.0;
+	}
+	return std::normal_distribution<double>(0.0, sigma)(_rng);
+}
+
+TestbeamGenerator::event_t TestbeamGenerator::next()
+{
+	event_t event = emptyEvent(_eventNumber++);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	int numTracks = 0;
+	if(_config.meanTracks > 0.0) {
+		numTracks = std::poisson_distribution<int>(_config.meanTracks)(_rng);
+	}
+	for(int i = 0; i < numTracks; ++i) {
+		Eigen::Vector3d start(
+			_config.beamCenter(0) + (2*uniform(_rng) - 1) * _config.beamHalfSize(0),
+			_config.beamCenter(1) + (2*uniform(_rng) - 1) * _config.beamHalfSize(1),
+			0.0
+		);
+		Eigen::Vector3d direction(gauss(_config.divergence), gauss(_config.divergence), 1.0);
+		Track measured;
+		for(size_t plane = 0; plane <= num_planes; ++plane) {
+			const bool ref = plane == num_planes;
+			const double z = ref ? _config.refZ : _config.planeZ[plane];
+			const double resolution = ref ? _config.refResolution : _config.telescopeResolution;
+			Eigen::Vector3d point = start + direction*z;
+			point(0) += gauss(resolution);
+			point(1) += gauss(resolution);
+			measured.sensorIDs.push_back(plane);
+			measured.points.push_back(point);
+		}
+		event.tracks.push_back(measured);
+		// the MaPSA sees the true track
+		Track truth;
+		truth.points = {start, start + direction};
+		try {
+			auto idx = _transform.getPixelIndex(_transform.mpaPlaneTrackIntersect(truth));
+			if(uniform(_rng) < _config.efficiency) {
+				++event.pixels[idx];
+			}
+		} catch(std::out_of_range& e) {
+		}
+	}
+	if(_config.noise > 0.0) {
+		for(auto& pixel: event.pixels) {
+			if(uniform(_rng) < _config.noise) {
+				++pixel;
+			}
+		}
+	}
+	return event;
+}
+
+TestbeamGenerator::event_t TestbeamGenerator::emptyEvent(int eventNumber)
+{
+	event_t event;
+	event.eventNumber = eventNumber;
+	event.pixels.fill(0);
+	return event;
+}
+
+std::string TestbeamGenerator::counterLine(const event_t& event)
+{
+	std::ostringstream line;
+	line << "[";
+	for(size_t i = 0; i < event.pixels.size(); ++i) {
+		line << (i ? ", " : "") << event.pixels[i];
+	}
+	line << "]";
+	return line.str();
+}
+
+std::string TestbeamGenerator::memoryLine(const event_t& event)
+{
+	std::string line("[");
+	if(std::any_of(event.pixels.begin(), event.pixels.end(), [](int c) { return c > 0; })) {
+		line += "'11111111";
+		const int bxId = event.eventNumber & 0xffff;
+		for(int bit = 15; bit >= 0; --bit) {
+			line += (bxId >> bit) & 1 ? '1' : '0';
+		}
+		// inverse of the index mapping in MpaMemoryStreamReader, which swaps the order of the middle row
+		for(int i = 0; i < MpaTransform::num_pixels; ++i) {
+			int idx = (i >= 16 && i <= 31) ? 47 - i : i;
+			line += event.pixels[idx] ? '1' : '0';
+		}
+		line += "'";
+	}
+	line += "]";
+	return line;
+}
+
+void TestbeamGenerator::generate(const output_t& output)
+{
+	reset();
+	std::ofstream counter, memory, tracks;
+	auto open = [](std::ofstream& fout, const std::string& filename) {
+		if(filename.empty()) {
+			return;
+		}
+		fout.open(filename);
+		if(!fout) {
+			throw io_error(filename);
+		}
+	};
+	open(counter, output.counterFile);
+	open(memory, output.memoryFile);
+	open(tracks, output.trackFile);
+	if(tracks.is_open()) {
+		tracks << "# X Y Z SensorID Evt Run\n";
+	}
+	std::unique_ptr<TFile> file;
+	if(!output.rootFile.empty()) {
+		file.reset(new TFile(output.rootFile.c_str(), "recreate"));
+		if(!file || file->IsZombie()) {
+			throw io_error(output.rootFile);
+		}
+	}
+	TTree* tree = nullptr;
+	auto telescope = new TelescopeData;
+	auto telhits = new TelescopeHits;
+	auto mpa = new MpaData;
+	if(file) {
+		// owned by the file
+		tree = new TTree("data", "data");
+		tree->Branch("telescope", &telescope);
+		tree->Branch("telhits", &telhits);
+		tree->Branch("mpa_2", &mpa);
+	}
+	TelescopePlaneClusters* clusterPlanes[] = {
+		&telescope->p1, &telescope->p2, &telescope->p3,
+		&telescope->p4, &telescope->p5, &telescope->p6, &telescope->ref
+	};
+	PlaneHits* hitPlanes[] = {
+		&telhits->p1, &telhits->p2, &telhits->p3,
+		&telhits->p4, &telhits->p5, &telhits->p6, &telhits->ref
+	};
+
+	auto writeMpa = [&](const event_t& event) {
+		if(counter.is_open()) {
+			counter << counterLine(event) << "\n";
+		}
+		if(memory.is_open()) {
+			memory << memoryLine(event) << "\n";
+		}
+	};
+	// negative data offsets: the MaPSA data starts with events the telescope did not record
+	for(int i = 0; i < -_config.dataOffset; ++i) {
+		writeMpa(emptyEvent(i - _config.dataOffset));
+	}
+	for(size_t evt = 0; evt < _config.numEvents; ++evt) {
+		auto event = next();
+		// positive data offsets: the MaPSA missed the first events
+		if(event.eventNumber >= _config.dataOffset) {
+			writeMpa(event);
+		}
+		if(tracks.is_open()) {
+			for(const auto& track: event.tracks) {
+				for(size_t i = 0; i < track.points.size(); ++i) {
+					const auto& point = track.points[i];
+					tracks << point(0) << " " << point(1) << " " << point(2) << " "
+					       << track.sensorIDs[i] << " " << event.eventNumber << " " << _config.runId << "\n";
+				}
+				tracks << "\n\n";
+			}
+		}
+		if(tree) {
+			const int numTracks = event.tracks.size();
+			for(size_t plane = 0; plane <= num_planes; ++plane) {
+				clusterPlanes[plane]->x.ResizeTo(numTracks);
+				clusterPlanes[plane]->y.ResizeTo(numTracks);
+				hitPlanes[plane]->x.ResizeTo(numTracks);
+				hitPlanes[plane]->y.ResizeTo(numTracks);
+				hitPlanes[plane]->z.ResizeTo(numTracks);
+				for(int i = 0; i < numTracks; ++i) {
+					const auto& point = event.tracks[i].points[plane];
+					clusterPlanes[plane]->x[i] = point(0);
+					clusterPlanes[plane]->y[i] = point(1);
+					hitPlanes[plane]->x[i] = point(0);
+					hitPlanes[plane]->y[i] = point(1);
+					hitPlanes[plane]->z[i] = point(2);
+				}
+			}
+			std::copy(event.pixels.begin(), event.pixels.end(), mpa->counter.pixels);
+			tree->Fill();
+		}
+	}
+	if(tree) {
+		tree->Write();
+		file->Close();
+	}
+	delete telescope;
+	delete telhits;
+	delete mpa;
+
+	if(!output.alignFile.empty()) {
+		std::ofstream align(output.alignFile);
+		if(!align) {
+			throw io_error(output.alignFile);
+		}
+		// same layout as written by MpaAlign and read by MpaEfficiency, the residual width is zero
+		align << _config.mpaOffset(0) << " "
+		      << _config.mpaOffset(1) << " "
+		      << _config.mpaOffset(2) << " "
+		      << 0.0 << " "
+		      << _config.mpaRotation(0) << " "
+		      << _config.mpaRotation(1) << " "
+		      << _config.mpaRotation(2) << std::endl;
+	}
+}
@@ -5,17 +5,22 @@
 #include <iostream>
 #include <cxxabi.h>
 #include <algorithm>
+#include <set>
+#include <stdexcept>
 #include "mpastreamreader.h"
 #include "util.h"
 
 using namespace core;
 
 TrackAnalysis::TrackAnalysis() :
-	Analysis(), _analysisRunning(false)
+	Analysis(), _sampleSize(0), _samplingMode(EventSampler::SM_STRATIFIED), _sampleSeed(0), _analysisRunning(false)
 {
 	getOptionsDescription().add_options()
 		("runlist,l", po::value<std::string>()->default_value("../runlist.csv"), "Per-run information table")
 		("telescope,t", "The number specified by --run is a telescope run ID")
+		("event-filter", po::value<std::string>(), "Only analyse events matching an expression like \"tracks == 1 && hits <= 1\". Fields are tracks, hits and bx.")
+		("sampling", po::value<std::string>()->default_value("stratified"), "How analyses with a sample size draw their sample: first, uniform or stratified (spread evenly over the run)")
+		("sample-seed", po::value<unsigned int>()->default_value(1), "Seed of the random sample")
 	;
 }
 
@@ -24,6 +29,25 @@ bool TrackAnalysis::loadConfig(const po::variables_map& vm)
 	if(!Analysis::loadConfig(vm)) {
 		return false;
 	}
+	if(vm.count("event-filter")) {
+		try {
+			_optionFilter = EventIndex::parseFilter(vm["event-filter"].as<std::string>());
+		} catch(std::invalid_argument& e) {
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+	}
+	if(vm.count("sampling")) {
+		try {
+			_samplingMode = EventSampler::parseMode(vm["sampling"].as<std::string>());
+		} catch(std::invalid_argument& e) {
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+	}
+	if(vm.count("sample-seed")) {
+		_sampleSeed = vm["sample-seed"].as<unsigned int>();
+	}
 	try {
 		if(vm.count("runlist")) {
 			_runlist.read(vm["runlist"].as<std::string>());
@@ -93,11 +117,60 @@ void TrackAnalysis::run(const po::variables_map& vm)
 		}
 		readers.push_back(r);
 	}
-	for(const auto& process: _processes) {
-		executeProcess(readers, process);
+	distributeSample(readers);
+	std::set<std::string> finished;
+	std::vector<bool> done(_processes.size(), false);
+	while(finished.size() < _processes.size()) {
+		std::vector<const process_t*> ready;
+		for(size_t i = 0; i < _processes.size(); ++i) {
+			const auto& depends = _processes[i].depends;
+			if(!done[i] && std::all_of(depends.begin(), depends.end(),
+			                           [&finished](const std::string& dep) { return finished.count(dep) > 0; })) {
+				ready.push_back(&_processes[i]);
+				done[i] = true;
+			}
+		}
+		if(ready.empty()) {
+			throw std::runtime_error("Processes have unknown or circular dependencies");
+		}
+		if(ready.size() == 1) {
+			executeProcess(readers, *ready.front());
+		} else {
+			executeFusedProcesses(readers, ready);
+		}
+		for(const auto proc: ready) {
+			finished.insert(proc->name);
+		}
 	}
 }
 
+std::vector<std::string> TrackAnalysis::getInputFiles(const po::variables_map& vm)
+{
+	std::vector<std::string> files;
+	for(auto runId: _allRunIds) {
+		_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(runId)));
+		_config.setVariable("MpaRun", getMpaIdPadded(runId));
+		files.push_back(_config.getVariable("mapsa_data"));
+		files.push_back(_config.getVariable("track_data"));
+	}
+	_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(_currentRunId)));
+	_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
+	return files;
+}
+
+std::string TrackAnalysis::getRunlistKey() const
+{
+	std::ostringstream sstr;
+	sstr << std::setprecision(17);
+	for(auto runId: _allRunIds) {
+		const auto& run = _runlist.getByMpaRun(runId);
+		sstr << run.mpa_run << " " << run.telescope_run << " " << run.data_offset << " "
+		     << run.angle << " " << run.bias_voltage << " " << run.bias_current << " "
+		     << run.threshold << ";";
+	}
+	return sstr.str();
+}
+
 std::string TrackAnalysis::getUsage(const std::string& argv0) const
 {
 	std::ostringstream sstr;
@@ -190,6 +263,19 @@ bool TrackAnalysis::multirunConsistencyCheck(const std::string& argv0, const po:
 void TrackAnalysis::addProcess(const process_t& proc)
 {
 	_processes.push_back(proc);
+	if(_processes.size() > 1 && proc.depends.empty()) {
+		_processes.back().depends.push_back(_processes[_processes.size() - 2].name);
+	}
+}
+
+void TrackAnalysis::setProcessDependencies(const std::string& name, const std::vector<std::string>& depends)
+{
+	auto it = std::find_if(_processes.begin(), _processes.end(),
+	                       [&name](const process_t& proc) { return proc.name == name; });
+	if(it == _processes.end()) {
+		throw std::invalid_argument("Unknown process '" + name + "'");
+	}
+	it->depends = depends;
 }
 
 void TrackAnalysis::setDataOffset(int dataOffset)
@@ -204,9 +290,110 @@ void TrackAnalysis::rerun()
 	_rerunProcess = true;
 }
 
-void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pair_t>& reader, const process_t& process)
+void TrackAnalysis::publishProgress(size_t evtCount)
+{
+	_progress.update(evtCount);
+	if(_progress.isCancelled()) {
+		_analysisRunning = false;
+		throw Progress::cancelled_error();
+	}
+}
+
+void TrackAnalysis::finishProgress(callback_stop_t mode, int runId, size_t evtCount)
+{
+	_progress.update(evtCount);
+	auto& expected = _eventsPerRun[{mode, runId}];
+	expected = std::max(expected, evtCount);
+}
+
+void TrackAnalysis::distributeSample(std::vector<run_read_pair_t>& reader)
+{
+	if(_sampleSize == 0) {
+		return;
+	}
+	std::vector<size_t> numEvents;
+	size_t total = 0;
+	for(const auto& read: reader) {
+		auto index = read.pixelreader->getIndex();
+		if(!index) {
+			index = read.trackreader.getIndex();
+		}
+		numEvents.push_back(index->getEntries().size());
+		total += numEvents.back();
+	}
+	// the first events are drawn from every run, the analysis stops when it has enough
+	size_t cumulative = 0;
+	for(size_t i = 0; i < reader.size(); ++i) {
+		if(_samplingMode == EventSampler::SM_FIRST || total == 0) {
+			reader[i].sampleSize = _sampleSize;
+			continue;
+		}
+		size_t begin = (double)_sampleSize * cumulative / total;
+		cumulative += numEvents[i];
+		size_t end = (double)_sampleSize * cumulative / total;
+		reader[i].sampleSize = end - begin;
+	}
+}
+
+void TrackAnalysis::selectEvents(run_read_pair_t& read, callback_stop_t mode)
+{
+	read.filterDecoded = false;
+	read.pixelreader->setSelection(nullptr);
+	read.trackreader.setSelection(nullptr);
+	bool filter = _eventFilter || _optionFilter;
+	if(!filter && _sampleSize == 0) {
+		return;
+	}
+	auto pixelIndex = read.pixelreader->getIndex();
+	std::shared_ptr<EventIndex::selection_t> pixelSelection(new EventIndex::selection_t);
+	std::shared_ptr<EventIndex::selection_t> trackSelection(new EventIndex::selection_t);
+	// the sample of a run is the same in every pass
+	EventSampler sampler(_samplingMode, _sampleSeed + read.runId);
+	if(pixelIndex) {
+		bool sample = _sampleSize > 0;
+		EventIndex::select(*pixelIndex, *read.trackreader.getIndex(), _dataOffset,
+		                   [this, mode, sample](const EventIndex::summary_t& summary) {
+		                           return (!sample || mode == CS_ALWAYS || summary.tracks > 0) && acceptEvent(summary);
+		                   },
+		                   *pixelSelection, *trackSelection);
+		if(sample) {
+			EventIndex::keep(*pixelSelection, *trackSelection, _dataOffset,
+			                 sampler.draw(pixelSelection->size(), read.sampleSize));
+		}
+	} else if(_sampleSize > 0 && !filter && mode == CS_TRACK) {
+		// the pixel reader cannot seek, it reads up to each pixel event of the sampled track events
+		const auto& tracks = read.trackreader.getIndex()->getEntries();
+		for(auto pos: sampler.draw(tracks.size(), read.sampleSize)) {
+			trackSelection->push_back(tracks[pos]);
+			pixelSelection->push_back({tracks[pos].eventNumber - _dataOffset, 0, 0, 0});
+		}
+	} else {
+		read.filterDecoded = filter;
+		return;
+	}
+	read.pixelreader->setSelection(pixelSelection);
+	read.trackreader.setSelection(trackSelection);
+}
+
+bool TrackAnalysis::acceptEvent(const EventIndex::summary_t& summary) const
+{
+	return (!_eventFilter || _eventFilter(summary)) && (!_optionFilter || _optionFilter(summary));
+}
+
+bool TrackAnalysis::acceptDecodedEvent(const run_read_pair_t& read, size_t tracks,
+                                       const BaseSensorStreamReader::event_t& pixel) const
+{
+	if(!read.filterDecoded) {
+		return true;
+	}
+	return acceptEvent({pixel.eventNumber, tracks, read.pixelreader->countHits(pixel), pixel.bunchCrossing.size()});
+}
+
+void TrackAnalysis::executeProcess(std::vector<TrackAnalysis::run_read_pair_t>& reader, const process_t& process)
 {
 	_rerunNumber = 0;
+	const size_t alignStage = Instrumentation::stage("TrackAnalysis::alignEvents");
+	const size_t runStage = Instrumentation::stage(process.name + "::run");
 	do {
 		if(process.init) {
 			process.init();
@@ -214,7 +401,7 @@ void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pai
 		_rerunProcess = false;
 		size_t evtCount = 0;
 		if(process.mode == CS_ALWAYS && process.run) {
-			for(const auto& read: reader) {
+			for(auto& read: reader) {
 				_currentRunId = read.runId;
 				_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(_currentRunId)));
 				_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
@@ -223,32 +410,41 @@ void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pai
 				}
 				_analysisRunning = true;
 				evtCount = 0;
+				selectEvents(read, CS_ALWAYS);
+				_progress.begin(process.name, read.runId, _rerunNumber, _eventsPerRun[{CS_ALWAYS, read.runId}]);
 				auto track_it = read.trackreader.begin();
 				for(const auto& pixel: *read.pixelreader) {
-					while(track_it->eventNumber < (int)pixel.eventNumber + _dataOffset && track_it != read.trackreader.end())
-						++track_it;
-					TrackStreamReader::event_t track = *track_it;
-					if(track.eventNumber != pixel.eventNumber) {
-						track.tracks.clear();
-						track.eventNumber = pixel.eventNumber;
+					TrackStreamReader::event_t track;
+					{
+						ScopedTimer timer(alignStage);
+						while(track_it->eventNumber < (int)pixel.eventNumber + _dataOffset && track_it != read.trackreader.end())
+							++track_it;
+						track = *track_it;
+						if(track.eventNumber != pixel.eventNumber) {
+							track.tracks.clear();
+							track.eventNumber = pixel.eventNumber;
+						}
 					}
-					if(evtCount % 1000 == 0) {
-						std::cout << process.name << ": Processing step " << evtCount;
-						if(_rerunNumber)
-							std::cout << " rerun " << _rerunNumber;
-						std::cout << " for MPA run " << read.runId << std::endl;
+					bool joined = track_it != read.trackreader.end() &&
+					              track_it->eventNumber == (int)pixel.eventNumber + _dataOffset;
+					if(!acceptDecodedEvent(read, joined ? track_it->tracks.size() : 0, pixel)) {
+						continue;
+					}
+					if((++evtCount & progress_interval_mask) == 0) {
+						publishProgress(evtCount);
 					}
-					++evtCount;
+					ScopedTimer timer(runStage);
 					if(!process.run(track, pixel))
 						break;
 				}
+				finishProgress(CS_ALWAYS, read.runId, evtCount);
 				_analysisRunning = false;
 				if(process.run_post) {
 					process.run_post();
 				}
 			}
 		} else if (process.run) {
-			for(const auto& read: reader) {
+			for(auto& read: reader) {
 				_currentRunId = read.runId;
 				_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(_currentRunId)));
 				_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
@@ -257,28 +453,33 @@ void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pai
 				}
 				_analysisRunning = true;
 				evtCount = 0;
+				selectEvents(read, CS_TRACK);
+				_progress.begin(process.name, read.runId, _rerunNumber, _eventsPerRun[{CS_TRACK, read.runId}]);
 				auto pixel_it = read.pixelreader->begin();
 				for(const auto& track: read.trackreader) {
-					while((int)pixel_it->eventNumber + _dataOffset < track.eventNumber &&
-					      pixel_it != read.pixelreader->end())
-						++pixel_it;
+					{
+						ScopedTimer timer(alignStage);
+						while((int)pixel_it->eventNumber + _dataOffset < track.eventNumber &&
+						      pixel_it != read.pixelreader->end())
+							++pixel_it;
+					}
 					if((int)pixel_it->eventNumber + _dataOffset > track.eventNumber) {
 						continue;
 					}
-					if(evtCount % 1000 == 0) {
-						std::cout << process.name <<  ": Processing step " << evtCount;
-						if(_rerunNumber)
-							std::cout << " rerun " << _rerunNumber;
-						std::cout << " event no. " << track.eventNumber << "/" << pixel_it->eventNumber;
-						std::cout << " for MPA run " << _currentRunId << std::endl;
+					if((++evtCount & progress_interval_mask) == 0) {
+						publishProgress(evtCount);
 					}
-					++evtCount;
 					if(pixel_it == read.pixelreader->end())
 						break;
 					assert((int)pixel_it->eventNumber + _dataOffset == track.eventNumber);
+					if(!acceptDecodedEvent(read, track.tracks.size(), *pixel_it)) {
+						continue;
+					}
+					ScopedTimer timer(runStage);
 					if(!process.run(track, *pixel_it))
 						break;
 				}
+				finishProgress(CS_TRACK, read.runId, evtCount);
 				_analysisRunning = false;
 				if(process.run_post) {
 					process.run_post();
@@ -291,3 +492,145 @@ void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pai
 		++_rerunNumber;
 	} while(_rerunProcess);
 }
+
+void TrackAnalysis::executeFusedProcesses(std::vector<TrackAnalysis::run_read_pair_t>& reader,
+                                          std::vector<const process_t*> processes)
+{
+	const size_t alignStage = Instrumentation::stage("TrackAnalysis::alignEvents");
+	std::vector<size_t> runStages;
+	std::vector<size_t> rerunNumbers(processes.size(), 0);
+	for(const auto proc: processes) {
+		runStages.push_back(Instrumentation::stage(proc->name + "::run"));
+	}
+	while(!processes.empty()) {
+		std::string name;
+		for(size_t i = 0; i < processes.size(); ++i) {
+			name += (i ? "+" : "") + processes[i]->name;
+			if(processes[i]->init) {
+				_rerunNumber = rerunNumbers[i];
+				processes[i]->init();
+			}
+		}
+		for(auto& read: reader) {
+			_currentRunId = read.runId;
+			_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(_currentRunId)));
+			_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
+			std::vector<bool> active(processes.size(), false);
+			size_t numActive = 0;
+			for(size_t i = 0; i < processes.size(); ++i) {
+				if(!processes[i]->run) {
+					continue;
+				}
+				active[i] = true;
+				++numActive;
+				if(processes[i]->run_init) {
+					_rerunNumber = rerunNumbers[i];
+					processes[i]->run_init();
+				}
+			}
+			if(numActive == 0) {
+				continue;
+			}
+			// CS_TRACK processes only see events with a track event, so they can share a sample of those
+			callback_stop_t mode = std::all_of(processes.begin(), processes.end(),
+			                                   [](const process_t* proc) { return proc->mode == CS_TRACK; }) ?
+			                       CS_TRACK : CS_ALWAYS;
+			selectEvents(read, mode);
+			_analysisRunning = true;
+			size_t pixelCount = 0;
+			size_t trackCount = 0;
+			// the progress counts the events of the mode, like executeProcess()
+			const size_t& evtCount = mode == CS_TRACK ? trackCount : pixelCount;
+			_progress.begin(name, read.runId, *std::max_element(rerunNumbers.begin(), rerunNumbers.end()),
+			                _eventsPerRun[{mode, read.runId}]);
+			// Driven by the pixel events like CS_ALWAYS, CS_TRACK processes only see events with a track event
+			auto track_it = read.trackreader.begin();
+			for(const auto& pixel: *read.pixelreader) {
+				bool matched;
+				{
+					ScopedTimer timer(alignStage);
+					while(track_it != read.trackreader.end() &&
+					      track_it->eventNumber < (int)pixel.eventNumber + _dataOffset)
+						++track_it;
+					matched = track_it != read.trackreader.end() &&
+					          track_it->eventNumber == (int)pixel.eventNumber + _dataOffset;
+				}
+				if(!acceptDecodedEvent(read, matched ? track_it->tracks.size() : 0, pixel)) {
+					continue;
+				}
+				++pixelCount;
+				if(matched) {
+					++trackCount;
+				}
+				if((mode == CS_ALWAYS || matched) && (evtCount & progress_interval_mask) == 0) {
+					publishProgress(evtCount);
+				}
+				TrackStreamReader::event_t alwaysTrack;
+				bool haveAlwaysTrack = false;
+				for(size_t i = 0; i < processes.size(); ++i) {
+					if(!active[i]) {
+						continue;
+					}
+					const auto& proc = *processes[i];
+					bool cont = true;
+					if(proc.mode == CS_ALWAYS) {
+						if(!haveAlwaysTrack) {
+							if(track_it != read.trackreader.end() && track_it->eventNumber == (int)pixel.eventNumber) {
+								alwaysTrack = *track_it;
+							} else {
+								alwaysTrack.tracks.clear();
+								alwaysTrack.eventNumber = pixel.eventNumber;
+							}
+							haveAlwaysTrack = true;
+						}
+						_rerunNumber = rerunNumbers[i];
+						ScopedTimer timer(runStages[i]);
+						cont = proc.run(alwaysTrack, pixel);
+					} else if(matched) {
+						_rerunNumber = rerunNumbers[i];
+						ScopedTimer timer(runStages[i]);
+						cont = proc.run(*track_it, pixel);
+					}
+					if(!cont) {
+						active[i] = false;
+						--numActive;
+					}
+				}
+				if(numActive == 0) {
+					break;
+				}
+			}
+			finishProgress(mode, read.runId, evtCount);
+			if(mode == CS_ALWAYS) {
+				// all events were visited, the ones with a track event are what a CS_TRACK pass sees
+				auto& expected = _eventsPerRun[{CS_TRACK, read.runId}];
+				expected = std::max(expected, trackCount);
+			}
+			_analysisRunning = false;
+			for(size_t i = 0; i < processes.size(); ++i) {
+				if(processes[i]->run && processes[i]->run_post) {
+					_rerunNumber = rerunNumbers[i];
+					processes[i]->run_post();
+				}
+			}
+		}
+		std::vector<const process_t*> rerunProcesses;
+		std::vector<size_t> rerunProcessNumbers;
+		std::vector<size_t> rerunStages;
+		for(size_t i = 0; i < processes.size(); ++i) {
+			_rerunNumber = rerunNumbers[i];
+			_rerunProcess = false;
+			if(processes[i]->post) {
+				processes[i]->post();
+			}
+			if(_rerunProcess) {
+				rerunProcesses.push_back(processes[i]);
+				rerunProcessNumbers.push_back(rerunNumbers[i] + 1);
+				rerunStages.push_back(runStages[i]);
+			}
+		}
+		processes.swap(rerunProcesses);
+		rerunNumbers.swap(rerunProcessNumbers);
+		runStages.swap(rerunStages);
+	}
+}
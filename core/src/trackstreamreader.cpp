@@ -1,16 +1,20 @@
 
 #include "trackstreamreader.h"
+#include "instrumentation.h"
+#include "runcache.h"
 #include <cassert>
 #include <regex.h>
 #include <iostream>
+#include <sstream>
 
 using namespace core;
 
 #define REG_SUBSTR(str, match) str.substr(match.rm_so, match.rm_eo - match.rm_so)
 
-TrackStreamReader::EventIterator::EventIterator(const std::string& filename, bool end) :
+TrackStreamReader::EventIterator::EventIterator(const std::string& filename, bool end,
+                                                std::shared_ptr<const EventIndex::selection_t> selection) :
  _fin(), _filename(filename), _end(end), _currentEvent(), _nextEvent(),_regexCompiled(false), _eventsRead(0),
- _currentLineNo(0)
+ _currentLineNo(0), _selection(selection), _selectionPos(0)
 {
 	if(!_end) {
 		compileRegex();
@@ -19,12 +23,22 @@ TrackStreamReader::EventIterator::EventIterator(const std::string& filename, boo
 	}
 }
 
+TrackStreamReader::EventIterator::EventIterator(const std::string& filename,
+                                                std::shared_ptr<const std::vector<event_t>> events,
+                                                std::shared_ptr<const EventIndex::selection_t> selection) :
+ _fin(), _filename(filename), _end(false), _currentEvent(), _nextEvent(),_regexCompiled(false), _eventsRead(0),
+ _currentLineNo(0), _events(events), _selection(selection), _selectionPos(0)
+{
+	++(*this);
+}
+
 TrackStreamReader::EventIterator::EventIterator(const EventIterator& other)
  : _fin(), _filename(other._filename), _end(other._end), 
    _currentEvent(other._currentEvent), _nextEvent(other._nextEvent), _regexCompiled(false),
-   _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo)
+   _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo), _events(other._events),
+   _selection(other._selection), _selectionPos(other._selectionPos)
 {
-	if(!_end) {
+	if(!_end && !_events) {
 		compileRegex();
 		open();
 		_fin.seekg(other._fin.tellg());
@@ -41,9 +55,13 @@ TrackStreamReader::EventIterator::EventIterator(EventIterator&& other) noexcept
  _currentEvent(std::move(other._currentEvent)),
  _nextEvent(std::move(other._nextEvent)),
  _regexCompiled(other._regexCompiled), _regexLine(other._regexLine), _regexComment(other._regexComment),
- _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo)
+ _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo), _events(std::move(other._events)),
+ _selection(std::move(other._selection)), _selectionPos(other._selectionPos)
 {
 #ifdef NO_IOSTREAM_MOVE
+	if(_events) {
+		return;
+	}
 	open();
 	_fin.seekg(other._fin.tellg());
 	other._regexCompiled = false; // steal ownership of compiled regexes
@@ -70,8 +88,10 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator=(Ev
 {
 	_fin.close();
 #ifdef NO_IOSTREAM_MOVE
-	open();
-	_fin.seekg(other._fin.tellg());
+	if(!other._events) {
+		open();
+		_fin.seekg(other._fin.tellg());
+	}
 #else
 	_fin = std::move(other._fin);
 #endif
@@ -84,6 +104,9 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator=(Ev
 	_regexComment = other._regexLine;
 	_eventsRead = other._eventsRead;
 	_currentLineNo = other._currentLineNo;
+	_events = std::move(other._events);
+	_selection = std::move(other._selection);
+	_selectionPos = other._selectionPos;
 	other._regexCompiled = false; // steal regex ownership
 	return *this;
 }
@@ -103,7 +126,35 @@ bool TrackStreamReader::EventIterator::operator!=(const EventIterator& other) co
 
 TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 {
+	CORE_TIMED_SCOPE("TrackStreamReader::next");
+	const EventIndex::entry_t* selected = nullptr;
+	if(_selection) {
+		if(_selectionPos >= _selection->size()) {
+			_end = true;
+			return *this;
+		}
+		selected = &(*_selection)[_selectionPos++];
+	}
+	if(_events) {
+		while(selected && _eventsRead < _events->size() &&
+		      (*_events)[_eventsRead].eventNumber < selected->eventNumber) {
+			++_eventsRead;
+		}
+		if(_eventsRead < _events->size()) {
+			_currentEvent = (*_events)[_eventsRead++];
+		} else {
+			// like an iterator reading the file, the end iterator keeps the last event
+			_end = true;
+		}
+		return *this;
+	}
 	assert(_regexCompiled);
+	if(selected) {
+		// continue at the first line of the selected event, data read ahead belongs to another event
+		_fin.clear();
+		_fin.seekg(selected->offset);
+		_nextEvent.tracks.clear();
+	}
 	// last read reached EOF, so we are an end-iterator now
 	if(!_fin.good()) {
 		_end = true;
@@ -123,7 +174,7 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 	_currentEvent.tracks.clear();
 	_nextEvent.tracks.clear();
 
-	bool first_event = _eventsRead == 0;
+	bool first_event = _eventsRead == 0 || selected;
 	bool last_line_parsed = false;
 
 	regmatch_t m[10];
@@ -274,10 +325,72 @@ TrackStreamReader::TrackStreamReader(const std::string& filename)
 
 TrackStreamReader::EventIterator TrackStreamReader::begin() const
 {
-	return EventIterator(_filename, false);
+	if(RunCache::isEnabled()) {
+		auto events = RunCache::get<event_t>("TrackStreamReader", _filename,
+			[this](std::vector<event_t>& events, size_t maxBytes) {
+				size_t bytes = 0;
+				for(EventIterator it(_filename, false); !it.isEnd() && bytes <= maxBytes; ++it) {
+					events.push_back(*it);
+					bytes += sizeof(event_t) + RunCache::vectorBytes(events.back().tracks);
+					for(const auto& track: events.back().tracks) {
+						bytes += RunCache::vectorBytes(track.sensorIDs) + RunCache::vectorBytes(track.points);
+					}
+				}
+				return bytes;
+			});
+		if(events) {
+			return EventIterator(_filename, events, _selection);
+		}
+	}
+	if(_selection && _selection->empty()) {
+		return end();
+	}
+	return EventIterator(_filename, false, _selection);
 }
 
 TrackStreamReader::EventIterator TrackStreamReader::end() const
 {
 	return EventIterator(_filename, true);
 }
+
+std::shared_ptr<const EventIndex> TrackStreamReader::getIndex() const
+{
+	return EventIndex::get("TrackStreamReader", _filename, &TrackStreamReader::buildIndex);
+}
+
+void TrackStreamReader::buildIndex(std::istream& in, std::vector<EventIndex::entry_t>& entries)
+{
+	std::string line;
+	uint64_t offset = 0;
+	int num_empty_lines = 0;
+	// two empty lines end a track, the next data line starts a new one
+	bool block_ended = false;
+	while(std::getline(in, line)) {
+		uint64_t line_offset = offset;
+		offset += line.size() + 1;
+		if(line == "\r" || line == "") {
+			num_empty_lines++;
+			continue;
+		}
+		if(num_empty_lines >= 2) {
+			block_ended = true;
+		}
+		num_empty_lines = 0;
+		auto first = line.find_first_not_of(" \t\v\f\r");
+		if(first == std::string::npos || line[first] == '#') {
+			continue;
+		}
+		std::istringstream sstr(line);
+		std::string column;
+		int eventNumber;
+		if(!(sstr >> column >> column >> column >> column >> eventNumber)) {
+			continue;
+		}
+		if(entries.empty() || entries.back().eventNumber != eventNumber) {
+			entries.push_back({eventNumber, 1, 0, line_offset});
+		} else if(block_ended) {
+			entries.back().count++;
+		}
+		block_ended = false;
+	}
+}
@@ -1,4 +1,5 @@
 #include "triplet.h"
+#include "instrumentation.h"
 
 using namespace core;
 
@@ -7,6 +8,7 @@ std::vector<Triplet> Triplet::findTriplets(const core::run_data_t& run,
                                            double residual_cut,
                                            std::array<int, 3> planes)
 {
+	CORE_TIMED_SCOPE("Triplet::findTriplets");
 	std::vector<Triplet> triplets;
 	auto td = &(*run.telescopeHits)->p1;
 	for(int ia = 0; ia < td[planes[0]].x.GetNoElements(); ++ia) {
@@ -1,8 +1,10 @@
 #include "triplettrack.h"
+#include "instrumentation.h"
 #include <TFitResult.h>
 #include "mpahitgenerator.h"
 #include <iostream>
 #include "aligner.h"
+#include "candidategrid.h"
 
 using namespace core;
 
@@ -43,7 +45,10 @@ std::vector<core::TripletTrack> TripletTrack::getTracks(constants_t consts,
 {
 	std::vector<core::TripletTrack> candidates;
 	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+		{
+			CORE_TIMED_SCOPE("TTree::GetEntry");
+			run.tree->GetEntry(evt);
+		}
 		auto downstream = core::Triplet::findTriplets(run, consts.angle_cut, consts.downstream_residual_cut, {3, 4, 5});
 		if(hist) {
 			// debug histograms
@@ -110,7 +115,10 @@ std::vector<core::TripletTrack> TripletTrack::getTracksWithRef(constants_t const
 	assert(hist.down_angle_x);
 	std::vector<core::TripletTrack> candidates;
 	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+		{
+			CORE_TIMED_SCOPE("TTree::GetEntry");
+			run.tree->GetEntry(evt);
+		}
 		auto downstream = core::Triplet::findTriplets(run, consts.angle_cut, consts.downstream_residual_cut, {3, 4, 5});
 		// debug histograms
 		for(const auto& triplet: downstream) {
@@ -220,12 +228,17 @@ std::vector<std::pair<core::TripletTrack, Eigen::Vector3d>> TripletTrack::getTra
 {
 	assert(hist.down_angle_x);
 	std::vector<std::pair<core::TripletTrack, Eigen::Vector3d>> candidates;
-	MpaTransform transform;
-	transform.setOffset(consts.dut_offset);
-	transform.setRotation(consts.dut_rotation);
+	// chip of the DUT hit of each candidate
+	std::vector<int> candidateChips;
+	MpaAssembly assembly(consts.dut_assembly);
+	assembly.setPose(consts.dut_offset, consts.dut_rotation);
+	MpaHitGenerator::assembly_hits_t mpaHits;
 	int numMpa = 0;
 	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+		{
+			CORE_TIMED_SCOPE("TTree::GetEntry");
+			run.tree->GetEntry(evt);
+		}
 		auto downstream = core::Triplet::findTriplets(run, consts.angle_cut, consts.downstream_residual_cut, {3, 4, 5});
 		// debug histograms
 		for(const auto& triplet: downstream) {
@@ -244,77 +257,85 @@ std::vector<std::pair<core::TripletTrack, Eigen::Vector3d>> TripletTrack::getTra
 		}
 		// cut downstream triplets on their residual to ref hit
 		auto refData = (*run.telescopeHits)->ref;
-		std::vector<std::pair<core::Triplet, Eigen::Vector3d>> fullDownstream;
+		std::vector<Eigen::Vector3d> refHits;
 		for(int i = 0; i < refData.x.GetNoElements(); ++i) {
-			Eigen::Vector3d hit(refData.x[i],
+			refHits.emplace_back(refData.x[i],
 			                     refData.y[i],
 					     refData.z[i]);
-			for(auto triplet: downstream) {
-				double resx = triplet.getdx(hit - consts.ref_prealign);
-				double resy = triplet.getdy(hit - consts.ref_prealign);
-				if(std::abs(resx) > consts.ref_residual_precut || std::abs(resy) > consts.ref_residual_precut) {
-					continue;
-				}
-				hist.ref_down_res_x->Fill(resx);
-				hist.ref_down_res_y->Fill(resy);
-				fullDownstream.push_back({triplet, hit});
-			}
+		}
+		std::vector<std::pair<core::Triplet, Eigen::Vector3d>> fullDownstream;
+		for(const auto& match: matchRefHits(refHits, downstream, consts.ref_prealign, consts.ref_residual_precut)) {
+			const auto& hit = refHits[match.first];
+			const auto& triplet = downstream[match.second];
+			hist.ref_down_res_x->Fill(triplet.getdx(hit - consts.ref_prealign));
+			hist.ref_down_res_y->Fill(triplet.getdy(hit - consts.ref_prealign));
+			fullDownstream.push_back({triplet, hit});
 		}
 		// build upstream vector
 		std::vector<std::pair<core::Triplet, Eigen::Vector3d>> fullUpstream;
+		std::vector<int> fullUpstreamChips;
 		if(useDut) {
-			std::vector<int> clusterSize;
-			auto mpaHits = MpaHitGenerator::getCounterClusters(run, transform, &clusterSize, nullptr);
-			for(const auto& hit: mpaHits) {
-				for(const auto& triplet: upstream) {
-					auto plane_hit = transform.mpaPlaneTrackIntersect(triplet);
-					Eigen::Vector3d res = plane_hit - hit;
-					// Eigen::Vector3d plane_local_hit = transform.getInverseRotationMatrix()*(res);
-					// double resx = plane_local_hit(0);
-					// double resy = plane_local_hit(1);
-					double resx = res(0);
-					double resy = res(1);
-					//double resx = triplet.getdx(plane_local_hit(2));
-					//double resy = triplet.getdy(plane_local_hit(2));
-					hist.dut_up_res_x->Fill(resx);
-					hist.dut_up_res_y->Fill(resy);
-					fullUpstream.push_back({triplet, hit});
+			MpaHitGenerator::getAssemblyHits(run, assembly, mpaHits);
+			for(const auto& chip: mpaHits.chips) {
+				const auto& transform = assembly.getTransform(chip.index);
+				for(const auto& hit: chip.globalClusters) {
+					for(const auto& triplet: upstream) {
+						auto plane_hit = transform.mpaPlaneTrackIntersect(triplet);
+						Eigen::Vector3d res = plane_hit - hit;
+						// Eigen::Vector3d plane_local_hit = transform.getInverseRotationMatrix()*(res);
+						// double resx = plane_local_hit(0);
+						// double resy = plane_local_hit(1);
+						double resx = res(0);
+						double resy = res(1);
+						//double resx = triplet.getdx(plane_local_hit(2));
+						//double resy = triplet.getdy(plane_local_hit(2));
+						hist.dut_up_res_x->Fill(resx);
+						hist.dut_up_res_y->Fill(resy);
+						fullUpstream.push_back({triplet, hit});
+						fullUpstreamChips.push_back(chip.index);
+					}
+				}
+				for(auto size: chip.clusterSizes) {
+					hist.dut_cluster_size->Fill(size);
 				}
-			}
-			for(auto size: clusterSize) {
-				hist.dut_cluster_size->Fill(size);
 			}
 		} else {
 			for(const auto& triplet: upstream) {
 				fullUpstream.push_back({triplet, {0, 0, 0}});
+				fullUpstreamChips.push_back(2);
 			}
 		}
 		// build tracks
+		std::vector<core::Triplet> downTriplets;
+		for(const auto& pair: fullDownstream) {
+			downTriplets.push_back(pair.first);
+		}
+		std::vector<core::Triplet> upTriplets;
+		for(const auto& pair: fullUpstream) {
+			upTriplets.push_back(pair.first);
+		}
 		int numNewCandidates = 0;
-		for(auto pair: fullDownstream) {
-			auto down = pair.first;
-			auto ref = pair.second;
-			for(const auto uppair: fullUpstream) {
-				auto up = uppair.first;
-				Eigen::Vector3d dut = uppair.second;
-				core::TripletTrack t(evt, up, down, ref);
-				auto resx = t.xresidualat(consts.dut_offset(2));
-				auto resy = t.yresidualat(consts.dut_offset(2));
-				auto kinkx = std::abs(t.kinkx());
-				auto kinky = std::abs(t.kinky());
-				if(std::abs(resx) > consts.six_residual_cut || std::abs(resy) > consts.six_residual_cut) {
-					continue;
-				}
-				if(kinkx > consts.six_kink_cut || kinky > consts.six_kink_cut) {
-					continue;
-				}
-				hist.track_kink_x->Fill(kinkx);
-				hist.track_kink_y->Fill(kinky);
-				hist.track_residual_x->Fill(resx);
-				hist.track_residual_y->Fill(resy);
-				candidates.push_back({t, dut});
-				++numNewCandidates;
+		for(const auto& match: matchTriplets(downTriplets, upTriplets, consts.dut_offset(2), consts.six_residual_cut)) {
+			const auto& down = fullDownstream[match.first].first;
+			const auto& ref = fullDownstream[match.first].second;
+			size_t upIdx = match.second;
+			const auto& up = fullUpstream[upIdx].first;
+			Eigen::Vector3d dut = fullUpstream[upIdx].second;
+			core::TripletTrack t(evt, up, down, ref);
+			auto resx = t.xresidualat(consts.dut_offset(2));
+			auto resy = t.yresidualat(consts.dut_offset(2));
+			auto kinkx = std::abs(t.kinkx());
+			auto kinky = std::abs(t.kinky());
+			if(kinkx > consts.six_kink_cut || kinky > consts.six_kink_cut) {
+				continue;
 			}
+			hist.track_kink_x->Fill(kinkx);
+			hist.track_kink_y->Fill(kinky);
+			hist.track_residual_x->Fill(resx);
+			hist.track_residual_y->Fill(resy);
+			candidates.push_back({t, dut});
+			candidateChips.push_back(fullUpstreamChips[upIdx]);
+			++numNewCandidates;
 		}
 //		std::cout << "Array Sizes:"
 //		          << "\n  upstream:   " << upstream.size()
@@ -354,12 +375,14 @@ std::vector<std::pair<core::TripletTrack, Eigen::Vector3d>> TripletTrack::getTra
 	// find DUT prealignment
 	Eigen::Vector3d dutPreAlign(consts.dut_prealign);
 	if(new_dut_prealign) {
-		dutPreAlign = fitDutPrealignment(hist.dut_up_res_x, hist.dut_up_res_y, transform, consts.dut_plateau_x);
+		dutPreAlign = fitDutPrealignment(hist.dut_up_res_x, hist.dut_up_res_y, assembly.getTransform(2), consts.dut_plateau_x);
 		*new_dut_prealign = dutPreAlign;
 	}
 	std::vector<std::pair<core::TripletTrack, Eigen::Vector3d>> accepted;
-	transform.setOffset(consts.dut_offset + dutPreAlign);
-	for(auto pair: candidates) {
+	assembly.setPose(consts.dut_offset + dutPreAlign, consts.dut_rotation);
+	for(size_t candIdx = 0; candIdx < candidates.size(); ++candIdx) {
+		const auto& pair = candidates[candIdx];
+		const auto& transform = assembly.getTransform(candidateChips[candIdx]);
 		TripletTrack track = pair.first;
 		Eigen::Vector3d dut = pair.second + dutPreAlign; // activated DUT pixel in global coords
 		auto track_x = track.xresidualat(consts.dut_offset(2));
@@ -386,6 +409,78 @@ std::vector<std::pair<core::TripletTrack, Eigen::Vector3d>> TripletTrack::getTra
 	return accepted;
 }
 
+std::vector<std::pair<size_t, size_t>> TripletTrack::matchRefHits(const std::vector<Eigen::Vector3d>& refHits,
+                                                                 const std::vector<Triplet>& downstream,
+                                                                 const Eigen::Vector3d& prealign, double cut)
+{
+	CORE_TIMED_SCOPE("TripletTrack::matchRefHits");
+	std::vector<std::pair<size_t, size_t>> matches;
+	if(refHits.empty() || downstream.empty()) {
+		return matches;
+	}
+	// the triplets are placed at the Z of the first hit, the residual to another hit differs by the slope
+	// times the Z distance of the hits
+	double z = refHits[0](2) - prealign(2);
+	double maxSlope = 0;
+	for(const auto& triplet: downstream) {
+		double slope = triplet.slope().cwiseAbs().maxCoeff();
+		// NaN disables the grid
+		if(!(slope <= maxSlope)) {
+			maxSlope = slope;
+		}
+	}
+	double maxDistance = 0;
+	for(const auto& hit: refHits) {
+		double distance = std::abs(hit(2) - prealign(2) - z);
+		if(!(distance <= maxDistance)) {
+			maxDistance = distance;
+		}
+	}
+	CandidateGrid grid(cut + maxSlope * maxDistance);
+	Eigen::Vector3d plane(0, 0, z);
+	for(const auto& triplet: downstream) {
+		grid.insert({-triplet.getdx(plane), -triplet.getdy(plane)});
+	}
+	std::vector<size_t> indices;
+	for(size_t hitIdx = 0; hitIdx < refHits.size(); ++hitIdx) {
+		Eigen::Vector3d hit = refHits[hitIdx] - prealign;
+		grid.query(hit.head<2>(), indices);
+		for(auto idx: indices) {
+			double resx = downstream[idx].getdx(hit);
+			double resy = downstream[idx].getdy(hit);
+			if(std::abs(resx) > cut || std::abs(resy) > cut) {
+				continue;
+			}
+			matches.push_back({hitIdx, idx});
+		}
+	}
+	return matches;
+}
+
+std::vector<std::pair<size_t, size_t>> TripletTrack::matchTriplets(const std::vector<Triplet>& downstream,
+                                                                  const std::vector<Triplet>& upstream,
+                                                                  double z, double cut)
+{
+	CORE_TIMED_SCOPE("TripletTrack::matchTriplets");
+	std::vector<std::pair<size_t, size_t>> matches;
+	CandidateGrid grid(cut);
+	for(const auto& triplet: upstream) {
+		grid.insert(triplet.extrapolate(z).head<2>());
+	}
+	std::vector<size_t> indices;
+	for(size_t downIdx = 0; downIdx < downstream.size(); ++downIdx) {
+		grid.query(downstream[downIdx].extrapolate(z).head<2>(), indices);
+		for(auto upIdx: indices) {
+			TripletTrack t(0, upstream[upIdx], downstream[downIdx]);
+			if(std::abs(t.xresidualat(z)) > cut || std::abs(t.yresidualat(z)) > cut) {
+				continue;
+			}
+			matches.push_back({downIdx, upIdx});
+		}
+	}
+	return matches;
+}
+
 Eigen::Vector3d TripletTrack::fitDutPrealignment(TH1D* x, TH1D* y, const MpaTransform& transform, bool plateau_x)
 {
 	Eigen::Vector3d offset{0, 0, 0};
@@ -0,0 +1,109 @@
+#include "zscan.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+#include <cassert>
+
+using namespace core;
+
+ZScan::ZScan(size_t a, size_t b, size_t axis) :
+ _a(a), _b(b), _axis(axis)
+{
+	assert(axis < 3);
+	clear();
+}
+
+void ZScan::clear()
+{
+	_eventNumbers.clear();
+	_trackBegin.assign(1, 0);
+	_hitBegin.assign(1, 0);
+	_trackPoints.clear();
+	_trackDirections.clear();
+	_hits.clear();
+}
+
+void ZScan::addEvent(int eventNumber, const std::vector<Track>& tracks, const std::vector<hit_t>& hits)
+{
+	_eventNumbers.push_back(eventNumber);
+	for(const auto& track: tracks) {
+		const auto& A = track.points.at(_a);
+		_trackPoints.push_back(A);
+		_trackDirections.push_back(track.points.at(_b) - A);
+	}
+	_hits.insert(_hits.end(), hits.begin(), hits.end());
+	_trackBegin.push_back(_trackPoints.size());
+	_hitBegin.push_back(_hits.size());
+}
+
+void ZScan::scan(const std::vector<double>& positions, const fill_callback_t& fill,
+                 const event_callback_t& eventDone, size_t numThreads) const
+{
+	if(numThreads == 0) {
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	numThreads = std::min(numThreads, positions.size());
+	if(numThreads <= 1) {
+		for(size_t step = 0; step < positions.size(); ++step) {
+			scanStep(step, positions[step], fill, eventDone);
+		}
+		return;
+	}
+	std::atomic<size_t> nextStep(0);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	std::vector<std::thread> threads;
+	for(size_t i = 0; i < numThreads; ++i) {
+		threads.emplace_back([&]() {
+			size_t step;
+			while((step = nextStep++) < positions.size()) {
+				try {
+					scanStep(step, positions[step], fill, eventDone);
+				} catch(...) {
+					std::lock_guard<std::mutex> lk(errorMutex);
+					if(!error) {
+						error = std::current_exception();
+					}
+					nextStep = positions.size();
+				}
+			}
+		});
+	}
+	for(auto& thread: threads) {
+		thread.join();
+	}
+	if(error) {
+		std::rethrow_exception(error);
+	}
+}
+
+void ZScan::scanStep(size_t step, double position, const fill_callback_t& fill,
+                     const event_callback_t& eventDone) const
+{
+	for(size_t event = 0; event < _eventNumbers.size(); ++event) {
+		for(size_t track = _trackBegin[event]; track < _trackBegin[event+1]; ++track) {
+			// same arithmetic as Track::extrapolateOnPlane()
+			const auto& A = _trackPoints[track];
+			const auto& D = _trackDirections[track];
+			double t = (position - A(_axis)) / D(_axis);
+			Eigen::Vector3d point = D*t + A;
+			for(size_t hit = _hitBegin[event]; hit < _hitBegin[event+1]; ++hit) {
+				fill(step, event, point, _hits[hit]);
+			}
+		}
+		if(eventDone) {
+			eventDone(step, event);
+		}
+	}
+}
+
+std::vector<double> ZScan::steps(double low, double high, int numSteps)
+{
+	std::vector<double> positions;
+	for(int step = 0; step < numSteps; ++step) {
+		positions.push_back(low + (high - low) / (numSteps-1) * step);
+	}
+	return positions;
+}
@@ -0,0 +1,92 @@
+#include "aligner.h"
+#include "gtest/gtest.h"
+#include <TH1.h>
+#include <TH1D.h>
+#include <random>
+#include <vector>
+#include <utility>
+
+using namespace core;
+
+class aligner : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		TH1::AddDirectory(false);
+		// Gaussian peak on X, plateau on Y, a few residuals outside of the histogram ranges
+		std::mt19937 random(1);
+		std::normal_distribution<double> gaus(0.3, 0.2);
+		std::uniform_real_distribution<double> plateau(-0.8, 1.2);
+		std::normal_distribution<double> smear(0, 0.05);
+		for(int i = 0; i < 20000; ++i) {
+			_residuals.emplace_back(gaus(random), plateau(random) + smear(random));
+		}
+		_residuals.emplace_back(-7.0, 9.0);
+		_residuals.emplace_back(12.0, -6.0);
+		_residuals.emplace_back(5.0, 5.0);
+	}
+
+	/// Alignment from histograms filled with every residual, as before the residuals were counted
+	std::pair<Eigen::Vector3d, Eigen::Vector2d> fixedHistogramAlignment(const Aligner& config) const
+	{
+		TH1D x("referenceX", "", config.xHistogramConfig.nbins, config.xHistogramConfig.min,
+		       config.xHistogramConfig.max);
+		TH1D y("referenceY", "", config.yHistogramConfig.nbins, config.yHistogramConfig.min,
+		       config.yHistogramConfig.max);
+		for(const auto& residual: _residuals) {
+			x.Fill(residual.first);
+			y.Fill(residual.second);
+		}
+		auto xalign = Aligner::alignGaussian(&x, 0.5, 0.1, true);
+		auto yalign = Aligner::alignPlateau(&y, 1, 0.05, true);
+		return {{xalign(0), yalign(0), 0.0}, {xalign(1), yalign(1)}};
+	}
+
+	std::vector<std::pair<double, double>> _residuals;
+};
+
+TEST_F(aligner, histogram_equals_filled)
+{
+	Aligner al;
+	al.initHistograms("histogramX", "histogramY");
+	TH1D reference("reference", "", al.xHistogramConfig.nbins, al.xHistogramConfig.min, al.xHistogramConfig.max);
+	for(const auto& residual: _residuals) {
+		al.Fill(residual.first, residual.second);
+		reference.Fill(residual.first);
+	}
+	auto hist = al.getHistX();
+	ASSERT_EQ(hist->GetNbinsX(), reference.GetNbinsX());
+	EXPECT_EQ(hist->GetSumw2N(), 0);
+	EXPECT_EQ(hist->GetEntries(), reference.GetEntries());
+	EXPECT_DOUBLE_EQ(hist->GetMean(), reference.GetMean());
+	EXPECT_DOUBLE_EQ(hist->GetRMS(), reference.GetRMS());
+	for(int bin = 0; bin <= hist->GetNbinsX() + 1; ++bin) {
+		EXPECT_EQ(hist->GetBinContent(bin), reference.GetBinContent(bin)) << "bin " << bin;
+	}
+}
+
+TEST_F(aligner, alignment_equals_fixed_histogram)
+{
+	Aligner al;
+	al.initHistograms("alignX", "alignY");
+	for(const auto& residual: _residuals) {
+		al.Fill(residual.first, residual.second);
+	}
+	al.calculateAlignment(true);
+	auto reference = fixedHistogramAlignment(al);
+	for(int i = 0; i < 3; ++i) {
+		EXPECT_DOUBLE_EQ(al.getOffset()(i), reference.first(i));
+	}
+	for(int i = 0; i < 2; ++i) {
+		EXPECT_DOUBLE_EQ(al.getCuts()(i), reference.second(i));
+	}
+	EXPECT_NEAR(al.getOffset()(0), 0.3, 0.01);
+	EXPECT_NEAR(al.getCuts()(0), 0.2, 0.01);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include "alignmentstore.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <unistd.h>
+
+using namespace core;
+
+class alignmentstore : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		_filename = "/tmp/alignmentstore_test_" + std::to_string(getpid()) + ".sqldat";
+		std::remove(_filename.c_str());
+		// runs 1 to 6, angle 0 for odd runs and 10 for even runs, bias voltage 100 except run 5
+		for(int run = 1; run <= 6; ++run) {
+			_runlist.getRuns().push_back({run, run + 100, 0, run % 2 ? 0.0 : 10.0, run == 5 ? 50.0 : 100.0, 1.0, 0.5});
+		}
+	}
+
+	virtual void TearDown()
+	{
+		std::remove(_filename.c_str());
+	}
+
+	std::string _filename;
+	QuickRunlistReader _runlist;
+};
+
+TEST_F(alignmentstore, versions)
+{
+	AlignmentStore store(_filename);
+	AlignmentStore::alignment_t alignment;
+	EXPECT_FALSE(store.load(1, "MpaCmaesAlign", alignment));
+	EXPECT_EQ(store.save(1, "MpaCmaesAlign", {1.0, -2.0, 870.123456789012, 0.1, 0, 0}, 0.5, 1), 1);
+	EXPECT_EQ(store.save(1, "MpaCmaesAlign", {1.5, -2.5, 871, 0.2, 0, 0}, 0.25, 10), 2);
+	EXPECT_EQ(store.save(1, "MpaMinuitAlign", {1, 2, 3, 4, 5, 6}, 0.3), 1);
+	ASSERT_TRUE(store.load(1, "MpaCmaesAlign", alignment));
+	EXPECT_EQ(alignment.version, 2);
+	EXPECT_EQ(alignment.parameters, std::vector<double>({1.5, -2.5, 871, 0.2, 0, 0}));
+	EXPECT_EQ(alignment.fitness, 0.25);
+	EXPECT_EQ(alignment.status, 10);
+	ASSERT_TRUE(store.load(1, "MpaCmaesAlign", alignment, 1));
+	EXPECT_EQ(alignment.parameters, std::vector<double>({1.0, -2.0, 870.123456789012, 0.1, 0, 0}));
+	EXPECT_FALSE(store.load(1, "MpaCmaesAlign", alignment, 3));
+	EXPECT_EQ(store.getRuns("MpaCmaesAlign"), std::vector<int>({1}));
+	EXPECT_TRUE(store.getRuns("Other's").empty());
+}
+
+TEST_F(alignmentstore, persistent)
+{
+	AlignmentStore(_filename).save(4, "MpaCmaesAlign", {1, 2, 3}, 0.5);
+	AlignmentStore::alignment_t alignment;
+	AlignmentStore store(_filename);
+	EXPECT_TRUE(store.load(4, "MpaCmaesAlign", alignment));
+	EXPECT_EQ(store.save(4, "MpaCmaesAlign", {1, 2, 3}, 0.5), 2);
+}
+
+TEST_F(alignmentstore, nearest)
+{
+	AlignmentStore store(_filename);
+	AlignmentStore::alignment_t alignment;
+	EXPECT_FALSE(store.findNearest(_runlist, 3, {{"MpaCmaesAlign", {0}}}, alignment));
+	store.save(1, "MpaCmaesAlign", {1}, 0.5);
+	store.save(5, "MpaCmaesAlign", {5}, 0.5);
+	store.save(6, "MpaCmaesAlign", {6}, 0.5);
+	store.save(3, "MpaCmaesAlign", {3}, 0.5);
+	// run 3 itself and run 5 with a different bias voltage are not used
+	ASSERT_TRUE(store.findNearest(_runlist, 3, {{"MpaCmaesAlign", {0}}}, alignment));
+	EXPECT_EQ(alignment.runId, 1);
+	EXPECT_EQ(alignment.parameters, std::vector<double>({1}));
+	store.save(2, "MpaMinuitAlign", {2}, 0.5);
+	ASSERT_TRUE(store.findNearest(_runlist, 4, {{"MpaCmaesAlign", {0}}, {"MpaMinuitAlign", {0}}}, alignment));
+	EXPECT_EQ(alignment.runId, 2);
+	EXPECT_EQ(alignment.analysis, "MpaMinuitAlign");
+	EXPECT_FALSE(store.findNearest(_runlist, 5, {{"MpaCmaesAlign", {0}}, {"MpaMinuitAlign", {0}}}, alignment));
+	EXPECT_THROW(store.findNearest(_runlist, 7, {{"MpaCmaesAlign", {0}}}, alignment), std::invalid_argument);
+	EXPECT_EQ(_runlist.findByMpaRun(7), nullptr);
+	ASSERT_NE(_runlist.findByMpaRun(4), nullptr);
+	EXPECT_EQ(_runlist.findByMpaRun(4)->telescope_run, 104);
+}
+
+TEST_F(alignmentstore, nearest_accepted_status)
+{
+	AlignmentStore store(_filename);
+	AlignmentStore::alignment_t alignment;
+	store.save(1, "MpaCmaesAlign", {1}, 0.5, 1);
+	store.save(1, "MpaCmaesAlign", {1.5}, 0.5, 5);
+	store.save(3, "MpaCmaesAlign", {3}, 0.5, 5);
+	// the failed later version of run 1 is skipped, run 3 is not accepted at all
+	ASSERT_TRUE(store.findNearest(_runlist, 3, {{"MpaCmaesAlign", {1, 2}}}, alignment));
+	EXPECT_EQ(alignment.runId, 1);
+	EXPECT_EQ(alignment.version, 1);
+	EXPECT_EQ(alignment.parameters, std::vector<double>({1}));
+	EXPECT_FALSE(store.findNearest(_runlist, 3, {{"MpaCmaesAlign", {}}}, alignment));
+	ASSERT_TRUE(store.findNearest(_runlist, 3, {{"MpaCmaesAlign", {5}}}, alignment));
+	EXPECT_EQ(alignment.runId, 1);
+	EXPECT_EQ(alignment.version, 2);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
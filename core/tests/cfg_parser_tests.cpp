@@ -122,6 +122,38 @@ TEST(cfg_parser, whitespace_subst)
 		EXPECT_TRUE(false) << "Some exception occured during parsing." << p.what();
 	}
 }
+
+TEST(cfg_parser, cached_substitution_invalidation)
+{
+	CfgParse p;
+	p.parse("path = /data\nrun_db = @path@/run.db\nrun_file = @path@/run@RunNumber@.dat\nname = @run_file@.out");
+	p.setVariable("RunNumber", "0001");
+	EXPECT_EQ(p.getVariable("run_file"), "/data/run0001.dat");
+	EXPECT_EQ(p.getVariable("name"), "/data/run0001.dat.out");
+	EXPECT_EQ(p.getVariable("run_db"), "/data/run.db");
+	p.setVariable("RunNumber", "0002");
+	EXPECT_EQ(p.getVariable("name"), "/data/run0002.dat.out");
+	EXPECT_EQ(p.getVariable("run_file"), "/data/run0002.dat");
+	p.setVariable("path", "/other");
+	EXPECT_EQ(p.getVariable("run_db"), "/other/run.db");
+	EXPECT_EQ(p.getVariable("name"), "/other/run0002.dat.out");
+	p.setVariable("RunNumber", 3);
+	EXPECT_EQ(p.getVariable("run_file"), "/other/run3.dat");
+}
+
+TEST(cfg_parser, late_definition_and_recursion)
+{
+	CfgParse p;
+	p.parse("a = @b@\nx = @y@\ny = @x@");
+	EXPECT_THROW(p.getVariable("a"), CfgParse::no_variable_error);
+	p.setVariable("b", "defined");
+	EXPECT_EQ(p.getVariable("a"), "defined");
+	EXPECT_THROW(p.getVariable("x"), CfgParse::recursion_error);
+	EXPECT_THROW(p.getVariable("x"), CfgParse::recursion_error);
+	p.setVariable("y", "end");
+	EXPECT_EQ(p.getVariable("x"), "end");
+}
+
 int main(int argc, char **argv) {
 	::testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();
@@ -0,0 +1,180 @@
+#include "dataoffsetfinder.h"
+#include "quickrunlistreader.h"
+#include "gtest/gtest.h"
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace core;
+
+/* Synthetic run: sensor event e sees the tracks of telescope event e+trueOffset that pass the sensor,
+ * shifted by a constant misalignment. */
+static DataOffsetFinder makeRun(int trueOffset, size_t numEvents)
+{
+	std::mt19937 gen(3);
+	std::poisson_distribution<int> numTracks(1.5);
+	std::uniform_real_distribution<double> trackPos(-10.0, 10.0);
+	std::uniform_real_distribution<double> noise(0.0, 1.0);
+	std::vector<std::vector<double>> tracks(numEvents);
+	for(auto& evt: tracks) {
+		for(int i = numTracks(gen); i > 0; --i) {
+			evt.push_back(trackPos(gen));
+		}
+	}
+	DataOffsetFinder finder;
+	for(int e = 0; e < static_cast<int>(numEvents); ++e) {
+		std::vector<double> hits;
+		int tel = e + trueOffset;
+		if(tel >= 0 && tel < static_cast<int>(numEvents)) {
+			for(const auto& x: tracks[tel]) {
+				if(x > -2.0 && x < 2.0) {
+					hits.push_back(x + 0.7);
+				}
+			}
+		}
+		if(noise(gen) < 0.05) {
+			hits.push_back(noise(gen)*4 - 2);
+		}
+		finder.addEvent(e, hits, tracks[e]);
+	}
+	return finder;
+}
+
+TEST(dataoffsetfinder, residuals)
+{
+	DataOffsetFinder finder;
+	finder.addEvent(10, {1.0, 2.0}, {5.0});
+	finder.addEvent(11, {}, {7.0, 8.0});
+	EXPECT_EQ(finder.getNumEvents(), 2);
+	EXPECT_EQ(finder.getNumCombinations(), 2);
+	EXPECT_EQ(finder.residuals(0), std::vector<double>({4.0, 3.0}));
+	EXPECT_EQ(finder.residuals(1), std::vector<double>({6.0, 5.0, 7.0, 6.0}));
+	EXPECT_EQ(finder.residuals(1, 1).size(), 4);
+	EXPECT_TRUE(finder.residuals(2).empty());
+}
+
+TEST(dataoffsetfinder, sweep)
+{
+	auto finder = makeRun(3, 5000);
+	auto results = finder.sweep(-10, 10, 0.1, 2000);
+	ASSERT_EQ(results.size(), 21);
+	EXPECT_EQ(DataOffsetFinder::best(results).offset, 3);
+	EXPECT_EQ(DataOffsetFinder::ranked(results).front().offset, 3);
+}
+
+TEST(dataoffsetfinder, cross_correlation)
+{
+	auto finder = makeRun(-42, 20000);
+	auto results = finder.crossCorrelate(-500, 500);
+	ASSERT_EQ(results.size(), 1001);
+	EXPECT_EQ(DataOffsetFinder::best(results).offset, -42);
+}
+
+TEST(dataoffsetfinder, cross_correlation_direct)
+{
+	// compare FFT result with direct evaluation
+	std::mt19937 gen(5);
+	std::uniform_int_distribution<int> count(0, 3);
+	const int n = 300;
+	std::vector<double> h(n), t(n);
+	DataOffsetFinder finder;
+	for(int e = 0; e < n; ++e) {
+		h[e] = count(gen);
+		t[e] = count(gen);
+		finder.addEvent(e, std::vector<double>(h[e], 0.0), std::vector<double>(t[e], 0.0));
+	}
+	double mh = std::accumulate(h.begin(), h.end(), 0.0) / n;
+	double mt = std::accumulate(t.begin(), t.end(), 0.0) / n;
+	double nh = 0, nt = 0;
+	for(int e = 0; e < n; ++e) {
+		h[e] -= mh;
+		t[e] -= mt;
+		nh += h[e]*h[e];
+		nt += t[e]*t[e];
+	}
+	auto results = finder.crossCorrelate(-20, 20);
+	for(const auto& result: results) {
+		double sum = 0;
+		for(int e = 0; e < n; ++e) {
+			if(e + result.offset >= 0 && e + result.offset < n) {
+				sum += h[e] * t[e + result.offset];
+			}
+		}
+		EXPECT_NEAR(result.strength, sum / std::sqrt(nh*nt), 1e-9) << "offset " << result.offset;
+		EXPECT_EQ(result.entries, n - std::abs(result.offset));
+	}
+}
+
+TEST(runlist, write_data_offset)
+{
+	char tmpl[] = "/tmp/runlist_test_XXXXXX";
+	std::string dir = mkdtemp(tmpl);
+	std::string filename = dir + "/runlist.csv";
+	{
+		std::ofstream fout(filename);
+		fout << "# MPA Run\tTelescope Run\tAngle\tBias\tCur\tThresh\tMPA Trigger\tTel Trigger\tComments\tConverted\tData Offset\tCorrelation\t\n"
+		     << "28\t133\t0\t110\t\t110\t750812\t750809\tDistance\tYes\t0\tYes\t\t\n"
+		     << "# 29\t134\n"
+		     << "29\t134\t10\n";
+	}
+	QuickRunlistReader::writeDataOffset(filename, 28, -3);
+	QuickRunlistReader::writeDataOffset(filename, 29, 5);
+	EXPECT_THROW(QuickRunlistReader::writeDataOffset(filename, 30, 1), std::invalid_argument);
+	std::ifstream fin(filename);
+	std::string content((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+	EXPECT_EQ(content,
+	          "# MPA Run\tTelescope Run\tAngle\tBias\tCur\tThresh\tMPA Trigger\tTel Trigger\tComments\tConverted\tData Offset\tCorrelation\t\n"
+	          "28\t133\t0\t110\t\t110\t750812\t750809\tDistance\tYes\t-3\tYes\t\t\n"
+	          "# 29\t134\n"
+	          "29\t134\t10\t\t\t\t\t\t\t\t5\n");
+	QuickRunlistReader runlist;
+	runlist.read(filename);
+	EXPECT_EQ(runlist.getByMpaRun(28).data_offset, -3);
+	EXPECT_EQ(runlist.getByMpaRun(29).data_offset, 5);
+	std::system((std::string("rm -rf ") + dir).c_str());
+}
+
+TEST(runlist, write_data_offset_concurrent)
+{
+	char tmpl[] = "/tmp/runlist_test_XXXXXX";
+	std::string dir = mkdtemp(tmpl);
+	std::string filename = dir + "/runlist.csv";
+	const int numRuns = 8;
+	{
+		std::ofstream fout(filename);
+		fout << "# MPA Run\tTelescope Run\n";
+		for(int run = 1; run <= numRuns; ++run) {
+			fout << run << "\t" << 100 + run << "\n";
+		}
+	}
+	// every writer replaces the file, without the lock some of the updates would get lost
+	std::vector<std::thread> writers;
+	for(int run = 1; run <= numRuns; ++run) {
+		writers.emplace_back([&filename, run] {
+			for(int i = 1; i <= 10; ++i) {
+				QuickRunlistReader::writeDataOffset(filename, run, run * i);
+			}
+		});
+	}
+	for(auto& writer: writers) {
+		writer.join();
+	}
+	QuickRunlistReader runlist;
+	runlist.read(filename);
+	ASSERT_EQ(runlist.size(), numRuns);
+	for(int run = 1; run <= numRuns; ++run) {
+		EXPECT_EQ(runlist.getByMpaRun(run).data_offset, run * 10);
+	}
+	std::system((std::string("rm -rf ") + dir).c_str());
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,206 @@
+#include "eventindex.h"
+#include "mpastreamreader.h"
+#include "trackstreamreader.h"
+#include "runcache.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+using namespace core;
+
+class eventindex : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		_mpaFile = "/tmp/eventindex_test_" + std::to_string(getpid()) + "_mpa.txt";
+		_trackFile = "/tmp/eventindex_test_" + std::to_string(getpid()) + "_tracks.txt";
+		// event i has i % 3 hits, an empty line does not count as event
+		std::ofstream mpa(_mpaFile);
+		for(int i = 0; i < 30; ++i) {
+			mpa << "[" << (i % 3 > 0 ? i : 0) << ", 0, " << (i % 3 > 1 ? 10 : 0) << ", 0]\n";
+			if(i == 10) {
+				mpa << "\n";
+			}
+		}
+		mpa.close();
+		// every even event has (event / 2) % 2 + 1 tracks
+		std::ofstream tracks(_trackFile);
+		tracks << "# X\tY\tZ\tSensorID\tEvt\tRun\n";
+		for(int i = 0; i < 30; i += 2) {
+			for(int t = 0; t <= (i / 2) % 2; ++t) {
+				tracks << "1.0\t" << t << ".0\t0\t0\t" << i << "\t4\n"
+				       << "0.0\t2.0\t" << i << "\t1\t" << i << "\t4\n\n\n";
+			}
+		}
+		tracks.close();
+		EventIndex::clear();
+		RunCache::setBudget(0);
+	}
+
+	virtual void TearDown()
+	{
+		RunCache::setBudget(0);
+		for(const auto& file: {_mpaFile, _trackFile}) {
+			std::remove(file.c_str());
+			std::remove((file + ".evidx").c_str());
+		}
+	}
+
+	std::vector<BaseSensorStreamReader::event_t> readPixels(const MPAStreamReader& reader)
+	{
+		std::vector<BaseSensorStreamReader::event_t> events;
+		for(const auto& event: reader) {
+			events.push_back(event);
+		}
+		return events;
+	}
+
+	std::vector<TrackStreamReader::event_t> readTracks(const TrackStreamReader& reader)
+	{
+		std::vector<TrackStreamReader::event_t> events;
+		for(const auto& event: reader) {
+			events.push_back(event);
+		}
+		return events;
+	}
+
+	std::string _mpaFile;
+	std::string _trackFile;
+};
+
+TEST_F(eventindex, parseFilter)
+{
+	EventIndex::summary_t evt {0, 1, 2, 1};
+	EXPECT_TRUE(EventIndex::parseFilter("tracks == 1")(evt));
+	EXPECT_TRUE(EventIndex::parseFilter("tracks==1&&hits>1")(evt));
+	EXPECT_FALSE(EventIndex::parseFilter("tracks == 1 && hits <= 1")(evt));
+	EXPECT_TRUE(EventIndex::parseFilter("tracks != 1 && hits < 2 || bx >= 1")(evt));
+	EXPECT_FALSE(EventIndex::parseFilter("tracks > 1 || hits == 2 && bx == 0")(evt));
+	EXPECT_TRUE(EventIndex::parseFilter(" hits > -1 ")(evt));
+	EXPECT_THROW(EventIndex::parseFilter(""), std::invalid_argument);
+	EXPECT_THROW(EventIndex::parseFilter("pixels == 1"), std::invalid_argument);
+	EXPECT_THROW(EventIndex::parseFilter("tracks = 1"), std::invalid_argument);
+	EXPECT_THROW(EventIndex::parseFilter("tracks == 1 &&"), std::invalid_argument);
+	EXPECT_THROW(EventIndex::parseFilter("tracks == 1 hits == 1"), std::invalid_argument);
+}
+
+TEST_F(eventindex, build)
+{
+	MPAStreamReader mpa(_mpaFile);
+	auto pixels = mpa.getIndex();
+	ASSERT_EQ(pixels->getEntries().size(), 30);
+	for(int i = 0; i < 30; ++i) {
+		const auto& entry = pixels->getEntries()[i];
+		EXPECT_EQ(entry.eventNumber, i);
+		EXPECT_EQ(entry.count, (uint32_t)(i % 3));
+		EXPECT_EQ(entry.bunchCrossings, 1);
+	}
+	TrackStreamReader track(_trackFile);
+	auto tracks = track.getIndex();
+	ASSERT_EQ(tracks->getEntries().size(), 15);
+	auto events = readTracks(track);
+	for(size_t i = 0; i < events.size(); ++i) {
+		EXPECT_EQ(tracks->getEntries()[i].eventNumber, events[i].eventNumber);
+		EXPECT_EQ(tracks->getEntries()[i].count, events[i].tracks.size());
+	}
+	// the same index is returned while the file is unchanged
+	EXPECT_EQ(mpa.getIndex(), pixels);
+}
+
+TEST_F(eventindex, indexFile)
+{
+	auto built = MPAStreamReader(_mpaFile).getIndex();
+	EXPECT_TRUE(std::ifstream(_mpaFile + ".evidx").good());
+	EventIndex::clear();
+	int numBuilds = 0;
+	auto loaded = EventIndex::get("MPAStreamReader", _mpaFile,
+		[&numBuilds](std::istream& in, std::vector<EventIndex::entry_t>& entries) {
+			++numBuilds;
+			MPAStreamReader::buildIndex(in, entries);
+		});
+	EXPECT_EQ(numBuilds, 0);
+	ASSERT_EQ(loaded->getEntries().size(), built->getEntries().size());
+	for(size_t i = 0; i < built->getEntries().size(); ++i) {
+		EXPECT_EQ(loaded->getEntries()[i].offset, built->getEntries()[i].offset);
+		EXPECT_EQ(loaded->getEntries()[i].count, built->getEntries()[i].count);
+	}
+	// the size of the data file changes, so the index is rebuilt
+	std::ofstream mpa(_mpaFile, std::ios::app);
+	mpa << "[1, 1]\n";
+	mpa.close();
+	auto rebuilt = MPAStreamReader(_mpaFile).getIndex();
+	ASSERT_EQ(rebuilt->getEntries().size(), 31);
+	EXPECT_EQ(rebuilt->getEntries().back().count, 2);
+}
+
+TEST_F(eventindex, selectedEvents)
+{
+	MPAStreamReader mpa(_mpaFile);
+	TrackStreamReader track(_trackFile);
+	auto allPixels = readPixels(mpa);
+	auto allTracks = readTracks(track);
+	for(size_t budget: {0, 1 << 20}) {
+		RunCache::setBudget(budget);
+		for(int offset: {0, 2}) {
+			std::shared_ptr<EventIndex::selection_t> pixelSelection(new EventIndex::selection_t);
+			std::shared_ptr<EventIndex::selection_t> trackSelection(new EventIndex::selection_t);
+			EventIndex::select(*mpa.getIndex(), *track.getIndex(), offset,
+			                   EventIndex::parseFilter("tracks == 1 && hits == 1"),
+			                   *pixelSelection, *trackSelection);
+			mpa.setSelection(pixelSelection);
+			track.setSelection(trackSelection);
+			auto pixels = readPixels(mpa);
+			auto tracks = readTracks(track);
+			ASSERT_EQ(pixels.size(), tracks.size());
+			ASSERT_GT(pixels.size(), 0);
+			size_t expected = 0;
+			for(const auto& pixel: allPixels) {
+				for(const auto& evt: allTracks) {
+					if(evt.eventNumber == pixel.eventNumber + offset && evt.tracks.size() == 1 &&
+					   pixel.eventNumber % 3 == 1) {
+						ASSERT_LT(expected, pixels.size());
+						EXPECT_EQ(pixels[expected].eventNumber, pixel.eventNumber);
+						EXPECT_EQ(pixels[expected].data, pixel.data);
+						EXPECT_EQ(tracks[expected].eventNumber, evt.eventNumber);
+						ASSERT_EQ(tracks[expected].tracks.size(), 1);
+						EXPECT_EQ(tracks[expected].tracks[0].points, evt.tracks[0].points);
+						++expected;
+					}
+				}
+			}
+			EXPECT_EQ(expected, pixels.size());
+		}
+	}
+	// an empty selection yields no events
+	mpa.setSelection(std::make_shared<EventIndex::selection_t>());
+	EXPECT_TRUE(mpa.begin() == mpa.end());
+	mpa.setSelection(nullptr);
+	EXPECT_EQ(readPixels(mpa).size(), allPixels.size());
+}
+
+TEST_F(eventindex, keep)
+{
+	EventIndex::selection_t pixels;
+	EventIndex::selection_t tracks;
+	MPAStreamReader mpa(_mpaFile);
+	TrackStreamReader track(_trackFile);
+	EventIndex::select(*mpa.getIndex(), *track.getIndex(), 0, EventIndex::parseFilter("hits > 0"), pixels, tracks);
+	ASSERT_EQ(pixels.size(), 20);
+	ASSERT_EQ(tracks.size(), 10);
+	// pixel events 1, 2, 4 and 29, only 2 and 4 have a track event
+	EventIndex::keep(pixels, tracks, 0, {0, 1, 2, 19});
+	ASSERT_EQ(pixels.size(), 4);
+	EXPECT_EQ(pixels[0].eventNumber, 1);
+	EXPECT_EQ(pixels[3].eventNumber, 29);
+	ASSERT_EQ(tracks.size(), 2);
+	EXPECT_EQ(tracks[0].eventNumber, 2);
+	EXPECT_EQ(tracks[1].eventNumber, 4);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
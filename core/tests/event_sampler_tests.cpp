@@ -0,0 +1,70 @@
+#include "eventsampler.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <set>
+
+using namespace core;
+
+class eventsampler : public ::testing::Test
+{
+protected:
+	/// Positions are ascending, distinct and smaller than count
+	void checkPositions(const std::vector<size_t>& positions, size_t count)
+	{
+		EXPECT_TRUE(std::is_sorted(positions.begin(), positions.end()));
+		EXPECT_EQ(std::set<size_t>(positions.begin(), positions.end()).size(), positions.size());
+		if(!positions.empty()) {
+			EXPECT_LT(positions.back(), count);
+		}
+	}
+};
+
+TEST_F(eventsampler, first)
+{
+	EventSampler sampler(EventSampler::SM_FIRST, 1);
+	EXPECT_EQ(sampler.draw(100, 3), std::vector<size_t>({0, 1, 2}));
+	EXPECT_EQ(sampler.draw(2, 3), std::vector<size_t>({0, 1}));
+}
+
+TEST_F(eventsampler, uniform)
+{
+	EventSampler sampler(EventSampler::SM_UNIFORM, 1);
+	auto positions = sampler.draw(5000000, 10000);
+	ASSERT_EQ(positions.size(), 10000);
+	checkPositions(positions, 5000000);
+	// a uniform sample covers the whole range
+	EXPECT_LT(positions.front(), 5000);
+	EXPECT_GT(positions.back(), 4995000);
+	EXPECT_EQ(EventSampler(EventSampler::SM_UNIFORM, 1).draw(5000000, 10000), positions);
+	EXPECT_NE(EventSampler(EventSampler::SM_UNIFORM, 2).draw(5000000, 10000), positions);
+	EXPECT_EQ(sampler.draw(10, 10).size(), 10);
+	checkPositions(sampler.draw(10, 9), 10);
+}
+
+TEST_F(eventsampler, stratified)
+{
+	EventSampler sampler(EventSampler::SM_STRATIFIED, 7);
+	auto positions = sampler.draw(1003, 10);
+	ASSERT_EQ(positions.size(), 10);
+	checkPositions(positions, 1003);
+	for(size_t stratum = 0; stratum < positions.size(); ++stratum) {
+		EXPECT_GE(positions[stratum], stratum * 1003 / 10);
+		EXPECT_LT(positions[stratum], (stratum + 1) * 1003 / 10);
+	}
+	EXPECT_EQ(EventSampler(EventSampler::SM_STRATIFIED, 7).draw(1003, 10), positions);
+	EXPECT_TRUE(sampler.draw(0, 10).empty());
+}
+
+TEST_F(eventsampler, parseMode)
+{
+	EXPECT_EQ(EventSampler::parseMode("first"), EventSampler::SM_FIRST);
+	EXPECT_EQ(EventSampler::parseMode("uniform"), EventSampler::SM_UNIFORM);
+	EXPECT_EQ(EventSampler::parseMode("stratified"), EventSampler::SM_STRATIFIED);
+	EXPECT_THROW(EventSampler::parseMode("random"), std::invalid_argument);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,68 @@
+#include "fidelityschedule.h"
+#include "gtest/gtest.h"
+
+using namespace core;
+
+class fidelityschedule : public ::testing::Test
+{
+};
+
+TEST_F(fidelityschedule, disabled)
+{
+	FidelitySchedule schedule(10000, 0);
+	EXPECT_EQ(schedule.size(), 10000);
+	EXPECT_TRUE(schedule.isFull());
+	EXPECT_FALSE(schedule.grow());
+	EXPECT_EQ(FidelitySchedule(500, 1000).size(), 500);
+}
+
+TEST_F(fidelityschedule, sigma)
+{
+	FidelitySchedule schedule(10000, 1000, 4.0);
+	EXPECT_EQ(schedule.size(), 1000);
+	schedule.update(4.0, 10.0);
+	EXPECT_EQ(schedule.size(), 1000);
+	// the size grows with the square of the step size
+	schedule.update(2.0, 9.0);
+	EXPECT_EQ(schedule.size(), 4000);
+	// but never shrinks
+	schedule.update(3.0, 8.0);
+	EXPECT_EQ(schedule.size(), 4000);
+	schedule.update(1.0, 7.0);
+	EXPECT_TRUE(schedule.isFull());
+	schedule.update(1e-300, 6.0);
+	EXPECT_EQ(schedule.size(), 10000);
+}
+
+TEST_F(fidelityschedule, stagnation)
+{
+	FidelitySchedule schedule(10000, 1000, 1.0);
+	schedule.update(1.0, 10.0);
+	for(size_t i = 1; i < FidelitySchedule::patience; ++i) {
+		schedule.update(1.0, 10.0 - i * 1e-4);
+		EXPECT_EQ(schedule.size(), 1000);
+	}
+	schedule.update(1.0, 9.0);
+	EXPECT_EQ(schedule.size(), 1000);
+	for(size_t i = 0; i < FidelitySchedule::patience; ++i) {
+		schedule.update(1.0, 9.5);
+	}
+	EXPECT_EQ(schedule.size(), 2000);
+}
+
+TEST_F(fidelityschedule, grow)
+{
+	FidelitySchedule schedule(5000, 1000);
+	EXPECT_TRUE(schedule.grow());
+	EXPECT_EQ(schedule.size(), 2000);
+	EXPECT_TRUE(schedule.grow());
+	EXPECT_TRUE(schedule.grow());
+	EXPECT_EQ(schedule.size(), 5000);
+	EXPECT_FALSE(schedule.grow());
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,162 @@
+#include "inputfile.h"
+#include "mpastreamreader.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <zlib.h>
+#include <unistd.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace core;
+
+class inputfile : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		_prefix = "/tmp/inputfile_test_" + std::to_string(getpid());
+		// several blocks of decompressed data
+		std::ostringstream content;
+		for(int i = 0; i < 200000; ++i) {
+			content << "[" << i % 7 << ", 0, " << i << ", 0]\n";
+		}
+		_content = content.str();
+		std::ofstream fout(_prefix + ".txt");
+		fout << _content;
+		fout.close();
+		writeGzip(_prefix + ".txt.gz");
+#ifdef HAVE_ZSTD
+		writeZstd(_prefix + ".txt.zst");
+#endif
+	}
+
+	virtual void TearDown()
+	{
+		for(const auto& suffix: {".txt", ".txt.gz", ".txt.zst"}) {
+			std::remove((_prefix + suffix).c_str());
+			std::remove((_prefix + suffix + ".evidx").c_str());
+		}
+	}
+
+	/// Two gzip members, like a file extended by appending a compressed part
+	void writeGzip(const std::string& filename)
+	{
+		size_t half = _content.size() / 2;
+		gzFile file = gzopen(filename.c_str(), "wb");
+		gzwrite(file, _content.data(), half);
+		gzclose(file);
+		file = gzopen(filename.c_str(), "ab");
+		gzwrite(file, _content.data() + half, _content.size() - half);
+		gzclose(file);
+	}
+
+#ifdef HAVE_ZSTD
+	/// Seekable format with frames of 100 kB
+	void writeZstd(const std::string& filename)
+	{
+		std::ofstream fout(filename, std::ios_base::binary);
+		std::vector<uint32_t> table;
+		for(size_t pos = 0; pos < _content.size(); pos += 100000) {
+			size_t size = std::min<size_t>(100000, _content.size() - pos);
+			std::vector<char> frame(ZSTD_compressBound(size));
+			size_t len = ZSTD_compress(frame.data(), frame.size(), _content.data() + pos, size, 3);
+			fout.write(frame.data(), len);
+			table.push_back(len);
+			table.push_back(size);
+		}
+		uint32_t header[] = {0x184D2A5E, (uint32_t)(table.size() * 4 + 9)};
+		fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+		fout.write(reinterpret_cast<const char*>(table.data()), table.size() * 4);
+		uint32_t numFrames = table.size() / 2;
+		fout.write(reinterpret_cast<const char*>(&numFrames), 4);
+		fout.put(0);
+		uint32_t magic = 0x8F92EAB1;
+		fout.write(reinterpret_cast<const char*>(&magic), 4);
+	}
+#endif
+
+	std::vector<std::string> getFiles() const
+	{
+		std::vector<std::string> files {_prefix + ".txt", _prefix + ".txt.gz"};
+#ifdef HAVE_ZSTD
+		files.push_back(_prefix + ".txt.zst");
+#endif
+		return files;
+	}
+
+	std::string _prefix;
+	std::string _content;
+};
+
+TEST_F(inputfile, compression)
+{
+	EXPECT_EQ(InputFile::getCompression("run1_counter.txt_0"), InputFile::CT_NONE);
+	EXPECT_EQ(InputFile::getCompression("run1_counter.txt_0.gz"), InputFile::CT_GZIP);
+	EXPECT_EQ(InputFile::getCompression("tracks.csv.zst"), InputFile::CT_ZSTD);
+}
+
+TEST_F(inputfile, read)
+{
+	for(const auto& filename: getFiles()) {
+		InputFile fin(filename);
+		ASSERT_TRUE(fin.is_open()) << filename;
+		std::string content((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+		EXPECT_TRUE(content == _content) << filename;
+	}
+}
+
+TEST_F(inputfile, seek)
+{
+	for(const auto& filename: getFiles()) {
+		InputFile fin(filename);
+		std::string line;
+		std::getline(fin, line);
+		EXPECT_EQ(fin.tellg(), line.size() + 1);
+		// forward beyond the current block, backwards to the start and into the previous block
+		for(size_t pos: {size_t(2500000), size_t(0), size_t(2400000), size_t(_content.size() - 12), size_t(10)}) {
+			fin.clear();
+			fin.seekg(pos);
+			ASSERT_TRUE(std::getline(fin, line)) << filename << " " << pos;
+			EXPECT_EQ(line, _content.substr(pos, _content.find('\n', pos) - pos)) << filename << " " << pos;
+			EXPECT_EQ(fin.tellg(), _content.find('\n', pos) + 1) << filename;
+		}
+	}
+}
+
+TEST_F(inputfile, missing)
+{
+	InputFile plain(_prefix + "_missing.txt");
+	EXPECT_FALSE(plain.is_open());
+	EXPECT_TRUE(plain.fail());
+	InputFile compressed;
+	compressed.exceptions(std::ios_base::failbit);
+	EXPECT_THROW(compressed.open(_prefix + "_missing.txt.gz"), std::ios_base::failure);
+}
+
+TEST_F(inputfile, reader)
+{
+	MPAStreamReader plain(_prefix + ".txt");
+	MPAStreamReader compressed(_prefix + ".txt.gz");
+	auto it = compressed.begin();
+	size_t events = 0;
+	for(const auto& event: plain) {
+		ASSERT_NE(it, compressed.end());
+		EXPECT_EQ(event.data, it->data);
+		++it;
+		++events;
+	}
+	EXPECT_EQ(it, compressed.end());
+	EXPECT_EQ(events, 200000);
+	ASSERT_NE(compressed.getIndex(), nullptr);
+	EXPECT_EQ(compressed.getIndex()->getEntries().back().offset, plain.getIndex()->getEntries().back().offset);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,117 @@
+#include "instrumentation.h"
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+
+using namespace core;
+
+static Instrumentation::stage_t findStage(const std::string& name)
+{
+	for(const auto& stage: Instrumentation::collect()) {
+		if(stage.name == name) {
+			return stage;
+		}
+	}
+	return {name, 0, 0, 0};
+}
+
+static void timedFunction()
+{
+	CORE_TIMED_SCOPE("test::timedFunction");
+}
+
+TEST(instrumentation, stage)
+{
+	auto a = Instrumentation::stage("test::a");
+	auto b = Instrumentation::stage("test::b");
+	EXPECT_NE(a, b);
+	EXPECT_EQ(Instrumentation::stage("test::a"), a);
+}
+
+TEST(instrumentation, disabled)
+{
+	Instrumentation::setEnabled(false);
+	Instrumentation::reset();
+	for(int i = 0; i < 10; ++i) {
+		timedFunction();
+	}
+	Instrumentation::count(Instrumentation::stage("test::disabled"), 5);
+	EXPECT_EQ(findStage("test::timedFunction").calls, 0);
+	EXPECT_EQ(findStage("test::disabled").count, 0);
+}
+
+TEST(instrumentation, enabled)
+{
+	Instrumentation::setEnabled(true);
+	Instrumentation::reset();
+	for(int i = 0; i < 10; ++i) {
+		timedFunction();
+	}
+	auto stage = Instrumentation::stage("test::counter");
+	Instrumentation::count(stage, 3);
+	Instrumentation::count(stage);
+	EXPECT_EQ(findStage("test::timedFunction").calls, 10);
+	EXPECT_EQ(findStage("test::counter").count, 4);
+	EXPECT_EQ(findStage("test::counter").calls, 0);
+	{
+		ScopedTimer timer(stage);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	EXPECT_EQ(findStage("test::counter").calls, 1);
+	EXPECT_GE(findStage("test::counter").nanoseconds, 2000000);
+	Instrumentation::reset();
+	EXPECT_EQ(findStage("test::timedFunction").calls, 0);
+	Instrumentation::setEnabled(false);
+}
+
+TEST(instrumentation, threads)
+{
+	Instrumentation::setEnabled(true);
+	Instrumentation::reset();
+	auto stage = Instrumentation::stage("test::threads");
+	std::vector<std::thread> threads;
+	for(int t = 0; t < 4; ++t) {
+		threads.emplace_back([stage]() {
+			for(int i = 0; i < 1000; ++i) {
+				ScopedTimer timer(stage);
+				Instrumentation::count(stage, 2);
+			}
+		});
+	}
+	// statistics of running and finished threads are both collected
+	for(auto& thread: threads) {
+		thread.join();
+	}
+	{
+		ScopedTimer timer(stage);
+	}
+	auto stats = findStage("test::threads");
+	EXPECT_EQ(stats.calls, 4001);
+	EXPECT_EQ(stats.count, 8000);
+	Instrumentation::setEnabled(false);
+}
+
+TEST(instrumentation, report)
+{
+	Instrumentation::report_t report;
+	report.analysis = "Test";
+	report.runs = {1, 2};
+	report.wallSeconds = 2.0;
+	report.events = 1000;
+	report.peakRss = Instrumentation::peakRss();
+	report.stages = {{"reader \"next\"", 1000, 500000000, 0}};
+	EXPECT_GT(report.peakRss, 0);
+	auto json = Instrumentation::formatJson(report);
+	EXPECT_NE(json.find("\"runs\": [1, 2]"), std::string::npos);
+	EXPECT_NE(json.find("\"events_per_second\": 500"), std::string::npos);
+	EXPECT_NE(json.find("\"name\": \"reader \\\"next\\\"\", \"calls\": 1000, \"seconds\": 0.5"), std::string::npos);
+	auto table = Instrumentation::formatTable(report);
+	EXPECT_NE(table.find("500 events/s"), std::string::npos);
+	EXPECT_NE(table.find("reader \"next\""), std::string::npos);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
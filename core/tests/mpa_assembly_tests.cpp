@@ -0,0 +1,95 @@
+#include "mpaassembly.h"
+#include "cfgparse.h"
+#include "gtest/gtest.h"
+#include <cmath>
+
+using namespace core;
+
+class mpaassembly : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		_offset = Eigen::Vector3d(1.0, -2.0, 385.0);
+		_rotation = Eigen::Vector3d(0.01, -0.02, M_PI / 2);
+	}
+
+	Eigen::Vector3d _offset;
+	Eigen::Vector3d _rotation;
+};
+
+TEST_F(mpaassembly, defaultIsSingleChip)
+{
+	MpaAssembly assembly;
+	assembly.setPose(_offset, _rotation);
+	ASSERT_EQ(assembly.getEnabled(), std::vector<int>{2});
+	EXPECT_FALSE(assembly.isEnabled(1));
+	EXPECT_THROW(assembly.isEnabled(7), std::out_of_range);
+	MpaTransform single;
+	single.setOffset(_offset);
+	single.setRotation(_rotation);
+	const auto& chip = assembly.getTransform(2);
+	EXPECT_EQ(chip.getMpaIndex(), 2);
+	for(size_t idx = 0; idx < MpaTransform::num_pixels; ++idx) {
+		EXPECT_TRUE(chip.transform(idx).isApprox(single.transform(idx)))
+			<< " Pixel index " << idx;
+	}
+}
+
+TEST_F(mpaassembly, chipPoses)
+{
+	MpaAssembly assembly;
+	assembly.setChipPose(3, {MpaTransform::total_width, 0, 0});
+	assembly.setChipPose(1, {0, 0, 0.5}, {0, 0, M_PI});
+	EXPECT_EQ(assembly.getEnabled(), std::vector<int>({1, 2, 3}));
+	assembly.setPose(_offset, _rotation);
+	const auto& chip2 = assembly.getTransform(2);
+	const auto& chip3 = assembly.getTransform(3);
+	// the left edge of chip 3 touches the right edge of chip 2
+	EXPECT_TRUE(chip3.pixelCoordToGlobal(Eigen::Vector2d(0, 1)).isApprox(chip2.pixelCoordToGlobal(Eigen::Vector2d(16, 1))));
+	EXPECT_TRUE(chip3.getNormal().isApprox(chip2.getNormal()));
+	// chip 1 is turned around the lower left corner and shifted along the normal
+	Eigen::Vector3d corner = chip2.pixelCoordToGlobal(Eigen::Vector2d(0, 0)) + 0.5 * chip2.getNormal();
+	EXPECT_TRUE(assembly.getTransform(1).pixelCoordToGlobal(Eigen::Vector2d(0, 0)).isApprox(corner));
+	EXPECT_TRUE(assembly.getTransform(1).getNormal().isApprox(chip2.getNormal()));
+	for(size_t idx = 0; idx < MpaTransform::num_pixels; ++idx) {
+		auto global = chip3.transform(idx);
+		EXPECT_EQ(chip3.getPixelIndex(global), idx);
+		EXPECT_THROW(chip2.getPixelIndex(global), std::out_of_range);
+	}
+	assembly.disableChip(1);
+	EXPECT_EQ(assembly.getEnabled(), std::vector<int>({2, 3}));
+}
+
+TEST_F(mpaassembly, config)
+{
+	CfgParse config;
+	config.parse("mpa_1_offset = -1.8 0 0\n"
+	             "mpa_4_offset = 0 4.638 0\n"
+	             "mpa_4_rotation = 0 0 180\n"
+	             "mpa_5_offset = 1 2\n");
+	MpaAssembly assembly;
+	EXPECT_THROW(assembly.loadChipPoses(config), CfgParse::bad_cast);
+	config.setVariable("mpa_5_offset", "1 2 3");
+	assembly.loadChipPoses(config);
+	EXPECT_EQ(assembly.getEnabled(), std::vector<int>({1, 2, 4, 5}));
+	EXPECT_TRUE(assembly.getTransform(1).getOffset().isApprox(Eigen::Vector3d(-1.8, 0, 0)));
+	EXPECT_NEAR(std::abs(assembly.getTransform(4).getAngles()(2)), M_PI, 1e-9);
+}
+
+TEST_F(mpaassembly, blockLayout)
+{
+	EXPECT_EQ(MpaAssembly::num_pixels, 6 * 48);
+	EXPECT_EQ(MpaAssembly::blockOffset(1), 0);
+	EXPECT_EQ(MpaAssembly::blockOffset(6), 5 * 48);
+	MpaTransform transform;
+	EXPECT_THROW(transform.translatePixelIndex(48), std::out_of_range);
+	EXPECT_THROW(transform.translatePixelIndex(0, 7), std::out_of_range);
+	EXPECT_THROW(transform.setMpaIndex(0), std::out_of_range);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
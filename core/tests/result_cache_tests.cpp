@@ -0,0 +1,112 @@
+#include "resultcache.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+using namespace core;
+
+class CacheDirEnv : public ::testing::Environment
+{
+public:
+	virtual void SetUp()
+	{
+		char tmpl[] = "/tmp/resultcache_test_XXXXXX";
+		directory = mkdtemp(tmpl);
+	}
+
+	virtual void TearDown()
+	{
+		std::system((std::string("rm -rf ") + directory).c_str());
+	}
+
+	std::string getDirectory() const { return directory; }
+private:
+	std::string directory;
+};
+
+CacheDirEnv* env;
+
+static void writeFile(const std::string& filename, const std::string& content)
+{
+	std::ofstream fout(filename);
+	fout << content;
+}
+
+static std::string readFile(const std::string& filename)
+{
+	std::ifstream fin(filename);
+	return std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+TEST(resultcache, hash)
+{
+	EXPECT_EQ(ResultCache::hash(""), "cbf29ce484222325");
+	EXPECT_EQ(ResultCache::hash("a"), "af63dc4c8601ec8c");
+	EXPECT_NE(ResultCache::hash("analysis\tA"), ResultCache::hash("analysis\tB"));
+}
+
+TEST(resultcache, fingerprint)
+{
+	ResultCache cache(env->getDirectory() + "/fp_cache");
+	auto input = env->getDirectory() + "/input.txt";
+	EXPECT_EQ(cache.fingerprint(input), "missing");
+	writeFile(input, "some data");
+	auto fp = cache.fingerprint(input);
+	EXPECT_EQ(fp, cache.fingerprint(input));
+	// checksums are remembered across instances
+	ResultCache reopened(env->getDirectory() + "/fp_cache");
+	EXPECT_EQ(fp, reopened.fingerprint(input));
+	writeFile(input, "other data");
+	EXPECT_NE(fp, cache.fingerprint(input));
+}
+
+TEST(resultcache, store_restore)
+{
+	auto output = env->getDirectory() + "/output";
+	ResultCache cache(output + "/.cache");
+	writeFile(output + "/Unrelated_0001.txt", "old");
+	writeFile(output + "/MyAnalysis_0001.txt", "old result");
+	auto before = cache.snapshot(output);
+	EXPECT_EQ(before.size(), 2);
+
+	ResultCache::makePath(output + "/MyAnalysis/run1");
+	writeFile(output + "/MyAnalysis/run1/MyAnalysis_0001.status", "status");
+	writeFile(output + "/MyAnalysis_0001.txt", "new result with different size");
+	writeFile(output + "/Other_0001.txt", "created by other job");
+	writeFile(output + "/MyAnalysis_0001_0002.txt", "created by job of more runs");
+	EXPECT_FALSE(cache.contains("0123"));
+	EXPECT_EQ(cache.store("0123", output, before, {"MyAnalysis_0001"}, "description"), 2);
+	EXPECT_TRUE(cache.contains("0123"));
+
+	std::remove((output + "/MyAnalysis_0001.txt").c_str());
+	std::remove((output + "/MyAnalysis/run1/MyAnalysis_0001.status").c_str());
+	EXPECT_FALSE(cache.restore("4567", output));
+	EXPECT_TRUE(cache.restore("0123", output));
+	EXPECT_EQ(readFile(output + "/MyAnalysis_0001.txt"), "new result with different size");
+	EXPECT_EQ(readFile(output + "/MyAnalysis/run1/MyAnalysis_0001.status"), "status");
+	EXPECT_EQ(readFile(output + "/Unrelated_0001.txt"), "old");
+
+	// nothing changed, nothing stored
+	EXPECT_EQ(cache.store("89ab", output, cache.snapshot(output), {}, "description"), 0);
+	EXPECT_FALSE(cache.contains("89ab"));
+}
+
+TEST(resultcache, matches_stem)
+{
+	EXPECT_TRUE(ResultCache::matchesStem("MpaAlign_0001.root", "MpaAlign_0001"));
+	EXPECT_TRUE(ResultCache::matchesStem("sub/MpaAlign_0001_x.png", "MpaAlign_0001"));
+	EXPECT_TRUE(ResultCache::matchesStem("MpaAlign_0001", "MpaAlign_0001"));
+	EXPECT_FALSE(ResultCache::matchesStem("MpaAlign_0001_0002.root", "MpaAlign_0001"));
+	EXPECT_FALSE(ResultCache::matchesStem("MpaAlign_0001-to-0020.root", "MpaAlign_0001"));
+	EXPECT_FALSE(ResultCache::matchesStem("MpaAlign_00012.root", "MpaAlign_0001_"));
+	EXPECT_FALSE(ResultCache::matchesStem("MpaAlign_0001/Other_0001.root", "MpaAlign_0001"));
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	env = new CacheDirEnv;
+	::testing::AddGlobalTestEnvironment(env);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include "rootoutput.h"
+#include "gtest/gtest.h"
+#include <TFile.h>
+#include <TH1D.h>
+#include <TGraph.h>
+#include <TCanvas.h>
+#include <TROOT.h>
+#include <cstdio>
+#include <ios>
+#include <unistd.h>
+
+using namespace core;
+
+class rootoutput : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		_filename = "/tmp/rootoutput_test_" + std::to_string(getpid()) + ".root";
+		_image = "/tmp/rootoutput_test_" + std::to_string(getpid()) + ".png";
+		std::remove(_filename.c_str());
+		std::remove(_image.c_str());
+	}
+
+	virtual void TearDown()
+	{
+		std::remove(_filename.c_str());
+		std::remove(_image.c_str());
+		RootOutput::setImagesEnabled(true);
+	}
+
+	std::string _filename;
+	std::string _image;
+};
+
+TEST_F(rootoutput, writeObjects)
+{
+	TH1D kept("kept", "", 10, 0, 10);
+	kept.Fill(3);
+	{
+		RootOutput output(_filename);
+		for(int i = 0; i < 100; ++i) {
+			auto hist = new TH1D(("hist_" + std::to_string(i)).c_str(), "", 100, 0, 100);
+			hist->Fill(i);
+			output.write(hist);
+		}
+		auto graph = new TGraph(2);
+		graph->SetName("graph");
+		graph->SetPoint(0, 1, 2);
+		graph->SetPoint(1, 2, 4);
+		output.write(graph, "scan/step_0");
+		output.writeCopy(&kept);
+		output.flush();
+		EXPECT_EQ(output.getNumWritten(), 102);
+	}
+	// the original of writeCopy() is still usable
+	EXPECT_EQ(kept.GetEntries(), 1);
+
+	TFile file(_filename.c_str(), "READ");
+	ASSERT_FALSE(file.IsZombie());
+	TH1D* hist = nullptr;
+	file.GetObject("hist_42", hist);
+	ASSERT_NE(hist, nullptr);
+	EXPECT_EQ(hist->GetBinContent(hist->FindBin(42)), 1);
+	TGraph* graph = nullptr;
+	file.GetObject("scan/step_0/graph", graph);
+	ASSERT_NE(graph, nullptr);
+	EXPECT_EQ(graph->GetN(), 2);
+	file.GetObject("kept", hist);
+	ASSERT_NE(hist, nullptr);
+	EXPECT_EQ(hist->GetEntries(), 1);
+}
+
+TEST_F(rootoutput, images)
+{
+	{
+		RootOutput output(_filename);
+		auto canvas = new TCanvas("canvas", "", 200, 200);
+		output.addImage(canvas, _image);
+		EXPECT_NE(access(_image.c_str(), F_OK), 0);
+		// rendered by the owning thread on flush, not only on close
+		output.flush();
+		EXPECT_EQ(access(_image.c_str(), F_OK), 0);
+	}
+	EXPECT_EQ(access(_image.c_str(), F_OK), 0);
+	std::remove(_image.c_str());
+	RootOutput::setImagesEnabled(false);
+	{
+		RootOutput output(_filename);
+		output.addImage(new TCanvas("canvas", "", 200, 200), _image);
+	}
+	EXPECT_NE(access(_image.c_str(), F_OK), 0);
+}
+
+TEST_F(rootoutput, errors)
+{
+	EXPECT_THROW(RootOutput("/nonexistent/dir/file.root"), std::ios_base::failure);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	gROOT->SetBatch(true);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,189 @@
+#include "runcache.h"
+#include "mpastreamreader.h"
+#include "trackstreamreader.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <unistd.h>
+
+using namespace core;
+
+class runcache : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		_mpaFile = "/tmp/runcache_test_" + std::to_string(getpid()) + "_mpa.txt";
+		_trackFile = "/tmp/runcache_test_" + std::to_string(getpid()) + "_tracks.txt";
+		std::ofstream mpa(_mpaFile);
+		for(int i = 0; i < 100; ++i) {
+			mpa << "[" << i << ", " << i+1 << ", " << i+2 << "]\n";
+		}
+		mpa.close();
+		std::ofstream tracks(_trackFile);
+		for(int i = 0; i < 50; ++i) {
+			tracks << "1.0\t0.0\t0\t0\t" << 2*i << "\t4\n"
+			       << "0.0\t2.0\t" << i << "\t1\t" << 2*i << "\t4\n\n\n";
+		}
+		tracks.close();
+		RunCache::setBudget(0);
+		RunCache::clear();
+	}
+
+	virtual void TearDown()
+	{
+		RunCache::setBudget(0);
+		std::remove(_mpaFile.c_str());
+		std::remove(_trackFile.c_str());
+	}
+
+	std::vector<BaseSensorStreamReader::event_t> readPixels()
+	{
+		std::vector<BaseSensorStreamReader::event_t> events;
+		MPAStreamReader reader(_mpaFile);
+		for(const auto& event: reader) {
+			events.push_back(event);
+		}
+		return events;
+	}
+
+	std::vector<TrackStreamReader::event_t> readTracks()
+	{
+		std::vector<TrackStreamReader::event_t> events;
+		TrackStreamReader reader(_trackFile);
+		for(const auto& event: reader) {
+			events.push_back(event);
+		}
+		return events;
+	}
+
+	std::string _mpaFile;
+	std::string _trackFile;
+};
+
+TEST_F(runcache, sameEvents)
+{
+	auto pixels = readPixels();
+	auto tracks = readTracks();
+	ASSERT_EQ(pixels.size(), 100);
+	ASSERT_EQ(tracks.size(), 50);
+	RunCache::setBudget(1 << 20);
+	for(int pass = 0; pass < 2; ++pass) {
+		auto cachedPixels = readPixels();
+		ASSERT_EQ(cachedPixels.size(), pixels.size());
+		for(size_t i = 0; i < pixels.size(); ++i) {
+			EXPECT_EQ(cachedPixels[i].eventNumber, pixels[i].eventNumber);
+			EXPECT_EQ(cachedPixels[i].data, pixels[i].data);
+		}
+		auto cachedTracks = readTracks();
+		ASSERT_EQ(cachedTracks.size(), tracks.size());
+		for(size_t i = 0; i < tracks.size(); ++i) {
+			EXPECT_EQ(cachedTracks[i].eventNumber, tracks[i].eventNumber);
+			ASSERT_EQ(cachedTracks[i].tracks.size(), 1);
+			EXPECT_EQ(cachedTracks[i].tracks[0].points, tracks[i].tracks[0].points);
+		}
+	}
+	auto stats = RunCache::getStatistics();
+	EXPECT_EQ(stats.entries, 2);
+	EXPECT_EQ(stats.misses, 2);
+	EXPECT_EQ(stats.hits, 2);
+	EXPECT_GT(stats.bytes, 0);
+	EXPECT_LE(stats.bytes, stats.budget);
+}
+
+TEST_F(runcache, copiedIterators)
+{
+	RunCache::setBudget(1 << 20);
+	TrackStreamReader reader(_trackFile);
+	auto it = reader.begin();
+	++it;
+	auto copy = it;
+	++it;
+	EXPECT_EQ(copy->eventNumber, 2);
+	EXPECT_EQ(it->eventNumber, 4);
+	MPAStreamReader mpa(_mpaFile);
+	auto pixel = mpa.begin();
+	++pixel;
+	auto pixelCopy = pixel;
+	++pixel;
+	EXPECT_EQ(pixelCopy->eventNumber, 1);
+	EXPECT_EQ(pixel->eventNumber, 2);
+}
+
+TEST_F(runcache, invalidation)
+{
+	RunCache::setBudget(1 << 20);
+	readPixels();
+	// the modification time may not change within the resolution of the file system, the size does
+	std::ofstream mpa(_mpaFile, std::ios::app);
+	mpa << "[1000]\n";
+	mpa.close();
+	auto pixels = readPixels();
+	ASSERT_EQ(pixels.size(), 101);
+	EXPECT_EQ(pixels.back().data, std::vector<int>{1000});
+	EXPECT_EQ(RunCache::getStatistics().misses, 2);
+}
+
+TEST_F(runcache, budget)
+{
+	// too small for the tracks, they are read from disk every time
+	RunCache::setBudget(1024);
+	EXPECT_EQ(readTracks().size(), 50);
+	EXPECT_EQ(readTracks().size(), 50);
+	auto stats = RunCache::getStatistics();
+	EXPECT_EQ(stats.entries, 0);
+	EXPECT_EQ(stats.misses, 1);
+	// the least recently used entry is evicted
+	RunCache::setBudget(1 << 20);
+	readPixels();
+	readTracks();
+	size_t both = RunCache::getStatistics().bytes;
+	RunCache::setBudget(both - 1);
+	EXPECT_EQ(RunCache::getStatistics().entries, 1);
+	readTracks();
+	EXPECT_EQ(RunCache::getStatistics().hits, 1);
+	EXPECT_EQ(readPixels().size(), 100);
+	EXPECT_EQ(RunCache::getStatistics().entries, 1);
+	RunCache::setBudget(0);
+	EXPECT_EQ(RunCache::getStatistics().entries, 0);
+}
+
+TEST_F(runcache, emptyFile)
+{
+	std::ofstream(_mpaFile, std::ios::trunc).close();
+	MPAStreamReader uncached(_mpaFile);
+	EXPECT_TRUE(uncached.begin() == uncached.end());
+	RunCache::setBudget(1 << 20);
+	for(int pass = 0; pass < 2; ++pass) {
+		MPAStreamReader reader(_mpaFile);
+		EXPECT_TRUE(reader.begin() == reader.end());
+	}
+	EXPECT_EQ(RunCache::getStatistics().hits, 1);
+}
+
+TEST_F(runcache, missingSelectedEvent)
+{
+	RunCache::setBudget(1 << 20);
+	const auto& entries = MPAStreamReader(_mpaFile).getIndex()->getEntries();
+	ASSERT_EQ(entries.size(), 100);
+	auto missing = entries[50];
+	missing.eventNumber = 1000;
+	MPAStreamReader reader(_mpaFile);
+	// the iteration ends at the missing event instead of returning another one
+	reader.setSelection(std::make_shared<EventIndex::selection_t>(
+		EventIndex::selection_t{entries[10], missing, entries[60]}));
+	std::vector<int> visited;
+	for(const auto& event: reader) {
+		visited.push_back(event.eventNumber);
+	}
+	EXPECT_EQ(visited, std::vector<int>{10});
+	reader.setSelection(std::make_shared<EventIndex::selection_t>(EventIndex::selection_t{missing, entries[60]}));
+	EXPECT_TRUE(reader.begin() == reader.end());
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
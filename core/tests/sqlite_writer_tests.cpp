@@ -0,0 +1,93 @@
+#include "sqlitewriter.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <unistd.h>
+
+using namespace core;
+
+class sqlitewriter : public ::testing::Test
+{
+protected:
+	virtual void SetUp()
+	{
+		_filename = "/tmp/sqlitewriter_test_" + std::to_string(getpid()) + ".sqldat";
+		std::remove(_filename.c_str());
+	}
+
+	virtual void TearDown()
+	{
+		std::remove(_filename.c_str());
+	}
+
+	std::string _filename;
+};
+
+TEST_F(sqlitewriter, batches)
+{
+	{
+		SqliteWriter db(_filename, 100);
+		db.exec("CREATE TABLE path (id INTEGER PRIMARY KEY, job_id INTEGER, generation int, x float, name STRING)");
+		auto stmt = db.prepare("INSERT INTO path (job_id, generation, x, name) VALUES (?,?,?,?)");
+		for(size_t i = 0; i < 250; ++i) {
+			db.write(stmt, 7, i, 0.5*i, "gen");
+		}
+		EXPECT_EQ(db.getNumWrites(), 250);
+		EXPECT_EQ(db.lastInsertId(), 250);
+		// rows of the open transaction are visible to the writer itself
+		EXPECT_EQ(db.queryInt("SELECT count(*) FROM path"), 250);
+	}
+	// pending rows are committed on destruction
+	SqliteWriter db(_filename);
+	EXPECT_EQ(db.queryInt("SELECT count(*) FROM path WHERE job_id = 7 AND name = 'gen'"), 250);
+	EXPECT_EQ(db.queryInt("SELECT generation FROM path WHERE x = 100.0"), 200);
+	EXPECT_EQ(db.queryInt("SELECT job_id FROM path WHERE job_id = 8", -1), -1);
+	EXPECT_EQ(db.queryInt("SELECT max(job_id) FROM path WHERE job_id = 8", -1), -1);
+}
+
+TEST_F(sqlitewriter, concurrentWriters)
+{
+	SqliteWriter a(_filename, 10, 1000);
+	a.exec("CREATE TABLE jobs (job_id INTEGER, run_id INTEGER)");
+	SqliteWriter b(_filename, 10, 1000);
+	auto stmtA = a.prepare("INSERT INTO jobs (job_id, run_id) SELECT IFNULL(MAX(job_id), 0)+1, ? FROM jobs");
+	auto stmtB = b.prepare("INSERT INTO jobs (job_id, run_id) SELECT IFNULL(MAX(job_id), 0)+1, ? FROM jobs");
+	a.write(stmtA, 1);
+	// a holds the write lock until its transaction is committed
+	EXPECT_THROW(b.write(stmtB, 2), SqliteWriter::sqlite_error);
+	a.commit();
+	b.write(stmtB, 2);
+	b.commit();
+	EXPECT_EQ(a.queryInt("SELECT job_id FROM jobs WHERE run_id = 2"), 2);
+}
+
+TEST_F(sqlitewriter, checkAndInsert)
+{
+	SqliteWriter a(_filename, 10, 100);
+	a.exec("CREATE TABLE hits (run_id INTEGER)");
+	SqliteWriter b(_filename, 10, 100);
+	auto stmtA = a.prepare("INSERT INTO hits (run_id) VALUES (?)");
+	auto stmtB = b.prepare("INSERT INTO hits (run_id) VALUES (?)");
+	a.begin();
+	ASSERT_EQ(a.queryInt("SELECT count(*) FROM hits WHERE run_id = 1"), 0);
+	// b cannot check before a inserted its rows
+	EXPECT_THROW(b.begin(), SqliteWriter::sqlite_error);
+	a.write(stmtA, 1);
+	a.commit();
+	b.begin();
+	EXPECT_EQ(b.queryInt("SELECT count(*) FROM hits WHERE run_id = 1"), 1);
+	b.commit();
+}
+
+TEST_F(sqlitewriter, errors)
+{
+	EXPECT_THROW(SqliteWriter("/nonexistent/dir/db.sqldat"), SqliteWriter::sqlite_error);
+	SqliteWriter db(_filename);
+	EXPECT_THROW(db.prepare("INSERT INTO missing VALUES (?)"), SqliteWriter::sqlite_error);
+	EXPECT_THROW(db.exec("NOT SQL"), SqliteWriter::sqlite_error);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,212 @@
+#include "testbeamgenerator.h"
+#include "mpastreamreader.h"
+#include "mpamemorystreamreader.h"
+#include "trackstreamreader.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+using namespace core;
+
+static TestbeamGenerator::config_t smallRun()
+{
+	auto config = TestbeamGenerator::config_t::defaults();
+	config.numEvents = 500;
+	config.seed = 7;
+	// concentrate the beam on the MaPSA-light
+	config.beamCenter = {0.0, 0.0};
+	config.beamHalfSize = {1.0, 2.5};
+	config.mpaRotation = {0.0, 0.0, 0.1};
+	return config;
+}
+
+static std::string tempFilename()
+{
+	char s[4096];
+	return std::tmpnam(s);
+}
+
+static std::string readFile(const std::string& filename)
+{
+	std::ifstream fin(filename);
+	std::ostringstream sstr;
+	sstr << fin.rdbuf();
+	return sstr.str();
+}
+
+TEST(testbeamgenerator, deterministic)
+{
+	TestbeamGenerator a(smallRun());
+	TestbeamGenerator b(smallRun());
+	for(size_t i = 0; i < 100; ++i) {
+		auto ea = a.next();
+		auto eb = b.next();
+		EXPECT_EQ(ea.eventNumber, static_cast<int>(i));
+		EXPECT_EQ(ea.pixels, eb.pixels);
+		ASSERT_EQ(ea.tracks.size(), eb.tracks.size());
+		for(size_t t = 0; t < ea.tracks.size(); ++t) {
+			EXPECT_EQ(ea.tracks[t].points, eb.tracks[t].points);
+		}
+	}
+	auto config = smallRun();
+	config.seed = 8;
+	TestbeamGenerator c(config);
+	TestbeamGenerator d(smallRun());
+	bool differs = false;
+	for(size_t i = 0; i < 100; ++i) {
+		differs |= c.next().tracks.size() != d.next().tracks.size();
+	}
+	EXPECT_TRUE(differs);
+}
+
+TEST(testbeamgenerator, lines)
+{
+	auto event = TestbeamGenerator::emptyEvent(3);
+	event.pixels[0] = 2;
+	event.pixels[20] = 1;
+	auto counter = TestbeamGenerator::counterLine(event);
+	EXPECT_EQ(counter.substr(0, 10), "[2, 0, 0, ");
+	EXPECT_EQ(TestbeamGenerator::memoryLine(TestbeamGenerator::emptyEvent(0)), "[]");
+	auto memory = TestbeamGenerator::memoryLine(event);
+	// header, bunch crossing 3, pixel 0 and pixel 20 at character 47-20 of the pixel map
+	EXPECT_EQ(memory.substr(0, 26), "['111111110000000000000011");
+	EXPECT_EQ(memory[26], '1');
+	EXPECT_EQ(memory[26 + 27], '1');
+	EXPECT_EQ(std::count(memory.begin(), memory.end(), '1'), 8 + 2 + 2);
+}
+
+TEST(testbeamgenerator, readback)
+{
+	auto config = smallRun();
+	config.efficiency = 1.0;
+	config.noise = 0.0;
+	TestbeamGenerator::output_t output;
+	output.counterFile = tempFilename();
+	output.memoryFile = tempFilename();
+	output.trackFile = tempFilename();
+	TestbeamGenerator generator(config);
+	generator.generate(output);
+	// generate() starts over, so the files are reproducible
+	auto counterContent = readFile(output.counterFile);
+	auto trackContent = readFile(output.trackFile);
+	generator.generate(output);
+	EXPECT_EQ(readFile(output.counterFile), counterContent);
+	EXPECT_EQ(readFile(output.trackFile), trackContent);
+
+	std::vector<TestbeamGenerator::event_t> events;
+	generator = TestbeamGenerator(config);
+	for(size_t i = 0; i < config.numEvents; ++i) {
+		events.push_back(generator.next());
+	}
+
+	MPAStreamReader counter(output.counterFile);
+	size_t numEvents = 0;
+	size_t numHits = 0;
+	for(const auto& evt: counter) {
+		ASSERT_LT(numEvents, events.size());
+		ASSERT_EQ(evt.data.size(), MpaTransform::num_pixels);
+		for(size_t i = 0; i < evt.data.size(); ++i) {
+			EXPECT_EQ(evt.data[i], events[numEvents].pixels[i]);
+			numHits += evt.data[i];
+		}
+		++numEvents;
+	}
+	EXPECT_EQ(numEvents, config.numEvents);
+	EXPECT_GT(numHits, 50);
+
+	MpaMemoryStreamReader memory(output.memoryFile);
+	numEvents = 0;
+	for(const auto& evt: memory) {
+		for(size_t i = 0; i < evt.data.size(); ++i) {
+			EXPECT_EQ(evt.data[i], events[numEvents].pixels[i] ? 1 : 0);
+		}
+		++numEvents;
+	}
+	EXPECT_EQ(numEvents, config.numEvents);
+
+	// every MaPSA hit lies close to the extrapolation of a telescope track
+	MpaTransform transform;
+	transform.setOffset(config.mpaOffset);
+	transform.setRotation(config.mpaRotation);
+	TrackStreamReader tracks(output.trackFile);
+	size_t numTrackEvents = 0;
+	for(const auto& evt: tracks) {
+		const auto& expected = events.at(evt.eventNumber);
+		EXPECT_EQ(evt.runID, config.runId);
+		ASSERT_EQ(evt.tracks.size(), expected.tracks.size());
+		for(const auto& track: evt.tracks) {
+			ASSERT_EQ(track.points.size(), TestbeamGenerator::num_planes + 1);
+			EXPECT_NEAR(track.points[6](2), config.refZ, 1e-9);
+		}
+		for(size_t idx = 0; idx < expected.pixels.size(); ++idx) {
+			if(!expected.pixels[idx]) {
+				continue;
+			}
+			auto pixel = transform.transform(idx);
+			bool matched = false;
+			for(const auto& track: evt.tracks) {
+				auto hit = transform.mpaPlaneTrackIntersect(track, 3, 5);
+				matched |= (hit - pixel).head<2>().norm() < 1.0;
+			}
+			EXPECT_TRUE(matched) << "Pixel " << idx << " in event " << evt.eventNumber;
+		}
+		++numTrackEvents;
+	}
+	EXPECT_GT(numTrackEvents, config.numEvents / 2);
+	std::remove(output.counterFile.c_str());
+	std::remove(output.memoryFile.c_str());
+	std::remove(output.trackFile.c_str());
+}
+
+TEST(testbeamgenerator, data_offset)
+{
+	auto config = smallRun();
+	config.numEvents = 50;
+	TestbeamGenerator::output_t output;
+	output.counterFile = tempFilename();
+	std::vector<std::string> reference;
+	for(int offset: {0, 3, -2}) {
+		config.dataOffset = offset;
+		TestbeamGenerator(config).generate(output);
+		std::vector<std::string> lines;
+		std::ifstream fin(output.counterFile);
+		std::string line;
+		while(std::getline(fin, line)) {
+			lines.push_back(line);
+		}
+		if(offset == 0) {
+			reference = lines;
+			continue;
+		}
+		// MaPSA line e holds the data of telescope event e+offset
+		ASSERT_EQ(lines.size(), reference.size() - offset);
+		for(int e = 0; e < static_cast<int>(lines.size()); ++e) {
+			if(e + offset < 0) {
+				EXPECT_EQ(lines[e], TestbeamGenerator::counterLine(TestbeamGenerator::emptyEvent(0)));
+			} else {
+				EXPECT_EQ(lines[e], reference[e + offset]);
+			}
+		}
+	}
+	std::remove(output.counterFile.c_str());
+}
+
+TEST(testbeamgenerator, invalid_config)
+{
+	auto config = smallRun();
+	config.efficiency = 1.5;
+	EXPECT_THROW(TestbeamGenerator{config}, std::invalid_argument);
+	TestbeamGenerator generator(smallRun());
+	TestbeamGenerator::output_t output;
+	output.counterFile = "/nonexistent/dir/counter.txt";
+	EXPECT_THROW(generator.generate(output), TestbeamGenerator::io_error);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+/* Benchmark of the MpaEfficiency correlation kernel
+ *
+ * Compares the per-pixel evaluation using MpaTransform::transform() with the batched TrackPixelMatrix on a
+ * synthetic run. Both kernels have to produce identical counters.
+ *
+ * Usage: trackpixelmatrix_benchmark [num_events]
+ */
+#include "trackpixelmatrix.h"
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <cstdlib>
+
+using namespace core;
+
+struct event_t {
+	std::vector<Eigen::Vector3d> tracks;
+	std::vector<int> data;
+};
+
+struct counters_t {
+	size_t total;
+	size_t correlated;
+	size_t fake;
+	double distanceSum;
+	bool operator==(const counters_t& other) const {
+		return total == other.total && correlated == other.correlated && fake == other.fake &&
+		       distanceSum == other.distanceSum;
+	}
+};
+
+static const double nSigma = 1.5;
+
+counters_t perPixel(const std::vector<event_t>& events, const MpaTransform& trans)
+{
+	counters_t c{0, 0, 0, 0.0};
+	for(const auto& event: events) {
+		for(const auto& t_global: event.tracks) {
+			for(size_t idx = 0; idx < event.data.size(); ++idx) {
+				auto pixel_coord = trans.transform(idx, true);
+				auto pixel_size = trans.getPixelSize(idx);
+				if(!((pixel_coord - t_global).head<2>().array().abs() < pixel_size.array()*nSigma).all()) {
+					continue;
+				}
+				if(event.data[idx] > 0) {
+					++c.correlated;
+					c.distanceSum += (pixel_coord-t_global).head<1>().norm() / 0.1;
+					break;
+				}
+			}
+			++c.total;
+		}
+		for(size_t idx = 0; idx < event.data.size(); ++idx) {
+			if(event.data[idx] == 0) {
+				continue;
+			}
+			bool gotHit = false;
+			for(const auto& t_global: event.tracks) {
+				auto pixel_coord = trans.transform(idx, true);
+				auto pixel_size = trans.getPixelSize(idx);
+				if(((pixel_coord - t_global).head<2>().array().abs() < pixel_size.array()*nSigma).all()) {
+					gotHit = true;
+					break;
+				}
+			}
+			if(!gotHit) {
+				++c.fake;
+			}
+		}
+	}
+	return c;
+}
+
+counters_t batched(const std::vector<event_t>& events, const MpaTransform& trans)
+{
+	counters_t c{0, 0, 0, 0.0};
+	TrackPixelMatrix matrix(trans);
+	TrackPixelMatrix::mask_t window;
+	for(const auto& event: events) {
+		matrix.compute(event.tracks);
+		matrix.window(nSigma, window);
+		for(size_t track = 0; track < event.tracks.size(); ++track) {
+			for(size_t idx = 0; idx < event.data.size(); ++idx) {
+				if(window(track, idx) && event.data[idx] > 0) {
+					++c.correlated;
+					c.distanceSum += matrix.getAbsDx()(track, idx) / 0.1;
+					break;
+				}
+			}
+			++c.total;
+		}
+		for(size_t idx = 0; idx < event.data.size(); ++idx) {
+			if(event.data[idx] > 0 && !window.col(idx).any()) {
+				++c.fake;
+			}
+		}
+	}
+	return c;
+}
+
+template<typename F>
+counters_t measure(const char* name, F kernel, const std::vector<event_t>& events, const MpaTransform& trans)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto c = kernel(events, trans);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << name << ": " << seconds << " s, " << events.size() / seconds << " events/s" << std::endl;
+	return c;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t numEvents = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	MpaTransform trans;
+	trans.setOffset({-1.2, 0.7, 400.0});
+	trans.setRotation({0.01, -0.02, 0.005});
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<int> numTracks(0, 4);
+	std::uniform_real_distribution<double> pos(-1.0, 5.0);
+	std::uniform_int_distribution<int> pixel(0, MpaTransform::num_pixels-1);
+	std::vector<event_t> events(numEvents);
+	for(auto& event: events) {
+		event.data.assign(MpaTransform::num_pixels, 0);
+		for(int i = numTracks(gen); i > 0; --i) {
+			Eigen::Vector3d local(pos(gen), pos(gen), 0.0);
+			event.tracks.push_back(trans.getOffset() + local);
+			event.data[pixel(gen)] = 1;
+		}
+	}
+	std::cout << "Events: " << numEvents << std::endl;
+	auto a = measure("per-pixel", perPixel, events, trans);
+	auto b = measure("batched  ", batched, events, trans);
+	if(!(a == b)) {
+		std::cerr << "Kernels disagree!" << std::endl;
+		return 1;
+	}
+	std::cout << "tracks " << a.total << ", correlated " << a.correlated << ", fake " << a.fake << std::endl;
+	return 0;
+}
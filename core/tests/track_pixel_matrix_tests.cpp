@@ -0,0 +1,54 @@
+#include "trackpixelmatrix.h"
+#include "gtest/gtest.h"
+#include <random>
+
+using namespace core;
+
+TEST(trackpixelmatrix, identical_to_transform)
+{
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> offset(-4.0, 4.0);
+	std::uniform_real_distribution<double> angle(-0.1, 0.1);
+	std::uniform_real_distribution<double> pos(-1.0, 5.0);
+	for(size_t test_no = 0; test_no < 20; ++test_no) {
+		MpaTransform trans;
+		trans.setOffset({offset(gen), offset(gen), 400.0});
+		trans.setRotation({angle(gen), angle(gen), angle(gen)});
+		TrackPixelMatrix matrix(trans);
+		std::vector<Eigen::Vector3d> points;
+		for(size_t i = 0; i < test_no % 5; ++i) {
+			points.push_back(trans.getOffset() + Eigen::Vector3d(pos(gen), pos(gen), 0.0));
+		}
+		matrix.compute(points);
+		TrackPixelMatrix::mask_t window;
+		matrix.window(1.5, window);
+		ASSERT_EQ(matrix.getNumTracks(), points.size());
+		ASSERT_EQ(static_cast<size_t>(window.rows()), points.size());
+		for(size_t track = 0; track < points.size(); ++track) {
+			for(size_t idx = 0; idx < MpaTransform::num_pixels; ++idx) {
+				auto pixel_coord = trans.transform(idx, true);
+				auto pixel_size = trans.getPixelSize(idx);
+				EXPECT_EQ(matrix.getDx()(track, idx), pixel_coord(0) - points[track](0));
+				EXPECT_EQ(matrix.getDy()(track, idx), pixel_coord(1) - points[track](1));
+				bool inside = ((pixel_coord - points[track]).head<2>().array().abs()
+				               < pixel_size.array()*1.5).all();
+				EXPECT_EQ(window(track, idx), inside) << "track " << track << " pixel " << idx;
+			}
+		}
+	}
+}
+
+TEST(trackpixelmatrix, no_tracks)
+{
+	TrackPixelMatrix matrix{MpaTransform()};
+	matrix.compute({});
+	TrackPixelMatrix::mask_t window;
+	matrix.window(1.0, window);
+	EXPECT_EQ(window.rows(), 0);
+	EXPECT_FALSE(window.col(0).any());
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
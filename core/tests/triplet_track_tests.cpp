@@ -0,0 +1,161 @@
+#include "triplettrack.h"
+#include "candidategrid.h"
+#include "gtest/gtest.h"
+#include <random>
+#include <limits>
+
+using namespace core;
+
+typedef std::vector<std::pair<size_t, size_t>> matches_t;
+
+/// Events with many tracks, the triplets are smeared so that some fall just within and outside the cuts
+class triplettrack : public ::testing::Test
+{
+protected:
+	struct event_t {
+		std::vector<Triplet> upstream;
+		std::vector<Triplet> downstream;
+		std::vector<Eigen::Vector3d> refHits;
+	};
+
+	virtual void SetUp()
+	{
+		std::mt19937 gen(3);
+		std::uniform_real_distribution<double> position(-10, 10);
+		std::normal_distribution<double> slope(0, 1e-3);
+		std::normal_distribution<double> smear(0, 0.1);
+		std::poisson_distribution<int> numTracks(30);
+		for(int evt = 0; evt < 50; ++evt) {
+			event_t event;
+			int tracks = numTracks(gen);
+			for(int i = 0; i < tracks; ++i) {
+				Eigen::Vector3d start(position(gen), position(gen), 0);
+				Eigen::Vector3d direction(slope(gen), slope(gen), 1);
+				auto point = [&](double z) -> Eigen::Vector3d {
+					Eigen::Vector3d p = start + direction * z;
+					p(0) += smear(gen);
+					p(1) += smear(gen);
+					return p;
+				};
+				event.upstream.emplace_back(point(0), point(150), point(300));
+				event.downstream.emplace_back(point(600), point(750), point(900));
+				// the REF planes are slightly tilted
+				event.refHits.push_back(point(1000 + smear(gen)) + refPrealign);
+			}
+			events.push_back(event);
+		}
+	}
+
+	/// Loops over all pairs as TripletTrack::getTracksWithRefDut did
+	static matches_t allRefHits(const event_t& event, const Eigen::Vector3d& prealign, double cut)
+	{
+		matches_t matches;
+		for(size_t i = 0; i < event.refHits.size(); ++i) {
+			for(size_t j = 0; j < event.downstream.size(); ++j) {
+				double resx = event.downstream[j].getdx(event.refHits[i] - prealign);
+				double resy = event.downstream[j].getdy(event.refHits[i] - prealign);
+				if(std::abs(resx) > cut || std::abs(resy) > cut) {
+					continue;
+				}
+				matches.push_back({i, j});
+			}
+		}
+		return matches;
+	}
+
+	static matches_t allTriplets(const event_t& event, double z, double cut)
+	{
+		matches_t matches;
+		for(size_t i = 0; i < event.downstream.size(); ++i) {
+			for(size_t j = 0; j < event.upstream.size(); ++j) {
+				TripletTrack t(0, event.upstream[j], event.downstream[i]);
+				if(std::abs(t.xresidualat(z)) > cut || std::abs(t.yresidualat(z)) > cut) {
+					continue;
+				}
+				matches.push_back({i, j});
+			}
+		}
+		return matches;
+	}
+
+	std::vector<event_t> events;
+	const Eigen::Vector3d refPrealign {0.5, -0.3, 2.0};
+};
+
+TEST_F(triplettrack, candidateGrid)
+{
+	CandidateGrid grid(1.0);
+	grid.insert({0.0, 0.0});
+	grid.insert({5.0, 5.0});
+	grid.insert({std::numeric_limits<double>::quiet_NaN(), 0.0});
+	grid.insert({1.0, -1.0});
+	EXPECT_EQ(grid.size(), 4);
+	std::vector<size_t> indices;
+	grid.query({0.5, 0.0}, indices);
+	EXPECT_EQ(indices, (std::vector<size_t>{0, 2, 3}));
+	grid.query({std::numeric_limits<double>::infinity(), 0.0}, indices);
+	EXPECT_EQ(indices, (std::vector<size_t>{0, 1, 2, 3}));
+	CandidateGrid disabled(std::numeric_limits<double>::infinity());
+	disabled.insert({0.0, 0.0});
+	disabled.insert({1e300, 0.0});
+	disabled.query({0.0, 0.0}, indices);
+	EXPECT_EQ(indices, (std::vector<size_t>{0, 1}));
+	grid.clear();
+	grid.query({0.0, 0.0}, indices);
+	EXPECT_TRUE(indices.empty());
+}
+
+TEST_F(triplettrack, matchRefHits)
+{
+	size_t numMatches = 0;
+	for(double cut: {0.0, 0.05, 0.15, 0.7, 100.0}) {
+		for(const auto& event: events) {
+			auto expected = allRefHits(event, refPrealign, cut);
+			EXPECT_EQ(TripletTrack::matchRefHits(event.refHits, event.downstream, refPrealign, cut), expected);
+			numMatches += expected.size();
+		}
+	}
+	EXPECT_GT(numMatches, 0);
+}
+
+TEST_F(triplettrack, matchTriplets)
+{
+	size_t numMatches = 0;
+	for(double cut: {0.0, 0.05, 0.15, 0.7, 100.0}) {
+		for(double z: {450.0, 1000.0}) {
+			for(const auto& event: events) {
+				auto expected = allTriplets(event, z, cut);
+				EXPECT_EQ(TripletTrack::matchTriplets(event.downstream, event.upstream, z, cut), expected);
+				numMatches += expected.size();
+			}
+		}
+	}
+	EXPECT_GT(numMatches, 0);
+}
+
+TEST_F(triplettrack, boundary)
+{
+	// residuals exactly at the cut and non-finite coordinates are treated as by the loops over all pairs
+	event_t event;
+	double nan = std::numeric_limits<double>::quiet_NaN();
+	event.upstream.emplace_back(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 1), Eigen::Vector3d(0, 0, 2));
+	event.upstream.emplace_back(Eigen::Vector3d(0.1, 0, 0), Eigen::Vector3d(0.1, 0, 1), Eigen::Vector3d(0.1, 0, 2));
+	event.upstream.emplace_back(Eigen::Vector3d(nan, 0, 0), Eigen::Vector3d(0, 0, 1), Eigen::Vector3d(0, 0, 2));
+	event.upstream.emplace_back(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 1), Eigen::Vector3d(0, 0, 0));
+	event.downstream = event.upstream;
+	event.downstream.emplace_back(Eigen::Vector3d(-0.1, 0.1, 5), Eigen::Vector3d(-0.1, 0.1, 6),
+	                              Eigen::Vector3d(-0.1, 0.1, 7));
+	event.refHits = {{0.1, 0, 10}, {0, 0.1, 12}, {nan, 0, 10}, {0, 0, -3}};
+	for(double cut: {-1.0, 0.0, 0.1, nan}) {
+		EXPECT_EQ(TripletTrack::matchTriplets(event.downstream, event.upstream, 4, cut), allTriplets(event, 4, cut));
+		Eigen::Vector3d prealign(0, 0, 0);
+		EXPECT_EQ(TripletTrack::matchRefHits(event.refHits, event.downstream, prealign, cut),
+		          allRefHits(event, prealign, cut));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,93 @@
+#include "zscan.h"
+#include "gtest/gtest.h"
+#include <random>
+
+using namespace core;
+
+struct fill_t {
+	size_t event;
+	Eigen::Vector3d point;
+	int index;
+};
+
+static ZScan makeSample(std::vector<std::vector<Track>>& tracks)
+{
+	std::mt19937 gen(7);
+	std::uniform_real_distribution<double> pos(-5.0, 5.0);
+	ZScan scan(4, 5);
+	for(int event = 0; event < 50; ++event) {
+		std::vector<Track> evtTracks(event % 3);
+		for(auto& track: evtTracks) {
+			for(int plane = 0; plane < 6; ++plane) {
+				track.points.push_back({pos(gen), pos(gen), plane*150.0 + pos(gen)});
+			}
+		}
+		std::vector<ZScan::hit_t> hits;
+		for(int i = 0; i < event % 4; ++i) {
+			hits.push_back({i, Eigen::Vector2d(pos(gen), pos(gen))});
+		}
+		tracks.push_back(evtTracks);
+		scan.addEvent(event+100, evtTracks, hits);
+	}
+	return scan;
+}
+
+TEST(zscan, steps)
+{
+	auto steps = ZScan::steps(820, 860, 5);
+	ASSERT_EQ(steps.size(), 5);
+	EXPECT_EQ(steps.front(), 820);
+	EXPECT_EQ(steps.back(), 860);
+	EXPECT_EQ(steps[2], 840);
+}
+
+TEST(zscan, identical_to_extrapolation)
+{
+	std::vector<std::vector<Track>> tracks;
+	auto scan = makeSample(tracks);
+	ASSERT_EQ(scan.getNumEvents(), 50);
+	EXPECT_EQ(scan.getEventNumber(3), 103);
+	auto positions = ZScan::steps(800, 880, 9);
+	std::vector<std::vector<fill_t>> fills(positions.size());
+	std::vector<size_t> eventsDone(positions.size(), 0);
+	scan.scan(positions,
+	          [&](size_t step, size_t event, const Eigen::Vector3d& point, const ZScan::hit_t& hit) {
+	                  fills[step].push_back({event, point, hit.index});
+	          },
+	          [&](size_t step, size_t event) {
+	                  EXPECT_EQ(eventsDone[step]++, event);
+	          }, 4);
+	for(size_t step = 0; step < positions.size(); ++step) {
+		EXPECT_EQ(eventsDone[step], 50);
+		// same order as a sequential pass: events, tracks, hits
+		size_t i = 0;
+		for(size_t event = 0; event < tracks.size(); ++event) {
+			for(const auto& track: tracks[event]) {
+				auto expected = track.extrapolateOnPlane(4, 5, positions[step], 2);
+				for(int hit = 0; hit < static_cast<int>(event % 4); ++hit) {
+					ASSERT_LT(i, fills[step].size());
+					EXPECT_EQ(fills[step][i].event, event);
+					EXPECT_EQ(fills[step][i].index, hit);
+					EXPECT_EQ(fills[step][i].point, expected);
+					++i;
+				}
+			}
+		}
+		EXPECT_EQ(i, fills[step].size());
+	}
+}
+
+TEST(zscan, exception_in_thread)
+{
+	std::vector<std::vector<Track>> tracks;
+	auto scan = makeSample(tracks);
+	EXPECT_THROW(scan.scan(ZScan::steps(800, 880, 9),
+	             [](size_t step, size_t, const Eigen::Vector3d&, const ZScan::hit_t&) {
+	                     if(step == 3) throw std::runtime_error("fill failed");
+	             }, ZScan::event_callback_t{}, 4), std::runtime_error);
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -2,7 +2,11 @@
 #include <getopt.h>
 #include <iostream>
 #include <thread>
-#include <queue>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <mutex>
 #include <stddef.h>
 #include <stdlib.h>
@@ -10,11 +14,14 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
 #include <condition_variable>
 #include <memory>
 #include "utilsconfig.h"
 #include "core.h"
 #include "analysis.h"
+#include "runcache.h"
 
 std::mutex mutex_cerr;
 std::mutex mutex_workercounter;
@@ -66,7 +73,7 @@ public:
 			output << "Analysis '" << analysis_name << "' was not found." << std::endl;
 			return _isExecutable = false;
 		}
-		assert(analysis.get());
+		assert(_analysis.get());
 		try {
 			std::vector<const char*> argv_c;
 			for(const auto& arg: argv) {
@@ -121,7 +128,7 @@ public:
 	bool execute(std::ostream& output)
 	{
 		try {
-			_analysis->run(_vm);
+			_analysis->runCached(_vm);
 		} catch(core::CfgParse::parse_error& e) {
 			output << _argv0 << ": Error while parsing configuration:\n" << e.what() << std::endl;
 			return false;
@@ -140,6 +147,18 @@ public:
 
 	std::string getCommandline() const { return _cmdline; }
 
+	/// Progress of the analysis, nullptr after release()
+	core::Progress* getProgress()
+	{
+		return _analysis ? &_analysis->getProgress() : nullptr;
+	}
+
+	/// Destroy the analysis object, which flushes and closes its output files
+	void release()
+	{
+		_analysis.reset();
+	}
+
 private:
 	std::unique_ptr<core::Analysis> _analysis;
 	po::variables_map _vm;
@@ -154,109 +173,491 @@ std::ostream & operator<<(std::ostream& f, const Job& job)
 	return f;
 }
 
+/** \brief Scheduling hints of a submitted job
+ *
+ * Jobs with higher priority are started first. The number of threads and the amount of memory (in MB)
+ * are reserved while the job is running, a job is only started if both fit into the pool budget. The
+ * reserved threads are passed to the analysis as configuration variable \c job_threads.
+ */
+struct job_hints_t {
+	job_hints_t() : priority(0), threads(1), memory(0) {}
+	int priority;
+	size_t threads;
+	size_t memory;
+};
+
+enum job_state_t {
+	JS_QUEUED,
+	JS_RUNNING,
+	JS_FINISHED,
+	JS_FAILED,
+	JS_CANCELLED
+};
+
+const char* jobStateName(job_state_t state)
+{
+	switch(state) {
+	case JS_QUEUED: return "queued";
+	case JS_RUNNING: return "running";
+	case JS_FINISHED: return "finished";
+	case JS_FAILED: return "failed";
+	case JS_CANCELLED: return "cancelled";
+	}
+	return "unknown";
+}
+
+/// Information about a submitted job as reported to clients
+struct job_info_t {
+	size_t id;
+	job_state_t state;
+	job_hints_t hints;
+	std::string cmdline;
+	bool hasProgress;
+	core::Progress::status_t progress;
+};
+
+/** \brief Work-stealing job pool
+ *
+ * Every worker owns a set of deques, one per priority. New jobs are distributed round-robin over the
+ * workers. A worker takes the oldest job of the highest priority found in its own deques or, if another
+ * worker holds a job with higher priority, steals the newest job of that priority from the other worker.
+ * Idle workers sleep on a condition variable and are woken as soon as a job is pushed.
+ *
+ * Starting a job reserves the resources given in its job_hints_t. Admission is serialized, so a job
+ * waiting for resources cannot be overtaken by smaller jobs submitted later.
+ */
 class JobQueue
 {
 public:
-	JobQueue()
+	JobQueue() :
+		_workers(), _threads(), _tasks(), _nextWorker(0), _nextId(1), _pending(0), _running(0), _stop(false),
+		_threadBudget(1), _memoryBudget(0), _reservedMemory(0), _usedThreads(0), _usedMemory(0)
 	{
 	}
 
 	~JobQueue()
 	{
+		stopWorkers();
 	}
 
-	void push(Job&& job)
+	/** \brief Queue a job for execution
+	 *
+	 * \return ID of the job, 0 if the pool is stopped
+	 */
+	size_t push(Job&& job, const job_hints_t& hints=job_hints_t())
 	{
-		std::lock_guard<std::mutex>(this->_mutex);
-		_jobs.push(std::move(job));
-		wait_for_work.notify_one();
+		task_ptr task(new task_t(std::move(job), hints));
+		task->hints.threads = std::max<size_t>(1, std::min(hints.threads, _threadBudget));
+		task->hints.memory = std::min(hints.memory, _memoryBudget - _reservedMemory);
+		size_t id;
+		{
+			std::lock_guard<std::mutex> lk(_stateMutex);
+			if(_stop) {
+				return 0;
+			}
+			id = task->id = _nextId++;
+			_tasks[id] = task;
+			auto& worker = *_workers[_nextWorker++ % _workers.size()];
+			std::lock_guard<std::mutex> wlk(worker.mutex);
+			worker.tasks[task->hints.priority].push_back(task);
+			++_pending;
+		}
+		_wakeup.notify_one();
+		return id;
 	}
-	Job pop()
+
+	/** \brief Cancel a job
+	 *
+	 * Queued jobs are dropped, running analyses are asked to stop at the next progress update.
+	 * \return false if there is no queued or running job with the given ID
+	 */
+	bool cancel(size_t id)
 	{
-		std::lock_guard<std::mutex>(this->_mutex);
-		if(_jobs.size() == 0) {
-			throw no_jobs_left();
+		task_ptr task;
+		{
+			std::lock_guard<std::mutex> lk(_stateMutex);
+			auto it = _tasks.find(id);
+			if(it == _tasks.end()) {
+				return false;
+			}
+			task = it->second;
+			if(task->state == JS_QUEUED) {
+				// the task stays in the deques and is dropped by the worker taking it
+				task->state = JS_CANCELLED;
+				return true;
+			}
+			if(task->state != JS_RUNNING) {
+				return false;
+			}
+		}
+		std::lock_guard<std::mutex> tlk(task->mutex);
+		auto progress = task->job.getProgress();
+		if(progress) {
+			progress->cancel();
 		}
-		auto j = std::move(_jobs.front());
-		_jobs.pop();
-		return j;
+		return true;
 	}
+
+	/// Get information about job with the given ID, returns false if the job is unknown
+	bool info(size_t id, job_info_t& info)
+	{
+		task_ptr task;
+		{
+			std::lock_guard<std::mutex> lk(_stateMutex);
+			auto it = _tasks.find(id);
+			if(it == _tasks.end()) {
+				return false;
+			}
+			task = it->second;
+			info.state = task->state;
+		}
+		info.id = id;
+		info.hints = task->hints;
+		std::lock_guard<std::mutex> tlk(task->mutex);
+		info.cmdline = task->job.getCommandline();
+		auto progress = task->job.getProgress();
+		if(progress && info.state == JS_RUNNING) {
+			task->last = progress->get();
+			task->hasProgress = true;
+		}
+		info.hasProgress = task->hasProgress;
+		info.progress = task->last;
+		return true;
+	}
+
+	/// IDs of all known jobs, finished jobs are only remembered for a while
+	std::vector<size_t> jobIds()
+	{
+		std::lock_guard<std::mutex> lk(_stateMutex);
+		std::vector<size_t> ids;
+		for(const auto& item: _tasks) {
+			ids.push_back(item.first);
+		}
+		return ids;
+	}
+
+	/// Number of jobs waiting for execution
 	size_t size()
 	{
-		std::lock_guard<std::mutex>(this->_mutex);
-		return _jobs.size();
+		std::lock_guard<std::mutex> lk(_stateMutex);
+		return _pending;
 	}
 
-	class no_jobs_left : public std::exception
+	/// Number of jobs currently executed
+	size_t running()
 	{
-	};
+		std::lock_guard<std::mutex> lk(_stateMutex);
+		return _running;
+	}
+
+	/** \brief Take memory (in MB) from the budget of the jobs for the whole lifetime of the pool
+	 *
+	 * Must be called before any job is submitted.
+	 * \return The reserved memory, at most the budget
+	 */
+	size_t reserveMemory(size_t memory)
+	{
+		std::lock_guard<std::mutex> lk(_stateMutex);
+		_reservedMemory = std::min(memory, _memoryBudget);
+		return _reservedMemory;
+	}
+
+	/// Maximum number of threads of a job, set from NUM_THREADS by startWorkers()
+	size_t getThreadBudget()
+	{
+		std::lock_guard<std::mutex> lk(_stateMutex);
+		return _threadBudget;
+	}
+
+	/// Memory available to the jobs in MB, set from BELPHEGOR_MEMORY by startWorkers()
+	size_t getMemoryBudget()
+	{
+		std::lock_guard<std::mutex> lk(_stateMutex);
+		return _memoryBudget;
+	}
 
 	void startWorkers()
 	{
-		stop_worker = false;
 		auto num_threads_str = std::getenv("NUM_THREADS");
 		int num_threads = std::thread::hardware_concurrency();
 		if(num_threads_str) {
 			num_threads = std::stoi(num_threads_str);
 			assert(num_threads > 0);
 		}
-		for(size_t i = 0; i < num_threads; ++i) {
-			_workers.push_back(std::thread(JobQueue::workerFunction, i+1, this));
+		if(num_threads < 1) {
+			num_threads = 1;
+		}
+		_threadBudget = num_threads;
+		_memoryBudget = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) / 1024
+		              * static_cast<size_t>(sysconf(_SC_PAGE_SIZE)) / 1024;
+		auto memory_str = std::getenv("BELPHEGOR_MEMORY");
+		if(memory_str) {
+			_memoryBudget = std::stoul(memory_str);
+		}
+		_stop = false;
+		for(size_t i = 0; i < static_cast<size_t>(num_threads); ++i) {
+			_workers.push_back(std::unique_ptr<worker_t>(new worker_t));
+		}
+		for(size_t i = 0; i < _workers.size(); ++i) {
+			_threads.push_back(std::thread(&JobQueue::workerFunction, this, i));
 		}
 	}
 
 	void stopWorkers()
 	{
-		std::lock_guard<std::mutex>(this->_mutex);
-		while(!_jobs.empty()) {
-			_jobs.pop();
+		{
+			std::lock_guard<std::mutex> lk(_stateMutex);
+			_stop = true;
+			for(auto& worker: _workers) {
+				std::lock_guard<std::mutex> wlk(worker->mutex);
+				worker->tasks.clear();
+			}
+			_pending = 0;
 		}
-		stop_worker = true;
-		wait_for_work.notify_one();
-		for(auto& w: _workers) {
-			w.join();
+		_wakeup.notify_all();
+		_resourcesFreed.notify_all();
+		for(auto& t: _threads) {
+			t.join();
 		}
+		_threads.clear();
 	}
 
 private:
-	static void workerFunction(int workerId, JobQueue* jobQueue)
+	struct task_t {
+		task_t(Job&& j, const job_hints_t& h) :
+		 id(0), job(std::move(j)), hints(h), state(JS_QUEUED), mutex(), hasProgress(false), last()
+		{
+		}
+		size_t id;
+		Job job;
+		job_hints_t hints;
+		/// Guarded by JobQueue::_stateMutex
+		job_state_t state;
+		/// Guards access to the analysis of job and the progress below
+		std::mutex mutex;
+		bool hasProgress;
+		core::Progress::status_t last;
+	};
+	typedef std::shared_ptr<task_t> task_ptr;
+	/// Number of finished jobs to remember for status queries
+	static constexpr size_t max_finished_tasks = 256;
+	/// Wait in ms before a worker looks for its claimed task again
+	static constexpr int take_retry_interval = 1;
+
+	struct worker_t {
+		std::mutex mutex;
+		std::map<int, std::deque<task_ptr>> tasks;
+	};
+
+	/// Highest priority with queued tasks of worker, returns false if there are none
+	static bool topPriority(worker_t& worker, int& priority)
 	{
-		/*{
-			std::lock_guard<std::mutex> cl(mutex_cerr);
-			std::cerr << "Worker " << workerId << " started." << std::endl;
-		}*/
-		while(!stop_worker) {
-			try {
-				auto job = std::move(jobQueue->pop());
-				auto numJobs = jobQueue->size();
-				{
-					std::lock_guard<std::mutex> cl(mutex_cerr);
-					std::cerr << "Worker " << workerId
-					          << " (" << numJobs << " jobs left): '" << job << "'" << std::endl;
+		std::lock_guard<std::mutex> lk(worker.mutex);
+		for(auto it = worker.tasks.rbegin(); it != worker.tasks.rend(); ++it) {
+			if(it->second.size()) {
+				priority = it->first;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// Take a task from the own deques or steal one with a higher priority from another worker
+	task_ptr take(size_t workerId)
+	{
+		int best = 0;
+		size_t victim = workerId;
+		bool found = topPriority(*_workers[workerId], best);
+		for(size_t i = 1; i < _workers.size(); ++i) {
+			size_t idx = (workerId + i) % _workers.size();
+			int prio;
+			if(topPriority(*_workers[idx], prio) && (!found || prio > best)) {
+				best = prio;
+				victim = idx;
+				found = true;
+			}
+		}
+		if(!found) {
+			return task_ptr();
+		}
+		auto& worker = *_workers[victim];
+		std::lock_guard<std::mutex> lk(worker.mutex);
+		auto it = worker.tasks.find(best);
+		if(it == worker.tasks.end() || it->second.empty()) {
+			// somebody else was faster
+			return task_ptr();
+		}
+		task_ptr task;
+		if(victim == workerId) {
+			task = std::move(it->second.front());
+			it->second.pop_front();
+		} else {
+			task = std::move(it->second.back());
+			it->second.pop_back();
+		}
+		if(it->second.empty()) {
+			worker.tasks.erase(it);
+		}
+		return task;
+	}
+
+	/// Wait until the resources requested by task are available and reserve them
+	bool acquire(task_t& task)
+	{
+		std::lock_guard<std::mutex> admission(_admissionMutex);
+		std::unique_lock<std::mutex> lk(_stateMutex);
+		_resourcesFreed.wait(lk, [&] {
+			return _stop || task.state != JS_QUEUED ||
+			       (_usedThreads + task.hints.threads <= _threadBudget &&
+			        _reservedMemory + _usedMemory + task.hints.memory <= _memoryBudget);
+		});
+		if(_stop || task.state != JS_QUEUED) {
+			return false;
+		}
+		_usedThreads += task.hints.threads;
+		_usedMemory += task.hints.memory;
+		++_running;
+		task.state = JS_RUNNING;
+		return true;
+	}
+
+	void release(task_t& task, job_state_t state)
+	{
+		{
+			std::lock_guard<std::mutex> lk(_stateMutex);
+			_usedThreads -= task.hints.threads;
+			_usedMemory -= task.hints.memory;
+			--_running;
+			task.state = state;
+			retire(task.id);
+		}
+		_resourcesFreed.notify_all();
+	}
+
+	/// Remember finished task for status queries, requires _stateMutex
+	void retire(size_t id)
+	{
+		_finished.push_back(id);
+		while(_finished.size() > max_finished_tasks) {
+			_tasks.erase(_finished.front());
+			_finished.pop_front();
+		}
+	}
+
+	void workerFunction(size_t workerId)
+	{
+		while(true) {
+			size_t numJobs;
+			{
+				std::unique_lock<std::mutex> lk(_stateMutex);
+				_wakeup.wait(lk, [this] { return _stop || _pending > 0; });
+				if(_stop) {
+					return;
+				}
+				// claim a job, it is guaranteed to be found by take()
+				numJobs = --_pending;
+			}
+			task_ptr task;
+			while(!(task = take(workerId))) {
+				// another worker took the task we saw, ours is still queued
+				std::unique_lock<std::mutex> lk(_stateMutex);
+				if(_wakeup.wait_for(lk, std::chrono::milliseconds(take_retry_interval), [this] { return _stop; })) {
+					return;
 				}
-				job.execute(std::cout);
-			} catch(JobQueue::no_jobs_left& e) {
-				std::unique_lock<std::mutex> lk(JobQueue::cv_mutex);
-				JobQueue::wait_for_work.wait_for(lk, std::chrono::seconds(2));
+			}
+			if(!acquire(*task)) {
+				std::lock_guard<std::mutex> lk(_stateMutex);
+				if(_stop) {
+					return;
+				}
+				// cancelled while queued
+				retire(task->id);
+				continue;
+			}
+			{
+				std::lock_guard<std::mutex> cl(mutex_cerr);
+				std::cerr << "Worker " << workerId+1
+				          << " (" << numJobs << " jobs left): job " << task->id
+				          << " '" << task->job << "'" << std::endl;
+			}
+			bool success = false;
+			try {
+				success = task->job.execute(std::cout);
 			} catch(std::exception& e) {
 				std::lock_guard<std::mutex> cl(mutex_cerr);
 				std::cerr << "Error occured during execution of Analysis: " << e.what() << std::endl;
 			}
+			bool cancelled;
+			{
+				std::lock_guard<std::mutex> tlk(task->mutex);
+				auto progress = task->job.getProgress();
+				task->last = progress->get();
+				task->hasProgress = true;
+				cancelled = progress->isCancelled();
+				task->job.release();
+			}
+			release(*task, cancelled ? JS_CANCELLED : (success ? JS_FINISHED : JS_FAILED));
 		}
 	}
-	std::queue<Job> _jobs;
-	std::mutex _mutex;
-	static std::condition_variable wait_for_work;
-	static std::mutex cv_mutex;
-	static bool stop_worker;
-	std::vector<std::thread> _workers;
-};
 
-std::condition_variable JobQueue::wait_for_work;
-std::mutex JobQueue::cv_mutex;
-bool JobQueue::stop_worker = false;
+	std::vector<std::unique_ptr<worker_t>> _workers;
+	std::vector<std::thread> _threads;
+	/// All queued, running and recently finished tasks by ID
+	std::map<size_t, task_ptr> _tasks;
+	std::deque<size_t> _finished;
+	size_t _nextWorker;
+	size_t _nextId;
+	/// Protects the counters below and the distribution of new jobs
+	std::mutex _stateMutex;
+	std::mutex _admissionMutex;
+	std::condition_variable _wakeup;
+	std::condition_variable _resourcesFreed;
+	size_t _pending;
+	size_t _running;
+	bool _stop;
+	size_t _threadBudget;
+	size_t _memoryBudget;
+	/// Part of _memoryBudget used by the daemon itself, e.g. the RunCache
+	size_t _reservedMemory;
+	size_t _usedThreads;
+	size_t _usedMemory;
+};
 
 
+/** \brief UNIX socket server accepting commands from sacrifice
+ *
+ * A client sends a single command consisting of NUL separated fields and shuts down its sending side. The
+ * first field is the command:
+ *
+ * - <tt>SACRIFICE argv0 [--priority N] [--threads N] [--memory MB] ANALYSIS [options]</tt> submits a job
+ * - <tt>STATUS [ID]</tt> reports all known jobs or a single job
+ * - <tt>CANCEL ID</tt> cancels a queued or running job
+ * - <tt>WATCH [ID]</tt> streams the progress of a job (or all running jobs) every second until it finished
+ * - <tt>WAKE</tt> does nothing but print a message
+ *
+ * The answer is text. Besides free-form messages (e.g. from the analysis setup), machine-readable lines
+ * start with a keyword followed by key=value pairs:
+ *
+ * \verbatim
+QUEUE pending=3 running=2
+JOB id=7 state=running priority=0 threads=1 memory=0 cmd=./belphegor MpaEfficiency -r 123
+PROGRESS id=7 step=efficiency run=123 rerun=0 events=40960 expected=100000 rate=5120.5 eta=11.6 elapsed=8.0 rss=812
+ERROR id=9 unknown job
+\endverbatim
+ *
+ * \c rss is the resident memory of the whole daemon in MB, as all jobs share the process. The memory hint
+ * of each job is listed in its JOB line. Each connection is handled by its own thread.
+ *
+ * The decoded input files are kept in the core::RunCache, so jobs analysing the same run parse it only once.
+ * Its budget in MB is taken from the environment variable BELPHEGOR_RUN_CACHE, by default a quarter of the
+ * memory budget of the jobs (BELPHEGOR_MEMORY, by default the physical memory), 0 disables it. The cache
+ * budget is reserved from the memory budget, so the memory hints of the jobs share the rest. STATUS reports
+ * the cache in a line like
+ *
+ * \verbatim
+CACHE entries=4 bytes=1073741824 budget=4294967296 hits=12 misses=4
+\endverbatim
+ */
 class Listener
 {
 public:
@@ -288,38 +689,22 @@ public:
 	void start()
 	{
 		_queue.startWorkers();
-		listen(_socket, 5);
+		size_t cacheBudget = _queue.getMemoryBudget() / 4;
+		auto cache_str = std::getenv("BELPHEGOR_RUN_CACHE");
+		if(cache_str) {
+			cacheBudget = std::stoul(cache_str);
+		}
+		cacheBudget = _queue.reserveMemory(cacheBudget);
+		core::RunCache::setBudget(cacheBudget * 1024 * 1024);
+		listen(_socket, SOMAXCONN);
 		int csock = 0;
-		const size_t bufsize = 8192;
-		char buf[bufsize];
 		while(!g_quit) {
 			csock = accept(_socket, nullptr, nullptr);
 			if(csock == -1) {
 				std::cerr << "Listener::listen(): accept: << " << strerror(errno) << std::endl;
 				continue;
 			}
-			size_t size = recv(csock, &buf, bufsize, MSG_PEEK);
-			std::string command;
-			auto argv = getArgv(std::string(buf, size), command);
-			if(command == "WAKE") {
-				std::cout << "Belphegor awakens." << std::endl;
-			} else if(command == "SACRIFICE") {
-				if(argv.size() == 1) {
-					std::cout << "Supported analyses:\n";
-					for(const auto& name: core::AnalysisFactory::Instance()->getTypes()) {
-						std::cout << " " << name << " : " <<
-							core::AnalysisFactory::Instance()->getDescription(name) << "\n";
-					}
-				} else {
-					if(argv[1][0] == '-') {
-						handleCommand(csock, argv);
-					} else {
-						std::cout << "Belphegor accepts your sacrifice." << std::endl;
-						submit(csock, argv);
-					}
-				}
-			}
-			close(csock);
+			std::thread(&Listener::handleConnection, this, csock).detach();
 		}
 	}
 
@@ -350,25 +735,265 @@ public:
 		}
 		return vec;
 	}
+
+	/** \brief Extract scheduling options preceding the analysis name
+	 *
+	 * Supported options are <tt>--priority N</tt>, <tt>--threads N</tt> and <tt>--memory MB</tt>,
+	 * also in the form <tt>--option=value</tt>. The options are removed from argv.
+	 */
+	static job_hints_t getHints(std::vector<std::string>& argv)
+	{
+		job_hints_t hints;
+		while(argv.size() > 1 && argv[1].compare(0, 2, "--") == 0) {
+			auto option = argv[1];
+			std::string value;
+			size_t consumed = 1;
+			auto eq = option.find('=');
+			if(eq != std::string::npos) {
+				value = option.substr(eq+1);
+				option = option.substr(0, eq);
+			} else if(argv.size() > 2) {
+				value = argv[2];
+				consumed = 2;
+			}
+			if(option != "--priority" && option != "--threads" && option != "--memory") {
+				break;
+			}
+			try {
+				if(option == "--priority") {
+					hints.priority = std::stoi(value);
+				} else if(option == "--threads") {
+					hints.threads = std::stoul(value);
+				} else {
+					hints.memory = std::stoul(value);
+				}
+			} catch(std::logic_error& e) {
+				std::lock_guard<std::mutex> cl(mutex_cerr);
+				std::cerr << "Ignoring invalid value '" << value << "' for " << option << std::endl;
+			}
+			argv.erase(argv.begin()+1, argv.begin()+1+consumed);
+		}
+		return hints;
+	}
+
+	/// Resident memory of the daemon in MB
+	static size_t getResidentMemory()
+	{
+		std::ifstream fin("/proc/self/statm");
+		size_t pages = 0, resident = 0;
+		fin >> pages >> resident;
+		return resident * static_cast<size_t>(sysconf(_SC_PAGE_SIZE)) / (1024*1024);
+	}
+
+	static std::string formatJob(const job_info_t& info)
+	{
+		std::ostringstream sstr;
+		sstr << "JOB id=" << info.id << " state=" << jobStateName(info.state)
+		     << " priority=" << info.hints.priority << " threads=" << info.hints.threads
+		     << " memory=" << info.hints.memory << " cmd=" << info.cmdline << "\n";
+		return sstr.str();
+	}
+
+	static std::string formatProgress(const job_info_t& info)
+	{
+		const auto& p = info.progress;
+		std::ostringstream sstr;
+		sstr << std::fixed << std::setprecision(1)
+		     << "PROGRESS id=" << info.id << " step=" << p.step << " run=" << p.runId
+		     << " rerun=" << p.rerun << " events=" << p.events << " expected=" << p.expectedEvents
+		     << " rate=" << p.eventsPerSecond << " eta=" << p.eta << " elapsed=" << p.totalSeconds
+		     << " rss=" << getResidentMemory() << "\n";
+		return sstr.str();
+	}
+
 private:
-	void submit(int sock, const std::vector<std::string>& argv)
+	/// Time a client may take to send its command, in ms
+	static constexpr int receive_timeout = 10000;
+
+	/** \brief Read until the client shuts down its sending side
+	 *
+	 * \return false if the client did not send anything for receive_timeout or on error
+	 */
+	static bool receive(int sock, std::string& message)
+	{
+		const size_t bufsize = 8192;
+		char buf[bufsize];
+		message.clear();
+		struct pollfd pfd { sock, POLLIN, 0 };
+		while(true) {
+			int ready = poll(&pfd, 1, receive_timeout);
+			if(ready < 0 && errno == EINTR) {
+				continue;
+			}
+			if(ready <= 0) {
+				return false;
+			}
+			ssize_t size = recv(sock, buf, bufsize, 0);
+			if(size == 0) {
+				return true;
+			} else if(size < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			message.append(buf, size);
+		}
+	}
+
+	/// Send text to client, returns false if the client disconnected
+	static bool reply(int sock, const std::string& s)
 	{
+		size_t sent = 0;
+		while(sent < s.size()) {
+			auto ret = send(sock, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+			if(ret <= 0) {
+				return false;
+			}
+			sent += ret;
+		}
+		return true;
+	}
+
+	static bool parseId(const std::vector<std::string>& argv, size_t pos, size_t& id)
+	{
+		if(argv.size() <= pos) {
+			return false;
+		}
+		try {
+			id = std::stoul(argv[pos]);
+		} catch(std::logic_error& e) {
+			return false;
+		}
+		return true;
+	}
+
+	void handleConnection(int csock)
+	{
+		std::string command;
+		std::string message;
+		if(!receive(csock, message)) {
+			reply(csock, "ERROR no complete command received\n");
+			close(csock);
+			return;
+		}
+		auto argv = getArgv(message, command);
+		if(command == "WAKE") {
+			std::cout << "Belphegor awakens." << std::endl;
+		} else if(command == "SACRIFICE") {
+			if(argv.size() == 1) {
+				std::ostringstream sstr;
+				sstr << "Supported analyses:\n";
+				for(const auto& name: core::AnalysisFactory::Instance()->getTypes()) {
+					sstr << " " << name << " : " <<
+						core::AnalysisFactory::Instance()->getDescription(name) << "\n";
+				}
+				reply(csock, sstr.str());
+			} else {
+				auto hints = getHints(argv);
+				if(argv.size() < 2) {
+					reply(csock, "ERROR no analysis given\n");
+				} else if(argv[1][0] == '-') {
+					status(csock, argv, 2);
+				} else {
+					submit(csock, argv, hints);
+				}
+			}
+		} else if(command == "STATUS") {
+			status(csock, argv, 0);
+		} else if(command == "CANCEL") {
+			size_t id;
+			if(!parseId(argv, 0, id)) {
+				reply(csock, "ERROR missing job ID\n");
+			} else if(_queue.cancel(id)) {
+				reply(csock, "CANCELLED id=" + std::to_string(id) + "\n");
+			} else {
+				reply(csock, "ERROR id=" + std::to_string(id) + " no queued or running job\n");
+			}
+		} else if(command == "WATCH") {
+			watch(csock, argv);
+		} else {
+			reply(csock, "ERROR unknown command '" + command + "'\n");
+		}
+		close(csock);
+	}
+
+	void submit(int sock, std::vector<std::string> argv, const job_hints_t& hints)
+	{
+		// the analysis may use as many threads as the job reserves
+		auto threads = std::max<size_t>(1, std::min(hints.threads, _queue.getThreadBudget()));
+		argv.push_back("-D");
+		argv.push_back("job_threads=" + std::to_string(threads));
 		Job job;
 		std::ostringstream sstr;
 		if(job.setup(argv, sstr)) {
-			_queue.push(std::move(job));
+			std::cout << "Belphegor accepts your sacrifice." << std::endl;
+			auto id = _queue.push(std::move(job), hints);
+			job_info_t info;
+			if(id && _queue.info(id, info)) {
+				sstr << formatJob(info);
+			}
 		}
-		auto s = sstr.str();
-		send(sock, &s[0], s.size()+1, 0);
+		reply(sock, sstr.str());
 	}
-	void handleCommand(int sock, const std::vector<std::string>& argv)
-	{
 
+	void status(int sock, const std::vector<std::string>& argv, size_t idPos)
+	{
 		std::ostringstream sstr;
-		sstr << "Job Queue size: " << _queue.size() << std::endl;	
-		auto s = sstr.str();
-		send(sock, &s[0], s.size()+1, 0);
+		sstr << "QUEUE pending=" << _queue.size() << " running=" << _queue.running() << "\n";
+		auto cache = core::RunCache::getStatistics();
+		sstr << "CACHE entries=" << cache.entries << " bytes=" << cache.bytes << " budget=" << cache.budget
+		     << " hits=" << cache.hits << " misses=" << cache.misses << "\n";
+		size_t id;
+		std::vector<size_t> ids;
+		if(parseId(argv, idPos, id)) {
+			ids.push_back(id);
+		} else {
+			ids = _queue.jobIds();
+		}
+		for(auto jobId: ids) {
+			job_info_t info;
+			if(!_queue.info(jobId, info)) {
+				sstr << "ERROR id=" << jobId << " unknown job\n";
+				continue;
+			}
+			sstr << formatJob(info);
+			if(info.hasProgress) {
+				sstr << formatProgress(info);
+			}
+		}
+		reply(sock, sstr.str());
 	}
+
+	void watch(int sock, const std::vector<std::string>& argv)
+	{
+		size_t id = 0;
+		bool single = parseId(argv, 0, id);
+		while(true) {
+			std::ostringstream sstr;
+			bool active = false;
+			for(auto jobId: single ? std::vector<size_t>{id} : _queue.jobIds()) {
+				job_info_t info;
+				if(!_queue.info(jobId, info)) {
+					sstr << "ERROR id=" << jobId << " unknown job\n";
+					continue;
+				}
+				if(info.state == JS_RUNNING && info.hasProgress) {
+					sstr << formatProgress(info);
+				}
+				if(info.state == JS_QUEUED || info.state == JS_RUNNING) {
+					active = true;
+				} else if(single) {
+					sstr << formatJob(info);
+				}
+			}
+			if(!reply(sock, sstr.str()) || !active) {
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+	}
+
 	int _socket;
 	JobQueue _queue;
 };
@@ -393,6 +1018,7 @@ void wakeMaster()
 	}
 	std::string message("WAKE\0");
 	send(sock, message.c_str(), message.size(), 0);
+	shutdown(sock, SHUT_WR);
 	close(sock);
 }
 
@@ -0,0 +1,121 @@
+#!/bin/bash
+#####################
+## End-to-end benchmark on synthetic testbeam data.
+##
+## Generates runs of different sizes with gentestbeam and times each analysis on them. The data is
+## deterministic, so timings of different builds are comparable. Results are appended to
+## ${BENCH_DIR}/benchmark.csv.
+##
+## Analyses depending on the results of others run their prerequisite steps first, these are not timed:
+## RefPreAlign before GblAlign, GblAlign before MpaTripletEfficiency. MpaEfficiency uses the true
+## alignment written by gentestbeam.
+##
+## All configuration is passed in environment variables.
+##  MPA_UTIL_BIN_PATH   directory of the gentestbeam binary, usually $BUILD/utils
+##  MPA_ANALYSES_BIN    analyses binary, usually $BUILD/analyses/analyses
+##  MPA_CONFIG          configuration file, defaults to config.cfg of the source tree
+##  BENCH_DIR           scratch directory for data and output, defaults to /tmp/mapsa_benchmark
+##  BENCH_EVENTS        event counts, defaults to "10000 100000 1000000"
+##  BENCH_ANALYSES      analyses to run, defaults to "MpaEfficiency MpaCmaesAlign GblAlign MpaTripletEfficiency"
+##  BENCH_SEED          random seed, defaults to 42
+####################
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BENCH_DIR=${BENCH_DIR:-/tmp/mapsa_benchmark}
+BENCH_EVENTS=${BENCH_EVENTS:-"10000 100000 1000000"}
+BENCH_ANALYSES=${BENCH_ANALYSES:-"MpaEfficiency MpaCmaesAlign GblAlign MpaTripletEfficiency"}
+BENCH_SEED=${BENCH_SEED:-42}
+MPA_CONFIG=${MPA_CONFIG:-${SOURCE_DIR}/config.cfg}
+
+if [ -z ${MPA_UTIL_BIN_PATH} ]; then
+	echo "Please point MPA_UTIL_BIN_PATH to utility binaries directory. Usually \$BUILD/utils"
+	exit 1
+fi
+
+if [ -z ${MPA_ANALYSES_BIN} ]; then
+	echo "Please point MPA_ANALYSES_BIN to the analyses binary. Usually \$BUILD/analyses/analyses"
+	exit 1
+fi
+
+# untimed steps producing the inputs of an analysis, in order
+prerequisites() {
+	case $1 in
+		GblAlign) echo "RefPreAlign" ;;
+		MpaTripletEfficiency) echo "RefPreAlign GblAlign" ;;
+	esac
+}
+
+# run_analysis <analysis> <events> [options...]
+run_analysis() {
+	local analysis=$1
+	local events=$2
+	shift 2
+	(cd ${BENCH_DIR}/out_${events} && ${MPA_ANALYSES_BIN} ${analysis} -c ${MPA_CONFIG} -r ${RUN} \
+		-l ${BENCH_DIR}/data_${events}/runlist.csv "$@" \
+		-D "output_dir = ${BENCH_DIR}/out_${events}" \
+		-D "alignment_dir = ${BENCH_DIR}/data_${events}" \
+		-D "result_cache_dir = ${BENCH_DIR}/out_${events}/.result_cache" \
+		-D "mapsa_data = ${BENCH_DIR}/data_${events}/run@MpaRun@_counter.txt_0" \
+		-D "track_data = ${BENCH_DIR}/data_${events}/run@TelRun@-reftracks.csv" \
+		-D "testbeam_data = ${BENCH_DIR}/data_${events}/t_shifted@MpaRun@.root" \
+		-D "pixel_mask = ${SOURCE_DIR}/masks/mpa_inner_fiducal.mask" \
+		> ${BENCH_DIR}/out_${events}/${analysis}.log 2>&1)
+}
+
+# column widths of the report
+NAME_WIDTH=8
+for analysis in ${BENCH_ANALYSES}; do
+	if [ ${#analysis} -gt ${NAME_WIDTH} ]; then
+		NAME_WIDTH=${#analysis}
+	fi
+done
+EVENTS_WIDTH=6
+for events in ${BENCH_EVENTS}; do
+	if [ ${#events} -gt ${EVENTS_WIDTH} ]; then
+		EVENTS_WIDTH=${#events}
+	fi
+done
+
+RUN=1
+RESULTS=${BENCH_DIR}/benchmark.csv
+mkdir -p ${BENCH_DIR}
+if [ ! -f ${RESULTS} ]; then
+	echo -e "# Date\tAnalysis\tEvents\tSeconds\tStatus" > ${RESULTS}
+fi
+
+printf "%-${NAME_WIDTH}s %${EVENTS_WIDTH}s %10s  %s\n" "Analysis" "Events" "Seconds" "Status"
+for events in ${BENCH_EVENTS}; do
+	DATA=${BENCH_DIR}/data_${events}
+	OUT=${BENCH_DIR}/out_${events}
+	mkdir -p ${DATA} ${OUT}
+	if [ ! -f ${DATA}/runlist.csv ]; then
+		echo "Generating ${events} events..."
+		${MPA_UTIL_BIN_PATH}/gentestbeam -n ${events} -s ${BENCH_SEED} -r ${RUN} -o ${DATA} || exit 1
+	fi
+	for analysis in ${BENCH_ANALYSES}; do
+		status=""
+		# restored from the result cache if they already ran on this data
+		for step in $(prerequisites ${analysis}); do
+			if ! run_analysis ${step} ${events}; then
+				status="prerequisite ${step} failed, see ${OUT}/${step}.log"
+				break
+			fi
+		done
+		if [ -n "${status}" ]; then
+			printf "%-${NAME_WIDTH}s %${EVENTS_WIDTH}d %10s  %s\n" ${analysis} ${events} "-" "${status}"
+			echo -e "$(date -Iseconds)\t${analysis}\t${events}\t\t${status}" >> ${RESULTS}
+			continue
+		fi
+		start=$(date +%s.%N)
+		run_analysis ${analysis} ${events} --force
+		ret=$?
+		end=$(date +%s.%N)
+		seconds=$(echo "${end} - ${start}" | bc)
+		status="ok"
+		if [ ${ret} -ne 0 ]; then
+			status="failed (${ret}), see ${OUT}/${analysis}.log"
+		fi
+		printf "%-${NAME_WIDTH}s %${EVENTS_WIDTH}d %8.2f s  %s\n" ${analysis} ${events} ${seconds} "${status}"
+		echo -e "$(date -Iseconds)\t${analysis}\t${events}\t${seconds}\t${status}" >> ${RESULTS}
+	done
+done
@@ -68,10 +68,16 @@ if [ -z "${LAMBDAS}" ]; then
 fi
 
 
+# The jobs write into the database themselves, there is no conversion step afterwards
+if ! ./analyses/analyses MpaCmaesAlign --help 2>/dev/null | grep -q -- "--database"; then
+	echo "./analyses/analyses does not provide MpaCmaesAlign with --database. Run from the build directory."
+	exit 1
+fi
+
 CMD_FILE=".cmds"
 MULTI_PREFIX=`date "+%Y-%m-%d__%H-%M-%S"`
 
-DATA_PATH="${MPAOUT}/MpaCmaesAlign/${MULTI_PREFIX}"
+DATABASE="${MPAOUT}/multirun_${MULTI_PREFIX}.sqldat"
 
 # Generate job file
 rm -f ${CMD_FILE}
@@ -80,7 +86,7 @@ for run in ${RUNS}; do
 	echo "Preparing run ${run}..."
 	for lambda in ${LAMBDAS}; do
 		for retry in `seq ${NUM_RETRIES}`; do
-			echo "./analyses/analyses MpaCmaesAlign -C -M ${MULTI_PREFIX} --run ${run} -n ${NUM_SAMPLES} -D \"cmaes_lambda=${lambda}\" -D \"output_prefix=num${num}\" -D \"cmaes_param_preset_and_restrict=${RESTRICT}\" -D \"cmaes_parameter_init_from_alignment=${INIT_FROM_ALIGN}\" -E -F > /dev/null 2>&1" >> ${CMD_FILE}
+			echo "./analyses/analyses MpaCmaesAlign -C -M ${MULTI_PREFIX} --run ${run} -n ${NUM_SAMPLES} -D \"cmaes_lambda=${lambda}\" -D \"output_prefix=num${num}\" --database ${DATABASE} --job-id ${num} -D \"cmaes_param_preset_and_restrict=${RESTRICT}\" -D \"cmaes_parameter_init_from_alignment=${INIT_FROM_ALIGN}\" -E -F > /dev/null 2>&1" >> ${CMD_FILE}
 			num=`expr ${num} + 1`
 		done
 	done
@@ -90,10 +96,9 @@ done
 time ${MPA_UTIL_BIN_PATH}/batchsubmit < ${CMD_FILE}
 pkill analyses
 
-# Merge data in sqlite3 database
-python ${MPA_UTIL_SCRIPT_PATH}/cmaes2sqlite.py ${DATA_PATH} ${MPAOUT}/multirun_${MULTI_PREFIX}.sqldat
+# All jobs write directly into the sqlite3 database
 echo
 echo "########################"
 echo
-echo "Output written to ${MPAOUT}/multirun_${MULTI_PREFIX}.sqldat"
+echo "Output written to ${DATABASE}"
 
@@ -0,0 +1,92 @@
+#!/bin/bash
+#####################
+## Compare the CMA-ES alignment on growing event subsets with the alignment on all events.
+##
+## Generates a synthetic run with gentestbeam and aligns it with MpaCmaesAlign twice on the same cached
+## sample: with fidelity_min_events = 0, which evaluates every candidate on all cached events, and with
+## fidelity_min_events = ${FIDELITY_MIN_EVENTS}. CMA-ES seeds every run differently, so the alignments are
+## compared within tolerances. The script fails if they differ by more.
+##
+## All configuration is passed in environment variables.
+##  MPA_UTIL_BIN_PATH   directory of the gentestbeam binary, usually $BUILD/utils
+##  MPA_ANALYSES_BIN    analyses binary, usually $BUILD/analyses/analyses
+##  MPA_CONFIG          configuration file, defaults to config.cfg of the source tree
+##  COMPARE_DIR         scratch directory for data and output, defaults to /tmp/mapsa_fidelity
+##  COMPARE_EVENTS      number of generated events, defaults to 100000
+##  COMPARE_SEED        random seed of the data, defaults to 42
+##  FIDELITY_MIN_EVENTS size of the first subsets, defaults to 1000
+##  TOLERANCE_POSITION  allowed difference of x, y and z, defaults to 0.05
+##  TOLERANCE_ANGLE     allowed difference of the angles, defaults to 0.001
+####################
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+COMPARE_DIR=${COMPARE_DIR:-/tmp/mapsa_fidelity}
+COMPARE_EVENTS=${COMPARE_EVENTS:-100000}
+COMPARE_SEED=${COMPARE_SEED:-42}
+FIDELITY_MIN_EVENTS=${FIDELITY_MIN_EVENTS:-1000}
+TOLERANCE_POSITION=${TOLERANCE_POSITION:-0.05}
+TOLERANCE_ANGLE=${TOLERANCE_ANGLE:-0.001}
+MPA_CONFIG=${MPA_CONFIG:-${SOURCE_DIR}/config.cfg}
+
+if [ -z ${MPA_UTIL_BIN_PATH} ]; then
+	echo "Please point MPA_UTIL_BIN_PATH to utility binaries directory. Usually \$BUILD/utils"
+	exit 1
+fi
+
+if [ -z ${MPA_ANALYSES_BIN} ]; then
+	echo "Please point MPA_ANALYSES_BIN to the analyses binary. Usually \$BUILD/analyses/analyses"
+	exit 1
+fi
+
+RUN=1
+DATA=${COMPARE_DIR}/data
+mkdir -p ${DATA}
+if [ ! -f ${DATA}/runlist.csv ]; then
+	echo "Generating ${COMPARE_EVENTS} events..."
+	${MPA_UTIL_BIN_PATH}/gentestbeam -n ${COMPARE_EVENTS} -s ${COMPARE_SEED} -r ${RUN} -o ${DATA} || exit 1
+fi
+
+# align <min events>, writes the alignment to ${COMPARE_DIR}/out_<min events>
+align() {
+	local out=${COMPARE_DIR}/out_$1
+	mkdir -p ${out}
+	(cd ${out} && ${MPA_ANALYSES_BIN} MpaCmaesAlign -c ${MPA_CONFIG} -r ${RUN} -l ${DATA}/runlist.csv --force \
+		-D "fidelity_min_events = $1" \
+		-D "cmaes_elitism = 0" \
+		-D "output_dir = ${out}" \
+		-D "alignment_dir = ${DATA}" \
+		-D "result_cache_dir = ${out}/.result_cache" \
+		-D "mapsa_data = ${DATA}/run@MpaRun@_counter.txt_0" \
+		-D "track_data = ${DATA}/run@TelRun@-reftracks.csv" \
+		-D "pixel_mask = ${SOURCE_DIR}/masks/mpa_inner_fiducal.mask" \
+		> ${out}/MpaCmaesAlign.log 2>&1)
+	if [ $? -ne 0 ]; then
+		echo "MpaCmaesAlign failed, see ${out}/MpaCmaesAlign.log"
+		exit 1
+	fi
+	ls ${out}/MpaCmaesAlign*.align | head -n 1
+}
+
+FULL=$(align 0) || { echo "${FULL}"; exit 1; }
+SUBSETS=$(align ${FIDELITY_MIN_EVENTS}) || { echo "${SUBSETS}"; exit 1; }
+
+# first line of an .align file: x y z fitness phi theta omega
+paste <(head -n 1 ${FULL}) <(head -n 1 ${SUBSETS}) | awk \
+	-v position=${TOLERANCE_POSITION} -v angle=${TOLERANCE_ANGLE} -v min_events=${FIDELITY_MIN_EVENTS} '
+function abs(v) { return v < 0 ? -v : v }
+{
+	split("x y z fitness phi theta omega", names, " ")
+	printf "%-8s %14s %14s %14s\n", "", "all events", "from " min_events, "difference"
+	failed = 0
+	for(i = 1; i <= 7; ++i) {
+		diff = $(i + 7) - $i
+		tolerance = i <= 3 ? position : angle
+		mark = ""
+		if(i != 4 && abs(diff) > tolerance) {
+			mark = "  > " tolerance
+			failed = 1
+		}
+		printf "%-8s %14.6g %14.6g %14.6g%s\n", names[i], $i, $(i + 7), diff, mark
+	}
+	exit failed
+}'
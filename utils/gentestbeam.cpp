@@ -0,0 +1,114 @@
+#include "testbeamgenerator.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+std::string getUsage(const std::string& argv0)
+{
+	std::ostringstream str;
+	str << "Usage: " << argv0 << " [-n events] [-s seed] [-r run] [-t telrun] [-o dir] [options]";
+	return str.str();
+}
+
+std::string padded(int id, int width)
+{
+	std::ostringstream str;
+	str << std::setw(width) << std::setfill('0') << id;
+	return str.str();
+}
+
+int main(int argc, char* argv[])
+{
+	auto defaults = core::TestbeamGenerator::config_t::defaults();
+	po::options_description options;
+	options.add_options()
+		("help,h", "Show help message")
+		("events,n", po::value<size_t>()->default_value(defaults.numEvents), "Number of events")
+		("seed,s", po::value<unsigned long>()->default_value(defaults.seed), "Random number seed")
+		("run,r", po::value<int>()->default_value(defaults.runId), "MaPSA run ID")
+		("telrun,t", po::value<int>(), "Telescope run ID, defaults to the MaPSA run ID")
+		("output-dir,o", po::value<std::string>()->default_value("."), "Output directory")
+		("mpa-x", po::value<double>()->default_value(defaults.mpaOffset(0)), "MaPSA X offset in mm")
+		("mpa-y", po::value<double>()->default_value(defaults.mpaOffset(1)), "MaPSA Y offset in mm")
+		("mpa-z", po::value<double>()->default_value(defaults.mpaOffset(2)), "MaPSA Z position in mm")
+		("mpa-phi", po::value<double>()->default_value(defaults.mpaRotation(0)), "MaPSA rotation around X in rad")
+		("mpa-theta", po::value<double>()->default_value(defaults.mpaRotation(1)), "MaPSA rotation around Y in rad")
+		("mpa-omega", po::value<double>()->default_value(defaults.mpaRotation(2)), "MaPSA rotation around Z in rad")
+		("tracks", po::value<double>()->default_value(defaults.meanTracks), "Mean number of tracks per event")
+		("efficiency", po::value<double>()->default_value(defaults.efficiency), "MaPSA pixel efficiency")
+		("noise", po::value<double>()->default_value(defaults.noise), "Noise hit probability per pixel and event")
+		("data-offset", po::value<int>()->default_value(defaults.dataOffset), "Offset of MaPSA to telescope data")
+		("no-root", "Do not write the merged ROOT file")
+		("no-memory", "Do not write the memory text file")
+	;
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, options), vm);
+	} catch(std::exception& e) {
+		std::cerr << argv[0] << ": " << e.what();
+		std::cerr << "\n\n" << getUsage(argv[0]) << std::endl;
+		return 1;
+	}
+	if(vm.count("help")) {
+		std::cout << getUsage(argv[0]) << "\n\n"
+		          << "Writes a synthetic testbeam run with the file names of config.cfg:\n"
+		          << "  run<MpaRun>_counter.txt_0, run<MpaRun>_memory.txt_0, run<TelRun>-reftracks.csv,\n"
+		          << "  t_shifted<MpaRun>.root, MpaAlign_<MpaRun>.align (true pose) and runlist.csv\n\n"
+		          << "Options:\n" << options << std::endl;
+		return 0;
+	}
+	po::notify(vm);
+
+	auto config = defaults;
+	config.numEvents = vm["events"].as<size_t>();
+	config.seed = vm["seed"].as<unsigned long>();
+	config.runId = vm["run"].as<int>();
+	config.mpaOffset = {vm["mpa-x"].as<double>(), vm["mpa-y"].as<double>(), vm["mpa-z"].as<double>()};
+	config.mpaRotation = {vm["mpa-phi"].as<double>(), vm["mpa-theta"].as<double>(), vm["mpa-omega"].as<double>()};
+	config.meanTracks = vm["tracks"].as<double>();
+	config.efficiency = vm["efficiency"].as<double>();
+	config.noise = vm["noise"].as<double>();
+	config.dataOffset = vm["data-offset"].as<int>();
+	const int mpaRun = config.runId;
+	const int telRun = vm.count("telrun") ? vm["telrun"].as<int>() : mpaRun;
+
+	const auto dir = vm["output-dir"].as<std::string>() + "/";
+	const auto mpaId = padded(mpaRun, 4);
+	core::TestbeamGenerator::output_t output;
+	output.counterFile = dir + "run" + mpaId + "_counter.txt_0";
+	if(!vm.count("no-memory")) {
+		output.memoryFile = dir + "run" + mpaId + "_memory.txt_0";
+	}
+	output.trackFile = dir + "run" + padded(telRun, 6) + "-reftracks.csv";
+	if(!vm.count("no-root")) {
+		output.rootFile = dir + "t_shifted" + mpaId + ".root";
+	}
+	output.alignFile = dir + "MpaAlign_" + mpaId + ".align";
+
+	auto start = std::chrono::steady_clock::now();
+	try {
+		core::TestbeamGenerator generator(config);
+		generator.generate(output);
+		std::ofstream runlist(dir + "runlist.csv");
+		if(!runlist) {
+			throw core::TestbeamGenerator::io_error(dir + "runlist.csv");
+		}
+		runlist << "# MPA Run\tTelescope Run\tAngle (°)\tBias Volt (V)\tBias Cur (μA)\tThreshold\t"
+		        << "MPA Trigger\tTelescope  Trigger\tComments\tConverted\tData Offset\tCorrelation\tComments\n"
+		        << mpaRun << "\t" << telRun << "\t0\t110\t\t110\t"
+		        << config.numEvents << "\t" << config.numEvents << "\tsynthetic, seed " << config.seed << "\tYes\t"
+		        << config.dataOffset << "\tYes\t\n";
+	} catch(std::exception& e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Generated " << config.numEvents << " events for run " << mpaRun
+	          << " in " << elapsed << " s" << std::endl;
+	return 0;
+}
@@ -29,11 +29,29 @@ int main(int argc, char* argv[])
 	if(connect(sock, (struct sockaddr*)& name, sizeof(name)) != 0) {
 		std::cerr << argv[0] << ": connecting to belphegor: " << strerror(errno) << std::endl;
 	}
+	// --status [ID], --cancel ID and --watch [ID] are translated to the corresponding belphegor
+	// command, anything else is submitted as job
 	std::string message("SACRIFICE");
-	for(size_t i=0; i<argc; ++i) {
+	int first = 0;
+	if(argc > 1) {
+		std::string option(argv[1]);
+		if(option == "--status") {
+			message = "STATUS";
+			first = 2;
+		} else if(option == "--cancel") {
+			message = "CANCEL";
+			first = 2;
+		} else if(option == "--watch") {
+			message = "WATCH";
+			first = 2;
+		}
+	}
+	for(int i=first; i<argc; ++i) {
 		message += std::string("\0", 1) + std::string(argv[i]);
 	}
 	send(sock, message.c_str(), message.size(), 0);
+	// signal end of command, belphegor reads until EOF
+	shutdown(sock, SHUT_WR);
 	const size_t bufsize = 1024;
 	char tmpbuf[bufsize];
 	std::string answer("");
@@ -3,6 +3,8 @@
 #include <limits>
 #include <QApplication>
 #include <QDebug>
+#include <QTimer>
+#include <QMutexLocker>
 
 class Sqlite3Stmt
 {
@@ -13,14 +15,55 @@ public:
 	sqlite3_stmt* stmt;
 };
 
+void Database::data_t::append(const data_t& other)
+{
+	x += other.x;
+	x_err += other.x_err;
+	y += other.y;
+	y_err += other.y_err;
+	median += other.median;
+	first_quartile += other.first_quartile;
+	third_quartile += other.third_quartile;
+	upper_whisker += other.upper_whisker;
+	lower_whisker += other.lower_whisker;
+}
+
+size_t Database::data_t::size() const
+{
+	return sizeof(double) * (x.size() + x_err.size() + y.size() + y_err.size() + median.size()
+		+ first_quartile.size() + third_quartile.size() + upper_whisker.size() + lower_whisker.size());
+}
+
 Database::Database(QObject* parent) :
- QObject(parent), _db(nullptr)
+ QObject(parent), _db(nullptr), _worker(new QueryWorker), _nextTicket(1), _resultCacheSize(0)
 {
+	qRegisterMetaType<Database::data_t>("Database::data_t");
+	_worker->moveToThread(&_workerThread);
+	connect(&_workerThread, &QThread::finished, _worker, &QObject::deleteLater);
+	connect(_worker, &QueryWorker::chunk, this, [this](quint64 ticket, Database::data_t chunk) {
+		if(_activeTickets.contains(ticket)) {
+			emit queryChunk(ticket, chunk);
+		}
+	});
+	connect(_worker, &QueryWorker::finished, this, &Database::workerFinished);
+	connect(_worker, &QueryWorker::failed, this, [this](quint64 ticket, QString message) {
+		if(_activeTickets.remove(ticket)) {
+			emit queryFailed(ticket, message);
+		}
+	});
+	connect(_worker, &QueryWorker::cancelled, this, [this](quint64 ticket) {
+		if(_activeTickets.remove(ticket)) {
+			emit queryCancelled(ticket);
+		}
+	});
+	_workerThread.start();
 }
 
 Database::~Database()
 {
 	close();
+	_workerThread.quit();
+	_workerThread.wait();
 }
 
 void Database::open(QString filename)
@@ -35,6 +78,7 @@ void Database::open(QString filename)
 		_db = nullptr;
 		throw database_error(result, "Opening Database");
 	}
+	QMetaObject::invokeMethod(_worker, "open", Qt::QueuedConnection, Q_ARG(QString, filename));
 	emit opened();
 	emit opened(true);
 	importCache();
@@ -43,6 +87,16 @@ void Database::open(QString filename)
 void Database::close()
 {
 	if(_db) {
+		auto tickets = _activeTickets;
+		_activeTickets.clear();
+		for(auto ticket: tickets) {
+			_worker->cancel(ticket);
+			emit queryCancelled(ticket);
+		}
+		_resultCache.clear();
+		_resultCacheOrder.clear();
+		_resultCacheSize = 0;
+		QMetaObject::invokeMethod(_worker, "close", Qt::QueuedConnection);
 		emit closed();
 		emit opened(false);
 		sqlite3_close(_db);
@@ -66,9 +120,6 @@ void Database::testQuery(QString query, bool jobQuery, bool statbox)
 	if(result != SQLITE_OK) {
 		throw database_error(result, "Preparing Query", sqlite3_errmsg(_db));
 	}
-	static const QVector<QString> allowed_xy = {"x", "xerr", "y", "yerr"};
-	static const QVector<QString> allowed_statbox = {"x, median",
-		"first_quartile", "third_quartile", "upper_whisker", "lower_whisker"};
 	if(jobQuery) {
 /*		for(size_t i = 0; i < sqlite3_column_count(stmt.stmt); ++i) {
 			if(QString("job_id") != sqlite3_column_name(stmt.stmt, i)) {
@@ -77,84 +128,87 @@ void Database::testQuery(QString query, bool jobQuery, bool statbox)
 		}*/
 		// do whatever you want...
 	} else {
-		if(statbox) {
-			for(size_t i = 0; i < sqlite3_column_count(stmt.stmt); ++i) {
-			if(allowed_statbox.indexOf(sqlite3_column_name(stmt.stmt, i)) == -1) {
-					throw unknown_column(sqlite3_column_name(stmt.stmt, i));
-				}
-			}
-		} else {
-			for(size_t i = 0; i < sqlite3_column_count(stmt.stmt); ++i) {
-				if(allowed_xy.indexOf(sqlite3_column_name(stmt.stmt, i)) == -1) {
-					throw unknown_column(sqlite3_column_name(stmt.stmt, i));
-				}
-			}
+		mapColumns(stmt.stmt, statbox);
+	}
+}
+
+QVector<Database::column_t> Database::mapColumns(sqlite3_stmt* stmt, bool statbox)
+{
+	static const QMap<QString, column_t> allowed_xy = {
+		{"x", &data_t::x}, {"xerr", &data_t::x_err}, {"y", &data_t::y}, {"yerr", &data_t::y_err}
+	};
+	static const QMap<QString, column_t> allowed_statbox = {
+		{"x", &data_t::x}, {"median", &data_t::median},
+		{"first_quartile", &data_t::first_quartile}, {"third_quartile", &data_t::third_quartile},
+		{"upper_whisker", &data_t::upper_whisker}, {"lower_whisker", &data_t::lower_whisker}
+	};
+	const auto& allowed = statbox ? allowed_statbox : allowed_xy;
+	QVector<column_t> columns;
+	for(int i = 0; i < sqlite3_column_count(stmt); ++i) {
+		QString name(sqlite3_column_name(stmt, i));
+		if(!allowed.contains(name)) {
+			throw unknown_column(name);
 		}
+		columns.push_back(allowed[name]);
 	}
+	return columns;
 }
 
-Database::data_t Database::exec(QString query, bool statbox)
+QString Database::cacheKey(QString query, bool statbox)
+{
+	return (statbox ? QStringLiteral("statbox:") : QStringLiteral("xy:")) + query;
+}
+
+quint64 Database::execAsync(QString query, bool statbox)
 {
 	testQuery(query, false, statbox);
-	Sqlite3Stmt stmt;
-	auto utf8Query = query.toUtf8();
-	auto result = sqlite3_prepare_v2(_db, utf8Query.constData(), utf8Query.size()+1, &stmt.stmt, nullptr);
-	if(result != SQLITE_OK) {
-		throw database_error(result, "Preparing Query", sqlite3_errmsg(_db));
-	}
-	qDebug() << "Read rows for " << query;
-	data_t data;
-	size_t num_rows = 0;
-	do {
-		result = sqlite3_step(stmt.stmt);
-		if(result != SQLITE_DONE && result != SQLITE_ROW) {
-			throw database_error(result, "Executing Query", sqlite3_errmsg(_db));
-		}
-		if(result == SQLITE_ROW) {
-			num_rows++;
-			if(num_rows % 1000 == 0) {
-				QApplication::processEvents();
-			}
-			if(num_rows % 10000 == 0) {
-				qDebug() << num_rows << "rows read.";
-			}
-			for(size_t i = 0; i < sqlite3_column_count(stmt.stmt); ++i) {
-				QString name(sqlite3_column_name(stmt.stmt, i));
-				double val = sqlite3_column_double(stmt.stmt, i);
-				if(statbox) {
-					if(name == "x") {
-						data.x.push_back(val);
-					} else if(name == "median") {
-						data.median.push_back(val);
-					} else if(name == "first_quartile") {
-						data.first_quartile.push_back(val);
-					} else if(name == "third_quartile") {
-						data.third_quartile.push_back(val);
-					} else if(name == "lower_whisker") {
-						data.lower_whisker.push_back(val);
-					} else if(name == "upper_whisker") {
-						data.upper_whisker.push_back(val);
-					} else {
-						throw unknown_column(name);
-					}
-				} else {
-					if(name == "x") {
-						data.x.push_back(val);
-					} else if(name == "y") {
-						data.y.push_back(val);
-					} else if(name == "xerr") {
-						data.x_err.push_back(val);
-					} else if(name == "yerr") {
-						data.y_err.push_back(val);
-					} else {
-						throw unknown_column(name);
-					}
-				}
+	auto ticket = _nextTicket++;
+	_activeTickets.insert(ticket);
+	auto key = cacheKey(query, statbox);
+	if(_resultCache.contains(key)) {
+		qDebug() << "Cached result for" << query;
+		_resultCacheOrder.removeOne(key);
+		_resultCacheOrder.append(key);
+		auto data = _resultCache[key];
+		// deliver asynchronously like a query result, as a single chunk
+		QTimer::singleShot(0, this, [this, ticket, data]() {
+			if(_activeTickets.remove(ticket)) {
+				emit queryChunk(ticket, data);
+				emit queryFinished(ticket, data);
 			}
+		});
+		return ticket;
+	}
+	qDebug() << "Read rows for" << query;
+	QMetaObject::invokeMethod(_worker, "run", Qt::QueuedConnection,
+		Q_ARG(quint64, ticket), Q_ARG(QString, query), Q_ARG(QString, key), Q_ARG(bool, statbox));
+	return ticket;
+}
+
+void Database::cancel(quint64 ticket)
+{
+	if(_activeTickets.remove(ticket)) {
+		_worker->cancel(ticket);
+		emit queryCancelled(ticket);
+	}
+}
+
+void Database::workerFinished(quint64 ticket, QString key, Database::data_t data)
+{
+	auto size = data.size();
+	if(!_resultCache.contains(key) && size <= cacheCapacity) {
+		while(_resultCacheSize + size > cacheCapacity) {
+			auto oldest = _resultCacheOrder.takeFirst();
+			_resultCacheSize -= _resultCache.take(oldest).size();
 		}
-	} while(result != SQLITE_DONE);
-	qDebug() << "Read all rows";
-	return data;
+		_resultCache.insert(key, data);
+		_resultCacheOrder.append(key);
+		_resultCacheSize += size;
+	}
+	if(_activeTickets.remove(ticket)) {
+		qDebug() << "Read all rows";
+		emit queryFinished(ticket, data);
+	}
 }
 
 void Database::importCache()
@@ -200,3 +254,133 @@ void Database::importCache()
 	qDebug() << "Run IDs" << _cache.keys();
 	emit cacheChanged(&_cache);
 }
+
+QueryWorker::QueryWorker(QObject* parent) :
+ QObject(parent), _db(nullptr), _running(0), _lastRun(0)
+{
+}
+
+QueryWorker::~QueryWorker()
+{
+	close();
+}
+
+void QueryWorker::cancel(quint64 ticket)
+{
+	QMutexLocker lock(&_mutex);
+	if(ticket <= _lastRun && ticket != _running) {
+		// already finished, nothing to cancel
+		return;
+	}
+	_cancelled.insert(ticket);
+	if(_running == ticket && _db) {
+		sqlite3_interrupt(_db);
+	}
+}
+
+bool QueryWorker::isCancelled(quint64 ticket)
+{
+	QMutexLocker lock(&_mutex);
+	return _cancelled.contains(ticket);
+}
+
+void QueryWorker::open(QString filename)
+{
+	close();
+	sqlite3* db = nullptr;
+	auto result = sqlite3_open_v2(filename.toUtf8().constData(), &db, SQLITE_OPEN_READONLY, nullptr);
+	if(result != SQLITE_OK) {
+		qDebug() << "Query worker cannot open database:" << sqlite3_errstr(result);
+		sqlite3_close(db);
+		return;
+	}
+	QMutexLocker lock(&_mutex);
+	_db = db;
+}
+
+void QueryWorker::close()
+{
+	QMutexLocker lock(&_mutex);
+	if(_db) {
+		sqlite3_close(_db);
+		_db = nullptr;
+	}
+}
+
+void QueryWorker::run(quint64 ticket, QString query, QString key, bool statbox)
+{
+	{
+		QMutexLocker lock(&_mutex);
+		_running = ticket;
+		_lastRun = ticket;
+	}
+	try {
+		if(isCancelled(ticket)) {
+			throw std::runtime_error("Cancelled");
+		}
+		if(!_db) {
+			throw Database::no_database();
+		}
+		Sqlite3Stmt stmt;
+		auto utf8Query = query.toUtf8();
+		auto result = sqlite3_prepare_v2(_db, utf8Query.constData(), utf8Query.size()+1, &stmt.stmt, nullptr);
+		if(result != SQLITE_OK) {
+			throw Database::database_error(result, "Preparing Query", sqlite3_errmsg(_db));
+		}
+		// look up the columns once instead of comparing names for each value
+		auto columns = Database::mapColumns(stmt.stmt, statbox);
+		Database::data_t data;
+		Database::data_t rows;
+		int num_rows = 0;
+		while((result = sqlite3_step(stmt.stmt)) == SQLITE_ROW) {
+			if(num_rows == 0) {
+				for(const auto& col: columns) {
+					(rows.*col).reserve(Database::chunkRows);
+				}
+			}
+			for(int i = 0; i < columns.size(); ++i) {
+				(rows.*columns[i]).push_back(sqlite3_column_double(stmt.stmt, i));
+			}
+			if(++num_rows == Database::chunkRows) {
+				if(isCancelled(ticket)) {
+					break;
+				}
+				emit chunk(ticket, rows);
+				data.append(rows);
+				rows = Database::data_t();
+				num_rows = 0;
+			}
+		}
+		if(!isCancelled(ticket)) {
+			if(result != SQLITE_DONE) {
+				throw Database::database_error(result, "Executing Query", sqlite3_errmsg(_db));
+			}
+			if(num_rows > 0) {
+				emit chunk(ticket, rows);
+				data.append(rows);
+			}
+			emit finished(ticket, key, data);
+		}
+	} catch(std::exception& e) {
+		if(!isCancelled(ticket)) {
+			emit failed(ticket, e.what());
+		}
+	}
+	bool wasCancelled;
+	{
+		QMutexLocker lock(&_mutex);
+		_running = 0;
+		wasCancelled = _cancelled.remove(ticket);
+		// tickets answered without a query, e.g. from the result cache, never run
+		for(auto it = _cancelled.begin(); it != _cancelled.end();) {
+			if(*it < ticket) {
+				it = _cancelled.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+	if(wasCancelled) {
+		emit cancelled(ticket);
+	}
+}
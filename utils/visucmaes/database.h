@@ -4,10 +4,17 @@
 #include <QObject>
 #include <QVector>
 #include <QMap>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QMutex>
+#include <QThread>
 #include <sqlite3.h>
 #include <exception>
 #include <Eigen/Dense>
 
+class QueryWorker;
+
 class Database : public QObject
 {
 	Q_OBJECT
@@ -26,7 +33,14 @@ public:
 		QVector<double> third_quartile;
 		QVector<double> upper_whisker;
 		QVector<double> lower_whisker;
+
+		/// Append the rows of another result
+		void append(const data_t& other);
+		/// Approximate memory usage in bytes
+		size_t size() const;
 	};
+	/// Column of the query result stored in a member of data_t
+	typedef QVector<double> data_t::* column_t;
 
 	struct cache_entry_t
 	{
@@ -41,7 +55,26 @@ public:
 	bool isOpen() const;
 
 	void testQuery(QString query, bool jobQuery, bool statbox);
-	data_t exec(QString query, bool statbox);
+
+	/** Execute query in the worker thread
+	 *
+	 * The rows are delivered in chunks by queryChunk() and completely by queryFinished(). Results
+	 * are kept in a LRU cache keyed by the query text, a cached result is delivered as a single chunk.
+	 * Errors of the query itself are reported by queryFailed(). Every ticket ends with exactly one of
+	 * queryFinished(), queryFailed() or queryCancelled().
+	 * \return Ticket identifying the query in the signals
+	 */
+	quint64 execAsync(QString query, bool statbox);
+	/// Stop a running or queued query, queryCancelled() is emitted and no further signals for it
+	void cancel(quint64 ticket);
+
+	/// Map the result columns of a statement to the members of data_t
+	static QVector<column_t> mapColumns(sqlite3_stmt* stmt, bool statbox);
+
+	/// Rows per queryChunk()
+	static constexpr int chunkRows = 65536;
+	/// Upper limit of the memory used by the result cache
+	static constexpr size_t cacheCapacity = 512*1024*1024;
 
 	const run_cache_t* getCache() const { return &_cache; }
 
@@ -95,10 +128,68 @@ signals:
 	void closed();
 	void cacheChanged(const run_cache_t* cache);
 
+	void queryChunk(quint64 ticket, Database::data_t chunk);
+	void queryFinished(quint64 ticket, Database::data_t data);
+	void queryFailed(quint64 ticket, QString message);
+	void queryCancelled(quint64 ticket);
+
+private slots:
+	void workerFinished(quint64 ticket, QString key, Database::data_t data);
+
 private:
 	void importCache();
+	static QString cacheKey(QString query, bool statbox);
 	sqlite3* _db;
 	run_cache_t _cache;
+
+	QThread _workerThread;
+	QueryWorker* _worker;
+	quint64 _nextTicket;
+	QSet<quint64> _activeTickets;
+	/// Cached query results and their keys in order of use, least recently used first
+	QHash<QString, data_t> _resultCache;
+	QList<QString> _resultCacheOrder;
+	size_t _resultCacheSize;
+};
+
+Q_DECLARE_METATYPE(Database::data_t)
+
+/** Executes queries on its own read-only connection in the worker thread of Database
+ *
+ * Queries are run in the order they are requested. cancel() may be called from any thread and
+ * interrupts a running query.
+ */
+class QueryWorker : public QObject
+{
+	Q_OBJECT
+public:
+	explicit QueryWorker(QObject* parent=nullptr);
+	~QueryWorker();
+
+	void cancel(quint64 ticket);
+
+public slots:
+	void open(QString filename);
+	void close();
+	void run(quint64 ticket, QString query, QString key, bool statbox);
+
+signals:
+	void chunk(quint64 ticket, Database::data_t chunk);
+	void finished(quint64 ticket, QString key, Database::data_t data);
+	void failed(quint64 ticket, QString message);
+	/// Emitted instead of finished() or failed() for a query cancelled before or while running
+	void cancelled(quint64 ticket);
+
+private:
+	bool isCancelled(quint64 ticket);
+	QMutex _mutex;
+	sqlite3* _db;
+	/// Cancelled tickets that did not run yet, guarded by _mutex like the following
+	QSet<quint64> _cancelled;
+	/// Ticket of the running query, 0 if none
+	quint64 _running;
+	/// Ticket of the last query run, tickets are run in ascending order
+	quint64 _lastRun;
 };
 
 #endif//DATABASE_H
@@ -0,0 +1,233 @@
+#include "lod.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <vector>
+#include <cmath>
+
+void CurveLod::clear()
+{
+	_x.clear();
+	_y.clear();
+	_levels.clear();
+	_dirty = false;
+}
+
+void CurveLod::append(const QVector<double>& x, const QVector<double>& y)
+{
+	assert(x.size() == y.size());
+	_x += x;
+	_y += y;
+	_dirty = true;
+}
+
+void CurveLod::build()
+{
+	std::vector<std::pair<double, double>> points(_x.size());
+	for(int i = 0; i < _x.size(); ++i) {
+		points[i] = { _x[i], _y[i] };
+	}
+	std::sort(points.begin(), points.end(),
+	          [](const std::pair<double, double>& a, const std::pair<double, double>& b) { return a.first < b.first; });
+	for(int i = 0; i < _x.size(); ++i) {
+		_x[i] = points[i].first;
+		_y[i] = points[i].second;
+	}
+	_levels.clear();
+	QVector<bucket_t> leaves;
+	leaves.reserve(_x.size() / leafSize + 1);
+	for(int i = 0; i < _x.size(); i += leafSize) {
+		bucket_t bucket { _x[i], _y[i], _x[i], _y[i], 0.0, 0.0, 0 };
+		for(int j = i; j < std::min(i + leafSize, _x.size()); ++j) {
+			if(_y[j] < bucket.yMin) {
+				bucket.xAtMin = _x[j];
+				bucket.yMin = _y[j];
+			}
+			if(_y[j] > bucket.yMax) {
+				bucket.xAtMax = _x[j];
+				bucket.yMax = _y[j];
+			}
+			bucket.sumX += _x[j];
+			bucket.sumY += _y[j];
+			++bucket.count;
+		}
+		leaves.push_back(bucket);
+	}
+	_levels.push_back(leaves);
+	while(_levels.back().size() > 1) {
+		const auto& lower = _levels.back();
+		QVector<bucket_t> upper;
+		upper.reserve(lower.size() / branching + 1);
+		for(int i = 0; i < lower.size(); i += branching) {
+			bucket_t bucket = lower[i];
+			for(int j = i + 1; j < std::min(i + branching, lower.size()); ++j) {
+				if(lower[j].yMin < bucket.yMin) {
+					bucket.xAtMin = lower[j].xAtMin;
+					bucket.yMin = lower[j].yMin;
+				}
+				if(lower[j].yMax > bucket.yMax) {
+					bucket.xAtMax = lower[j].xAtMax;
+					bucket.yMax = lower[j].yMax;
+				}
+				bucket.sumX += lower[j].sumX;
+				bucket.sumY += lower[j].sumY;
+				bucket.count += lower[j].count;
+			}
+			upper.push_back(bucket);
+		}
+		_levels.push_back(upper);
+	}
+	_dirty = false;
+}
+
+void CurveLod::view(QCPRange range, int columns, QVector<double>& x, QVector<double>& y)
+{
+	if(_dirty) {
+		build();
+	}
+	x.clear();
+	y.clear();
+	columns = std::max(columns, 1);
+	int first = std::lower_bound(_x.begin(), _x.end(), range.lower) - _x.begin();
+	int last = std::upper_bound(_x.begin(), _x.end(), range.upper) - _x.begin();
+	// one more point on each side, so lines continue out of the view
+	first = std::max(first - 1, 0);
+	last = std::min(last + 1, _x.size());
+	int count = last - first;
+	if(count <= leafSize * columns) {
+		x = _x.mid(first, count);
+		y = _y.mid(first, count);
+		return;
+	}
+	int level = 0;
+	int bucketSize = leafSize;
+	while(level + 1 < _levels.size() && count / (bucketSize * branching) >= columns) {
+		++level;
+		bucketSize *= branching;
+	}
+	const auto& buckets = _levels[level];
+	x.reserve(3 * (count / bucketSize + 2));
+	y.reserve(3 * (count / bucketSize + 2));
+	for(int i = first / bucketSize; i <= (last - 1) / bucketSize && i < buckets.size(); ++i) {
+		const auto& bucket = buckets[i];
+		std::array<QPair<double, double>, 3> points = {{
+			{ bucket.xAtMin, bucket.yMin },
+			{ bucket.sumX / bucket.count, bucket.sumY / bucket.count },
+			{ bucket.xAtMax, bucket.yMax }
+		}};
+		std::sort(points.begin(), points.end());
+		for(const auto& point: points) {
+			x.push_back(point.first);
+			y.push_back(point.second);
+		}
+	}
+}
+
+HistogramPyramid::HistogramPyramid() :
+ _lowX(0), _highX(0), _widthX(1), _cellsX(1),
+ _lowY(0), _highY(0), _widthY(1), _cellsY(1), _finest(0)
+{
+}
+
+void HistogramPyramid::reset(int nbinsX, double lowX, double highX, int nbinsY, double lowY, double highY)
+{
+	_lowX = lowX;
+	_highX = highX;
+	_cellsX = nbinsX + 1;
+	_widthX = nbinsX > 0 ? (highX - lowX) / nbinsX : 1.0;
+	_lowY = lowY;
+	_highY = highY;
+	_cellsY = nbinsY + 1;
+	_widthY = nbinsY > 0 ? (highY - lowY) / nbinsY : 1.0;
+	_finest = 0;
+	while(cellsX(_finest + 1) <= maxCells && cellsY(_finest + 1) <= maxCells) {
+		++_finest;
+	}
+	_levels = QVector<QVector<double>>(_finest + 1);
+	_levels[_finest].fill(0.0, cellsX(_finest) * cellsY(_finest));
+	_dirty = QVector<bool>(_finest + 1, true);
+	_dirty[_finest] = false;
+}
+
+void HistogramPyramid::fill(const QVector<double>& x, const QVector<double>& y)
+{
+	assert(x.size() == y.size());
+	auto& cells = _levels[_finest];
+	const int nx = cellsX(_finest);
+	const int ny = cellsY(_finest);
+	// the cells of level 0 are centered on the bin positions, so the finest level starts half a bin lower
+	const double originX = _lowX - _widthX / 2;
+	const double originY = _lowY - _widthY / 2;
+	const double scaleX = (1 << _finest) / _widthX;
+	const double scaleY = (1 << _finest) / _widthY;
+	for(int i = 0; i < x.size(); ++i) {
+		if(x[i] < _lowX || x[i] > _highX || y[i] < _lowY || y[i] > _highY) {
+			continue;
+		}
+		int ix = std::min(static_cast<int>((x[i] - originX) * scaleX), nx - 1);
+		int iy = std::min(static_cast<int>((y[i] - originY) * scaleY), ny - 1);
+		cells[iy * nx + ix] += 1;
+	}
+	_dirty.fill(true);
+	_dirty[_finest] = false;
+}
+
+const QVector<double>& HistogramPyramid::level(int l)
+{
+	if(_dirty[l]) {
+		const auto& finer = level(l + 1);
+		const int nx = cellsX(l);
+		const int ny = cellsY(l);
+		auto& cells = _levels[l];
+		cells.fill(0.0, nx * ny);
+		for(int iy = 0; iy < 2 * ny; ++iy) {
+			for(int ix = 0; ix < 2 * nx; ++ix) {
+				cells[(iy / 2) * nx + ix / 2] += finer[iy * 2 * nx + ix];
+			}
+		}
+		_dirty[l] = false;
+	}
+	return _levels[l];
+}
+
+void HistogramPyramid::apply(QCPColorMapData* data, QCPRange visibleX, QCPRange visibleY)
+{
+	auto levelFor = [this](double fullSize, double visibleSize) {
+		if(visibleSize <= 0) {
+			return _finest;
+		}
+		int l = static_cast<int>(std::floor(std::log2(fullSize / visibleSize)));
+		return std::max(0, std::min(l, _finest));
+	};
+	int l = std::min(levelFor(_widthX * _cellsX, visibleX.size()), levelFor(_widthY * _cellsY, visibleY.size()));
+	const auto& cells = level(l);
+	const int nx = cellsX(l);
+	const int ny = cellsY(l);
+	const double cellX = _widthX / (1 << l);
+	const double cellY = _widthY / (1 << l);
+	const double originX = _lowX - _widthX / 2;
+	const double originY = _lowY - _widthY / 2;
+	auto window = [](double lower, double upper, double origin, double cell, int n, int& first, int& last) {
+		first = std::max(0, std::min(static_cast<int>(std::floor((lower - origin) / cell)), n - 1));
+		last = std::max(0, std::min(static_cast<int>(std::floor((upper - origin) / cell)), n - 1));
+		// QCPColorMapData needs two cells to span a range
+		if(last == first && n > 1) {
+			if(last + 1 < n) {
+				++last;
+			} else {
+				--first;
+			}
+		}
+	};
+	int firstX, lastX, firstY, lastY;
+	window(visibleX.lower, visibleX.upper, originX, cellX, nx, firstX, lastX);
+	window(visibleY.lower, visibleY.upper, originY, cellY, ny, firstY, lastY);
+	data->setSize(lastX - firstX + 1, lastY - firstY + 1);
+	data->setRange(QCPRange(originX + (firstX + 0.5) * cellX, originX + (lastX + 0.5) * cellX),
+	               QCPRange(originY + (firstY + 0.5) * cellY, originY + (lastY + 0.5) * cellY));
+	for(int iy = firstY; iy <= lastY; ++iy) {
+		for(int ix = firstX; ix <= lastX; ++ix) {
+			data->setCell(ix - firstX, iy - firstY, cells[iy * nx + ix]);
+		}
+	}
+}
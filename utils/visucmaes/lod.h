@@ -0,0 +1,91 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <QVector>
+#include "qcustomplot.h"
+
+/** Min/max/mean decimation of a curve with many points
+ *
+ * The points are sorted by x and summarized in buckets of leafSize points. Each further level of the
+ * pyramid combines `branching` buckets of the level below. view() returns the raw points if few of them are
+ * visible, otherwise the minimum, mean and maximum of each bucket of the coarsest level that still has at
+ * least one bucket per pixel column. The pyramid is built on the first view() after data was appended.
+ */
+class CurveLod
+{
+public:
+	static constexpr int leafSize = 64;
+	static constexpr int branching = 4;
+
+	CurveLod() : _dirty(false) {}
+
+	void clear();
+	void append(const QVector<double>& x, const QVector<double>& y);
+	int size() const { return _x.size(); }
+
+	/// Points to draw for the visible x range with the given number of pixel columns, sorted by x
+	void view(QCPRange range, int columns, QVector<double>& x, QVector<double>& y);
+
+private:
+	struct bucket_t
+	{
+		double xAtMin;
+		double yMin;
+		double xAtMax;
+		double yMax;
+		double sumX;
+		double sumY;
+		int count;
+	};
+	void build();
+
+	QVector<double> _x;
+	QVector<double> _y;
+	QVector<QVector<bucket_t>> _levels;
+	bool _dirty;
+};
+
+/** 2D histogram at several resolutions
+ *
+ * Level 0 has the binning of the curve configuration: nbins+1 cells per axis with the centers of the first
+ * and last cell at low and high. Each further level halves the cell size, up to the finest level with at most
+ * maxCells cells per axis. Only the finest level is filled, the coarser levels are summed up when they are
+ * needed. apply() shows the visible part of the level that has about as many visible cells as level 0 has in
+ * total, so zooming in refines the binning.
+ */
+class HistogramPyramid
+{
+public:
+	static constexpr int maxCells = 1024;
+
+	HistogramPyramid();
+
+	void reset(int nbinsX, double lowX, double highX, int nbinsY, double lowY, double highY);
+	/// Add points, points outside of [low, high] are ignored
+	void fill(const QVector<double>& x, const QVector<double>& y);
+	/// Write the cells covering the visible range into the color map data
+	void apply(QCPColorMapData* data, QCPRange visibleX, QCPRange visibleY);
+
+	/// Range of the cell centers of level 0
+	QCPRange rangeX() const { return QCPRange(_lowX, _highX); }
+	QCPRange rangeY() const { return QCPRange(_lowY, _highY); }
+
+private:
+	const QVector<double>& level(int l);
+	int cellsX(int l) const { return _cellsX << l; }
+	int cellsY(int l) const { return _cellsY << l; }
+
+	double _lowX;
+	double _highX;
+	double _widthX;
+	int _cellsX;
+	double _lowY;
+	double _highY;
+	double _widthY;
+	int _cellsY;
+	int _finest;
+	QVector<QVector<double>> _levels;
+	QVector<bool> _dirty;
+};
+
+#endif//LOD_H
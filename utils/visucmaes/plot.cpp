@@ -1,24 +1,43 @@
 
 #include "plot.h"
 #include <QApplication>
+#include <QTimer>
+#include <cmath>
+#include <limits>
 
 Plot::Plot(QWidget* parent, size_t id, PlotDocument* doc)
  : QCustomPlot(parent), _id(id), _doc(doc), _config(nullptr), _selectedParameters(6),
  _xSelectionLine(new QCPItemLine(this)), _ySelectionLine(new QCPItemLine(this)),
- _colorScale(new QCPColorScale(this))
+ _colorScale(new QCPColorScale(this)), _lodTimer(new QTimer(this))
 {
 	plotLayout()->addElement(0, 1, _colorScale);
 	_colorScale->setType(QCPAxis::atRight);
 	_colorScale->setVisible(false);
 	setInteraction(QCP::iSelectPlottables, true);
 	setInteraction(QCP::iSelectLegend, true);
+	setInteraction(QCP::iRangeDrag, true);
+	setInteraction(QCP::iRangeZoom, true);
 	legend->setSelectableParts(QCPLegend::spItems);
 	_tickerFixed = xAxis->ticker();
 	connect(this, &QCustomPlot::selectionChangedByUser, this, &Plot::checkSelections);
+	connect(&_doc->db, &Database::queryChunk, this, &Plot::queryChunk);
+	connect(&_doc->db, &Database::queryFinished, this, &Plot::queryFinished);
+	connect(&_doc->db, &Database::queryFailed, this, &Plot::queryFailed);
+	connect(&_doc->db, &Database::queryCancelled, this, &Plot::queryCancelled);
+	_lodTimer->setSingleShot(true);
+	_lodTimer->setInterval(50);
+	connect(_lodTimer, &QTimer::timeout, this, &Plot::updateAllLod);
+	connect(xAxis, QOverload<const QCPRange&>::of(&QCPAxis::rangeChanged), _lodTimer, QOverload<>::of(&QTimer::start));
+	connect(yAxis, QOverload<const QCPRange&>::of(&QCPAxis::rangeChanged), _lodTimer, QOverload<>::of(&QTimer::start));
 }
 
 Plot::~Plot()
 {
+	// the receivers of curveProcessed() may already be gone
+	disconnect(&_doc->db, nullptr, this, nullptr);
+	for(auto ticket: _pendingQueries.keys()) {
+		_doc->db.cancel(ticket);
+	}
 }
 
 bool Plot::setConfig(const PlotDocument::global_config_t global_config)
@@ -28,6 +47,7 @@ bool Plot::setConfig(const PlotDocument::global_config_t global_config)
 	} catch(std::out_of_range& e) {
 		return false;
 	}
+	cancelQueries();
 	_curves.clear();
 	clearPlottables();
 	_global = global_config;
@@ -151,25 +171,22 @@ void Plot::mouseMoveEvent(QMouseEvent* event)
 
 void Plot::refresh()
 {
-	// Execute query and get write data to plots
-	try {
-		for(const auto& curve: _curves) {
-			qDebug() << "getData";
-			try {
-				auto data = getData(curve.config->id);
-				applyGraph(data, curve);
-				qDebug() << "processed";
-			} catch(std::exception& e) {
-				emit curveProcessed();
-				QApplication::processEvents();
-				throw;
-			}
+	// Write cached data to plots and start queries for the rest
+	cancelQueries();
+	for(const auto& curve: _curves) {
+		if(_cache.contains(curve.config->id)) {
+			applyGraph(_cache[curve.config->id], curve);
 			emit curveProcessed();
-			QApplication::processEvents();
+		} else {
+			requestData(curve);
 		}
-	} catch(std::runtime_error& e) {
-		qDebug() << "Error:" << e.what();
 	}
+	updateRanges();
+	replot();
+}
+
+void Plot::updateRanges()
+{
 	// apply auto-ranges and (semi-)fixed ranges
 	if(!(_config->use_xmin && _config->use_xmax)) {
 		xAxis->rescale();
@@ -193,7 +210,6 @@ void Plot::refresh()
 		// TODO: apply manual range
 	}
 	updateSelectionLines();
-	replot();
 }
 
 void Plot::forcedRefresh()
@@ -311,21 +327,93 @@ void Plot::checkSelections()
 	}
 }
 
-Database::data_t Plot::getData(size_t curveId)
+void Plot::requestData(const curve_t& curve)
 {
-	if(_cache.contains(curveId)) {
-		return _cache[curveId];
-	}
-	qDebug() << "Query data for curve" << _id << ":" << curveId;
+	qDebug() << "Query data for curve" << _id << ":" << curve.config->id;
 	QString jobQuery = _global.global_query;
 	if(_config->job_query.size() > 0) {
 		jobQuery = _config->job_query;
 	}
-	auto curve_cfg = PlotDocument::curveById(_global, _id, curveId);
-	QString query(curve_cfg.query);
+	QString query(curve.config->query);
 	query.replace("%jobs", jobQuery);
-	_cache[curveId] = _doc->db.exec(query, curve_cfg.mode == PlotDocument::cmStatisticalBox);
-	return _cache[curveId];
+	// start empty, the rows are added as they arrive
+	applyGraph(Database::data_t(), curve);
+	try {
+		auto ticket = _doc->db.execAsync(query, curve.config->mode == PlotDocument::cmStatisticalBox);
+		_pendingQueries[ticket] = curve.config->id;
+	} catch(std::runtime_error& e) {
+		qDebug() << "Error:" << e.what();
+		emit curveProcessed();
+	}
+}
+
+void Plot::cancelQueries()
+{
+	for(auto ticket: _pendingQueries.keys()) {
+		_doc->db.cancel(ticket);
+		// usually already done by queryCancelled()
+		if(_pendingQueries.remove(ticket)) {
+			emit curveProcessed();
+		}
+	}
+}
+
+const Plot::curve_t* Plot::curveById(size_t curveId) const
+{
+	for(const auto& curve: _curves) {
+		if(curve.config->id == curveId) {
+			return &curve;
+		}
+	}
+	return nullptr;
+}
+
+void Plot::queryChunk(quint64 ticket, Database::data_t chunk)
+{
+	if(!_pendingQueries.contains(ticket)) {
+		return;
+	}
+	auto curve = curveById(_pendingQueries[ticket]);
+	if(curve) {
+		applyGraph(chunk, *curve, true);
+		updateRanges();
+		replot(QCustomPlot::rpQueuedReplot);
+	}
+}
+
+void Plot::queryFinished(quint64 ticket, Database::data_t data)
+{
+	if(!_pendingQueries.contains(ticket)) {
+		return;
+	}
+	auto curveId = _pendingQueries.take(ticket);
+	_cache[curveId] = data;
+	qDebug() << "processed";
+	auto curve = curveById(curveId);
+	if(curve) {
+		// the chunks of large curves were only drawn as a preview
+		updateLod(*curve, true);
+		updateRanges();
+		replot(QCustomPlot::rpQueuedReplot);
+	}
+	emit curveProcessed();
+}
+
+void Plot::queryFailed(quint64 ticket, QString message)
+{
+	if(!_pendingQueries.contains(ticket)) {
+		return;
+	}
+	_pendingQueries.remove(ticket);
+	qDebug() << "Error:" << message;
+	emit curveProcessed();
+}
+
+void Plot::queryCancelled(quint64 ticket)
+{
+	if(_pendingQueries.remove(ticket)) {
+		emit curveProcessed();
+	}
 }
 
 void Plot::checkCacheInvalidation(PlotDocument::global_config_t newConfig)
@@ -372,12 +460,16 @@ void Plot::invalidateAllCaches()
 {
 	qDebug() << "Invalidate all caches on plot" << _id;
 	_cache.clear();
+	_lod.clear();
+	_pyramids.clear();
 }
 
 void Plot::invalidateCache(size_t curve_id)
 {
 	qDebug() << "Invalidate curve" << _id << ":" << curve_id;
 	_cache.remove(curve_id);
+	_lod.remove(curve_id);
+	_pyramids.remove(curve_id);
 }
 
 void Plot::updateSelectionLines()
@@ -403,24 +495,99 @@ void Plot::updateSelectionLines()
 	}
 }
 
-void Plot::applyGraph(Database::data_t data, const curve_t& curve)
+void Plot::applyGraph(Database::data_t data, const curve_t& curve, bool append)
 {
 	if(curve.config->mode == PlotDocument::cmPoints) {
-		curve.graph->setData(data.x, data.y);
+		plotPoints(data, curve, append);
 	} else if(curve.config->mode == PlotDocument::cmHistogram) {
-		plotHistogram(data, curve.config, curve.graph);
+		plotHistogram(data, curve.config, curve.graph, append);
 	} else if(curve.config->mode == PlotDocument::cmHistogram2D) {
-		plotHistogram2D(data, curve.config, curve.colormap);
+		plotHistogram2D(data, curve, append);
+	}
+}
+
+void Plot::plotPoints(Database::data_t data, const curve_t& curve, bool append)
+{
+	auto& lod = _lod[curve.config->id];
+	if(!append) {
+		lod.clear();
+	}
+	lod.append(data.x, data.y);
+	if(lod.size() <= lodThreshold) {
+		if(append) {
+			curve.graph->addData(data.x, data.y);
+		} else {
+			curve.graph->setData(data.x, data.y);
+		}
+	} else if(append) {
+		// preview while loading, the decimated curve replaces it when the query is finished
+		int stride = lod.size() / lodThreshold + 1;
+		QVector<double> x;
+		QVector<double> y;
+		for(int i = 0; i < data.x.size(); i += stride) {
+			x.push_back(data.x[i]);
+			y.push_back(data.y[i]);
+		}
+		curve.graph->addData(x, y);
+	} else {
+		updateLod(curve, true);
 	}
 }
 
-void Plot::plotHistogram(Database::data_t data, const PlotDocument::curve_config_t* config, QCPGraph* graph)
+void Plot::updateLod(const curve_t& curve, bool fullRange)
+{
+	auto id = curve.config->id;
+	if(curve.config->mode == PlotDocument::cmPoints && _lod.contains(id)) {
+		auto& lod = _lod[id];
+		if(lod.size() <= lodThreshold) {
+			return;
+		}
+		QCPRange range = xAxis->range();
+		if(fullRange) {
+			range = QCPRange(-std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+		}
+		QVector<double> x;
+		QVector<double> y;
+		lod.view(range, axisRect()->width(), x, y);
+		curve.graph->setData(x, y, true);
+	} else if(curve.config->mode == PlotDocument::cmHistogram2D && _pyramids.contains(id)) {
+		auto& pyramid = _pyramids[id];
+		if(fullRange) {
+			pyramid.apply(curve.colormap->data(), pyramid.rangeX(), pyramid.rangeY());
+		} else {
+			pyramid.apply(curve.colormap->data(), xAxis->range(), yAxis->range());
+		}
+		curve.colormap->rescaleDataRange(false);
+	}
+}
+
+void Plot::updateAllLod()
+{
+	auto pending = _pendingQueries.values();
+	for(const auto& curve: _curves) {
+		// building the decimation of a curve that is still loading would be repeated for every chunk
+		if(!pending.contains(curve.config->id)) {
+			updateLod(curve);
+		}
+	}
+	replot(QCustomPlot::rpQueuedReplot);
+}
+
+void Plot::plotHistogram(Database::data_t data, const PlotDocument::curve_config_t* config, QCPGraph* graph, bool append)
 {
 	QVector<double> bin_x(config->hist_nbins_x+1);
 	QVector<double> count(config->hist_nbins_x+1);
 	for(size_t i = 0; i < config->hist_nbins_x+1; ++i) {
 		bin_x[i] = (config->hist_high_x - config->hist_low_x) / (config->hist_nbins_x+1) *i + config->hist_low_x;
 	}
+	if(append) {
+		// continue counting from the previous chunks
+		int idx = 0;
+		for(auto it = graph->data()->constBegin(); it != graph->data()->constEnd() && idx < count.size(); ++it, ++idx) {
+			count[idx] = it->value;
+		}
+	}
+	const double width = (config->hist_high_x - config->hist_low_x) / (config->hist_nbins_x+1);
 	for(size_t i = 0; i < data.x.size(); ++i) {
 		if(data.x[i] < bin_x[0]) {
 			continue;
@@ -428,39 +595,27 @@ void Plot::plotHistogram(Database::data_t data, const PlotDocument::curve_config
 		if(data.x[i] > bin_x[config->hist_nbins_x]) {
 			continue;
 		}
-		for(int idx = config->hist_nbins_x; idx >= 0; --idx) {
-			if(data.x[i] > bin_x[idx]) {
-				count[idx] += 1;
-				break;
-			}
+		// last bin whose lower edge is below the value
+		int idx = static_cast<int>(std::ceil((data.x[i] - config->hist_low_x) / width)) - 1;
+		if(idx >= 0 && idx <= static_cast<int>(config->hist_nbins_x)) {
+			count[idx] += 1;
 		}
 	}
 	qDebug() << "Histogram size x/y" << bin_x.size() << count.size();
-	qDebug() << bin_x;
-	qDebug() << count;
-	graph->setData(bin_x, count);
+	graph->setData(bin_x, count, true);
 }
 
-void Plot::plotHistogram2D(Database::data_t data, const PlotDocument::curve_config_t* config, QCPColorMap* colorMap)
+void Plot::plotHistogram2D(Database::data_t data, const curve_t& curve, bool append)
 {
+	const auto config = curve.config;
 	_colorScale->setVisible(true);
-	colorMap->data()->clear();
-	colorMap->data()->setSize(config->hist_nbins_x+1, config->hist_nbins_y+1);
-	colorMap->data()->setRange(QCPRange(config->hist_low_x, config->hist_high_x),
-	                           QCPRange(config->hist_low_y, config->hist_high_y));
-	assert(data.x.size() == data.y.size());
-	for(size_t i = 0; i < data.x.size(); ++i) {
-		const auto& x = data.x[i];
-		const auto& y = data.y[i];
-		if(!colorMap->data()->keyRange().contains(x) ||
-		   !colorMap->data()->valueRange().contains(y)) {
-			continue;
-		}
-		int ix, iy;
-		colorMap->data()->coordToCell(x, y, &ix, &iy);
-		qDebug() << x << y << ix << iy;
-		colorMap->data()->setCell(ix, iy, colorMap->data()->cell(ix, iy) + 1);
-	}
-	colorMap->setGradient(config->gradient);
-	colorMap->rescaleDataRange(false);
+	auto& pyramid = _pyramids[config->id];
+	if(!append) {
+		pyramid.reset(config->hist_nbins_x, config->hist_low_x, config->hist_high_x,
+		              config->hist_nbins_y, config->hist_low_y, config->hist_high_y);
+	}
+	pyramid.fill(data.x, data.y);
+	updateLod(curve, !append);
+	curve.colormap->setGradient(config->gradient);
+	curve.colormap->rescaleDataRange(false);
 }
@@ -3,6 +3,7 @@
 
 #include "qcustomplot.h"
 #include "plotdocument.h"
+#include "lod.h"
 
 class PlotDocument;
 
@@ -36,6 +37,8 @@ public:
 public slots:
 	void refresh();
 	void forcedRefresh();
+	/// Stop loading all curves, curveProcessed() is emitted for each of them
+	void cancelQueries();
 
 	void setParameterSelectionX(double par);
 	void setParameterSelectionY(double par);
@@ -61,16 +64,28 @@ signals:
 
 private slots:
 	void checkSelections();
+	void queryChunk(quint64 ticket, Database::data_t chunk);
+	void queryFinished(quint64 ticket, Database::data_t data);
+	void queryFailed(quint64 ticket, QString message);
+	void queryCancelled(quint64 ticket);
+	void updateAllLod();
 
 private:
-	Database::data_t getData(size_t curveId);
+	void requestData(const curve_t& curve);
+	const curve_t* curveById(size_t curveId) const;
+	void updateRanges();
 	void checkCacheInvalidation(PlotDocument::global_config_t newConfig);
 	void invalidateAllCaches();
 	void invalidateCache(size_t curve_id);
 	void updateSelectionLines();
-	void applyGraph(Database::data_t data, const curve_t& curve);
-	void plotHistogram(Database::data_t data, const PlotDocument::curve_config_t* config, QCPGraph* graph);
-	void plotHistogram2D(Database::data_t data, const PlotDocument::curve_config_t* config, QCPColorMap* colorMap);
+	void applyGraph(Database::data_t data, const curve_t& curve, bool append=false);
+	void plotPoints(Database::data_t data, const curve_t& curve, bool append);
+	void plotHistogram(Database::data_t data, const PlotDocument::curve_config_t* config, QCPGraph* graph, bool append);
+	void plotHistogram2D(Database::data_t data, const curve_t& curve, bool append);
+	/// Show the level of detail of a decimated curve for the visible or the full range
+	void updateLod(const curve_t& curve, bool fullRange=false);
+	/// Curves with more points are decimated
+	static constexpr int lodThreshold = 200000;
 	size_t _id;
 	PlotDocument* _doc;
 	const PlotDocument::plot_config_t* _config;
@@ -78,6 +93,12 @@ private:
 	QVector<curve_t> _curves;
 	const curve_t* _selectedCurve;
 	QMap<size_t, Database::data_t> _cache;
+	/// Curve IDs of the running queries by ticket
+	QMap<quint64, size_t> _pendingQueries;
+	QMap<size_t, CurveLod> _lod;
+	QMap<size_t, HistogramPyramid> _pyramids;
+	/// Delays the refinement after range changes until zooming or dragging pauses
+	QTimer* _lodTimer;
 	QVector<double> _selectedParameters;
 	QCPItemLine* _xSelectionLine;
 	QCPItemLine* _ySelectionLine;
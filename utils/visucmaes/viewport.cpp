@@ -320,21 +320,20 @@ void Viewport::filterDataset()
 	if(_filter == efAllEvents) {
 		return;
 	}
-	for(size_t i = 0; i < _dataset.size(); ++i) {
-		qDebug() << "Test idx" << i;
-		const auto& entry = _dataset[i];
+	// single pass instead of removing entries one by one
+	QVector<Database::cache_entry_t> filtered;
+	filtered.reserve(_dataset.size());
+	for(const auto& entry: _dataset) {
+		bool hit = true;
 		try {
 			Eigen::Vector3d extrapPoint = _transform.mpaPlaneTrackIntersect({{0, 1}, {entry.a, entry.b}});
 			_transform.getPixelIndex(extrapPoint);
-			if(_filter == efFiducialMiss) {
-				_dataset.remove(i);
-				--i;
-			}
 		} catch (std::out_of_range& e) {
-			if(_filter == efFiducialHit) {
-				_dataset.remove(i);
-				--i;
-			}
+			hit = false;
+		}
+		if(hit == (_filter == efFiducialHit)) {
+			filtered.push_back(entry);
 		}
 	}
+	_dataset = filtered;
 }
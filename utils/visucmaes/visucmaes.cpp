@@ -290,6 +290,8 @@ Plot* Visucmaes::currentPlot() const
 
 void Visucmaes::createAndDeletePlots()
 {
+	// the cancelled curves count towards the progress, finish them before it is reset
+	cancelAllQueries();
 	_progress->setVisible(true);
 	size_t numCurves = 0;
 	for(const auto& plot: _doc->config().plots) {
@@ -299,9 +301,6 @@ void Visucmaes::createAndDeletePlots()
 	}
 	_progress->setRange(0, numCurves);
 	_progress->setValue(0);
-	setEnabled(false);
-	repaint();
-	QApplication::processEvents();
 	auto config = _doc->config();
 	auto windows = ui->mdiArea->subWindowList();
 	QVector<size_t> availablePlotIds;
@@ -326,9 +325,11 @@ void Visucmaes::createAndDeletePlots()
 			connect(win, &Plot::selectionChanged, ui->actionCurveDelete, &QAction::setEnabled);
 			connect(win, &Plot::selectionChanged, ui->actionCurveClone, &QAction::setEnabled);
 			connect(win, &Plot::curveProcessed, [this]() {
+				// queries run in the background, hide the progress when all curves are done
 				_progress->setValue(_progress->value()+1);
-				repaint();
-				_progress->repaint();
+				if(_progress->value() >= _progress->maximum()) {
+					_progress->setVisible(false);
+				}
 			});
 			ui->mdiArea->addSubWindow(win);
 			win->show();
@@ -336,17 +337,23 @@ void Visucmaes::createAndDeletePlots()
 			assert(result = true);
 		}
 	}
-	_progress->setVisible(false);
-	setEnabled(true);
-	repaint();
+	_progress->setVisible(_progress->value() < _progress->maximum());
+}
+
+void Visucmaes::cancelAllQueries()
+{
+	for(auto win: ui->mdiArea->subWindowList()) {
+		auto plot = dynamic_cast<Plot*>(win->widget());
+		if(plot) {
+			plot->cancelQueries();
+		}
+	}
 }
 
 void Visucmaes::forceRefresh()
 {
+	cancelAllQueries();
 	_progress->setVisible(true);
-	setEnabled(false);
-	repaint();
-	QApplication::processEvents();
 	size_t numCurves = 0;
 	for(const auto& plot: _doc->config().plots) {
 		for(const auto& curve: plot.curves) {
@@ -355,14 +362,11 @@ void Visucmaes::forceRefresh()
 	}
 	_progress->setRange(0, numCurves);
 	_progress->setValue(0);
-	repaint();
 	auto windows = ui->mdiArea->subWindowList();
 	for(auto win: windows) {
 		auto plot = dynamic_cast<Plot*>(win->widget());
 		plot->forcedRefresh();
 	}
-	_progress->setVisible(false);
-	setEnabled(true);
-	repaint();
+	_progress->setVisible(_progress->value() < _progress->maximum());
 }
 
@@ -46,6 +46,8 @@ private slots:
 	void forceRefresh();
 
 private:
+	void cancelAllQueries();
+
 	Ui::MainWindow* ui;
 	PlotDocument* _doc;
 	QProgressBar* _progress;